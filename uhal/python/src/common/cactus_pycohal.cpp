@@ -303,7 +303,7 @@ PYBIND11_MODULE(_core, m)
     .def ( "getDescription",  &uhal::Node::getDescription, pycohal::const_ref_return_policy )
     .def ( "getModule",       &uhal::Node::getModule,     pycohal::const_ref_return_policy )
     .def ( "write",           &uhal::Node::write )
-    .def ( "writeBlock",      &uhal::Node::writeBlock )
+    .def ( "writeBlock",      static_cast<uhal::ValHeader ( uhal::Node::* ) ( const std::vector< uint32_t >& ) const>( &uhal::Node::writeBlock ) )
     .def ( "writeBlockOffset",&uhal::Node::writeBlockOffset )
     .def ( "read",            &uhal::Node::read )
     .def ( "readBlock",       &uhal::Node::readBlock )
@@ -367,6 +367,9 @@ PYBIND11_MODULE(_core, m)
     .def ( "getNode", static_cast< const uhal::Node& ( uhal::HwInterface::* ) ( const std::string& ) const > ( &uhal::HwInterface::getNode ), pycohal::norm_ref_return_policy )
     .def ( "getNodes", static_cast< std::vector<std::string> ( uhal::HwInterface::* ) () const > ( &uhal::HwInterface::getNodes ) )
     .def ( "getNodes", static_cast< std::vector<std::string> ( uhal::HwInterface::* ) ( const std::string& ) const > ( &uhal::HwInterface::getNodes ) )
+    .def ( "invalidate", static_cast< void ( uhal::HwInterface::* ) () > ( &uhal::HwInterface::invalidate ) )
+    .def ( "invalidate", static_cast< void ( uhal::HwInterface::* ) ( const uhal::Node& ) > ( &uhal::HwInterface::invalidate ) )
+    .def ( "refresh", &uhal::HwInterface::refresh )
     .def ( "__str__", &uhal::HwInterface::id, pycohal::const_ref_return_policy )
     ;
 
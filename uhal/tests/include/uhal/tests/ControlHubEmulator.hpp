@@ -0,0 +1,137 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+/**
+	@file
+*/
+
+#ifndef _uhal_tests_ControlHubEmulator_hpp_
+#define _uhal_tests_ControlHubEmulator_hpp_
+
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "uhal/tests/DummyHardware.hpp"
+
+
+namespace uhal {
+  namespace tests {
+
+    /**
+      Minimal emulation of the ControlHub, for testing the chtcp clients without a ControlHub installation
+      Each IPbus packet in a TCP chunk is forwarded over UDP to the target named in its preamble, one at a time, and the replies are returned in a single chunk
+      Counts the connections, chunks and packets received, so that tests can check how the clients frame their traffic
+    */
+    class ControlHubEmulator : public DummyHardwareInterface
+    {
+      public:
+        /**
+          Constructor
+          @param aPort the TCP port on which the emulator accepts connections
+        */
+        ControlHubEmulator ( const uint16_t& aPort );
+
+        //! Destructor
+        ~ControlHubEmulator();
+
+        //! Accepts connections and serves them until the 'stop' method is called
+        void run();
+
+        void stop();
+
+        //! Returns the number of TCP connections accepted so far
+        size_t getConnectionCount() const;
+
+        //! Returns the number of TCP chunks received so far
+        size_t getChunkCount() const;
+
+        //! Returns the number of IPbus packets received so far
+        size_t getPacketCount() const;
+
+        //! Returns the largest number of IPbus packets received in a single TCP chunk
+        size_t getMaxPacketsPerChunk() const;
+
+        //! Returns the largest number of bytes (excluding the byte-count header) received in a single TCP chunk
+        size_t getMaxBytesPerChunk() const;
+
+      private:
+        //! A connection from a client, along with the chunk that is currently being received from it
+        struct Connection
+        {
+          Connection ( boost::asio::io_service& aIOservice ) :
+            socket ( aIOservice ),
+            byteCountHeader ( 0 )
+          {
+          }
+
+          boost::asio::ip::tcp::socket socket;
+          uint32_t byteCountHeader;
+          std::vector< uint8_t > chunk;
+        };
+
+        void accept();
+
+        void readChunkHeader ( const std::shared_ptr< Connection >& aConnection );
+
+        void handleChunk ( const std::shared_ptr< Connection >& aConnection );
+
+        /**
+          Forward an IPbus packet to its target, and append the ControlHub reply for it to the reply chunk
+          @param aPacket the packet, starting with its 8-byte ControlHub preamble
+          @param aSize the size of the packet in bytes, including the preamble
+          @param aReply the reply chunk
+        */
+        void forward ( const uint8_t* aPacket , const size_t aSize , std::vector< uint8_t >& aReply );
+
+        //! The BOOST ASIO io_service used by the TCP server
+        boost::asio::io_service mIOservice;
+        //! The TCP acceptor which opens the TCP port and handles the connections
+        boost::asio::ip::tcp::acceptor mAcceptor;
+        //! The socket through which packets are forwarded to, and replies received from, the targets
+        int mUdpSocket;
+
+        std::atomic< size_t > mConnectionCount;
+        std::atomic< size_t > mChunkCount;
+        std::atomic< size_t > mPacketCount;
+        std::atomic< size_t > mMaxPacketsPerChunk;
+        std::atomic< size_t > mMaxBytesPerChunk;
+    };
+
+  }
+}
+
+#endif
@@ -25,10 +25,14 @@ namespace uhal {
 
       ValHeader implementWriteBlock ( const uint32_t& aAddr, const std::vector< uint32_t >& aValues, const defs::BlockReadWriteMode& aMode );
 
+      ValHeader implementWriteBlock ( const uint32_t& aAddr, const std::shared_ptr< const std::vector< uint32_t > >& aValues, const defs::BlockReadWriteMode& aMode );
+
       ValWord< uint32_t > implementRead ( const uint32_t& aAddr, const uint32_t& aMask );
 
       ValVector< uint32_t > implementReadBlock ( const uint32_t& aAddr, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode );
 
+      ValHeader implementReadBlockInto ( const uint32_t& aAddr, uint32_t* aDestination, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode );
+
       ValWord< uint32_t > implementRMWbits ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm );
 
       ValWord< uint32_t > implementRMWsum ( const uint32_t& aAddr , const int32_t& aAddend );
@@ -40,6 +40,8 @@
 #define _uhal_tests_DummyHardware_hpp_
 
 
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <deque>
 #include <vector>
@@ -58,13 +60,18 @@ namespace uhal
     static const uint32_t REPLY_HISTORY_DEPTH = 5;
     //! Size of the receive and reply buffers
     static const uint32_t BUFFER_SIZE = 100000;
+    //! The default MTU reported in the IPbus 2.0 status reply; a jumbo-frame MTU, rather than the (much larger) size of the receive buffer, so that clients sized from the status reply see realistic values
+    static const uint32_t MTU = 9000;
   
 
     //! Common abstract base class for IPbus 1.3 and 2.0 dummy hardware
     class DummyHardwareInterface {
     public:
       DummyHardwareInterface(const std::chrono::microseconds& aReplyDelay) :
-        mReplyDelay(aReplyDelay)
+        mReplyDelay(aReplyDelay),
+        mTransactionCounts(),
+        mMtu(MTU),
+        mMaxRequestByteCount(0)
       {
       }
 
@@ -82,9 +89,36 @@ namespace uhal
           mReplyDelay = aDelay;
         }
 
+        //! Returns the number of transactions of the specified type that have been received so far
+        uint32_t getTransactionCount(const IPbusTransactionType aType) const
+        {
+          return mTransactionCounts.at(aType);
+        }
+
+        //! Sets the MTU reported in subsequent IPbus 2.0 status replies
+        void setMtu(const uint32_t aMtu)
+        {
+          mMtu = aMtu;
+        }
+
+        //! Returns the size, in bytes, of the largest request packet received so far
+        uint32_t getMaxRequestByteCount() const
+        {
+          return mMaxRequestByteCount;
+        }
+
       protected:
         //! The delay in seconds between the request and reply of the first transaction
         std::chrono::microseconds mReplyDelay;
+
+        //! The number of transactions received so far, indexed by transaction type (read from the test thread)
+        std::array< std::atomic<uint32_t>, CONFIG_SPACE_READ + 1 > mTransactionCounts;
+
+        //! The MTU reported in the IPbus 2.0 status reply
+        std::atomic<uint32_t> mMtu;
+
+        //! The size, in bytes, of the largest request packet received so far
+        std::atomic<uint32_t> mMaxRequestByteCount;
     };
 
 
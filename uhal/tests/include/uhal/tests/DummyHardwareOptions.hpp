@@ -56,6 +56,10 @@ namespace uhal {
       bool bigendian;
       //! IPbus version number - 1 or 2
       uint32_t version;
+      //! Period with which control requests are dropped (0 to disable)
+      uint32_t dropRequestPeriod;
+      //! Period with which replies to control requests are dropped (0 to disable)
+      uint32_t dropReplyPeriod;
 
       /**
         Static function to parse the command line arguments into a struct containing the information
@@ -83,6 +87,8 @@ namespace uhal {
       ( "port,p", boost::program_options::value<uint16_t>() , "Port number to listen on - required" )
       ( "big-endian,b", "Include the big-endian hack (version 2 only)" )
       ( "version,v", boost::program_options::value<uint32_t>() , "IPbus Major version (1 or 2) - required" )
+      ( "drop-requests", boost::program_options::value<uint32_t>()->default_value ( 0 ) , "Drop every N-th control request, to emulate packet loss (UDP only) - optional" )
+      ( "drop-replies", boost::program_options::value<uint32_t>()->default_value ( 0 ) , "Drop every N-th reply to a control request, to emulate packet loss (UDP only) - optional" )
       ( "verbose,V", "Produce verbose output" )
       ;
       boost::program_options::variables_map vm;
@@ -104,6 +110,8 @@ namespace uhal {
         lResult.port = vm["port"].as<uint16_t>();
         lResult.version = vm["version"].as<uint32_t>();
         lResult.bigendian = bool ( vm.count ( "big-endian" ) );
+        lResult.dropRequestPeriod = vm["drop-requests"].as<uint32_t>();
+        lResult.dropReplyPeriod = vm["drop-replies"].as<uint32_t>();
   
         if ( ( lResult.version == 1 ) && ( lResult.bigendian ) )
         {
@@ -47,7 +47,15 @@ class PCIeDummyHardware : public DummyHardware<2, 0>
 public:
   typedef DummyHardware<2, 0> base_type;
 
-  PCIeDummyHardware(const std::string& aDevicePathHostToFPGA, const std::string& aDevicePathFPGAToHost, const uint32_t& aReplyDelay, const bool& aBigEndianHack);
+  /**
+    Constructor
+    @param aDevicePathHostToFPGA path of the named pipe created to receive request packets
+    @param aDevicePathFPGAToHost path of the file created to hold the status words & reply pages
+    @param aReplyDelay the delay in seconds between the request and response of the first IPbus transaction
+    @param aBigEndianHack whether to include the big-endian hack
+    @param aDevicePathEvents path of the named pipe created to emulate the events file (to which a 1 is written for each reply published); not created if empty
+  */
+  PCIeDummyHardware(const std::string& aDevicePathHostToFPGA, const std::string& aDevicePathFPGAToHost, const uint32_t& aReplyDelay, const bool& aBigEndianHack, const std::string& aDevicePathEvents = "");
 
   ~PCIeDummyHardware();
 
@@ -63,7 +71,7 @@ private:
   static bool fileWrite(int aFileDescriptor, const uint32_t aAddr, const uint8_t* const aPtr, const size_t aNrBytes);
 
 
-  std::string mDevicePathHostToFPGA, mDevicePathFPGAToHost;
+  std::string mDevicePathHostToFPGA, mDevicePathFPGAToHost, mDevicePathEvents;
 
   const uint32_t mNumberOfPages;
   const uint32_t mWordsPerPage;
@@ -72,7 +80,7 @@ private:
 
   bool mStop;
 
-  int mDeviceFileHostToFPGA, mDeviceFileFPGAToHost;
+  int mDeviceFileHostToFPGA, mDeviceFileFPGAToHost, mDeviceFileEvents;
 };
 
 } // end ns tests
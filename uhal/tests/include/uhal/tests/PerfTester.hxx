@@ -118,6 +118,8 @@ namespace uhal
         bool m_verbose;  ///< Verbosity true/false flag.
         bool m_perIterationDispatch; ///< Perform a network dispatch every iteration flag.
         bool m_includeConnect; ///< Include (e.g. TCP) connect time in reported bandwidth/latency
+        boost::uint32_t m_clientsPerURI; ///< Number of clients created for each device URI
+        boost::uint32_t m_ioThreads; ///< Number of threads in the I/O pool shared by socket-based clients (0: one per client)
 
 
         // PRIVATE MEMBER FUNCTIONS - Test infrastructure
@@ -140,6 +142,12 @@ namespace uhal
         /// Outputs a standard result set to screen - provide it with the number of seconds the test took.
         void outputStandardResults ( double totalSeconds ) const;
 
+        /// Returns the number of threads in this process
+        static size_t getThreadCount();
+
+        /// Returns the resident set size of this process, in kB
+        static size_t getResidentSetSize();
+
         /// Returns a random uint32_t in the range [0,maxSize], with 1/x probability distribution -- so that p(x=0) = p(2<=x<4) = p(2^n <= x < 2^n+1)
         static uint32_t getRandomBlockSize ( const uint32_t maxSize );
 
@@ -165,6 +173,15 @@ namespace uhal
 
         void bandwidthRxTest();  ///< Read bandwidth test
         void bandwidthTxTest();  ///< Write bandwidth test
+        void dispatchLatencyTest();  ///< Per-dispatch latency test
+        void asyncDispatchLatencyTest();  ///< Multi-device round latency test, dispatch vs dispatchAsync
+        void transactionRateTest();  ///< Single-word read transaction rate test
+        void batchedBandwidthTest();  ///< Read & write bandwidth test, without vs with batched UDP send/receive
+        void busyPollLatencyTest();  ///< Per-dispatch latency test, with replies collected by the I/O thread vs by busy-polling
+        void mmapPageTransferTest();  ///< Packet write into & reply scatter from the pages of a stand-in mmap device file
+        void pcieReplyLatencyTest();  ///< Per-dispatch latency & CPU time test, with fixed-interval vs adaptive polling vs interrupts
+        void pcieSharedDeviceTest();  ///< Total dispatch rate & latency test for several client processes sharing a device, without vs with the scheduler
+        void nodeTreeStartupTest();  ///< Device creation & HwInterface copy time & memory test, with a generated address table
         void validationTest();   ///< Historic basic firmware/software validation test
 
     public:
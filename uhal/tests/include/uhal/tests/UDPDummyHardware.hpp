@@ -52,11 +52,18 @@ namespace uhal {
         @param aPort the port to be used by the hardware
         @param aReplyDelay a time delay between the reply and response for the first transaction
         @param aBigEndianHack whether we are using the dummy hardware with a client which uses the big-endian hack.
+        @param aDropRequestPeriod if non-zero, every N-th control request is dropped without being processed (emulates packet loss)
+        @param aDropReplyPeriod if non-zero, the reply to every N-th control request is dropped after the request has been processed (emulates packet loss)
       */
-      UDPDummyHardware ( const uint16_t& aPort , const uint32_t& aReplyDelay, const bool& aBigEndianHack ) :
+      UDPDummyHardware ( const uint16_t& aPort , const uint32_t& aReplyDelay, const bool& aBigEndianHack , const uint32_t& aDropRequestPeriod = 0 , const uint32_t& aDropReplyPeriod = 0 ) :
         DummyHardware< IPbus_major , IPbus_minor > ( aReplyDelay , aBigEndianHack ) ,
         mIOservice(),
-        mSocket ( mIOservice , boost::asio::ip::udp::endpoint ( boost::asio::ip::udp::v4(), aPort ) )
+        mSocket ( mIOservice , boost::asio::ip::udp::endpoint ( boost::asio::ip::udp::v4(), aPort ) ),
+        mDropRequestPeriod ( aDropRequestPeriod ),
+        mDropReplyPeriod ( aDropReplyPeriod ),
+        mControlRequestCounter ( 0 ),
+        mControlReplyCounter ( 0 ),
+        mDropNextControlRequest ( false )
       {
       }
   
@@ -73,15 +80,35 @@ namespace uhal {
   
       void stop();
 
+      //! Drop the next control request without processing it, in addition to any dropped periodically (emulates the loss of a single packet)
+      void dropNextControlRequest()
+      {
+        mDropNextControlRequest = true;
+      }
+
     private:
       void handle_receive(const boost::system::error_code& ec, std::size_t length);
 
+      //! Returns whether the datagram in the receive buffer is a control packet (rather than a status or resend request)
+      bool isControlPacket() const;
+
       //! The BOOST ASIO io_service used by the UDP server
       boost::asio::io_service mIOservice;
       //! The socket opened by the UDP server 
       boost::asio::ip::udp::socket mSocket;
       //! The endpoint which sent the UDP datagram
       boost::asio::ip::udp::endpoint mSenderEndpoint;
+
+      //! Every N-th control request is dropped (0 to disable)
+      uint32_t mDropRequestPeriod;
+      //! The reply to every N-th control request is dropped (0 to disable)
+      uint32_t mDropReplyPeriod;
+      //! The number of control requests received
+      uint32_t mControlRequestCounter;
+      //! The number of control requests processed
+      uint32_t mControlReplyCounter;
+      //! Whether the next control request is to be dropped (set from the test thread)
+      std::atomic<bool> mDropNextControlRequest;
   };
   }
 }
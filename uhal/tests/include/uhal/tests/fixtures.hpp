@@ -52,6 +52,14 @@ protected:
 
   static std::string getAddressFileURI();
 
+  /**
+    Returns a client with the fixture's timeout, whose URI is the specified one with extra attributes appended
+    @param aId the ID of the device
+    @param aUri the URI, with or without attributes of its own
+    @param aAttributes the attributes to append without a leading '?' or '&' (e.g. "coalesce=1&max_recovery_attempts=3"); may be empty
+  */
+  static uhal::HwInterface createHwInterface(const std::string& aId, const std::string& aUri, const std::string& aAttributes);
+
 public:
   static std::string connectionFileURI;
   // HW client timeout in milliseconds
@@ -71,6 +79,9 @@ struct MinimalFixture : public AbstractFixture {
 
   uhal::HwInterface getHwInterface() const;
 
+  //! Returns a client of the fixture's device whose URI has the specified attributes (e.g. "coalesce=1") appended to the one in the connection file
+  uhal::HwInterface getHwInterface(const std::string& aAttributes) const;
+
   static const DeviceType deviceType;
 
 protected:
@@ -86,6 +97,9 @@ struct MinimalFixture<IPBUS_2_0_PCIE> : public AbstractFixture {
 
   uhal::HwInterface getHwInterface() const;
 
+  //! Returns a client of the fixture's device whose URI has the specified attributes (e.g. "scheduler=1") appended to the one in the connection file
+  uhal::HwInterface getHwInterface(const std::string& aAttributes) const;
+
   static const DeviceType deviceType;
   std::string hardwareToClientFile;
   std::string clientToHardwareFile;
@@ -128,6 +142,12 @@ HwInterface MinimalFixture<type>::getHwInterface() const
   return hw;
 }
 
+template <DeviceType type>
+HwInterface MinimalFixture<type>::getHwInterface(const std::string& aAttributes) const
+{
+  return createHwInterface(deviceId, getHwInterface().uri(), aAttributes);
+}
+
 
 
 
@@ -162,6 +182,22 @@ template <>
 DummyHardwareFixture<IPBUS_2_0_PCIE>::DummyHardwareFixture();
 
 
+class ControlHubEmulator;
+
+//! Fixture running an IPbus 2.0 UDP dummy hardware behind an emulated ControlHub
+struct ControlHubEmulatorFixture : public DummyHardwareFixture<IPBUS_2_0_UDP> {
+  ControlHubEmulatorFixture();
+  ~ControlHubEmulatorFixture() {}
+
+  uhal::HwInterface getControlHubHwInterface(const std::string& aExtraAttributes = "", const uint16_t aTargetPort = 0) const;
+
+  uint16_t controlHubPort;
+  //! The emulator, owned by the runner
+  ControlHubEmulator* controlHub;
+  DummyHardwareRunner controlHubRunner;
+};
+
+
 } // end ns tests
 } // end ns uhal
 
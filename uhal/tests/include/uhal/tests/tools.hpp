@@ -47,6 +47,7 @@
 
 #include "uhal/ConnectionManager.hpp"
 #include "uhal/HwInterface.hpp"
+#include "uhal/ProtocolIPbusCore.hpp"
 #include "uhal/tests/definitions.hpp"
 
 
@@ -63,6 +64,15 @@ public:
 
   void setReplyDelay (const std::chrono::microseconds& aDelay);
 
+  //! Returns the number of transactions of the specified type that the dummy hardware has received
+  uint32_t getTransactionCount (const IPbusTransactionType aType) const;
+
+  //! Sets the MTU that the dummy hardware reports in IPbus 2.0 status replies
+  void setMtu (const uint32_t aMtu);
+
+  //! Returns the size, in bytes, of the largest request packet that the dummy hardware has received
+  uint32_t getMaxRequestByteCount () const;
+
 private:
   std::unique_ptr<DummyHardwareInterface> mHw;
   std::thread mHwThread;
@@ -107,6 +117,17 @@ double measureFileReadLatency(const std::string& aFilePath, uint32_t aBaseAddr,
 
 double measureFileWriteLatency(const std::string& aFilePath, uint32_t aBaseAddr, uint32_t aDepth, size_t aNrIterations, bool aVerbose);
 
+/**
+  Writes random values to a block of words within the specified node, and to single words that follow the block (each as its own transaction), then reads them all back in a second dispatch
+  @param aHw the device
+  @param aNodeId the ID of the node
+  @param aBlockSize the number of words written and read as a block
+  @param aNrSingleWords the number of words after the block that are written and read individually
+  @param aOffset the offset of the block from the start of the node
+  @return whether all of the values read back match those written
+*/
+bool writeAndReadBack(HwInterface& aHw, const std::string& aNodeId, const size_t aBlockSize, const size_t aNrSingleWords = 0, const uint32_t aOffset = 0);
+
 } // end ns tests
 } // end ns uhal
 
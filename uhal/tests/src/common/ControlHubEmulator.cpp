@@ -0,0 +1,227 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/tests/ControlHubEmulator.hpp"
+
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+#include "uhal/log/LogLevels.hpp"
+#include "uhal/log/log.hpp"
+
+
+namespace uhal {
+  namespace tests {
+
+    ControlHubEmulator::ControlHubEmulator ( const uint16_t& aPort ) :
+      DummyHardwareInterface ( std::chrono::microseconds(0) ),
+      mIOservice(),
+      mAcceptor ( mIOservice , boost::asio::ip::tcp::endpoint ( boost::asio::ip::tcp::v4() , aPort ) ),
+      mUdpSocket ( socket ( AF_INET , SOCK_DGRAM , 0 ) ),
+      mConnectionCount ( 0 ),
+      mChunkCount ( 0 ),
+      mPacketCount ( 0 ),
+      mMaxPacketsPerChunk ( 0 ),
+      mMaxBytesPerChunk ( 0 )
+    {
+      // Like the real ControlHub, give up on a target before the client gives up on the ControlHub
+      timeval lTimeout = { 0 , 500000 };
+      setsockopt ( mUdpSocket , SOL_SOCKET , SO_RCVTIMEO , &lTimeout , sizeof ( lTimeout ) );
+      mAcceptor.listen();
+    }
+
+
+    ControlHubEmulator::~ControlHubEmulator()
+    {
+      close ( mUdpSocket );
+    }
+
+
+    void ControlHubEmulator::run()
+    {
+      accept();
+      mIOservice.run();
+      mIOservice.reset();
+    }
+
+
+    void ControlHubEmulator::stop()
+    {
+      mIOservice.stop();
+    }
+
+
+    size_t ControlHubEmulator::getConnectionCount() const
+    {
+      return mConnectionCount;
+    }
+
+
+    size_t ControlHubEmulator::getChunkCount() const
+    {
+      return mChunkCount;
+    }
+
+
+    size_t ControlHubEmulator::getPacketCount() const
+    {
+      return mPacketCount;
+    }
+
+
+    size_t ControlHubEmulator::getMaxPacketsPerChunk() const
+    {
+      return mMaxPacketsPerChunk;
+    }
+
+
+    size_t ControlHubEmulator::getMaxBytesPerChunk() const
+    {
+      return mMaxBytesPerChunk;
+    }
+
+
+    void ControlHubEmulator::accept()
+    {
+      std::shared_ptr< Connection > lConnection ( new Connection ( mIOservice ) );
+      mAcceptor.async_accept ( lConnection->socket , [this, lConnection] (const boost::system::error_code& aError) {
+        if ( ! aError )
+        {
+          mConnectionCount++;
+          readChunkHeader ( lConnection );
+        }
+        accept();
+      } );
+    }
+
+
+    void ControlHubEmulator::readChunkHeader ( const std::shared_ptr< Connection >& aConnection )
+    {
+      boost::asio::async_read ( aConnection->socket , boost::asio::buffer ( &aConnection->byteCountHeader , 4 ) , boost::asio::transfer_exactly ( 4 ) ,
+                                [this, aConnection] (const boost::system::error_code& aError, std::size_t) {
+        if ( aError )
+          return;
+
+        aConnection->chunk.resize ( ntohl ( aConnection->byteCountHeader ) );
+        boost::asio::async_read ( aConnection->socket , boost::asio::buffer ( aConnection->chunk ) , boost::asio::transfer_exactly ( aConnection->chunk.size() ) ,
+                                  [this, aConnection] (const boost::system::error_code& aError, std::size_t) {
+          if ( ! aError )
+            handleChunk ( aConnection );
+        } );
+      } );
+    }
+
+
+    void ControlHubEmulator::handleChunk ( const std::shared_ptr< Connection >& aConnection )
+    {
+      std::vector< uint8_t > lReply ( 4 );
+      size_t lNrPackets ( 0 );
+
+      for ( size_t lOffset = 0; lOffset + 8 <= aConnection->chunk.size(); lNrPackets++ )
+      {
+        uint16_t lNrWords;
+        memcpy ( &lNrWords , &aConnection->chunk.at ( lOffset + 6 ) , 2 );
+        const size_t lSize ( 8 + 4 * size_t ( ntohs ( lNrWords ) ) );
+
+        if ( lOffset + lSize > aConnection->chunk.size() )
+        {
+          log ( Error() , "ControlHub emulator received a truncated packet" );
+          break;
+        }
+
+        forward ( &aConnection->chunk.at ( lOffset ) , lSize , lReply );
+        lOffset += lSize;
+      }
+
+      mChunkCount++;
+      mPacketCount += lNrPackets;
+
+      size_t lMax ( mMaxPacketsPerChunk );
+      while ( ( lNrPackets > lMax ) && ! mMaxPacketsPerChunk.compare_exchange_weak ( lMax , lNrPackets ) )
+        {}
+
+      const size_t lNrBytes ( aConnection->chunk.size() );
+      size_t lMaxBytes ( mMaxBytesPerChunk );
+      while ( ( lNrBytes > lMaxBytes ) && ! mMaxBytesPerChunk.compare_exchange_weak ( lMaxBytes , lNrBytes ) )
+        {}
+
+      const uint32_t lByteCount ( htonl ( lReply.size() - 4 ) );
+      memcpy ( &lReply.at ( 0 ) , &lByteCount , 4 );
+      boost::system::error_code lError;
+      boost::asio::write ( aConnection->socket , boost::asio::buffer ( lReply ) , lError );
+
+      if ( ! lError )
+        readChunkHeader ( aConnection );
+    }
+
+
+    void ControlHubEmulator::forward ( const uint8_t* aPacket , const size_t aSize , std::vector< uint8_t >& aReply )
+    {
+      // The preamble holds the target's IP address and port, both in network byte order, followed by the packet's word count
+      sockaddr_in lTarget;
+      memset ( &lTarget , 0 , sizeof ( lTarget ) );
+      lTarget.sin_family = AF_INET;
+      memcpy ( &lTarget.sin_addr.s_addr , aPacket , 4 );
+      memcpy ( &lTarget.sin_port , aPacket + 4 , 2 );
+
+      uint8_t lTargetReply [ 65536 ];
+      ssize_t lReplySize ( -1 );
+
+      if ( sendto ( mUdpSocket , aPacket + 8 , aSize - 8 , 0 , reinterpret_cast< const sockaddr* > ( &lTarget ) , sizeof ( lTarget ) ) == ssize_t ( aSize - 8 ) )
+      {
+        lReplySize = recv ( mUdpSocket , lTargetReply , sizeof ( lTargetReply ) , 0 );
+      }
+
+      // Reply preamble: byte count of the rest of this reply, target IP address and port, and error code (1 if the target did not reply)
+      const uint32_t lByteCount ( htonl ( 8 + std::max < ssize_t > ( lReplySize , 0 ) ) );
+      const uint16_t lErrorCode ( htons ( lReplySize < 0 ? 1 : 0 ) );
+      const uint8_t* lByteCountPtr ( reinterpret_cast< const uint8_t* > ( &lByteCount ) );
+      const uint8_t* lErrorCodePtr ( reinterpret_cast< const uint8_t* > ( &lErrorCode ) );
+      aReply.insert ( aReply.end() , lByteCountPtr , lByteCountPtr + 4 );
+      aReply.insert ( aReply.end() , aPacket , aPacket + 6 );
+      aReply.insert ( aReply.end() , lErrorCodePtr , lErrorCodePtr + 2 );
+
+      if ( lReplySize > 0 )
+        aReply.insert ( aReply.end() , lTargetReply , lTargetReply + lReplySize );
+    }
+
+  }
+}
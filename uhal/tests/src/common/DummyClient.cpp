@@ -37,6 +37,11 @@ ValHeader DummyClient::implementWriteBlock ( const uint32_t&, const std::vector<
   return ValHeader();
 }
 
+ValHeader DummyClient::implementWriteBlock ( const uint32_t&, const std::shared_ptr< const std::vector< uint32_t > >&, const defs::BlockReadWriteMode& )
+{
+  return ValHeader();
+}
+
 ValWord< uint32_t > DummyClient::implementRead ( const uint32_t&, const uint32_t& )
 {
   return ValWord<uint32_t>();
@@ -47,6 +52,11 @@ ValVector< uint32_t > DummyClient::implementReadBlock ( const uint32_t&, const u
   return ValVector< uint32_t >();
 }
 
+ValHeader DummyClient::implementReadBlockInto ( const uint32_t&, uint32_t*, const uint32_t&, const defs::BlockReadWriteMode& )
+{
+  return ValHeader();
+}
+
 ValWord< uint32_t > DummyClient::implementRMWbits ( const uint32_t& , const uint32_t& , const uint32_t& )
 {
   return ValWord<uint32_t>();
@@ -80,6 +80,11 @@ namespace uhal
     void DummyHardware<IPbus_major, IPbus_minor>::AnalyzeReceivedAndCreateReply ( const uint32_t& aByteCount )
     {
       //        std::cout << aByteCount << " bytes received" << std::endl;
+      if ( aByteCount > mMaxRequestByteCount )
+      {
+        mMaxRequestByteCount = aByteCount;
+      }
+
       if ( IPbus_major == 2 )
       {
         bool is_status_request = ( *mReceive.begin() == 0xF1000020 );
@@ -180,6 +185,7 @@ namespace uhal
     {
       mReceivedControlPacketHeaderHistory.push_back ( base_type::mPacketHeader );
       mReceivedControlPacketHeaderHistory.pop_front();
+      mTransactionCounts.at ( base_type::mType )++;
       uint32_t lExpected ( IPbus< IPbus_major , IPbus_minor >::ExpectedHeader ( base_type::mType , 0 , base_type::mTransactionId ) );
       mReply.push_back ( lExpected );
       mSentControlPacketHeaderHistory.push_back ( lExpected );
@@ -192,6 +198,7 @@ namespace uhal
     {
       mReceivedControlPacketHeaderHistory.push_back ( base_type::mPacketHeader );
       mReceivedControlPacketHeaderHistory.pop_front();
+      mTransactionCounts.at ( base_type::mType )++;
       uint32_t lAddress ( aAddress );
       uint32_t lExpected ( IPbus< IPbus_major , IPbus_minor >::ExpectedHeader ( base_type::mType , base_type::mWordCounter , base_type::mTransactionId ) );
       mReply.push_back ( lExpected );
@@ -210,6 +217,7 @@ namespace uhal
     {
       mReceivedControlPacketHeaderHistory.push_back ( base_type::mPacketHeader );
       mReceivedControlPacketHeaderHistory.pop_front();
+      mTransactionCounts.at ( base_type::mType )++;
       uint32_t lAddress ( aAddress );
       uint32_t lExpected ( IPbus< IPbus_major , IPbus_minor >::ExpectedHeader ( base_type::mType , base_type::mWordCounter , base_type::mTransactionId ) );
       mReply.push_back ( lExpected );
@@ -228,6 +236,7 @@ namespace uhal
     {
       mReceivedControlPacketHeaderHistory.push_back ( base_type::mPacketHeader );
       mReceivedControlPacketHeaderHistory.pop_front();
+      mTransactionCounts.at ( base_type::mType )++;
       uint32_t lAddress ( aAddress );
       uint32_t lExpected ( IPbus< IPbus_major , IPbus_minor >::ExpectedHeader ( base_type::mType , base_type::mWordCounter , base_type::mTransactionId ) );
       mReply.push_back ( lExpected );
@@ -246,6 +255,7 @@ namespace uhal
     {
       mReceivedControlPacketHeaderHistory.push_back ( base_type::mPacketHeader );
       mReceivedControlPacketHeaderHistory.pop_front();
+      mTransactionCounts.at ( base_type::mType )++;
       uint32_t lAddress ( aAddress );
 
       while ( aIt != aEnd )
@@ -275,6 +285,7 @@ namespace uhal
     {
       mReceivedControlPacketHeaderHistory.push_back ( base_type::mPacketHeader );
       mReceivedControlPacketHeaderHistory.pop_front();
+      mTransactionCounts.at ( base_type::mType )++;
       uint32_t lAddress ( aAddress );
 
       while ( aIt != aEnd )
@@ -304,6 +315,7 @@ namespace uhal
     {
       mReceivedControlPacketHeaderHistory.push_back ( base_type::mPacketHeader );
       mReceivedControlPacketHeaderHistory.pop_front();
+      mTransactionCounts.at ( base_type::mType )++;
       uint32_t lAddress ( aAddress );
       uint32_t lExpected ( IPbus< IPbus_major , IPbus_minor >::ExpectedHeader ( base_type::mType , 1 , base_type::mTransactionId ) );
       mReply.push_back ( lExpected );
@@ -334,6 +346,7 @@ namespace uhal
     {
       mReceivedControlPacketHeaderHistory.push_back ( base_type::mPacketHeader );
       mReceivedControlPacketHeaderHistory.pop_front();
+      mTransactionCounts.at ( base_type::mType )++;
       uint32_t lAddress ( aAddress );
       uint32_t lExpected ( IPbus< IPbus_major , IPbus_minor >::ExpectedHeader ( base_type::mType , 1 , base_type::mTransactionId ) );
       mReply.push_back ( lExpected );
@@ -408,7 +421,7 @@ namespace uhal
     void DummyHardware<IPbus_major, IPbus_minor>::status_packet_header ( )
     {
       mReply.push_back ( base_type::mPacketHeader );
-      mReply.push_back ( BUFFER_SIZE * sizeof ( uint32_t ) );
+      mReply.push_back ( mMtu );
       mReply.push_back ( REPLY_HISTORY_DEPTH );
       uint16_t lTemp ( ( ( mLastPacketHeader>>8 ) &0x0000FFFF ) + 1 );
 
@@ -0,0 +1,95 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+---------------------------------------------------------------------------
+*/
+
+
+
+#include <iostream>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#include "uhal/log/LogLevels.hpp"
+#include "uhal/log/log.hpp"
+#include "uhal/tests/PCIeDummyHardware.hpp"
+
+
+using namespace uhal;
+using namespace uhal::tests;
+
+int main ( int argc, char* argv[] )
+{
+  // Declare the supported options.
+  boost::program_options::options_description desc ( "Allowed options" );
+  desc.add_options()
+  ( "help,h", "Produce this help message" )
+  ( "delay,d", boost::program_options::value<uint32_t>()->default_value ( 0 ) , "Reply delay for first packet (in seconds) - optional" )
+  ( "to-device,i", boost::program_options::value<std::string>() , "Path of the named pipe to create for client-to-device packets (must not exist) - required" )
+  ( "to-client,o", boost::program_options::value<std::string>() , "Path of the file to create for device-to-client packets (must not exist) - required" )
+  ( "events,e", boost::program_options::value<std::string>()->default_value ( "" ) , "Path of the named pipe to create for emulating the events file (must not exist) - optional" )
+  ( "big-endian,b", "Include the big-endian hack" )
+  ( "verbose,V", "Produce verbose output" )
+  ;
+  boost::program_options::variables_map vm;
+
+  try
+  {
+    boost::program_options::store ( boost::program_options::parse_command_line ( argc, argv, desc ), vm );
+    boost::program_options::notify ( vm );
+  }
+  catch ( std::exception& e )
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+    std::cout << "Usage: " << argv[0] << " [OPTIONS]" << std::endl;
+    std::cout << desc << std::endl;
+    return 1;
+  }
+
+  if ( vm.count ( "help" ) or ( not vm.count ( "to-device" ) ) or ( not vm.count ( "to-client" ) ) )
+  {
+    std::cout << "Usage: " << argv[0] << " [OPTIONS]" << std::endl;
+    std::cout << desc << std::endl;
+    return ( vm.count ( "help" ) ? 0 : 1 );
+  }
+
+  if ( vm.count ( "verbose" ) )
+  {
+    setLogLevelTo ( Debug() );
+  }
+  else
+  {
+    setLogLevelTo ( Notice() );
+  }
+
+  PCIeDummyHardware lDummyHardware ( vm["to-device"].as<std::string>() , vm["to-client"].as<std::string>() , vm["delay"].as<uint32_t>() , bool ( vm.count ( "big-endian" ) ) , vm["events"].as<std::string>() );
+  lDummyHardware.run();
+
+  return 0;
+}
@@ -46,12 +46,12 @@ int main ( int argc, char* argv[] )
 
   if ( lOptions.version == 1 )
   {
-    UDPDummyHardware<1,3> lDummyHardware ( lOptions.port , lOptions.delay, false );
+    UDPDummyHardware<1,3> lDummyHardware ( lOptions.port , lOptions.delay, false , lOptions.dropRequestPeriod , lOptions.dropReplyPeriod );
     lDummyHardware.run();
   }
   else if ( lOptions.version == 2 )
   {
-    UDPDummyHardware<2,0> lDummyHardware ( lOptions.port , lOptions.delay, lOptions.bigendian );
+    UDPDummyHardware<2,0> lDummyHardware ( lOptions.port , lOptions.delay, lOptions.bigendian , lOptions.dropRequestPeriod , lOptions.dropReplyPeriod );
     lDummyHardware.run();
   }
   else
@@ -38,6 +38,7 @@
 #include <chrono>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <thread>
 #include <string>
 #include <sys/ioctl.h>
@@ -55,17 +56,19 @@
 namespace uhal {
 namespace tests {
 
-PCIeDummyHardware::PCIeDummyHardware(const std::string& aDevicePathHostToFPGA, const std::string& aDevicePathFPGAToHost, const uint32_t& aReplyDelay, const bool& aBigEndianHack) :
+PCIeDummyHardware::PCIeDummyHardware(const std::string& aDevicePathHostToFPGA, const std::string& aDevicePathFPGAToHost, const uint32_t& aReplyDelay, const bool& aBigEndianHack, const std::string& aDevicePathEvents) :
   DummyHardware<2, 0>(aReplyDelay, aBigEndianHack),
   mDevicePathHostToFPGA(aDevicePathHostToFPGA),
   mDevicePathFPGAToHost(aDevicePathFPGAToHost),
+  mDevicePathEvents(aDevicePathEvents),
   mNumberOfPages(3),
   mWordsPerPage(360),
   mNextPageIndex(0),
   mPublishedPageCount(0),
   mStop(false),
   mDeviceFileHostToFPGA(-1),
-  mDeviceFileFPGAToHost(-1)
+  mDeviceFileFPGAToHost(-1),
+  mDeviceFileEvents(-1)
 {
   log(Debug(), "PCIe dummy hardware is creating client-to-device named PIPE ", Quote (mDevicePathHostToFPGA));
   int rc = mkfifo(mDevicePathHostToFPGA.c_str(), 0666);
@@ -74,7 +77,8 @@ PCIeDummyHardware::PCIeDummyHardware(const std::string& aDevicePathHostToFPGA, c
     throw lExc;
   }
 
-  mDeviceFileHostToFPGA = open(mDevicePathHostToFPGA.c_str(), O_RDONLY | O_NONBLOCK); /* O_NONBLOCK so that open does not hang */
+  /* O_NONBLOCK so that open does not hang; O_RDWR so that the pipe always has a writer, and hence poll does not report a hang-up once the client has closed its end */
+  mDeviceFileHostToFPGA = open(mDevicePathHostToFPGA.c_str(), O_RDWR | O_NONBLOCK);
   if ( mDeviceFileHostToFPGA < 0 ) {
     std::runtime_error lExc("Problem opening host-to-FPGA device file '" + mDevicePathHostToFPGA + "', errno=" + std::to_string(errno) + " (dummy hw)");
     throw lExc;
@@ -85,7 +89,7 @@ PCIeDummyHardware::PCIeDummyHardware(const std::string& aDevicePathHostToFPGA, c
   fcntl(mDeviceFileHostToFPGA, F_SETFL, lFileFlags & ~O_NONBLOCK);
 
   log(Debug(), "PCIe dummy hardware is creating device-to-client file ", Quote (mDevicePathFPGAToHost));
-  mDeviceFileFPGAToHost = open(mDevicePathFPGAToHost.c_str(), O_RDWR | O_CREAT | O_DIRECTORY, 0666 /* permission */);
+  mDeviceFileFPGAToHost = open(mDevicePathFPGAToHost.c_str(), O_RDWR | O_CREAT, 0666 /* permission */);
   if ( mDeviceFileFPGAToHost < 0 ) {
     std::runtime_error lExc("Cannot open FPGA-to-host device file '" + mDevicePathFPGAToHost + "' (dummy hw)");
     throw lExc;
@@ -99,6 +103,21 @@ PCIeDummyHardware::PCIeDummyHardware(const std::string& aDevicePathHostToFPGA, c
 
   fileWrite(mDeviceFileFPGAToHost, 0, lFPGAToHostData);
 
+  if ( not mDevicePathEvents.empty() ) {
+    log(Debug(), "PCIe dummy hardware is creating events named PIPE ", Quote (mDevicePathEvents));
+    rc = mkfifo(mDevicePathEvents.c_str(), 0666);
+    if ( rc != 0 ) {
+      std::runtime_error lExc("Cannot create events FIFO; mkfifo returned " + std::to_string(rc) + ", errno=" + std::to_string(errno));
+      throw lExc;
+    }
+
+    mDeviceFileEvents = open(mDevicePathEvents.c_str(), O_RDWR | O_NONBLOCK);
+    if ( mDeviceFileEvents < 0 ) {
+      std::runtime_error lExc("Problem opening events file '" + mDevicePathEvents + "', errno=" + std::to_string(errno) + " (dummy hw)");
+      throw lExc;
+    }
+  }
+
   log(Notice(), "Starting IPbus 2.0 PCIe dummy hardware ", Quote(mDevicePathHostToFPGA), ", ", Quote(mDevicePathFPGAToHost), "; ", Integer(mNumberOfPages), " pages, ", Integer(mWordsPerPage), " words per page");
 }
 
@@ -116,6 +135,13 @@ PCIeDummyHardware::~PCIeDummyHardware()
     log(Fatal(), "Problem occurred when closing ", Quote(mDevicePathFPGAToHost), " during dummy hardware destruction");
   if (remove(mDevicePathFPGAToHost.c_str()))
     log(Fatal(), "Problem occurred when removing ", Quote(mDevicePathFPGAToHost), " during dummy hardware destruction");
+
+  if (mDeviceFileEvents != -1) {
+    if (close(mDeviceFileEvents))
+      log(Fatal(), "Problem occurred when closing ", Quote(mDevicePathEvents), " during dummy hardware destruction");
+    if (remove(mDevicePathEvents.c_str()))
+      log(Fatal(), "Problem occurred when removing ", Quote(mDevicePathEvents), " during dummy hardware destruction");
+  }
 }
 
 
@@ -124,15 +150,20 @@ void PCIeDummyHardware::run()
   log(Info(), "Entering run method for IPbus 2.0 PCIe dummy hardware ", Quote(mDevicePathHostToFPGA), ", ", Quote(mDevicePathFPGAToHost));
 
   while ( !mStop ) {
+    // Block until a request arrives, waking up periodically to check whether the dummy hardware has been stopped
+    struct pollfd lPollFd;
+    lPollFd.fd = mDeviceFileHostToFPGA;
+    lPollFd.events = POLLIN;
+    lPollFd.revents = 0;
+    poll(&lPollFd, 1, 10);
+
     int lNrBytes;
     int lRC = ioctl(mDeviceFileHostToFPGA, FIONREAD, &lNrBytes);
     log (Debug(), "PCIeDummyHardware::run  -  ioctl returns ", Integer(lRC), ", ", Integer(lNrBytes), " bytes available");
     assert (lRC == 0);
 
-    if (lNrBytes == 0) {
-      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    if (lNrBytes == 0)
       continue;
-    }
 
     log(Debug(), "IPbus 2.0 PCIe dummy hardware ", Quote(mDevicePathHostToFPGA), ", ", Quote(mDevicePathFPGAToHost), " : data ready; reading 'packet length' header");
     // FIXME: Define template method that reads sizeof(T) bytes and returns T
@@ -173,6 +204,12 @@ void PCIeDummyHardware::run()
     lStatusBlock.at(2) = mNextPageIndex;
     lStatusBlock.at(3) = mPublishedPageCount;
     fileWrite(mDeviceFileFPGAToHost, 0, lStatusBlock);
+
+    if (mDeviceFileEvents != -1) {
+      const uint32_t lEvent = 1;
+      if (::write(mDeviceFileEvents, &lEvent, sizeof lEvent) != sizeof lEvent)
+        log(Error(), "IPbus 2.0 PCIe dummy hardware ", Quote(mDevicePathHostToFPGA), ", ", Quote(mDevicePathFPGAToHost), " : failed to write to events file ", Quote(mDevicePathEvents));
+    }
   }
 
   log(Info(), "Exiting run method for IPbus 2.0 PCIe dummy hardware ", Quote(mDevicePathHostToFPGA), ", ", Quote(mDevicePathFPGAToHost));
@@ -35,18 +35,31 @@
 #include "uhal/tests/PerfTester.hxx"
 
 // C++ headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <iomanip>
+#include <numeric>
 #include <sstream>
 #include <cstdlib>
+#include <new>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 // Boost headers
 #include <boost/program_options.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/mem_fn.hpp>
 
 // uHAL headers
 #include "uhal/ClientFactory.hpp"
+#include "uhal/ProtocolMmap.hpp"
 #include "uhal/tests/tools.hpp"
 
 // Namespace resolution
@@ -54,6 +67,35 @@ namespace po = boost::program_options;
 using namespace std;
 
 
+// Replacement global allocation functions, counting heap allocations so that the TransactionRate test can report them
+namespace
+{
+  std::atomic< uint64_t > gHeapAllocations ( 0 );
+}
+
+void* operator new ( std::size_t aSize )
+{
+  gHeapAllocations.fetch_add ( 1 , std::memory_order_relaxed );
+
+  if ( void* lPtr = std::malloc ( aSize ? aSize : 1 ) )
+  {
+    return lPtr;
+  }
+
+  throw std::bad_alloc();
+}
+
+void operator delete ( void* aPtr ) noexcept
+{
+  std::free ( aPtr );
+}
+
+void operator delete ( void* aPtr , std::size_t ) noexcept
+{
+  std::free ( aPtr );
+}
+
+
 // PUBLIC METHODS
 
 uhal::tests::PerfTester::PerfTester() :
@@ -68,7 +110,9 @@ uhal::tests::PerfTester::PerfTester() :
   m_bandwidthTestDepth ( 0 ),
   m_verbose ( false ),
   m_perIterationDispatch ( false ),
-  m_includeConnect ( false )
+  m_includeConnect ( false ),
+  m_clientsPerURI ( 1 ),
+  m_ioThreads ( 0 )
 {
   // ***** DECLARE TESTS HERE - descriptions should not be longer than a shortish line. *****:
   // Receive bandwidth test
@@ -77,6 +121,33 @@ uhal::tests::PerfTester::PerfTester() :
   // Transmit bandwidth test
   m_testFuncMap["BandwidthTx"] = &PerfTester::bandwidthTxTest;
   m_testDescMap["BandwidthTx"] = "Block write test (default depth = 340) to find the transmit bandwidth.";
+  // Dispatch latency test
+  m_testFuncMap["DispatchLatency"] = &PerfTester::dispatchLatencyTest;
+  m_testDescMap["DispatchLatency"] = "Single-word read & dispatch on each client in turn; reports latency and thread count.";
+  // Multi-device asynchronous dispatch latency test
+  m_testFuncMap["AsyncDispatchLatency"] = &PerfTester::asyncDispatchLatencyTest;
+  m_testDescMap["AsyncDispatchLatency"] = "Single-word read on every client, then dispatch to all of them; reports round latency with dispatch in turn vs dispatchAsync.";
+  // Transaction rate test
+  m_testFuncMap["TransactionRate"] = &PerfTester::transactionRateTest;
+  m_testDescMap["TransactionRate"] = "Many single-word reads (default 340 per iteration), each a separate transaction; reports transactions per second and heap allocations per transaction.";
+  // Batched UDP bandwidth test
+  m_testFuncMap["BatchedBandwidth"] = &PerfTester::batchedBandwidthTest;
+  m_testDescMap["BatchedBandwidth"] = "Block read & write test (UDP only); reports bandwidths without and with the 'batch' URI attribute (sendmmsg/recvmmsg).";
+  // Busy-poll latency test
+  m_testFuncMap["BusyPollLatency"] = &PerfTester::busyPollLatencyTest;
+  m_testDescMap["BusyPollLatency"] = "Single-word read & dispatch (UDP/TCP only); reports latency percentiles without and with the 'poll=busy' URI attribute.";
+  // Mmap page transfer test
+  m_testFuncMap["MmapPageTransfer"] = &PerfTester::mmapPageTransferTest;
+  m_testDescMap["MmapPageTransfer"] = "Block write packet into & reply out of page 0 of an ipbusmmap device file, with no handshake (stand-in files only, e.g. in /dev/shm).";
+  // PCIe reply latency test
+  m_testFuncMap["PCIeReplyLatency"] = &PerfTester::pcieReplyLatencyTest;
+  m_testDescMap["PCIeReplyLatency"] = "Single-word read & dispatch (PCIe only); reports latency & CPU time with status polled every 50 us vs adaptively vs interrupts ('events').";
+  // PCIe shared device test
+  m_testFuncMap["PCIeSharedDevice"] = &PerfTester::pcieSharedDeviceTest;
+  m_testDescMap["PCIeSharedDevice"] = "Block read & dispatch from 'clientsPerURI' processes per device (PCIe only); reports total dispatch rate & latency with device locked per dispatch vs 'scheduler'.";
+  // Node tree startup test
+  m_testFuncMap["NodeTreeStartup"] = &PerfTester::nodeTreeStartupTest;
+  m_testDescMap["NodeTreeStartup"] = "Create 'iterations' devices with the first URI & a generated address table of 'depth' registers, then copy them; reports time & RSS growth.";
   // Validation test
   m_testFuncMap["Validation"] = &PerfTester::validationTest;
   m_testDescMap["Validation"] = "For validating downstream subsystems, such as the Control Hub or the IPbus firmware.";
@@ -105,7 +176,9 @@ int uhal::tests::PerfTester::run ( int argc, char* argv[] )
     ( "baseAddr,b", po::value<string> ( &m_baseAddrStr )->default_value ( "0x0" ), "Base address (in hex) of the test location on the target device(s)." )
     ( "bandwidthTestDepth,w", po::value<boost::uint32_t> ( &m_bandwidthTestDepth )->default_value ( 340 ), "Depth of read/write used in bandwidth tests." )
     ( "perIterationDispatch,p", "Force a network dispatch every test iteration instead of the default single dispatch call at the end." )
-    ( "includeConnect,c", "Include connect time in reported bandwidths and latencies" );
+    ( "includeConnect,c", "Include connect time in reported bandwidths and latencies" )
+    ( "clientsPerURI,m", po::value<boost::uint32_t> ( &m_clientsPerURI )->default_value ( 1 ), "Number of clients to create for each device URI (e.g. to emulate many devices with one dummy hardware instance)." )
+    ( "ioThreads,n", po::value<boost::uint32_t> ( &m_ioThreads )->default_value ( 0 ), "Number of threads in the I/O pool shared by UDP & TCP clients (0: one I/O thread per client)." );
     po::variables_map argMap;
     po::store ( po::parse_command_line ( argc, argv, argDescriptions ), argMap );
     po::notify ( argMap );
@@ -185,7 +258,10 @@ void uhal::tests::PerfTester::outputHelpText ( const string& argDescriptions ) c
        <<  argDescriptions
        <<  "Usage examples:\n\n"
        "  PerfTester.exe -t BandwidthTx -b 0xf0 -d ipbusudp-1.3://localhost:50001 ipbusudp-1.3://localhost:50002\n"
-       "  PerfTester.exe -t BandwidthTx -w 5 -i 100 chtcp-1.3://localhost:10203?target=127.0.0.1:50001" << endl;
+       "  PerfTester.exe -t BandwidthTx -w 5 -i 100 chtcp-1.3://localhost:10203?target=127.0.0.1:50001\n"
+       "  PerfTester.exe -t DispatchLatency -m 1000 -n 4 -i 10 -d ipbusudp-2.0://localhost:50001\n"
+       "  PerfTester.exe -t AsyncDispatchLatency -m 100 -n 1 -i 100 -d ipbusudp-2.0://localhost:50001\n"
+       "  PerfTester.exe -t TransactionRate -w 10000 -i 100 -d ipbusudp-2.0://localhost:50001" << endl;
   outputTestDescriptionsList();
 }
 
@@ -232,6 +308,8 @@ void uhal::tests::PerfTester::outputUserChoices() const
        << "  Test register addr  ----->  " << std::hex << showbase << m_baseAddr << noshowbase << std::dec << endl
        << "  Test iterations  -------->  " << m_iterations << endl
        << "  Per-iteration dispatch -->  " << ( m_perIterationDispatch?"Yes":"No" ) << endl
+       << "  Clients per URI  -------->  " << m_clientsPerURI << endl
+       << "  I/O threads  ------------>  " << ( m_ioThreads == 0 ? "One per client" : std::to_string ( m_ioThreads ) + " (shared)" ) << endl
        << "  Device URIs:" << endl;
   StringVec::const_iterator iDevice = m_deviceURIs.begin(), iDeviceEnd = m_deviceURIs.end();
 
@@ -256,11 +334,15 @@ void uhal::tests::PerfTester::buildClients()
     setLogLevelTo ( Warning() );
   }
 
-  m_clients.reserve ( m_deviceURIs.size() );
+  ClientFactory::getInstance().setSharedIOservicePool ( m_ioThreads );
+  m_clients.reserve ( m_deviceURIs.size() * m_clientsPerURI );
 
   for ( unsigned int iURI = 0 ; iURI < m_deviceURIs.size() ; ++iURI )
   {
-    m_clients.push_back ( ClientFactory::getInstance().getClient ( "MyDevice", m_deviceURIs.at ( iURI ) ) );
+    for ( unsigned int iClient = 0 ; iClient < m_clientsPerURI ; ++iClient )
+    {
+      m_clients.push_back ( ClientFactory::getInstance().getClient ( "MyDevice", m_deviceURIs.at ( iURI ) ) );
+    }
   }
 
   if ( m_verbose )
@@ -345,6 +427,630 @@ void uhal::tests::PerfTester::bandwidthTxTest()
 }
 
 
+void uhal::tests::PerfTester::dispatchLatencyTest()
+{
+  if ( ! m_includeConnect )
+  {
+    for ( ClientPtr& iClient: m_clients )
+    {
+      iClient->read ( m_baseAddr );
+      iClient->dispatch();
+    }
+  }
+
+  const size_t nrThreads = getThreadCount();
+  std::vector<double> latencies;
+  latencies.reserve ( m_iterations * m_clients.size() );
+  Timer timer;
+
+  for ( unsigned i = 0; i < m_iterations; ++i )
+  {
+    for ( ClientPtr& iClient: m_clients )
+    {
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      iClient->read ( m_baseAddr );
+      iClient->dispatch();
+      latencies.push_back ( std::chrono::duration<double, std::micro> ( std::chrono::steady_clock::now() - start ).count() );
+    }
+  }
+
+  const double totalSeconds = timer.elapsedSeconds();
+  std::sort ( latencies.begin(), latencies.end() );
+  outputStandardResults ( totalSeconds );
+  cout << "Number of clients               = " << m_clients.size() << "\n"
+       << "Threads in process              = " << nrThreads << "\n"
+       << "Dispatch latency, mean          = " << std::accumulate ( latencies.begin(), latencies.end(), 0.0 ) / latencies.size() << " us\n"
+       << "Dispatch latency, median        = " << latencies.at ( latencies.size() / 2 ) << " us\n"
+       << "Dispatch latency, 99th pctile   = " << latencies.at ( ( latencies.size() * 99 ) / 100 ) << " us\n"
+       << "Dispatch latency, max           = " << latencies.back() << " us" << endl;
+}
+
+
+void uhal::tests::PerfTester::asyncDispatchLatencyTest()
+{
+  if ( ! m_includeConnect )
+  {
+    for ( ClientPtr& iClient: m_clients )
+    {
+      iClient->read ( m_baseAddr );
+      iClient->dispatch();
+    }
+  }
+
+  std::vector<double> serialLatencies, asyncLatencies;
+  serialLatencies.reserve ( m_iterations );
+  asyncLatencies.reserve ( m_iterations );
+  std::vector< std::future<void> > futures;
+  futures.reserve ( m_clients.size() );
+  Timer timer;
+
+  for ( unsigned i = 0; i < m_iterations; ++i )
+  {
+    // One round with a blocking dispatch on each client in turn ...
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for ( ClientPtr& iClient: m_clients )
+    {
+      iClient->read ( m_baseAddr );
+      iClient->dispatch();
+    }
+
+    serialLatencies.push_back ( std::chrono::duration<double, std::micro> ( std::chrono::steady_clock::now() - start ).count() );
+
+    // ... then one round in which all clients are dispatched before waiting for any of the replies
+    start = std::chrono::steady_clock::now();
+
+    for ( ClientPtr& iClient: m_clients )
+    {
+      iClient->read ( m_baseAddr );
+      futures.push_back ( iClient->dispatchAsync() );
+    }
+
+    for ( std::future<void>& iFuture: futures )
+    {
+      iFuture.get();
+    }
+
+    futures.clear();
+    asyncLatencies.push_back ( std::chrono::duration<double, std::micro> ( std::chrono::steady_clock::now() - start ).count() );
+  }
+
+  const double totalSeconds = timer.elapsedSeconds();
+  std::sort ( serialLatencies.begin(), serialLatencies.end() );
+  std::sort ( asyncLatencies.begin(), asyncLatencies.end() );
+  outputStandardResults ( totalSeconds );
+  cout << "Number of clients               = " << m_clients.size() << "\n"
+       << "Threads in process              = " << getThreadCount() << "\n"
+       << "Round latency, dispatch, median = " << serialLatencies.at ( serialLatencies.size() / 2 ) << " us\n"
+       << "Round latency, dispatch, 99%    = " << serialLatencies.at ( ( serialLatencies.size() * 99 ) / 100 ) << " us\n"
+       << "Round latency, async, median    = " << asyncLatencies.at ( asyncLatencies.size() / 2 ) << " us\n"
+       << "Round latency, async, 99%       = " << asyncLatencies.at ( ( asyncLatencies.size() * 99 ) / 100 ) << " us" << endl;
+}
+
+
+void uhal::tests::PerfTester::transactionRateTest()
+{
+  if ( ! m_includeConnect )
+  {
+    for ( ClientPtr& iClient: m_clients )
+    {
+      iClient->read ( m_baseAddr );
+      iClient->dispatch();
+    }
+  }
+
+  const uint64_t lInitialHeapAllocations = gHeapAllocations.load();
+  Timer timer;
+
+  for ( unsigned i = 0; i < m_iterations; ++i )
+  {
+    for ( ClientPtr& iClient: m_clients )
+    {
+      for ( unsigned j = 0; j < m_bandwidthTestDepth; ++j )
+      {
+        iClient->read ( m_baseAddr );
+      }
+
+      if ( m_perIterationDispatch )
+      {
+        iClient->dispatch();
+      }
+    }
+  }
+
+  if ( ! m_perIterationDispatch )
+  {
+    for ( ClientPtr& iClient: m_clients )
+    {
+      iClient->dispatch();
+    }
+  }
+
+  const double totalSeconds = timer.elapsedSeconds();
+  const double totalHeapAllocations = double ( gHeapAllocations.load() - lInitialHeapAllocations );
+  const double totalTransactions = double ( m_clients.size() ) * m_iterations * m_bandwidthTestDepth;
+  outputStandardResults ( totalSeconds );
+  cout << "Reads queued each iteration     = " << m_bandwidthTestDepth << " single-word transactions\n"
+       << "Total transactions              = " << totalTransactions << "\n"
+       << "Transaction rate                = " << totalTransactions / totalSeconds << " Hz\n"
+       << "Heap allocations                = " << totalHeapAllocations / totalTransactions << " per transaction" << endl;
+}
+
+
+void uhal::tests::PerfTester::batchedBandwidthTest()
+{
+  // A second client for each URI sends packets and receives replies in batches
+  ClientVec lBatchedClients;
+
+  for ( const std::string& iURI: m_deviceURIs )
+  {
+    lBatchedClients.push_back ( ClientFactory::getInstance().getClient ( "MyDevice", iURI + ( iURI.find ( '?' ) == std::string::npos ? "?" : "&" ) + "batch=1" ) );
+  }
+
+  std::vector<ClientInterface*> lClients, lBatched;
+  for ( ClientPtr& iClient: m_clients )
+  {
+    lClients.push_back( &*iClient );
+  }
+  for ( ClientPtr& iClient: lBatchedClients )
+  {
+    lBatched.push_back( &*iClient );
+  }
+
+  if ( ! m_includeConnect )
+  {
+    for ( ClientInterface* iClient: lClients )
+    {
+      iClient->readBlock ( m_baseAddr, 1, defs::NON_INCREMENTAL );
+      iClient->dispatch();
+    }
+    for ( ClientInterface* iClient: lBatched )
+    {
+      iClient->readBlock ( m_baseAddr, 1, defs::NON_INCREMENTAL );
+      iClient->dispatch();
+    }
+  }
+
+  Timer timer;
+  const double readSeconds = measureReadLatency(lClients, m_baseAddr, m_bandwidthTestDepth, m_iterations, m_perIterationDispatch, m_verbose);
+  const double batchedReadSeconds = measureReadLatency(lBatched, m_baseAddr, m_bandwidthTestDepth, m_iterations, m_perIterationDispatch, m_verbose);
+  const double writeSeconds = measureWriteLatency(lClients, m_baseAddr, m_bandwidthTestDepth, m_iterations, m_perIterationDispatch, m_verbose);
+  const double batchedWriteSeconds = measureWriteLatency(lBatched, m_baseAddr, m_bandwidthTestDepth, m_iterations, m_perIterationDispatch, m_verbose);
+  const double totalPayloadKB = m_deviceURIs.size() * m_iterations * m_bandwidthTestDepth * 4. / 1024.;
+  outputStandardResults ( timer.elapsedSeconds() );
+  cout << "Read/write depth each iteration = " << m_bandwidthTestDepth << " 32-bit words\n"
+       << "Read bandwidth                  = " << totalPayloadKB / readSeconds << " KB/s\n"
+       << "Read bandwidth, batched         = " << totalPayloadKB / batchedReadSeconds << " KB/s\n"
+       << "Write bandwidth                 = " << totalPayloadKB / writeSeconds << " KB/s\n"
+       << "Write bandwidth, batched        = " << totalPayloadKB / batchedWriteSeconds << " KB/s" << endl;
+}
+
+
+void uhal::tests::PerfTester::busyPollLatencyTest()
+{
+  std::vector<double> latencies, busyLatencies;
+  latencies.reserve ( m_iterations * m_clients.size() );
+  busyLatencies.reserve ( m_iterations * m_clients.size() );
+  Timer timer;
+
+  for ( size_t i = 0; i < 2; i++ )
+  {
+    // The second time round, the clients are replaced by ones which collect replies from the dispatching thread (closing the
+    // original clients' connections first, since the dummy TCP hardware only serves one connection at a time)
+    if ( i == 1 )
+    {
+      m_clients.clear();
+
+      for ( const std::string& iURI: m_deviceURIs )
+      {
+        m_clients.push_back ( ClientFactory::getInstance().getClient ( "MyDevice", iURI + ( iURI.find ( '?' ) == std::string::npos ? "?" : "&" ) + "poll=busy" ) );
+      }
+    }
+
+    if ( ! m_includeConnect )
+    {
+      for ( ClientPtr& iClient: m_clients )
+      {
+        iClient->read ( m_baseAddr );
+        iClient->dispatch();
+      }
+    }
+
+    std::vector<double>& lLatencies ( i == 0 ? latencies : busyLatencies );
+
+    for ( unsigned j = 0; j < m_iterations; ++j )
+    {
+      for ( ClientPtr& iClient: m_clients )
+      {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        iClient->read ( m_baseAddr );
+        iClient->dispatch();
+        lLatencies.push_back ( std::chrono::duration<double, std::micro> ( std::chrono::steady_clock::now() - start ).count() );
+      }
+    }
+  }
+
+  const double totalSeconds = timer.elapsedSeconds();
+  std::sort ( latencies.begin(), latencies.end() );
+  std::sort ( busyLatencies.begin(), busyLatencies.end() );
+  outputStandardResults ( totalSeconds );
+  cout << "Dispatch latency, median        = " << latencies.at ( latencies.size() / 2 ) << " us\n"
+       << "Dispatch latency, 99th pctile   = " << latencies.at ( ( latencies.size() * 99 ) / 100 ) << " us\n"
+       << "Busy-poll latency, median       = " << busyLatencies.at ( busyLatencies.size() / 2 ) << " us\n"
+       << "Busy-poll latency, 99th pctile  = " << busyLatencies.at ( ( busyLatencies.size() * 99 ) / 100 ) << " us" << endl;
+}
+
+
+void uhal::tests::PerfTester::mmapPageTransferTest()
+{
+  // The transfers bypass the page handshake, so that the time taken to serialise packets into the mapped region and to scatter
+  // replies out of it can be measured against a plain file (e.g. in /dev/shm) standing in for the device
+  if ( 4 * ( m_bandwidthTestDepth + 4 ) > 32 * 1024 )
+  {
+    cerr << "The depth of the MmapPageTransfer test must fit within the 32 kB mapped region" << endl;
+    std::exit ( 1 );
+  }
+
+  // Request: page header word, block write transaction header and address, then the payload; reply: page header word, reply packet & transaction headers, then the payload
+  const uint32_t lPageHeader ( 0x10000 | ( m_bandwidthTestDepth + 2 ) );
+  const U32Vec lRequestHeaders = { 0x200000f0, 0x2000001f | ( ( m_bandwidthTestDepth & 0xff ) << 8 ), m_baseAddr };
+  const U32Vec lRequestPayload ( m_bandwidthTestDepth, 0xdeadbeef );
+  const std::vector< std::pair< const uint8_t*, size_t > > lSegments = {
+    std::make_pair ( reinterpret_cast< const uint8_t* > ( &lPageHeader ), sizeof ( lPageHeader ) ),
+    std::make_pair ( reinterpret_cast< const uint8_t* > ( lRequestHeaders.data() ), 4 * lRequestHeaders.size() ),
+    std::make_pair ( reinterpret_cast< const uint8_t* > ( lRequestPayload.data() ), 4 * lRequestPayload.size() ) };
+  U32Vec lReplyHeaders ( 2 ), lReplyPayload ( m_bandwidthTestDepth );
+  const std::deque< std::pair< uint8_t*, uint32_t > > lReplyBuffers = {
+    std::make_pair ( reinterpret_cast< uint8_t* > ( lReplyHeaders.data() ), uint32_t ( 4 * lReplyHeaders.size() ) ),
+    std::make_pair ( reinterpret_cast< uint8_t* > ( lReplyPayload.data() ), uint32_t ( 4 * lReplyPayload.size() ) ) };
+
+  double writeSeconds ( 0 ), readSeconds ( 0 );
+  Timer timer;
+
+  for ( const std::string& iURI: m_deviceURIs )
+  {
+    const std::string lPrefix ( "ipbusmmap-2.0://" );
+    if ( iURI.compare ( 0, lPrefix.size(), lPrefix ) != 0 )
+    {
+      cerr << "The MmapPageTransfer test only supports ipbusmmap-2.0 URIs; " << iURI << " is not one" << endl;
+      std::exit ( 1 );
+    }
+
+    Mmap::File lFile ( iURI.substr ( lPrefix.size(), iURI.find ( '?' ) - lPrefix.size() ), O_RDWR );
+    lFile.open();
+
+    Timer writeTimer;
+    for ( unsigned i = 0; i < m_iterations; ++i )
+    {
+      lFile.write ( 0, lSegments );
+    }
+    writeSeconds += writeTimer.elapsedSeconds();
+
+    Timer readTimer;
+    for ( unsigned i = 0; i < m_iterations; ++i )
+    {
+      lFile.read ( 1, lReplyBuffers, 4 * ( m_bandwidthTestDepth + 2 ) );
+    }
+    readSeconds += readTimer.elapsedSeconds();
+  }
+
+  const double totalPackets = double ( m_deviceURIs.size() ) * m_iterations;
+  const double totalPayloadMB = totalPackets * m_bandwidthTestDepth * 4. / ( 1024. * 1024. );
+  outputStandardResults ( timer.elapsedSeconds() );
+  cout << "Block depth of each packet      = " << m_bandwidthTestDepth << " 32-bit words\n"
+       << "Request write time              = " << 1e9 * writeSeconds / totalPackets << " ns per packet\n"
+       << "Request write bandwidth         = " << totalPayloadMB / writeSeconds << " MB/s\n"
+       << "Reply scatter time              = " << 1e9 * readSeconds / totalPackets << " ns per packet\n"
+       << "Reply scatter bandwidth         = " << totalPayloadMB / readSeconds << " MB/s" << endl;
+}
+
+
+void uhal::tests::PerfTester::pcieReplyLatencyTest()
+{
+  // Each URI is run with the 'events' attribute as given (if at all), and then with the status word polled adaptively, and
+  // at fixed 50 us intervals (the events variant runs first, so that it isn't woken by stale interrupts from the others)
+  std::vector< std::vector< std::string > > lVariantURIs ( 3 );
+
+  for ( const std::string& iURI: m_deviceURIs )
+  {
+    if ( iURI.compare ( 0, 16, "ipbuspcie-2.0://" ) != 0 )
+    {
+      cerr << "The PCIeReplyLatency test only supports ipbuspcie-2.0 URIs; " << iURI << " is not one" << endl;
+      std::exit ( 1 );
+    }
+
+    const size_t lQueryPos ( iURI.find ( '?' ) );
+    std::string lPollingURI ( iURI.substr ( 0, lQueryPos ) ), lSeparator ( "?" );
+    std::istringstream lQuery ( lQueryPos == std::string::npos ? "" : iURI.substr ( lQueryPos + 1 ) );
+
+    for ( std::string lArg; std::getline ( lQuery, lArg, '&' ); )
+    {
+      if ( lArg.compare ( 0, 7, "events=" ) == 0 )
+      {
+        lVariantURIs.at ( 0 ).push_back ( iURI );
+      }
+      else if ( lArg.compare ( 0, 6, "sleep=" ) != 0 )
+      {
+        lPollingURI += lSeparator + lArg;
+        lSeparator = "&";
+      }
+    }
+
+    lVariantURIs.at ( 1 ).push_back ( lPollingURI );
+    lVariantURIs.at ( 2 ).push_back ( lPollingURI + lSeparator + "sleep=50" );
+  }
+
+  const char* const lNames[] = { "Interrupts", "Adaptive polling", "Fixed 50us polling" };
+  Timer timer;
+  std::ostringstream lResults;
+
+  for ( size_t i = 0; i < lVariantURIs.size(); i++ )
+  {
+    if ( lVariantURIs.at ( i ).empty() )
+    {
+      continue;
+    }
+
+    ClientVec lClients;
+    for ( const std::string& iURI: lVariantURIs.at ( i ) )
+    {
+      lClients.push_back ( ClientFactory::getInstance().getClient ( "MyDevice", iURI ) );
+    }
+
+    if ( ! m_includeConnect )
+    {
+      for ( ClientPtr& iClient: lClients )
+      {
+        iClient->read ( m_baseAddr );
+        iClient->dispatch();
+      }
+    }
+
+    std::vector<double> lLatencies;
+    lLatencies.reserve ( m_iterations * lClients.size() );
+    struct rusage lStartUsage, lEndUsage;
+    getrusage ( RUSAGE_SELF, &lStartUsage );
+
+    for ( unsigned j = 0; j < m_iterations; ++j )
+    {
+      for ( ClientPtr& iClient: lClients )
+      {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        iClient->read ( m_baseAddr );
+        iClient->dispatch();
+        lLatencies.push_back ( std::chrono::duration<double, std::micro> ( std::chrono::steady_clock::now() - start ).count() );
+      }
+    }
+
+    getrusage ( RUSAGE_SELF, &lEndUsage );
+    const double lCpuMicroseconds = 1e6 * ( lEndUsage.ru_utime.tv_sec - lStartUsage.ru_utime.tv_sec + lEndUsage.ru_stime.tv_sec - lStartUsage.ru_stime.tv_sec )
+                                    + ( lEndUsage.ru_utime.tv_usec - lStartUsage.ru_utime.tv_usec + lEndUsage.ru_stime.tv_usec - lStartUsage.ru_stime.tv_usec );
+
+    std::sort ( lLatencies.begin(), lLatencies.end() );
+    lResults << std::left << std::setw ( 19 ) << lNames[i] << "latency, median = " << lLatencies.at ( lLatencies.size() / 2 ) << " us\n"
+             << std::setw ( 19 ) << lNames[i] << "latency, 99th   = " << lLatencies.at ( ( lLatencies.size() * 99 ) / 100 ) << " us\n"
+             << std::setw ( 19 ) << lNames[i] << "CPU time        = " << lCpuMicroseconds / lLatencies.size() << " us per dispatch\n";
+  }
+
+  outputStandardResults ( timer.elapsedSeconds() );
+  cout << lResults.str() << std::flush;
+}
+
+
+void uhal::tests::PerfTester::pcieSharedDeviceTest()
+{
+  for ( const std::string& iURI: m_deviceURIs )
+  {
+    if ( iURI.compare ( 0, 16, "ipbuspcie-2.0://" ) != 0 )
+    {
+      cerr << "The PCIeSharedDevice test only supports ipbuspcie-2.0 URIs; " << iURI << " is not one" << endl;
+      std::exit ( 1 );
+    }
+  }
+
+  // Each client runs in its own process, like independent monitoring applications; the client processes report their start & end
+  // times and dispatch latencies to this process through pipes
+  const char* const lNames[] = { "Locked", "Scheduler" };
+  Timer timer;
+  std::ostringstream lResults;
+
+  for ( size_t i = 0; i < 2; i++ )
+  {
+    std::vector< std::pair<pid_t, int> > lChildren;
+
+    for ( const std::string& iURI: m_deviceURIs )
+    {
+      const std::string lURI ( i == 0 ? iURI : iURI + ( iURI.find ( '?' ) == std::string::npos ? "?" : "&" ) + "scheduler=1" );
+
+      for ( unsigned j = 0; j < m_clientsPerURI; ++j )
+      {
+        int lPipe[2];
+        if ( pipe ( lPipe ) != 0 )
+        {
+          cerr << "Failed to create pipe for client process" << endl;
+          std::exit ( 1 );
+        }
+
+        const pid_t lPid = fork();
+        if ( lPid == 0 )
+        {
+          close ( lPipe[0] );
+          ClientPtr lClient ( ClientFactory::getInstance().getClient ( "MyDevice", lURI ) );
+          std::vector<double> lTimes ( 2 + m_iterations );
+
+          try
+          {
+            if ( ! m_includeConnect )
+            {
+              lClient->read ( m_baseAddr );
+              lClient->dispatch();
+            }
+
+            lTimes.at ( 0 ) = std::chrono::duration<double, std::micro> ( std::chrono::steady_clock::now().time_since_epoch() ).count();
+            for ( unsigned k = 0; k < m_iterations; ++k )
+            {
+              const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+              lClient->readBlock ( m_baseAddr, m_bandwidthTestDepth );
+              lClient->dispatch();
+              lTimes.at ( 2 + k ) = std::chrono::duration<double, std::micro> ( std::chrono::steady_clock::now() - start ).count();
+            }
+            lTimes.at ( 1 ) = std::chrono::duration<double, std::micro> ( std::chrono::steady_clock::now().time_since_epoch() ).count();
+          }
+          catch ( std::exception& e )
+          {
+            cerr << "Error - exception thrown in client process ..." << endl << e.what() << endl;
+            _exit ( 1 );
+          }
+
+          const size_t lNrBytes ( lTimes.size() * sizeof ( double ) );
+          _exit ( ( ::write ( lPipe[1], lTimes.data(), lNrBytes ) == ssize_t ( lNrBytes ) ) ? 0 : 1 );
+        }
+
+        close ( lPipe[1] );
+        lChildren.push_back ( std::make_pair ( lPid, lPipe[0] ) );
+      }
+    }
+
+    std::vector<double> lLatencies;
+    double lStartTime = 0, lEndTime = 0;
+    for ( size_t j = 0; j < lChildren.size(); j++ )
+    {
+      std::vector<double> lTimes ( 2 + m_iterations );
+      const size_t lNrBytes ( lTimes.size() * sizeof ( double ) );
+      size_t lNrBytesRead = 0;
+      while ( lNrBytesRead < lNrBytes )
+      {
+        const ssize_t rc = ::read ( lChildren.at ( j ).second, reinterpret_cast<char*> ( lTimes.data() ) + lNrBytesRead, lNrBytes - lNrBytesRead );
+        if ( rc <= 0 )
+        {
+          break;
+        }
+        lNrBytesRead += rc;
+      }
+      close ( lChildren.at ( j ).second );
+
+      int lStatus = 0;
+      waitpid ( lChildren.at ( j ).first, &lStatus, 0 );
+      if ( ( lNrBytesRead != lNrBytes ) || ( ! WIFEXITED ( lStatus ) ) || ( WEXITSTATUS ( lStatus ) != 0 ) )
+      {
+        cerr << "Client process " << j << " failed (" << lNames[i] << ")" << endl;
+        std::exit ( 1 );
+      }
+
+      lStartTime = ( j == 0 ) ? lTimes.at ( 0 ) : std::min ( lStartTime, lTimes.at ( 0 ) );
+      lEndTime = std::max ( lEndTime, lTimes.at ( 1 ) );
+      lLatencies.insert ( lLatencies.end(), lTimes.begin() + 2, lTimes.end() );
+    }
+
+    std::sort ( lLatencies.begin(), lLatencies.end() );
+    lResults << std::left << std::setw ( 10 ) << lNames[i] << "total dispatch rate = " << 1e6 * lLatencies.size() / ( lEndTime - lStartTime ) << " Hz\n"
+             << std::setw ( 10 ) << lNames[i] << "latency, median     = " << lLatencies.at ( lLatencies.size() / 2 ) << " us\n"
+             << std::setw ( 10 ) << lNames[i] << "latency, 99th       = " << lLatencies.at ( ( lLatencies.size() * 99 ) / 100 ) << " us\n";
+  }
+
+  outputStandardResults ( timer.elapsedSeconds() );
+  cout << lResults.str() << std::flush;
+}
+
+
+void uhal::tests::PerfTester::nodeTreeStartupTest()
+{
+  // Generated address table: 'depth' registers with descriptions, tags & parameters, in modules of 16
+  char lFileName[] = "/tmp/uhal_perftester_address_XXXXXX.xml";
+  const int lFd = mkstemps ( lFileName, 4 );
+  if ( lFd < 0 )
+  {
+    cerr << "Failed to create address table file" << endl;
+    std::exit ( 1 );
+  }
+  close ( lFd );
+
+  {
+    std::ofstream lFile ( lFileName );
+    lFile << "<node id=\"TOP\">\n";
+    for ( uint32_t i = 0; i < m_bandwidthTestDepth; i += 16 )
+    {
+      lFile << "  <node id=\"MODULE_" << i / 16 << "\" address=\"0x" << std::hex << ( i / 16 ) * 0x100 << std::dec << "\" description=\"Generated module\">\n";
+      for ( uint32_t j = i; ( j < i + 16 ) && ( j < m_bandwidthTestDepth ); ++j )
+      {
+        lFile << "    <node id=\"REG_" << j << "\" address=\"0x" << std::hex << j % 16 << std::dec << "\" permission=\"rw\""
+              << " description=\"Generated register " << j << "\" tags=\"perf\" parameters=\"index=" << j << "\"/>\n";
+      }
+      lFile << "  </node>\n";
+    }
+    lFile << "</node>\n";
+  }
+
+  std::vector<HwInterface> lDevices, lCopies;
+  lDevices.reserve ( m_iterations );
+  lCopies.reserve ( m_iterations );
+
+  const size_t lRssStart = getResidentSetSize();
+  Timer timer;
+  for ( unsigned i = 0; i < m_iterations; ++i )
+  {
+    lDevices.push_back ( ConnectionManager::getDevice ( "device" + boost::lexical_cast<std::string> ( i ), m_deviceURIs.at ( 0 ), std::string ( "file://" ) + lFileName ) );
+  }
+  const double lCreateSeconds = timer.elapsedSeconds();
+  const size_t lRssCreated = getResidentSetSize();
+
+  Timer copyTimer;
+  for ( const HwInterface& iDevice: lDevices )
+  {
+    lCopies.push_back ( iDevice );
+  }
+  const double lCopySeconds = copyTimer.elapsedSeconds();
+  const size_t lRssCopied = getResidentSetSize();
+
+  unlink ( lFileName );
+
+  outputStandardResults ( timer.elapsedSeconds() );
+  cout << "Registers in address table      = " << m_bandwidthTestDepth << "\n"
+       << "Nodes per device                = " << std::distance ( lDevices.front().getNode().begin(), lDevices.front().getNode().end() ) << "\n"
+       << "getDevice, total time           = " << lCreateSeconds << " s\n"
+       << "getDevice, RSS growth           = " << ( lRssCreated - lRssStart ) / 1024 << " MB\n"
+       << "HwInterface copy, total time    = " << lCopySeconds << " s\n"
+       << "HwInterface copy, RSS growth    = " << ( lRssCopied - lRssCreated ) / 1024 << " MB" << endl;
+}
+
+
+size_t uhal::tests::PerfTester::getResidentSetSize()
+{
+  std::ifstream status ( "/proc/self/status" );
+  std::string line;
+
+  while ( std::getline ( status, line ) )
+  {
+    if ( line.compare ( 0, 6, "VmRSS:" ) == 0 )
+    {
+      std::istringstream lStream ( line.substr ( 6 ) );
+      size_t lValue = 0;
+      lStream >> lValue;
+      return lValue;
+    }
+  }
+
+  return 0;
+}
+
+
+size_t uhal::tests::PerfTester::getThreadCount()
+{
+  std::ifstream status ( "/proc/self/status" );
+  std::string line;
+
+  while ( std::getline ( status, line ) )
+  {
+    if ( line.compare ( 0, 8, "Threads:" ) == 0 )
+    {
+      return boost::lexical_cast<size_t> ( boost::algorithm::trim_copy ( line.substr ( 8 ) ) );
+    }
+  }
+
+  return 0;
+}
+
+
 void uhal::tests::PerfTester::validationTest()
 {
   std::vector<ClientInterface*> lClients;
@@ -1,6 +1,10 @@
 
 #include "uhal/tests/UDPDummyHardware.hpp"
 
+#include "uhal/log/LogLevels.hpp"
+#include "uhal/log/log_inserters.integer.hpp"
+#include "uhal/log/log.hpp"
+
 
 template< uint8_t IPbus_major, uint8_t IPbus_minor>
 void uhal::tests::UDPDummyHardware<IPbus_major,IPbus_minor>::run()
@@ -25,11 +29,26 @@ void uhal::tests::UDPDummyHardware<IPbus_major,IPbus_minor>::handle_receive(cons
 {
   // std::cout << "> Dummy HW entering handle_receive" << std::endl;
 
+  const bool lIsControlPacket ( isControlPacket() );
+
+  if ( lIsControlPacket && ( mDropNextControlRequest.exchange ( false ) || ( mDropRequestPeriod && ( ( ++mControlRequestCounter % mDropRequestPeriod ) == 0 ) ) ) )
+  {
+    log ( Notice() , "Dummy hardware dropping control request (header " , Integer ( base_type::mReceive[0] , IntFmt<hex,fixed>() ) , ")" );
+    mSocket.async_receive_from(boost::asio::buffer ( & ( base_type::mReceive[0] ), base_type::mReceive.size() <<2 ),
+        mSenderEndpoint,
+        [&] (const boost::system::error_code& e, std::size_t n) { this->handle_receive(e, n); });
+    return;
+  }
+
   base_type::mReply.clear();
 
   base_type::AnalyzeReceivedAndCreateReply ( length );
 
-  if ( base_type::mReply.size() )
+  if ( lIsControlPacket && mDropReplyPeriod && base_type::mReply.size() && ( ( ++mControlReplyCounter % mDropReplyPeriod ) == 0 ) )
+  {
+    log ( Notice() , "Dummy hardware dropping reply (header " , Integer ( base_type::mReply[0] , IntFmt<hex,fixed>() ) , ")" );
+  }
+  else if ( base_type::mReply.size() )
   {
     mSocket.send_to ( boost::asio::buffer ( & ( base_type::mReply[0] ) , base_type::mReply.size() <<2 ) , mSenderEndpoint );
   }
@@ -41,5 +60,18 @@ void uhal::tests::UDPDummyHardware<IPbus_major,IPbus_minor>::handle_receive(cons
   // std::cout << "> Dummy HW exiting handle_receive" << std::endl;
 }
 
+template< uint8_t IPbus_major, uint8_t IPbus_minor>
+bool uhal::tests::UDPDummyHardware<IPbus_major,IPbus_minor>::isControlPacket() const
+{
+  if ( IPbus_major == 1 )
+  {
+    return true;
+  }
+
+  // Control packet header, either in native byte order or with the big-endian hack
+  const uint32_t lHeader ( base_type::mReceive[0] );
+  return ( ( lHeader & 0xF00000FF ) == 0x200000F0 ) || ( ( lHeader & 0xFF0000F0 ) == 0xF0000020 );
+}
+
 template class uhal::tests::UDPDummyHardware<1,3>;
 template class uhal::tests::UDPDummyHardware<2,0>;
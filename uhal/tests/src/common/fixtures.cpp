@@ -2,6 +2,7 @@
 #include "uhal/tests/fixtures.hpp"
 
 
+#include "uhal/tests/ControlHubEmulator.hpp"
 #include "uhal/tests/PCIeDummyHardware.hpp"
 #include "uhal/tests/TCPDummyHardware.hpp"
 #include "uhal/tests/UDPDummyHardware.hpp"
@@ -22,6 +23,17 @@ std::string AbstractFixture::getAddressFileURI()
   return lURI;
 }
 
+HwInterface AbstractFixture::createHwInterface(const std::string& aId, const std::string& aUri, const std::string& aAttributes)
+{
+  std::string lUri(aUri);
+  if (not aAttributes.empty())
+    lUri += (lUri.find('?') == std::string::npos ? "?" : "&") + aAttributes;
+
+  HwInterface hw(ConnectionManager::getDevice(aId, lUri, getAddressFileURI()));
+  hw.setTimeoutPeriod(timeout);
+  return hw;
+}
+
 template <>
 MinimalFixture<IPBUS_1_3_UDP>::MinimalFixture() : 
   devicePort(50001),
@@ -86,6 +98,12 @@ HwInterface MinimalFixture<IPBUS_2_0_PCIE>::getHwInterface() const
 }
 
 
+HwInterface MinimalFixture<IPBUS_2_0_PCIE>::getHwInterface(const std::string& aAttributes) const
+{
+  return createHwInterface(deviceId, getHwInterface().uri(), aAttributes);
+}
+
+
 const DeviceType MinimalFixture<IPBUS_2_0_PCIE>::deviceType = IPBUS_2_0_PCIE;
 
 
@@ -143,5 +161,21 @@ DummyHardwareFixture<IPBUS_2_0_PCIE>::DummyHardwareFixture() :
 {
 }
 
+
+
+ControlHubEmulatorFixture::ControlHubEmulatorFixture() :
+  controlHubPort(10213),
+  controlHub(new ControlHubEmulator(controlHubPort)),
+  controlHubRunner(controlHub)
+{
+}
+
+HwInterface ControlHubEmulatorFixture::getControlHubHwInterface(const std::string& aExtraAttributes, const uint16_t aTargetPort) const
+{
+  const uint16_t lTargetPort = (aTargetPort == 0 ? devicePort : aTargetPort);
+  const std::string lAttributes = "target=localhost:" + std::to_string(lTargetPort) + (aExtraAttributes.empty() ? "" : "&" + aExtraAttributes);
+  return createHwInterface(deviceId, "chtcp-2.0://localhost:" + std::to_string(controlHubPort), lAttributes);
+}
+
 } // end ns tests
 } // end ns uhal
@@ -33,6 +33,10 @@
 */
 
 #include "uhal/uhal.hpp"
+#include "uhal/Buffers.hpp"
+#include "uhal/ClientFactory.hpp"
+#include "uhal/ProtocolIPbus.hpp"
+#include "uhal/ProtocolUDP.hpp"
 
 #include "uhal/tests/definitions.hpp"
 #include "uhal/tests/fixtures.hpp"
@@ -40,6 +44,7 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
 #include <cstdlib>
@@ -128,6 +133,151 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BlockReadWriteTestSuite, block_write_read, D
 )
 
 
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BlockReadWriteTestSuite, block_write_read_into, DummyHardwareFixture,
+{
+  std::vector<size_t> lDepths = getBlockUnitTestDepths(quickTest ? N_1MB : N_10MB);
+
+  for(size_t i=0; i<lDepths.size(); i++) {
+    const size_t N = lDepths.at(i);
+    BOOST_TEST_MESSAGE("  N = " << N);
+
+    HwInterface hw = getHwInterface();
+
+    std::vector<uint32_t> xx;
+    xx.reserve ( N );
+    for ( size_t i=0; i!= N; ++i )
+    {
+      xx.push_back ( static_cast<uint32_t> ( rand() ) );
+    }
+
+    // Destination has a guard word at the end, to check that nothing is written beyond the requested size
+    std::vector<uint32_t> yy ( N + 1 , 0xDEADBEEF );
+
+    hw.getNode ( "LARGE_MEM" ).writeBlock ( xx );
+    ValHeader mem = hw.getNode ( "LARGE_MEM" ).readBlockInto ( yy.data() , N );
+    BOOST_CHECK ( !mem.valid() );
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+    BOOST_CHECK ( mem.valid() );
+    BOOST_CHECK_EQUAL ( yy.back(), uint32_t ( 0xDEADBEEF ) );
+
+    //This check will fail when DummyHardware::ADDRESS_MASK < N
+    if ( N < N_10MB )
+    {
+      BOOST_CHECK ( std::equal ( xx.begin(), xx.end(), yy.begin() ) );
+    }
+  }
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BlockReadWriteTestSuite, block_write_moved_read, DummyHardwareFixture,
+{
+  std::vector<size_t> lDepths = getBlockUnitTestDepths(quickTest ? N_1MB : N_10MB);
+
+  for(size_t i=0; i<lDepths.size(); i++) {
+    const size_t N = lDepths.at(i);
+    BOOST_TEST_MESSAGE("  N = " << N);
+
+    HwInterface hw = getHwInterface();
+
+    std::vector<uint32_t> xx;
+    xx.reserve ( N );
+    for ( size_t i=0; i!= N; ++i )
+    {
+      xx.push_back ( static_cast<uint32_t> ( rand() ) );
+    }
+
+    // The moved-in vector is sent directly from its own memory, rather than being copied into the send buffers
+    std::vector<uint32_t> lSource ( xx );
+    ValHeader lWrite = hw.getNode ( "LARGE_MEM" ).writeBlock ( std::move ( lSource ) );
+    ValVector< uint32_t > mem = hw.getNode ( "LARGE_MEM" ).readBlock ( N );
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+    BOOST_CHECK ( lWrite.valid() );
+    BOOST_CHECK ( mem.valid() );
+    BOOST_CHECK_EQUAL ( mem.size(), N );
+
+    //This check will fail when DummyHardware::ADDRESS_MASK < N
+    if ( N < N_10MB )
+    {
+      BOOST_CHECK ( std::equal ( mem.begin(), mem.end(), xx.begin() ) );
+    }
+  }
+}
+)
+
+
+//! IPbus 2.0 UDP client that records the memory segments of each packet that it sends
+class SegmentRecordingClient : public UDP< IPbus< 2 , 0 > >
+{
+public:
+  SegmentRecordingClient ( const std::string& aId, const URI& aUri ) :
+    UDP< IPbus< 2 , 0 > > ( aId , aUri ),
+    packetCount ( 0 )
+  {
+  }
+
+  //! The number of packets sent so far
+  size_t packetCount;
+  //! The segments of every packet sent so far
+  std::vector< std::pair< const uint8_t* , uint32_t > > segments;
+
+private:
+  void predispatch ( std::shared_ptr< Buffers > aBuffers )
+  {
+    UDP< IPbus< 2 , 0 > >::predispatch ( aBuffers );
+    const std::vector< std::pair< const uint8_t* , uint32_t > >& lSegments ( aBuffers->getSendSegments() );
+    segments.insert ( segments.end() , lSegments.begin() , lSegments.end() );
+    packetCount++;
+  }
+};
+
+
+BOOST_AUTO_TEST_SUITE(ipbusudp_2_0)
+
+BOOST_AUTO_TEST_SUITE(BlockReadWriteTestSuite)
+
+BOOST_FIXTURE_TEST_CASE(block_write_moved_referenced, DummyHardwareFixture<IPBUS_2_0_UDP>)
+{
+  const std::string lScheme ( "__segment_recording_udp__" );
+  HwInterface hw ( ConnectionManager::getDevice ( "segments", lScheme + "://localhost:" + std::to_string ( devicePort ), getAddressFileURI(), std::vector<std::string> ( 1, lScheme ) ) );
+  hw.setTimeoutPeriod ( timeout );
+  SegmentRecordingClient& lClient ( dynamic_cast<SegmentRecordingClient&> ( hw.getClient() ) );
+
+  const size_t N = 100 * N_1kB;
+  std::vector<uint32_t> xx ( N );
+  for ( size_t i = 0; i < xx.size(); i++ )
+    xx.at(i) = static_cast<uint32_t> ( rand() );
+
+  // The moved vector keeps its memory, so the packets must reference this memory rather than a copy of it
+  std::vector<uint32_t> lSource ( xx );
+  const uint8_t* lBegin ( reinterpret_cast<const uint8_t*> ( lSource.data() ) );
+  const uint8_t* lEnd ( lBegin + N * 4 );
+  hw.getNode ( "LARGE_MEM" ).writeBlock ( std::move ( lSource ) );
+  ValVector< uint32_t > mem = hw.getNode ( "LARGE_MEM" ).readBlock ( N );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK ( std::equal ( mem.begin(), mem.end(), xx.begin() ) );
+
+  // Only a transaction that fills the end of a packet with fewer than 512 bytes of payload may have been copied
+  size_t lReferencedByteCount ( 0 );
+  for ( const auto& lSegment : lClient.segments )
+  {
+    if ( ( lSegment.first >= lBegin ) && ( lSegment.first < lEnd ) )
+    {
+      BOOST_CHECK ( lSegment.first + lSegment.second <= lEnd );
+      lReferencedByteCount += lSegment.second;
+    }
+  }
+
+  BOOST_CHECK_GT ( lReferencedByteCount , size_t ( 0 ) );
+  BOOST_CHECK_LE ( lReferencedByteCount , N * 4 );
+  BOOST_CHECK_GE ( lReferencedByteCount + 512 * lClient.packetCount , N * 4 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
 UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BlockReadWriteTestSuite, fifo_write_read, DummyHardwareFixture,
 {
   std::vector<size_t> lDepths = getBlockUnitTestDepths(quickTest ? N_1MB : N_200MB);
@@ -260,6 +410,7 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BlockReadWriteTestSuite, block_access_type_v
   xx.resize ( N_1kB );
   BOOST_CHECK_THROW ( hw.getNode ( "REG" ).writeBlock ( xx ) , uhal::exception::BulkTransferOnSingleRegister );
   BOOST_CHECK_THROW ( ValVector< uint32_t > mem = hw.getNode ( "REG" ).readBlock( N_1kB ) , uhal::exception::BulkTransferOnSingleRegister );
+  BOOST_CHECK_THROW ( hw.getNode ( "REG" ).readBlockInto ( xx.data() , N_1kB ) , uhal::exception::BulkTransferOnSingleRegister );
 
   BOOST_CHECK_THROW ( hw.getNode ( "FIFO" ).writeBlockOffset ( xx , 1 ) , uhal::exception::BulkTransferOffsetRequestedForFifo );
   BOOST_CHECK_THROW ( ValVector< uint32_t > mem = hw.getNode ( "FIFO" ).readBlockOffset ( N_1kB , 1 ) , uhal::exception::BulkTransferOffsetRequestedForFifo );
@@ -275,6 +426,7 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BlockReadWriteTestSuite, block_bigger_than_s
   xx.resize ( N_1MB );
   BOOST_CHECK_THROW ( hw.getNode ( "SMALL_MEM" ).writeBlock ( xx ) , uhal::exception::BulkTransferRequestedTooLarge );
   BOOST_CHECK_THROW ( ValVector< uint32_t > mem = hw.getNode ( "SMALL_MEM" ).readBlock ( N_1MB ) , uhal::exception::BulkTransferRequestedTooLarge );
+  BOOST_CHECK_THROW ( hw.getNode ( "SMALL_MEM" ).readBlockInto ( xx.data() , N_1MB ) , uhal::exception::BulkTransferRequestedTooLarge );
 }
 )
 
@@ -295,6 +447,182 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(BlockReadWriteTestSuite, block_offset_bigger
 )
 
 
+//! Checks a large block write/read through a client with the specified URI (e.g. one with non-default attributes)
+void checkBlockWriteRead(const std::string& aUri, const std::string& aAddressFileURI, const size_t aTimeout)
+{
+  HwInterface hw(ConnectionManager::getDevice("custom_uri", aUri, aAddressFileURI));
+  hw.setTimeoutPeriod(aTimeout);
+
+  std::vector<uint32_t> xx(N_1MB);
+  for (size_t i = 0; i < xx.size(); i++)
+    xx.at(i) = static_cast<uint32_t> ( rand() );
+
+  hw.getNode ( "LARGE_MEM" ).writeBlock ( xx );
+  ValVector< uint32_t > mem = hw.getNode ( "LARGE_MEM" ).readBlock ( xx.size() );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK ( mem.valid() );
+  BOOST_CHECK ( std::equal ( mem.begin(), mem.end(), xx.begin() ) );
+}
+
+
+//! Checks a block read followed by many single-word reads, each of which has its own reply destinations, through a client with the specified URI
+void checkBlockAndSingleReads(const std::string& aUri, const std::string& aAddressFileURI, const size_t aTimeout)
+{
+  HwInterface hw(ConnectionManager::getDevice("custom_uri", aUri, aAddressFileURI));
+  hw.setTimeoutPeriod(aTimeout);
+  const uint32_t lAddr = hw.getNode ( "LARGE_MEM" ).getAddress();
+
+  std::vector<uint32_t> xx(N_1kB * 20);
+  for (size_t i = 0; i < xx.size(); i++)
+    xx.at(i) = static_cast<uint32_t> ( rand() );
+
+  hw.getNode ( "LARGE_MEM" ).writeBlock ( xx );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+
+  ValVector< uint32_t > mem = hw.getNode ( "LARGE_MEM" ).readBlock ( xx.size() );
+  std::vector< ValWord< uint32_t > > lWords;
+  for (size_t i = 0; i < xx.size(); i++)
+    lWords.push_back ( hw.getClient().read ( lAddr + i ) );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+
+  BOOST_CHECK ( mem.valid() );
+  BOOST_CHECK ( std::equal ( mem.begin(), mem.end(), xx.begin() ) );
+  size_t lNrMismatches = 0;
+  for (size_t i = 0; i < xx.size(); i++)
+    lNrMismatches += ( lWords.at(i).valid() && lWords.at(i).value() == xx.at(i) ) ? 0 : 1;
+  BOOST_CHECK_EQUAL ( lNrMismatches, size_t(0) );
+}
+
+
+//! Checks that a client with the specified URI, which sizes its packets from the target's status, queries the target again after a timeout (during which the target's MTU changes)
+void checkResizedAfterTimeout(const std::string& aUri, DummyHardwareRunner& aHwRunner, const std::string& aAddressFileURI, const size_t aTimeout)
+{
+  aHwRunner.setMtu(1500);
+  HwInterface hw(ConnectionManager::getDevice("custom_uri", aUri, aAddressFileURI));
+  hw.setTimeoutPeriod(aTimeout);
+
+  std::vector<uint32_t> xx(N_1kB * 20);
+  for (size_t i = 0; i < xx.size(); i++)
+    xx.at(i) = static_cast<uint32_t> ( rand() );
+
+  hw.getNode ( "LARGE_MEM" ).writeBlock ( xx );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK_LE ( aHwRunner.getMaxRequestByteCount(), uint32_t(1500) );
+
+  aHwRunner.setMtu(9000);
+  aHwRunner.setReplyDelay( std::chrono::milliseconds(aTimeout) + std::chrono::seconds(1) );
+  hw.getNode ( "REG" ).read();
+  BOOST_CHECK_THROW ( hw.dispatch() , uhal::exception::exception );
+  std::this_thread::sleep_for( std::chrono::milliseconds(aTimeout) + std::chrono::seconds(1) );
+
+  hw.getNode ( "LARGE_MEM" ).writeBlock ( xx );
+  ValVector< uint32_t > mem = hw.getNode ( "LARGE_MEM" ).readBlock ( xx.size() );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK ( mem.valid() );
+  BOOST_CHECK ( std::equal ( mem.begin(), mem.end(), xx.begin() ) );
+  BOOST_CHECK_GT ( aHwRunner.getMaxRequestByteCount(), uint32_t(1500) );
+  BOOST_CHECK_LE ( aHwRunner.getMaxRequestByteCount(), uint32_t(9000) );
+}
+
+
+BOOST_AUTO_TEST_SUITE(ipbusudp_2_0)
+
+BOOST_AUTO_TEST_SUITE(BlockReadWriteTestSuite)
+
+// With the default payload size, each reply has fewer than IOV_MAX destinations, and so is received directly into them;
+// with the largest possible payload size, the replies to single-word reads have more, and so are received into a bounce buffer
+BOOST_FIXTURE_TEST_CASE(block_and_single_reads_in_place_and_bounced, DummyHardwareFixture<IPBUS_2_0_UDP>)
+{
+  checkBlockAndSingleReads("ipbusudp-2.0://localhost:" + std::to_string(devicePort), getAddressFileURI(), timeout);
+  checkBlockAndSingleReads("ipbusudp-2.0://localhost:" + std::to_string(devicePort) + "?max_payload_size=65000", getAddressFileURI(), timeout);
+}
+
+BOOST_FIXTURE_TEST_CASE(block_write_read_sized_from_status, DummyHardwareFixture<IPBUS_2_0_UDP>)
+{
+  checkBlockWriteRead("ipbusudp-2.0://localhost:" + std::to_string(devicePort) + "?query_status=1", getAddressFileURI(), timeout);
+  BOOST_CHECK_THROW ( ConnectionManager::getDevice("query_status", "ipbusudp-1.3://localhost:" + std::to_string(devicePort) + "?query_status=1", getAddressFileURI()) , uhal::exception::InvalidURI );
+}
+
+BOOST_FIXTURE_TEST_CASE(block_write_read_resized_after_timeout, DummyHardwareFixture<IPBUS_2_0_UDP>)
+{
+  checkResizedAfterTimeout("ipbusudp-2.0://localhost:" + std::to_string(devicePort) + "?query_status=1", hwRunner, getAddressFileURI(), timeout);
+}
+
+BOOST_FIXTURE_TEST_CASE(block_write_read_batched, DummyHardwareFixture<IPBUS_2_0_UDP>)
+{
+  checkBlockWriteRead("ipbusudp-2.0://localhost:" + std::to_string(devicePort) + "?batch=1", getAddressFileURI(), timeout);
+  BOOST_CHECK_THROW ( ConnectionManager::getDevice("batch", "ipbusudp-2.0://localhost:" + std::to_string(devicePort) + "?batch=1&max_recovery_attempts=3", getAddressFileURI()) , uhal::exception::InvalidURI );
+}
+
+BOOST_FIXTURE_TEST_CASE(block_and_single_reads_busy_poll, DummyHardwareFixture<IPBUS_2_0_UDP>)
+{
+  checkBlockWriteRead("ipbusudp-2.0://localhost:" + std::to_string(devicePort) + "?poll=busy", getAddressFileURI(), timeout);
+  checkBlockAndSingleReads("ipbusudp-2.0://localhost:" + std::to_string(devicePort) + "?poll=busy", getAddressFileURI(), timeout);
+  checkBlockAndSingleReads("ipbusudp-2.0://localhost:" + std::to_string(devicePort) + "?poll=busy&max_payload_size=65000", getAddressFileURI(), timeout);
+  BOOST_CHECK_THROW ( ConnectionManager::getDevice("busy", "ipbusudp-2.0://localhost:" + std::to_string(devicePort) + "?poll=busy&batch=1", getAddressFileURI()) , uhal::exception::InvalidURI );
+  BOOST_CHECK_THROW ( ConnectionManager::getDevice("busy", "ipbusudp-2.0://localhost:" + std::to_string(devicePort) + "?poll=sometimes", getAddressFileURI()) , uhal::exception::InvalidURI );
+
+  // Nothing listens on this port, so the dispatching thread gives up once the timeout has passed
+  HwInterface hw(ConnectionManager::getDevice("busy", "ipbusudp-2.0://localhost:60099?poll=busy", getAddressFileURI()));
+  hw.setTimeoutPeriod(timeout);
+  hw.getNode ( "REG" ).read();
+  BOOST_CHECK_THROW ( hw.dispatch() , uhal::exception::ClientTimeout );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+BOOST_AUTO_TEST_SUITE(ipbusudp_1_3)
+
+BOOST_AUTO_TEST_SUITE(BlockReadWriteTestSuite)
+
+BOOST_FIXTURE_TEST_CASE(block_write_read_batched, DummyHardwareFixture<IPBUS_1_3_UDP>)
+{
+  checkBlockWriteRead("ipbusudp-1.3://localhost:" + std::to_string(devicePort) + "?batch=1", getAddressFileURI(), timeout);
+}
+
+BOOST_FIXTURE_TEST_CASE(block_and_single_reads_in_place_and_bounced, DummyHardwareFixture<IPBUS_1_3_UDP>)
+{
+  checkBlockAndSingleReads("ipbusudp-1.3://localhost:" + std::to_string(devicePort), getAddressFileURI(), timeout);
+  checkBlockAndSingleReads("ipbusudp-1.3://localhost:" + std::to_string(devicePort) + "?max_payload_size=65000", getAddressFileURI(), timeout);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+BOOST_AUTO_TEST_SUITE(ipbustcp_2_0)
+
+BOOST_AUTO_TEST_SUITE(BlockReadWriteTestSuite)
+
+BOOST_FIXTURE_TEST_CASE(block_write_read_sized_from_status, DummyHardwareFixture<IPBUS_2_0_TCP>)
+{
+  checkBlockWriteRead("ipbustcp-2.0://localhost:" + std::to_string(devicePort) + "?query_status=1", getAddressFileURI(), timeout);
+  BOOST_CHECK_THROW ( ConnectionManager::getDevice("query_status", "ipbustcp-1.3://localhost:" + std::to_string(devicePort) + "?query_status=1", getAddressFileURI()) , uhal::exception::InvalidURI );
+}
+
+BOOST_FIXTURE_TEST_CASE(block_write_read_resized_after_timeout, DummyHardwareFixture<IPBUS_2_0_TCP>)
+{
+  checkResizedAfterTimeout("ipbustcp-2.0://localhost:" + std::to_string(devicePort) + "?query_status=1", hwRunner, getAddressFileURI(), timeout);
+}
+
+BOOST_FIXTURE_TEST_CASE(block_and_single_reads_busy_poll, DummyHardwareFixture<IPBUS_2_0_TCP>)
+{
+  checkBlockWriteRead("ipbustcp-2.0://localhost:" + std::to_string(devicePort) + "?poll=busy", getAddressFileURI(), timeout);
+  checkBlockAndSingleReads("ipbustcp-2.0://localhost:" + std::to_string(devicePort) + "?poll=busy", getAddressFileURI(), timeout);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
 } // end ns tests
 } // end ns uhal
 
+
+UHAL_REGISTER_EXTERNAL_CLIENT(uhal::tests::SegmentRecordingClient, "__segment_recording_udp__", "IPbus 2.0 UDP client that records the memory segments of the packets it sends")
+
@@ -0,0 +1,113 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/uhal.hpp"
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "uhal/tests/ControlHubEmulator.hpp"
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/tools.hpp"
+
+
+namespace uhal {
+namespace tests {
+
+
+void checkBlockWriteReadViaControlHub(HwInterface& hw)
+{
+  for (size_t i = 0; i < 3; i++)
+    BOOST_CHECK ( writeAndReadBack ( hw, "LARGE_MEM", 100000 ) );
+}
+
+
+BOOST_AUTO_TEST_SUITE(chtcp_2_0)
+
+BOOST_AUTO_TEST_SUITE(ChunkingTestSuite)
+
+
+BOOST_FIXTURE_TEST_CASE(fixed_chunks, ControlHubEmulatorFixture)
+{
+  HwInterface hw = getControlHubHwInterface();
+  checkBlockWriteReadViaControlHub(hw);
+  BOOST_CHECK ( controlHub->getMaxPacketsPerChunk() <= 3 );
+
+  HwInterface hw5 = getControlHubHwInterface("buffers_per_send=5");
+  checkBlockWriteReadViaControlHub(hw5);
+  BOOST_CHECK_EQUAL ( controlHub->getMaxPacketsPerChunk(), size_t(5) );
+}
+
+
+BOOST_FIXTURE_TEST_CASE(adaptive_chunks, ControlHubEmulatorFixture)
+{
+  HwInterface hw = getControlHubHwInterface("buffers_per_send=adaptive");
+  checkBlockWriteReadViaControlHub(hw);
+  BOOST_CHECK ( controlHub->getMaxPacketsPerChunk() > 3 );
+  BOOST_CHECK ( controlHub->getChunkCount() < controlHub->getPacketCount() / 3 );
+
+  // Sparse traffic is sent a packet at a time
+  const size_t lNrChunks = controlHub->getChunkCount();
+  for (size_t i = 0; i < 10; i++)
+  {
+    ValWord< uint32_t > x = hw.getNode ( "REG" ).read();
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+    BOOST_CHECK ( x.valid() );
+  }
+  BOOST_CHECK_EQUAL ( controlHub->getChunkCount(), lNrChunks + 10 );
+}
+
+
+BOOST_FIXTURE_TEST_CASE(byte_budget, ControlHubEmulatorFixture)
+{
+  // Budget of ~3 full-size packets
+  HwInterface hw = getControlHubHwInterface("buffers_per_send=adaptive&max_bytes_per_send=4500");
+  checkBlockWriteReadViaControlHub(hw);
+  BOOST_CHECK ( controlHub->getMaxBytesPerChunk() <= 4500 );
+  BOOST_CHECK ( controlHub->getMaxPacketsPerChunk() > 1 );
+
+  BOOST_CHECK_THROW ( getControlHubHwInterface("buffers_per_send=0"), uhal::exception::InvalidURI );
+  BOOST_CHECK_THROW ( getControlHubHwInterface("max_bytes_per_send=lots"), uhal::exception::InvalidURI );
+  BOOST_CHECK_THROW ( ConnectionManager::getDevice("tcp", "ipbustcp-2.0://localhost:" + std::to_string(devicePort) + "?buffers_per_send=adaptive", getAddressFileURI()), uhal::exception::InvalidURI );
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+} // end ns tests
+} // end ns uhal
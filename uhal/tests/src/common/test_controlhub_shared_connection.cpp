@@ -0,0 +1,221 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/uhal.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include "uhal/ClientFactory.hpp"
+#include "uhal/ProtocolControlHub.hpp"
+#include "uhal/SharedTCPConnection.hpp"
+
+#include "uhal/tests/ControlHubEmulator.hpp"
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/tools.hpp"
+#include "uhal/tests/UDPDummyHardware.hpp"
+
+
+namespace uhal {
+namespace tests {
+
+
+//! Fixture running several IPbus 2.0 UDP dummy hardware instances behind an emulated ControlHub, for clients that share a connection to it
+struct SharedConnectionFixture : public ControlHubEmulatorFixture {
+  SharedConnectionFixture() :
+    otherDevicePorts({60011, 60012, 60013})
+  {
+    for (const uint16_t lPort : otherDevicePorts)
+      otherHwRunners.push_back(std::unique_ptr<DummyHardwareRunner>(new DummyHardwareRunner(new UDPDummyHardware<2,0>(lPort, 0, false))));
+  }
+
+  ~SharedConnectionFixture() {}
+
+  std::vector<HwInterface> getSharedConnectionHwInterfaces(const std::string& aExtraAttributes) const
+  {
+    std::vector<HwInterface> lHwInterfaces(1, getControlHubHwInterface(aExtraAttributes));
+    for (const uint16_t lPort : otherDevicePorts)
+      lHwInterfaces.push_back(getControlHubHwInterface(aExtraAttributes, lPort));
+    return lHwInterfaces;
+  }
+
+  std::vector<uint16_t> otherDevicePorts;
+  std::vector<std::unique_ptr<DummyHardwareRunner> > otherHwRunners;
+};
+
+
+void checkWriteReadViaSharedConnection(std::vector<HwInterface>& aHwInterfaces)
+{
+  const size_t N = 20000;
+
+  for (size_t i = 0; i < 3; i++)
+  {
+    std::vector<std::vector<uint32_t> > xx(aHwInterfaces.size(), std::vector<uint32_t>(N));
+    std::vector<ValVector<uint32_t> > yy;
+    std::vector<std::future<void> > lDispatched;
+
+    for (size_t j = 0; j < aHwInterfaces.size(); j++)
+    {
+      std::generate(xx.at(j).begin(), xx.at(j).end(), rand);
+      aHwInterfaces.at(j).getNode ( "MEM" ).writeBlock ( xx.at(j) );
+      yy.push_back ( aHwInterfaces.at(j).getNode ( "MEM" ).readBlock ( N ) );
+      lDispatched.push_back ( aHwInterfaces.at(j).dispatchAsync() );
+    }
+
+    for (size_t j = 0; j < aHwInterfaces.size(); j++)
+    {
+      BOOST_CHECK_NO_THROW ( lDispatched.at(j).get() );
+      BOOST_CHECK ( yy.at(j).valid() );
+      BOOST_CHECK ( std::equal ( yy.at(j).begin(), yy.at(j).end(), xx.at(j).begin() ) );
+    }
+  }
+}
+
+
+BOOST_AUTO_TEST_SUITE(chtcp_2_0)
+
+BOOST_AUTO_TEST_SUITE(SharedConnectionTestSuite)
+
+
+BOOST_FIXTURE_TEST_CASE(write_read_many_targets, SharedConnectionFixture)
+{
+  std::vector<HwInterface> lHwInterfaces = getSharedConnectionHwInterfaces("shared_connection=test");
+  checkWriteReadViaSharedConnection(lHwInterfaces);
+  BOOST_CHECK_EQUAL ( controlHub->getConnectionCount(), size_t(1) );
+}
+
+
+BOOST_FIXTURE_TEST_CASE(stalled_controlhub, SharedConnectionFixture)
+{
+  // Connections to this port are completed by the kernel, but nothing ever reads from them, so sends stall once the socket buffers are full
+  const uint16_t lStalledPort = 10214;
+  boost::asio::io_service lIOservice;
+  boost::asio::ip::tcp::acceptor lStalledControlHub ( lIOservice , boost::asio::ip::tcp::endpoint ( boost::asio::ip::address_v4::loopback() , lStalledPort ) );
+
+  // All of the clients are serviced by the same I/O thread, so it must not wait for the shared connection's sends to complete
+  ClientFactory::getInstance().setSharedIOservicePool ( 1 );
+  std::vector<HwInterface> lStalledHwInterfaces;
+  for (uint16_t i = 0; i < 64; i++)
+  {
+    lStalledHwInterfaces.push_back ( createHwInterface(deviceId, "chtcp-2.0://localhost:" + std::to_string(lStalledPort), "target=localhost:" + std::to_string(60100 + i) + "&shared_connection=stalled") );
+    lStalledHwInterfaces.back().setTimeoutPeriod ( 4 * timeout );
+  }
+  HwInterface hw = createHwInterface(deviceId, "ipbusudp-2.0://localhost:" + std::to_string(otherDevicePorts.at(0)), "");
+  ClientFactory::getInstance().setSharedIOservicePool ( 0 );
+
+  const std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+  std::vector<std::future<void> > lStalledDispatches;
+  for (HwInterface& lStalledHw : lStalledHwInterfaces)
+  {
+    lStalledHw.getNode ( "MEM" ).writeBlock ( std::vector<uint32_t>(100000, 0) );
+    lStalledDispatches.push_back ( lStalledHw.dispatchAsync() );
+  }
+
+  hw.getNode ( "REG" ).write ( 42 );
+  ValWord<uint32_t> x = hw.getNode ( "REG" ).read();
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK_EQUAL ( x.value(), uint32_t(42) );
+  BOOST_CHECK ( std::chrono::steady_clock::now() - lStart < std::chrono::milliseconds ( 2 * timeout ) );
+
+  for (std::future<void>& lStalledDispatch : lStalledDispatches)
+    BOOST_CHECK_THROW ( lStalledDispatch.get(), uhal::exception::exception );
+}
+
+
+BOOST_FIXTURE_TEST_CASE(connection_pool, SharedConnectionFixture)
+{
+  std::vector<HwInterface> lHwInterfaces = getSharedConnectionHwInterfaces("shared_connection=pool&connection_pool=2&buffers_per_send=adaptive");
+  checkWriteReadViaSharedConnection(lHwInterfaces);
+  BOOST_CHECK_EQUAL ( controlHub->getConnectionCount(), size_t(2) );
+
+  BOOST_CHECK_THROW ( getControlHubHwInterface("connection_pool=2"), uhal::exception::InvalidURI );
+  BOOST_CHECK_THROW ( getControlHubHwInterface("connection_pool=0&shared_connection=pool"), uhal::exception::InvalidURI );
+  BOOST_CHECK_THROW ( getControlHubHwInterface("shared_connection=pool&poll=busy"), uhal::exception::InvalidURI );
+  BOOST_CHECK_THROW ( ConnectionManager::getDevice("tcp", "ipbustcp-2.0://localhost:" + std::to_string(devicePort) + "?shared_connection=pool", getAddressFileURI()), uhal::exception::InvalidURI );
+}
+
+
+BOOST_FIXTURE_TEST_CASE(one_client_per_target, SharedConnectionFixture)
+{
+  HwInterface hw = getControlHubHwInterface("shared_connection=test");
+  BOOST_CHECK_THROW ( getControlHubHwInterface("shared_connection=test"), uhal::exception::SharedControlHubTargetInUse );
+
+  // A client whose URI is rejected must not be left attached to the group's connection
+  BOOST_CHECK_THROW ( getControlHubHwInterface("shared_connection=test&so_busy_poll=50", 60099), uhal::exception::InvalidURI );
+  BOOST_CHECK_NO_THROW ( getControlHubHwInterface("shared_connection=test", 60099) );
+
+  // Copies of a HwInterface share its client
+  HwInterface hwCopy ( hw );
+  hwCopy.getNode ( "REG" ).write ( 42 );
+  ValWord<uint32_t> x = hw.getNode ( "REG" ).read();
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK_EQUAL ( x.value(), uint32_t(42) );
+}
+
+
+BOOST_FIXTURE_TEST_CASE(target_timeout, SharedConnectionFixture)
+{
+  HwInterface hw = getControlHubHwInterface("shared_connection=test");
+  HwInterface deadHw = getControlHubHwInterface("shared_connection=test", 60099);
+
+  deadHw.getNode ( "REG" ).read();
+  BOOST_CHECK_THROW ( deadHw.dispatch(), uhal::exception::ControlHubTargetTimeout );
+
+  // The other client in the group is unaffected
+  hw.getNode ( "REG" ).write ( 0x1234 );
+  ValWord<uint32_t> x = hw.getNode ( "REG" ).read();
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK_EQUAL ( x.value(), uint32_t(0x1234) );
+
+  // The failed client fails in the same way again, rather than being passed a stale reply
+  deadHw.getNode ( "REG" ).read();
+  BOOST_CHECK_THROW ( deadHw.dispatch(), uhal::exception::ControlHubTargetTimeout );
+  BOOST_CHECK_EQUAL ( controlHub->getConnectionCount(), size_t(1) );
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+} // end ns tests
+} // end ns uhal
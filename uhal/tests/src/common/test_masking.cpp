@@ -44,6 +44,7 @@
 #include <ios>
 #include <cstdlib>
 #include <typeinfo>
+#include <vector>
 
 
 namespace uhal {
@@ -76,5 +77,44 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(MaskedNodeTestSuite, write_read_masked, Dumm
 )
 
 
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(MaskedNodeTestSuite, coalesced_masked_writes, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface ( "coalesce=1" );
+  ClientInterface& lClient = hw.getClient();
+  const uint32_t lAddr ( hw.getNode ( "REG" ).getAddress() );
+  const uint32_t lInitialRmwBitsCount ( hwRunner.getTransactionCount ( RMW_BITS ) );
+
+  // Successive masked writes to one register (including overlapping fields) are merged into one RMW-bits transaction
+  const uint32_t x = static_cast<uint32_t> ( rand() );
+  lClient.write ( lAddr , x );
+  std::vector< ValHeader > lWrites;
+  for ( uint32_t i = 0; i != 8; ++i )
+  {
+    lWrites.push_back ( lClient.write ( lAddr , i , 0xF << ( 4 * i ) ) );
+  }
+  lWrites.push_back ( lClient.write ( lAddr , 0xAB , 0x00FF0000 ) );
+  ValWord< uint32_t > lMerged = lClient.read ( lAddr );
+
+  // A read of the same register in between must see the intermediate value
+  lClient.write ( lAddr , 0x1 , 0x0000000F );
+  ValWord< uint32_t > lIntermediate = lClient.read ( lAddr );
+  lClient.write ( lAddr , 0x2 , 0x000000F0 );
+  ValWord< uint32_t > lFinal = lClient.read ( lAddr );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+
+  for ( size_t i = 0; i != lWrites.size(); ++i )
+  {
+    BOOST_CHECK ( lWrites.at ( i ).valid() );
+  }
+  BOOST_CHECK_EQUAL ( lMerged.value() , uint32_t ( 0x76AB3210 ) );
+  BOOST_CHECK_EQUAL ( lIntermediate.value() , uint32_t ( 0x76AB3211 ) );
+  BOOST_CHECK_EQUAL ( lFinal.value() , uint32_t ( 0x76AB3221 ) );
+
+  // One RMW-bits transaction for the nine merged writes, and one for each of the two writes separated by reads
+  BOOST_CHECK_EQUAL ( hwRunner.getTransactionCount ( RMW_BITS ) - lInitialRmwBitsCount , uint32_t ( 3 ) );
+}
+)
+
+
 } // end ns tests
 } // end ns uhal
@@ -0,0 +1,111 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+      Tom Williams, Rutherford Appleton Laboratory, Oxfordshire
+      email: tom.williams <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/ProtocolMmap.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <fcntl.h>
+#include <numeric>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+
+namespace uhal {
+namespace tests {
+
+
+//! Creates a temporary 32 kB file, standing in for an mmap device, that is filled with 0xFF bytes and removed on destruction
+struct MmapFileFixture {
+  MmapFileFixture() :
+    path("/tmp/uhal_mmap_test_XXXXXX")
+  {
+    const int lFd = mkstemp(&path[0]);
+    BOOST_REQUIRE(lFd != -1);
+    const std::vector<uint8_t> lContents(32 * 1024, 0xFF);
+    BOOST_REQUIRE_EQUAL(::write(lFd, lContents.data(), lContents.size()), ssize_t(lContents.size()));
+    ::close(lFd);
+  }
+
+  ~MmapFileFixture()
+  {
+    unlink(path.c_str());
+  }
+
+  std::string path;
+};
+
+
+BOOST_AUTO_TEST_SUITE( mmap_file )
+
+
+BOOST_FIXTURE_TEST_CASE(write_read_segments, MmapFileFixture)
+{
+  // Segment boundaries deliberately fall within the 64-bit words written, and reply buffer boundaries within the 32-bit words read
+  std::vector<uint8_t> lSource(52);
+  std::iota(lSource.begin(), lSource.end(), 1);
+  const std::vector<size_t> lSegmentSizes = {4, 12, 8, 20, 8};
+  std::vector<std::pair<const uint8_t*, size_t> > lSegments;
+  for (size_t i = 0, lOffset = 0; i < lSegmentSizes.size(); lOffset += lSegmentSizes.at(i++))
+    lSegments.push_back(std::make_pair(lSource.data() + lOffset, lSegmentSizes.at(i)));
+
+  Mmap::File lFile(path, O_RDWR);
+  lFile.write(8, lSegments);
+
+  // The trailing 32-bit word is written as a zero-extended 64-bit store
+  std::vector<uint32_t> lValues;
+  lFile.read(0, 18, lValues);
+  BOOST_CHECK_EQUAL(lValues.at(0), 0xFFFFFFFF);
+  BOOST_CHECK_EQUAL(lValues.at(1), 0xFFFFFFFF);
+  BOOST_CHECK(memcmp(lValues.data() + 2, lSource.data(), lSource.size()) == 0);
+  BOOST_CHECK_EQUAL(lValues.at(15), uint32_t(0));
+  BOOST_CHECK_EQUAL(lValues.at(16), 0xFFFFFFFF);
+  BOOST_CHECK_EQUAL(lFile.read(2), lValues.at(2));
+
+  std::vector<uint8_t> lDestination(64, 0);
+  const std::vector<size_t> lDestinationSizes = {4, 6, 10, 3, 25, 16};
+  std::deque<std::pair<uint8_t*, uint32_t> > lReplyBuffers;
+  for (size_t i = 0, lOffset = 0; i < lDestinationSizes.size(); lOffset += lDestinationSizes.at(i++))
+    lReplyBuffers.push_back(std::make_pair(lDestination.data() + lOffset, uint32_t(lDestinationSizes.at(i))));
+
+  lFile.read(2, lReplyBuffers, 48);
+  BOOST_CHECK(std::equal(lSource.begin(), lSource.begin() + 48, lDestination.begin()));
+  BOOST_CHECK(std::count(lDestination.begin() + 48, lDestination.end(), 0) == 16);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // end ns tests
+} // end ns uhal
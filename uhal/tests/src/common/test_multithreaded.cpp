@@ -44,6 +44,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include "uhal/uhal.hpp"
+#include "uhal/ClientFactory.hpp"
 #include "uhal/tests/definitions.hpp"
 #include "uhal/tests/fixtures.hpp"
 #include "uhal/tests/tools.hpp"
@@ -118,6 +119,39 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(MultithreadedTestSuite, multiple_hwinterface
 )
 
 
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(MultithreadedTestSuite, multiple_hwinterfaces_shared_io_service, DummyHardwareFixture,
+{
+  // Clients created from here on are all serviced by the same two I/O threads (socket-based clients only)
+  ClientFactory::getInstance().setSharedIOservicePool ( 2 );
+
+  std::vector<std::shared_ptr<std::thread>> jobs;
+
+  for ( size_t i=0; i!=N_THREADS; ++i )
+  {
+    jobs.emplace_back ( new std::thread(job_multiple, connectionFileURI, deviceId, timeout) );
+  }
+
+  for ( size_t i=0; i!=N_THREADS; ++i )
+  {
+    jobs[i]->join();
+  }
+
+  for ( size_t i=0; i!=N_ITERATIONS; ++i )
+  {
+    HwInterface hw = getHwInterface();
+    const uint32_t x = static_cast<uint32_t> ( rand() );
+    hw.getNode ( "REG" ).write ( x );
+    ValWord< uint32_t > reg = hw.getNode ( "REG" ).read();
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+    BOOST_CHECK ( reg.valid() );
+    BOOST_CHECK_EQUAL ( reg.value(), x );
+  }
+
+  ClientFactory::getInstance().setSharedIOservicePool ( 0 );
+}
+)
+
+
 void job_single ( HwInterface& hw )
 {
   BOOST_CHECK_NO_THROW (
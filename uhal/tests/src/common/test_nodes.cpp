@@ -281,7 +281,7 @@ DummyAddressFileFixture::DummyAddressFileFixture() :
   addrFileLevel2AbsPath.replace(addrFileAbsPath.size() - 11, 0, "level2_");
   addrFileLevel3AbsPath.replace(addrFileAbsPath.size() - 11, 0, "level3_");
 
-  nodeProperties.push_back(NodeProperties("", 0, defs::HIERARCHICAL, defs::READWRITE, 1, addrFileAbsPath, 55));
+  nodeProperties.push_back(NodeProperties("", 0, defs::HIERARCHICAL, defs::READWRITE, 1, addrFileAbsPath, 59));
 
   nodeProperties.push_back(NodeProperties("REG", 1, defs::SINGLE, defs::READWRITE, 1, addrFileAbsPath, 0));
   nodeProperties.back().tags = "test";
@@ -410,6 +410,14 @@ DummyAddressFileFixture::DummyAddressFileFixture() :
   nodeProperties.back().fwInfo["type"] = "endpoint";
   nodeProperties.back().fwInfo["width"] = "0x10";
 
+  nodeProperties.push_back(NodeProperties("SHADOWED", 0x800000, defs::HIERARCHICAL, defs::READWRITE, 1, addrFileAbsPath, 3));
+  nodeProperties.back().parameters["shadow"] = "1";
+  nodeProperties.push_back(NodeProperties("SHADOWED.REG", 0x800000, defs::SINGLE, defs::READWRITE, 1, addrFileAbsPath, 0));
+  nodeProperties.push_back(NodeProperties("SHADOWED.REG_UPPER_MASK", 0x800001, defs::SINGLE, defs::READWRITE, 1, addrFileAbsPath, 0));
+  nodeProperties.back().mask = 0xffff0000;
+  nodeProperties.push_back(NodeProperties("SHADOWED.REG_LOWER_MASK", 0x800001, defs::SINGLE, defs::READWRITE, 1, addrFileAbsPath, 0));
+  nodeProperties.back().mask = 0xffff;
+
   for (size_t i=0; i < nodeProperties.size(); i++) {
     BOOST_REQUIRE_LE(nodeProperties.at(i).descendantIds.size(), (nodeProperties.size() - i - 1));
     for (size_t j=0; j < nodeProperties.at(i).descendantIds.size(); j++) {
@@ -748,6 +756,29 @@ BOOST_FIXTURE_TEST_CASE (address_description, DummyAddressFileFixture) {
 }
 
 
+BOOST_FIXTURE_TEST_CASE (shared_properties, DummyAddressFileFixture) {
+  const std::shared_ptr<uhal::Node> lTopNode1(NodeTreeBuilder::getInstance().getNodeTree(addrFileURI, boost::filesystem::current_path() / "."));
+  const std::shared_ptr<uhal::Node> lTopNode2(NodeTreeBuilder::getInstance().getNodeTree(addrFileURI, boost::filesystem::current_path() / "."));
+
+  // Each tree has its own nodes, but the address table properties of those nodes are shared
+  BOOST_CHECK(&lTopNode1->getNode("REG") != &lTopNode2->getNode("REG"));
+  BOOST_CHECK_EQUAL(&lTopNode1->getNode("REG").getTags(), &lTopNode2->getNode("REG").getTags());
+  BOOST_CHECK_EQUAL(&lTopNode1->getNode("SUBSYSTEM1.SUBMODULE.REG").getTags(), &lTopNode2->getNode("SUBSYSTEM1.SUBMODULE.REG").getTags());
+
+  // ... except between different instances of the same module, which have different addresses
+  BOOST_CHECK(&lTopNode1->getNode("SUBSYSTEM1.REG").getTags() != &lTopNode1->getNode("SUBSYSTEM2.REG").getTags());
+  BOOST_CHECK_EQUAL(lTopNode1->getNode("SUBSYSTEM1.REG").getAddress(), uint32_t(0x210002));
+  BOOST_CHECK_EQUAL(lTopNode1->getNode("SUBSYSTEM2.REG").getAddress(), uint32_t(0x310002));
+
+  // Including a module in another table must not modify the module's own node tree
+  const std::shared_ptr<uhal::Node> lModuleNode(NodeTreeBuilder::getInstance().getNodeTree("file://" + addrFileLevel2AbsPath, boost::filesystem::current_path() / "."));
+  BOOST_CHECK_EQUAL(lModuleNode->getAddress(), uint32_t(0x10001));
+  BOOST_CHECK_EQUAL(lModuleNode->getNode("REG").getAddress(), uint32_t(0x10002));
+  BOOST_CHECK_EQUAL(lModuleNode->getNode("SUBMODULE.REG").getAddress(), lTopNode1->getNode("SUBSYSTEM1.SUBMODULE.REG").getAddress() - 0x200000);
+  BOOST_CHECK(lModuleNode->getParameters() != lTopNode1->getNode("SUBSYSTEM2").getParameters());
+}
+
+
 BOOST_AUTO_TEST_SUITE( simple )
 
 BOOST_FIXTURE_TEST_CASE (valid_default, SimpleAddressTableFixture)
@@ -0,0 +1,172 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Tom Williams, Rutherford Appleton Laboratory, Oxfordshire
+      email: tom.williams <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/uhal.hpp"
+
+#include <cstdlib>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "uhal/ProtocolIPbus.hpp"
+#include "uhal/ProtocolUDP.hpp"
+
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/tools.hpp"
+#include "uhal/tests/UDPDummyHardware.hpp"
+
+
+namespace uhal {
+namespace tests {
+
+
+//! Fixture running an IPbus 2.0 UDP dummy hardware that periodically drops requests and replies
+template <uint32_t DropRequestPeriod, uint32_t DropReplyPeriod>
+struct LossyDummyHardwareFixture : public MinimalFixture<IPBUS_2_0_UDP> {
+  LossyDummyHardwareFixture() :
+    dummyHardware(new UDPDummyHardware<2,0>(devicePort, 0, false, DropRequestPeriod, DropReplyPeriod)),
+    hwRunner(dummyHardware)
+  {
+  }
+
+  ~LossyDummyHardwareFixture() {}
+
+  //! The dummy hardware, owned by the runner
+  UDPDummyHardware<2,0>* dummyHardware;
+  DummyHardwareRunner hwRunner;
+};
+
+
+typedef LossyDummyHardwareFixture<0, 0> LosslessFixture;
+typedef LossyDummyHardwareFixture<11, 7> OccasionalLossFixture;
+typedef LossyDummyHardwareFixture<1, 0> TotalRequestLossFixture;
+
+
+BOOST_AUTO_TEST_SUITE(ipbusudp_2_0)
+
+BOOST_AUTO_TEST_SUITE(PacketLossTestSuite)
+
+
+BOOST_FIXTURE_TEST_CASE(recover_lost_packets, OccasionalLossFixture)
+{
+  HwInterface hw = getHwInterface("max_recovery_attempts=3");
+  const size_t N = 2000;
+
+  for (size_t i = 0; i < 10; i++)
+  {
+    const uint32_t x = static_cast<uint32_t> ( rand() );
+    std::vector<uint32_t> xx(N);
+    for (size_t j = 0; j < N; j++)
+      xx.at(j) = static_cast<uint32_t> ( rand() );
+
+    hw.getNode ( "REG" ).write ( x );
+    hw.getNode ( "MEM" ).writeBlock ( xx );
+    ValWord< uint32_t > y = hw.getNode ( "REG" ).read();
+    ValVector< uint32_t > yy = hw.getNode ( "MEM" ).readBlock ( N );
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+
+    BOOST_CHECK ( y.valid() );
+    BOOST_CHECK_EQUAL ( y.value(), x );
+    BOOST_CHECK ( yy.valid() );
+    BOOST_CHECK ( std::equal ( yy.begin(), yy.end(), xx.begin() ) );
+  }
+
+  UDP< IPbus< 2 , 0 > >& lClient = dynamic_cast< UDP< IPbus< 2 , 0 > >& > ( hw.getClient() );
+  BOOST_CHECK ( lClient.getRecoveredPacketLosses() > 0 );
+  BOOST_CHECK_EQUAL ( lClient.getFatalPacketLosses(), uint64_t(0) );
+}
+
+
+BOOST_FIXTURE_TEST_CASE(adaptive_window, LosslessFixture)
+{
+  HwInterface hw = getHwInterface("max_recovery_attempts=3&adaptive_window=1");
+  UDP< IPbus< 2 , 0 > >& lClient = dynamic_cast< UDP< IPbus< 2 , 0 > >& > ( hw.getClient() );
+  BOOST_CHECK_EQUAL ( lClient.getWindowSize(), uint32_t(1) );
+  const size_t N = 2000;
+
+  for (size_t i = 0; i < 10; i++)
+  {
+    std::vector<uint32_t> xx(N);
+    for (size_t j = 0; j < N; j++)
+      xx.at(j) = static_cast<uint32_t> ( rand() );
+
+    hw.getNode ( "MEM" ).writeBlock ( xx );
+    ValVector< uint32_t > yy = hw.getNode ( "MEM" ).readBlock ( N );
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+
+    BOOST_CHECK ( yy.valid() );
+    BOOST_CHECK ( std::equal ( yy.begin(), yy.end(), xx.begin() ) );
+  }
+
+  // Without losses, the window grows beyond one packet, even though the round-trip time grows as packets queue at the target
+  const uint32_t lWindowSize ( lClient.getWindowSize() );
+  BOOST_CHECK ( lClient.getRoundTripTime().count() > 0 );
+  BOOST_CHECK_GT ( lWindowSize, uint32_t(1) );
+  BOOST_CHECK_EQUAL ( lClient.getRecoveredPacketLosses(), uint64_t(0) );
+
+  // A lost packet halves the window
+  dummyHardware->dropNextControlRequest();
+  ValWord< uint32_t > x = hw.getNode ( "REG" ).read();
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK ( x.valid() );
+  BOOST_CHECK_EQUAL ( lClient.getRecoveredPacketLosses(), uint64_t(1) );
+  BOOST_CHECK_EQUAL ( lClient.getFatalPacketLosses(), uint64_t(0) );
+  BOOST_CHECK_LT ( lClient.getWindowSize(), lWindowSize );
+  BOOST_CHECK_GE ( lClient.getWindowSize(), uint32_t(1) );
+
+  BOOST_CHECK_THROW ( ConnectionManager::getDevice("adaptive_window", "ipbusudp-1.3://localhost:" + std::to_string(devicePort) + "?adaptive_window=1", getAddressFileURI()) , uhal::exception::InvalidURI );
+}
+
+
+BOOST_FIXTURE_TEST_CASE(unrecoverable_packet_loss, TotalRequestLossFixture)
+{
+  HwInterface hw = getHwInterface("max_recovery_attempts=3");
+
+  hw.getNode ( "REG" ).read();
+  BOOST_CHECK_THROW ( hw.dispatch(), uhal::exception::ClientTimeout );
+
+  UDP< IPbus< 2 , 0 > >& lClient = dynamic_cast< UDP< IPbus< 2 , 0 > >& > ( hw.getClient() );
+  BOOST_CHECK_EQUAL ( lClient.getRecoveredPacketLosses(), uint64_t(0) );
+  BOOST_CHECK_EQUAL ( lClient.getFatalPacketLosses(), uint64_t(1) );
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+} // end ns tests
+} // end ns uhal
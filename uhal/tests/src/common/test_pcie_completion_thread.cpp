@@ -0,0 +1,143 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+#include "uhal/uhal.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/tools.hpp"
+
+
+#define N_WORDS       uint32_t(5000)
+#define N_REGISTERS   size_t(1000)
+
+
+namespace uhal {
+namespace tests {
+
+
+//! Writes a block of random values and many single registers (spanning many more packets than there are pages), then reads them back in a separate dispatch, checking the values
+void checkWriteRead(HwInterface& aHw)
+{
+  BOOST_CHECK ( writeAndReadBack ( aHw, "MEM", N_WORDS, N_REGISTERS ) );
+}
+
+
+BOOST_AUTO_TEST_SUITE(ipbuspcie_2_0)
+
+BOOST_AUTO_TEST_SUITE(CompletionThreadTestSuite)
+
+
+BOOST_FIXTURE_TEST_CASE(write_read, DummyHardwareFixture<IPBUS_2_0_PCIE>)
+{
+  HwInterface hw = getHwInterface("completion_thread=1");
+  for (size_t i = 0; i < 3; i++)
+    checkWriteRead(hw);
+}
+
+
+BOOST_FIXTURE_TEST_CASE(write_read_scheduler, DummyHardwareFixture<IPBUS_2_0_PCIE>)
+{
+  HwInterface hw = getHwInterface("completion_thread=1&scheduler=1");
+  for (size_t i = 0; i < 3; i++)
+    checkWriteRead(hw);
+}
+
+
+BOOST_FIXTURE_TEST_CASE(dispatch_async, DummyHardwareFixture<IPBUS_2_0_PCIE>)
+{
+  HwInterface hw = getHwInterface("completion_thread=1");
+  const Node& lMem = hw.getNode ( "MEM" );
+
+  // Queue the reads while the replies to the writes are still being collected
+  std::vector<uint32_t> xx(N_WORDS);
+  for (size_t i = 0; i < N_WORDS; i++)
+    xx.at(i) = static_cast<uint32_t> ( rand() );
+  lMem.writeBlock ( xx );
+  std::future< void > lWritten = hw.dispatchAsync();
+
+  ValVector< uint32_t > yy = lMem.readBlock ( N_WORDS );
+  std::future< void > lRead = hw.dispatchAsync();
+
+  BOOST_CHECK_NO_THROW ( lWritten.get() );
+  BOOST_CHECK_NO_THROW ( lRead.get() );
+  BOOST_REQUIRE ( yy.valid() );
+  BOOST_CHECK ( std::equal ( yy.begin(), yy.end(), xx.begin() ) );
+
+  // The device must have been released, so that another client (without the completion thread) can use it
+  HwInterface hw2 = getHwInterface();
+  ValWord< uint32_t > lValue = hw2.getNode ( "MEM" ).read();
+  hw2.dispatch();
+  BOOST_CHECK_EQUAL ( lValue.value(), xx.at(0) );
+}
+
+
+BOOST_FIXTURE_TEST_CASE(reply_timeout, DummyHardwareFixture<IPBUS_2_0_PCIE>)
+{
+  HwInterface hw = getHwInterface("completion_thread=1");
+  hw.setTimeoutPeriod(1);
+  hwRunner.setReplyDelay ( std::chrono::milliseconds(50) );
+
+  hw.getNode ( "REG" ).read();
+  BOOST_CHECK_THROW ( hw.dispatch(), uhal::exception::ClientTimeout );
+
+  // Wait for the late reply to be published, since otherwise it would be mistaken for the reply to the next packet
+  std::this_thread::sleep_for ( std::chrono::milliseconds(500) );
+
+  // The exception caught by the completion thread must also be reported via the future returned by dispatchAsync
+  hwRunner.setReplyDelay ( std::chrono::milliseconds(50) );
+  hw.getNode ( "REG" ).read();
+  std::future< void > lFuture = hw.dispatchAsync();
+  BOOST_CHECK_THROW ( lFuture.get(), uhal::exception::ClientTimeout );
+
+  std::this_thread::sleep_for ( std::chrono::milliseconds(500) );
+  hw.setTimeoutPeriod(timeout);
+  checkWriteRead(hw);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+} // end ns tests
+} // end ns uhal
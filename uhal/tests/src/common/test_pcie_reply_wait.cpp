@@ -0,0 +1,139 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/uhal.hpp"
+#include "uhal/ProtocolPCIe.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/PCIeDummyHardware.hpp"
+#include "uhal/tests/tools.hpp"
+
+
+namespace uhal {
+namespace tests {
+
+
+//! Fixture running a PCIe dummy hardware that also emulates the events file, signalling each published reply
+struct PCIeEventsFixture : public MinimalFixture<IPBUS_2_0_PCIE> {
+  PCIeEventsFixture(const uint32_t aReplyDelay = 0);
+  ~PCIeEventsFixture() {}
+
+  std::string eventsFile;
+  DummyHardwareRunner hwRunner;
+};
+
+
+PCIeEventsFixture::PCIeEventsFixture(const uint32_t aReplyDelay) :
+  eventsFile("/tmp/uhal_pcie_events"),
+  hwRunner(new PCIeDummyHardware(clientToHardwareFile, hardwareToClientFile, aReplyDelay, false, eventsFile))
+{
+}
+
+
+//! As PCIeEventsFixture, but the reply to the first transaction is delayed beyond the client timeout
+struct DelayedPCIeEventsFixture : public PCIeEventsFixture {
+  DelayedPCIeEventsFixture() :
+    PCIeEventsFixture(2)
+  {
+  }
+};
+
+
+void checkWriteReadViaPCIe(HwInterface& hw)
+{
+  // Single-word transactions, each dispatched separately, followed by block transfers that span several pages
+  for (size_t i = 0; i < 100; i++)
+  {
+    const uint32_t x = static_cast<uint32_t> ( rand() );
+    hw.getNode ( "REG" ).write ( x );
+    ValWord< uint32_t > y = hw.getNode ( "REG" ).read();
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+    BOOST_CHECK ( y.valid() );
+    BOOST_CHECK_EQUAL ( y.value(), x );
+  }
+
+  BOOST_CHECK ( writeAndReadBack ( hw, "LARGE_MEM", 10000 ) );
+}
+
+
+BOOST_AUTO_TEST_SUITE(ipbuspcie_2_0)
+
+BOOST_AUTO_TEST_SUITE(ReplyWaitTestSuite)
+
+
+BOOST_FIXTURE_TEST_CASE(adaptive_polling, PCIeEventsFixture)
+{
+  HwInterface hw = getHwInterface();
+  checkWriteReadViaPCIe(hw);
+
+  // Status word polled at fixed intervals, as set by the 'sleep' attribute
+  HwInterface hwFixed = getHwInterface("sleep=20");
+  checkWriteReadViaPCIe(hwFixed);
+}
+
+
+BOOST_FIXTURE_TEST_CASE(events, PCIeEventsFixture)
+{
+  HwInterface hw = getHwInterface("events=" + eventsFile);
+  checkWriteReadViaPCIe(hw);
+}
+
+
+BOOST_FIXTURE_TEST_CASE(events_timeout, DelayedPCIeEventsFixture)
+{
+  // The client should block on the events file for no longer than the timeout period
+  HwInterface hw = getHwInterface("events=" + eventsFile);
+  ValWord< uint32_t > x = hw.getNode ( "REG" ).read();
+
+  const std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+  BOOST_CHECK_THROW ( hw.dispatch(), uhal::exception::PCIeTimeout );
+  const double lElapsedMs = std::chrono::duration<double, std::milli> ( std::chrono::steady_clock::now() - lStart ).count();
+  BOOST_CHECK ( lElapsedMs >= timeout );
+  BOOST_CHECK ( lElapsedMs < timeout + 500 );
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+} // end ns tests
+} // end ns uhal
@@ -0,0 +1,148 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/uhal.hpp"
+#include "uhal/ProtocolPCIe.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/tools.hpp"
+
+
+#define N_ITERATIONS  20
+#define N_WORDS       uint32_t(500)
+
+
+namespace uhal {
+namespace tests {
+
+
+//! Writes and reads back blocks (each spanning two pages) in a region of memory used only by this job; sets aSuccess if all reads match
+void job_write_read(HwInterface aHw, const uint32_t aOffset, bool& aSuccess)
+{
+  aSuccess = false;
+  try {
+    for (size_t i = 0; i < N_ITERATIONS; i++)
+    {
+      if ( not writeAndReadBack ( aHw, "MEM", N_WORDS, 0, aOffset ) )
+        return;
+    }
+    aSuccess = true;
+  }
+  catch ( const std::exception& aExc ) {
+    log ( Error(), "Exception thrown in PCIe scheduler test job: ", aExc.what() );
+  }
+}
+
+
+//! Runs job_write_read concurrently for each client, checking that all succeed
+void checkConcurrentWriteRead(const std::vector<HwInterface>& aClients)
+{
+  std::vector<std::shared_ptr<std::thread> > lJobs;
+  std::unique_ptr<bool[]> lSuccess(new bool[aClients.size()]);
+  for (size_t i = 0; i < aClients.size(); i++)
+    lJobs.emplace_back ( new std::thread(job_write_read, aClients.at(i), i * N_WORDS, std::ref(lSuccess[i])) );
+
+  for (size_t i = 0; i < aClients.size(); i++) {
+    lJobs.at(i)->join();
+    BOOST_CHECK_MESSAGE ( lSuccess[i], "Client " << i << " failed" );
+  }
+}
+
+
+BOOST_AUTO_TEST_SUITE(ipbuspcie_2_0)
+
+BOOST_AUTO_TEST_SUITE(SchedulerTestSuite)
+
+
+BOOST_FIXTURE_TEST_CASE(interleaved_clients, DummyHardwareFixture<IPBUS_2_0_PCIE>)
+{
+  // More clients than pages, so that clients must wait for others to collect their replies
+  std::vector<HwInterface> lClients;
+  for (size_t i = 0; i < 5; i++)
+  {
+    lClients.push_back ( getHwInterface("scheduler=1") );
+    lClients.back().setTimeoutPeriod ( 10 * timeout );
+  }
+
+  checkConcurrentWriteRead(lClients);
+}
+
+
+BOOST_FIXTURE_TEST_CASE(mixed_clients, DummyHardwareFixture<IPBUS_2_0_PCIE>)
+{
+  // Clients without the scheduler lock the device for each dispatch, excluding those with it
+  std::vector<HwInterface> lClients;
+  for (size_t i = 0; i < 4; i++)
+  {
+    lClients.push_back ( getHwInterface((i % 2) ? "scheduler=1" : "") );
+    lClients.back().setTimeoutPeriod ( 10 * timeout );
+  }
+
+  checkConcurrentWriteRead(lClients);
+}
+
+
+BOOST_FIXTURE_TEST_CASE(timeout_releases_pages, DummyHardwareFixture<IPBUS_2_0_PCIE>)
+{
+  // Pages reserved by a client whose dispatch failed must be released for use by other clients
+  HwInterface hw = getHwInterface("scheduler=1");
+  hw.setTimeoutPeriod(1);
+  hwRunner.setReplyDelay ( std::chrono::milliseconds(50) );
+  hw.getNode ( "REG" ).read();
+  BOOST_CHECK_THROW ( hw.dispatch(), uhal::exception::ClientTimeout );
+  hwRunner.setReplyDelay ( std::chrono::microseconds(0) );
+
+  // Wait for the late reply to be published, since otherwise the next client would mistake it for its own
+  std::this_thread::sleep_for ( std::chrono::milliseconds(100) );
+
+  std::vector<HwInterface> lClients(1, getHwInterface("scheduler=1"));
+  lClients.back().setTimeoutPeriod ( 10 * timeout );
+  checkConcurrentWriteRead(lClients);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+} // end ns tests
+} // end ns uhal
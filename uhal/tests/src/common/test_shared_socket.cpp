@@ -0,0 +1,176 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/uhal.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "uhal/SharedUDPSocket.hpp"
+
+#include "uhal/tests/definitions.hpp"
+#include "uhal/tests/fixtures.hpp"
+#include "uhal/tests/tools.hpp"
+#include "uhal/tests/UDPDummyHardware.hpp"
+
+
+namespace uhal {
+namespace tests {
+
+
+//! Fixture running two IPbus 2.0 UDP dummy hardware instances, for clients that share a socket
+struct SharedSocketFixture : public DummyHardwareFixture<IPBUS_2_0_UDP> {
+  SharedSocketFixture() :
+    otherDevicePort(50001),
+    otherHwRunner(new UDPDummyHardware<2,0>(otherDevicePort, 0, false))
+  {
+  }
+
+  ~SharedSocketFixture() {}
+
+  //! Returns a client of the other dummy hardware that shares a socket with other clients
+  HwInterface getOtherHwInterface() const
+  {
+    return createHwInterface(deviceId, "ipbusudp-2.0://localhost:" + std::to_string(otherDevicePort), "shared_socket=test");
+  }
+
+  uint16_t otherDevicePort;
+  DummyHardwareRunner otherHwRunner;
+};
+
+
+BOOST_AUTO_TEST_SUITE(ipbusudp_2_0)
+
+BOOST_AUTO_TEST_SUITE(SharedSocketTestSuite)
+
+
+BOOST_FIXTURE_TEST_CASE(write_read_two_targets, SharedSocketFixture)
+{
+  HwInterface hw = getHwInterface("shared_socket=test");
+  HwInterface otherHw = getOtherHwInterface();
+  const size_t N = 20000;
+
+  for (size_t i = 0; i < 5; i++)
+  {
+    std::vector<uint32_t> xx(N);
+    for (size_t j = 0; j < N; j++)
+      xx.at(j) = static_cast<uint32_t> ( rand() );
+    std::vector<uint32_t> yy(N);
+    for (size_t j = 0; j < N; j++)
+      yy.at(j) = static_cast<uint32_t> ( rand() );
+
+    hw.getNode ( "MEM" ).writeBlock ( xx );
+    otherHw.getNode ( "MEM" ).writeBlock ( yy );
+    ValVector< uint32_t > mem = hw.getNode ( "MEM" ).readBlock ( N );
+    ValVector< uint32_t > otherMem = otherHw.getNode ( "MEM" ).readBlock ( N );
+    std::future<void> lDispatched = hw.dispatchAsync();
+    BOOST_CHECK_NO_THROW ( otherHw.dispatch() );
+    BOOST_CHECK_NO_THROW ( lDispatched.get() );
+
+    BOOST_CHECK ( mem.valid() );
+    BOOST_CHECK ( std::equal ( mem.begin(), mem.end(), xx.begin() ) );
+    BOOST_CHECK ( otherMem.valid() );
+    BOOST_CHECK ( std::equal ( otherMem.begin(), otherMem.end(), yy.begin() ) );
+  }
+}
+
+
+BOOST_FIXTURE_TEST_CASE(one_client_per_target, SharedSocketFixture)
+{
+  HwInterface hw = getHwInterface("shared_socket=test");
+  BOOST_CHECK_THROW ( getHwInterface("shared_socket=test"), uhal::exception::SharedUdpEndpointInUse );
+
+  // Copies of a HwInterface share its client
+  HwInterface hwCopy ( hw );
+  hwCopy.getNode ( "REG" ).write ( 42 );
+  ValWord< uint32_t > x = hw.getNode ( "REG" ).read();
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK_EQUAL ( x.value(), uint32_t(42) );
+
+  // Replies are matched to their packets by the IPbus 2.0 packet header
+  BOOST_CHECK_THROW ( createHwInterface(deviceId, "ipbusudp-1.3://localhost:" + std::to_string(otherDevicePort), "shared_socket=test"), uhal::exception::InvalidURI );
+}
+
+
+BOOST_FIXTURE_TEST_CASE(client_timeout, SharedSocketFixture)
+{
+  // The dummy hardware delays its reply to the first request for longer than the timeout
+  HwInterface hw = getHwInterface("shared_socket=test");
+  HwInterface otherHw = getOtherHwInterface();
+  hwRunner.setReplyDelay( std::chrono::milliseconds(timeout) + std::chrono::seconds(1) );
+  hw.getNode ( "REG" ).read();
+  BOOST_CHECK_THROW ( hw.dispatch(), uhal::exception::ClientTimeout );
+
+  // Other clients in the group are unaffected, even while the late reply is still to come
+  otherHw.getNode ( "REG" ).write ( 7 );
+  ValWord< uint32_t > x = otherHw.getNode ( "REG" ).read();
+  BOOST_CHECK_NO_THROW ( otherHw.dispatch() );
+  BOOST_CHECK_EQUAL ( x.value(), uint32_t(7) );
+
+  // The client that timed out can still be used once the late reply has arrived (and been discarded)
+  std::this_thread::sleep_for( std::chrono::milliseconds(timeout) + std::chrono::seconds(1) );
+  hw.getNode ( "REG" ).write ( 8 );
+  ValWord< uint32_t > y = hw.getNode ( "REG" ).read();
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK_EQUAL ( y.value(), uint32_t(8) );
+}
+
+
+BOOST_FIXTURE_TEST_CASE(client_timeout_immediate_redispatch, SharedSocketFixture)
+{
+  // The dummy hardware delays its reply to the first request for longer than the timeout, but replies to the next one as soon as it has sent the late reply
+  HwInterface hw = getHwInterface("shared_socket=test");
+  hwRunner.setReplyDelay( std::chrono::milliseconds(timeout * 3 / 2) );
+  hw.getNode ( "REG" ).write ( 7 );
+  hw.getNode ( "REG" ).read();
+  BOOST_CHECK_THROW ( hw.dispatch(), uhal::exception::ClientTimeout );
+
+  // The late reply (to an identical packet) arrives while this dispatch is in progress, and must not be taken for its reply
+  hw.getNode ( "REG" ).write ( 8 );
+  ValWord< uint32_t > x = hw.getNode ( "REG" ).read();
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK_EQUAL ( x.value(), uint32_t(8) );
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+} // end ns tests
+} // end ns uhal
@@ -42,6 +42,8 @@
 #include <boost/filesystem.hpp>
 
 #include <vector>
+#include <chrono>
+#include <future>
 #include <algorithm>
 #include <string>
 #include <iostream>
@@ -111,6 +113,185 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(SingleReadWriteTestSuite, search_device_id,
 )
 
 
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(SingleReadWriteTestSuite, values_outlive_interface, DummyHardwareFixture,
+{
+  uint32_t x = static_cast<uint32_t> ( rand() );
+  std::vector< uint32_t > xx ( 64 );
+  for ( size_t i = 0; i != xx.size(); ++i )
+  {
+    xx.at ( i ) = static_cast<uint32_t> ( rand() );
+  }
+
+  ValWord< uint32_t > mem;
+  ValVector< uint32_t > block;
+  {
+    // The validated memories are allocated from the client's arena, which must live as long as they do
+    HwInterface hw = getHwInterface();
+    hw.getNode ( "REG" ).write ( x );
+    hw.getNode ( "SMALL_MEM" ).writeBlock ( xx );
+    mem = hw.getNode ( "REG" ).read();
+    block = hw.getNode ( "SMALL_MEM" ).readBlock ( xx.size() );
+    BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  }
+
+  BOOST_CHECK ( mem.valid() );
+  BOOST_CHECK_EQUAL ( mem.value(), x );
+  BOOST_REQUIRE ( block.valid() );
+  BOOST_CHECK ( std::equal ( block.begin(), block.end(), xx.begin() ) );
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(SingleReadWriteTestSuite, dispatch_async_write_read, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+
+  uint32_t x = static_cast<uint32_t> ( rand() );
+  // Large enough to be split over several packets
+  std::vector< uint32_t > xx ( 64 * 1024 );
+  for ( size_t i = 0; i != xx.size(); ++i )
+  {
+    xx.at ( i ) = static_cast<uint32_t> ( rand() );
+  }
+
+  hw.getNode ( "REG" ).write ( x );
+  hw.getNode ( "MEM" ).writeBlock ( xx );
+  ValWord< uint32_t > mem = hw.getNode ( "REG" ).read();
+  ValVector< uint32_t > block = hw.getNode ( "MEM" ).readBlock ( xx.size() );
+  std::future< void > lFuture = hw.dispatchAsync();
+
+  // Transactions queued after dispatchAsync are left for the next dispatch
+  ValWord< uint32_t > mem2 = hw.getNode ( "REG" ).read();
+  BOOST_CHECK_NO_THROW ( lFuture.get() );
+  BOOST_CHECK ( mem.valid() );
+  BOOST_CHECK_EQUAL ( mem.value(), x );
+  BOOST_REQUIRE ( block.valid() );
+  BOOST_CHECK ( std::equal ( block.begin(), block.end(), xx.begin() ) );
+  BOOST_CHECK ( !mem2.valid() );
+
+  BOOST_CHECK_NO_THROW ( hw.dispatchAsync().get() );
+  BOOST_CHECK ( mem2.valid() );
+  BOOST_CHECK_EQUAL ( mem2.value(), x );
+
+  // With nothing queued, the future is immediately ready
+  std::future< void > lEmptyFuture = hw.dispatchAsync();
+  BOOST_CHECK ( lEmptyFuture.wait_for ( std::chrono::seconds ( 0 ) ) == std::future_status::ready );
+  BOOST_CHECK_NO_THROW ( lEmptyFuture.get() );
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(SingleReadWriteTestSuite, coalesced_write_read, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface ( "coalesce=1" );
+  ClientInterface& lClient = hw.getClient();
+  const uint32_t lBaseAddr ( hw.getNode ( "MEM" ).getAddress() );
+  const uint32_t lInitialReadCount ( hwRunner.getTransactionCount ( READ ) );
+  const uint32_t lInitialWriteCount ( hwRunner.getTransactionCount ( WRITE ) );
+
+  // Long enough for the merged transactions to be split by the maximum word count and over several packets
+  std::vector< uint32_t > xx ( 2000 );
+  std::vector< ValWord< uint32_t > > lReads;
+  std::vector< ValWord< uint32_t > > lMaskedReads;
+  for ( size_t i = 0; i != xx.size(); ++i )
+  {
+    xx.at ( i ) = static_cast<uint32_t> ( rand() );
+    lClient.write ( lBaseAddr + i , xx.at ( i ) );
+  }
+
+  // Masked reads of consecutive addresses are merged too, with each mask applied to its own word
+  for ( size_t i = 0; i != xx.size(); ++i )
+  {
+    lReads.push_back ( lClient.read ( lBaseAddr + i ) );
+  }
+  for ( size_t i = 0; i != 300; ++i )
+  {
+    lMaskedReads.push_back ( lClient.read ( lBaseAddr + i , 0xFFFF0000 ) );
+  }
+
+  // A non-consecutive read and a single write in the middle of a run end it
+  ValWord< uint32_t > lReg = hw.getNode ( "REG" ).read();
+  hw.getNode ( "REG" ).write ( 0x12345678 );
+  ValWord< uint32_t > lRegAfter = hw.getNode ( "REG" ).read();
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+
+  for ( size_t i = 0; i != xx.size(); ++i )
+  {
+    BOOST_REQUIRE ( lReads.at ( i ).valid() );
+    BOOST_CHECK_EQUAL ( lReads.at ( i ).value() , xx.at ( i ) );
+  }
+  for ( size_t i = 0; i != lMaskedReads.size(); ++i )
+  {
+    BOOST_REQUIRE ( lMaskedReads.at ( i ).valid() );
+    BOOST_CHECK_EQUAL ( lMaskedReads.at ( i ).value() , xx.at ( i ) >> 16 );
+  }
+  BOOST_CHECK ( lReg.valid() );
+  BOOST_CHECK_EQUAL ( lRegAfter.value() , uint32_t ( 0x12345678 ) );
+
+  // Merged transactions are only split at the maximum word count and at the end of a packet, so there are far fewer transactions than accesses
+  BOOST_CHECK_LT ( hwRunner.getTransactionCount ( READ ) - lInitialReadCount , uint32_t ( 50 ) );
+  BOOST_CHECK_LT ( hwRunner.getTransactionCount ( WRITE ) - lInitialWriteCount , uint32_t ( 50 ) );
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(SingleReadWriteTestSuite, shadowed_write_read, DummyHardwareFixture,
+{
+  HwInterface hw = getHwInterface();
+  ClientInterface& lClient = hw.getClient();
+  const Node& lReg ( hw.getNode ( "SHADOWED.REG" ) );
+  const Node& lUpper ( hw.getNode ( "SHADOWED.REG_UPPER_MASK" ) );
+  const Node& lLower ( hw.getNode ( "SHADOWED.REG_LOWER_MASK" ) );
+
+  // Writes go through to the device, and later reads are served from the cache without waiting for a dispatch
+  const uint32_t x = static_cast<uint32_t> ( rand() );
+  ValHeader lWrite = lReg.write ( x );
+  ValWord< uint32_t > lCached = lReg.read();
+  BOOST_CHECK ( lCached.valid() );
+  BOOST_CHECK_EQUAL ( lCached.value() , x );
+
+  // The first read of a register which has not been cached goes to the device
+  ValWord< uint32_t > lMiss = lLower.read();
+  BOOST_CHECK ( !lMiss.valid() );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK ( lWrite.valid() );
+  BOOST_CHECK ( lMiss.valid() );
+  ValWord< uint32_t > lDevice = lClient.read ( lReg.getAddress() );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK_EQUAL ( lDevice.value() , x );
+
+  // Masked writes are composed against the cached value
+  lLower.write ( 0x1234 );
+  lUpper.write ( 0xABCD );
+  ValWord< uint32_t > lComposed = lUpper.read();
+  BOOST_CHECK ( lComposed.valid() );
+  BOOST_CHECK_EQUAL ( lComposed.value() , uint32_t ( 0xABCD ) );
+  ValWord< uint32_t > lComposedDevice = lClient.read ( lUpper.getAddress() );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK_EQUAL ( lComposedDevice.value() , uint32_t ( 0xABCD1234 ) );
+
+  // Changes made behind the cache's back are only seen after a refresh or invalidate
+  lClient.write ( lReg.getAddress() , 0x55 );
+  lClient.write ( lLower.getAddress() , 0x66 );
+  BOOST_CHECK_NO_THROW ( lClient.dispatch() );
+  BOOST_CHECK_EQUAL ( lReg.read().value() , x );
+  BOOST_CHECK_EQUAL ( lLower.read().value() , uint32_t ( 0x1234 ) );
+  hw.refresh ( hw.getNode ( "SHADOWED" ) );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK_EQUAL ( lReg.read().value() , uint32_t ( 0x55 ) );
+  BOOST_CHECK_EQUAL ( lLower.read().value() , uint32_t ( 0x66 ) );
+
+  lClient.write ( lReg.getAddress() , 0x77 );
+  BOOST_CHECK_NO_THROW ( lClient.dispatch() );
+  hw.invalidate ( hw.getNode ( "SHADOWED" ) );
+  ValWord< uint32_t > lInvalidated = lReg.read();
+  BOOST_CHECK ( !lInvalidated.valid() );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK_EQUAL ( lInvalidated.value() , uint32_t ( 0x77 ) );
+}
+)
+
+
 } // end ns tests
 } // end ns uhal
 
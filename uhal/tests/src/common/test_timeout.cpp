@@ -37,6 +37,7 @@
 
 #include <chrono>
 #include <cstdlib>
+#include <future>
 #include <iostream>
 #include <thread>
 #include <typeinfo>
@@ -81,5 +82,56 @@ UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(TimeoutTestSuite, check_timeout, DummyHardwa
 )
 
 
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(TimeoutTestSuite, check_timeout_async, DummyHardwareFixture,
+{
+  hwRunner.setReplyDelay( std::chrono::milliseconds(timeout) + std::chrono::seconds(1) );
+  HwInterface hw = getHwInterface();
+
+  // Check the timeout surfaces through the future returned by dispatchAsync
+  hw.getNode ( "REG" ).read();
+  std::future< void > lFuture = hw.dispatchAsync();
+  BOOST_CHECK_THROW ( lFuture.get() , uhal::exception::ClientTimeout );
+
+  const std::chrono::milliseconds sleepDuration = std::chrono::milliseconds(timeout) + std::chrono::seconds(1);
+  BOOST_TEST_MESSAGE("Sleeping for " << sleepDuration.count() << "ms to allow DummyHardware to clear itself");
+  std::this_thread::sleep_for(sleepDuration);
+  // Check the exception is not thrown a second time, and that we can continue as normal
+  uint32_t x = static_cast<uint32_t> ( rand() );
+  ValWord<uint32_t> y;
+  BOOST_CHECK_NO_THROW (
+    hw.getNode ( "REG" ).write ( x );
+    y = hw.getNode ( "REG" ).read();
+    hw.dispatch();
+  );
+  BOOST_CHECK ( x == y );
+}
+)
+
+
+UHAL_TESTS_DEFINE_CLIENT_TEST_CASES(TimeoutTestSuite, check_timeout_async_shadowed, DummyHardwareFixture,
+{
+  hwRunner.setReplyDelay( std::chrono::milliseconds(timeout) + std::chrono::seconds(1) );
+  HwInterface hw = getHwInterface();
+  const Node& lReg ( hw.getNode ( "SHADOWED.REG" ) );
+
+  // A value written through the cache may never have reached the device if the dispatch fails, so it must not be served from the cache afterwards
+  lReg.write ( static_cast<uint32_t> ( rand() ) );
+  std::future< void > lFuture = hw.dispatchAsync();
+  BOOST_CHECK_THROW ( lFuture.get() , uhal::exception::ClientTimeout );
+  ValWord< uint32_t > lDropped = lReg.read();
+  BOOST_CHECK ( ! lDropped.valid() );
+
+  const std::chrono::milliseconds sleepDuration = std::chrono::milliseconds(timeout) + std::chrono::seconds(1);
+  BOOST_TEST_MESSAGE("Sleeping for " << sleepDuration.count() << "ms to allow DummyHardware to clear itself");
+  std::this_thread::sleep_for(sleepDuration);
+  // The register is read from the device instead
+  ValWord< uint32_t > lDevice = hw.getClient().read ( lReg.getAddress() );
+  BOOST_CHECK_NO_THROW ( hw.dispatch() );
+  BOOST_CHECK ( lDropped.valid() );
+  BOOST_CHECK_EQUAL ( lDropped.value() , lDevice.value() );
+}
+)
+
+
 } // end ns tests
 } // end ns uhal
@@ -35,7 +35,9 @@
 #include "uhal/tests/tools.hpp"
 
 
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
 #include <fcntl.h>
 #include <vector>
 
@@ -64,6 +66,21 @@ void DummyHardwareRunner::setReplyDelay(const std::chrono::microseconds& aDelay)
   mHw->setReplyDelay(aDelay);
 }
 
+uint32_t DummyHardwareRunner::getTransactionCount(const IPbusTransactionType aType) const
+{
+  return mHw->getTransactionCount(aType);
+}
+
+void DummyHardwareRunner::setMtu(const uint32_t aMtu)
+{
+  mHw->setMtu(aMtu);
+}
+
+uint32_t DummyHardwareRunner::getMaxRequestByteCount() const
+{
+  return mHw->getMaxRequestByteCount();
+}
+
 
 double measureReadLatency(ClientInterface& aClient, uint32_t aBaseAddr, uint32_t aDepth, size_t aNrIterations, bool aDispatchEachIteration, bool aVerbose)
 {
@@ -188,5 +205,37 @@ double measureFileWriteLatency(const std::string& aFilePath, uint32_t aBaseAddr,
 }
 
 
+
+bool writeAndReadBack(HwInterface& aHw, const std::string& aNodeId, const size_t aBlockSize, const size_t aNrSingleWords, const uint32_t aOffset)
+{
+  std::vector<uint32_t> xx(aBlockSize);
+  for (size_t i = 0; i < aBlockSize; i++)
+    xx.at(i) = static_cast<uint32_t> ( rand() );
+
+  const Node& lNode = aHw.getNode ( aNodeId );
+  const uint32_t lSingleWordsAddr = lNode.getAddress() + aOffset + aBlockSize;
+  lNode.writeBlockOffset ( xx, aOffset );
+  for (size_t i = 0; i < aNrSingleWords; i++)
+    aHw.getClient().write ( lSingleWordsAddr + i, ~uint32_t(i) );
+  aHw.dispatch();
+
+  ValVector< uint32_t > yy = lNode.readBlockOffset ( aBlockSize, aOffset );
+  std::vector< ValWord< uint32_t > > lSingleWords;
+  for (size_t i = 0; i < aNrSingleWords; i++)
+    lSingleWords.push_back ( aHw.getClient().read ( lSingleWordsAddr + i ) );
+  aHw.dispatch();
+
+  if ( (not yy.valid()) or (not std::equal ( yy.begin(), yy.end(), xx.begin() )) )
+    return false;
+
+  for (size_t i = 0; i < aNrSingleWords; i++) {
+    if ( (not lSingleWords.at(i).valid()) or (lSingleWords.at(i).value() != ~uint32_t(i)) )
+      return false;
+  }
+
+  return true;
+}
+
+
 } // end ns tests
 } // end ns uhal
@@ -0,0 +1,156 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+/**
+	@file
+*/
+
+#ifndef _uhal_BufferPool_hpp_
+#define _uhal_BufferPool_hpp_
+
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+namespace uhal
+{
+  class Buffers;
+
+  /**
+    A lock-free pool of pre-allocated Buffers, shared between the user thread (which takes buffers, fills them and returns them on error) and the transport-layer thread (which returns them after validation).
+    Implemented as a ring of slots, each with a sequence number, so that buffers can be put and taken concurrently without a mutex; buffers are moved in and out of the slots, so the pool itself never touches the shared_ptr reference counts.
+    Buffers that do not fit in the ring (i.e. created because more were in circulation than the ring holds) are kept in a mutex-protected overflow list, and the ring is enlarged to hold them the next time that every buffer is back in the pool, so that the ring tracks the high-water mark of buffers in circulation.
+  */
+  class BufferPool
+  {
+    public:
+      BufferPool();
+
+      BufferPool ( const BufferPool& ) = delete;
+      BufferPool& operator= ( const BufferPool& ) = delete;
+
+      ~BufferPool();
+
+      /**
+        Create the pool's slots, and fill aCapacity of them with newly-created buffers
+        @param aCapacity the number of buffers to create; the pool can hold this number rounded up to the next power of two
+        @param aMaxSendSize the size of each buffer's send buffer
+        @warning Not thread safe - must only be called while no other thread is accessing the pool
+      */
+      void allocate ( const size_t aCapacity , const uint32_t aMaxSendSize );
+
+      /**
+        Destroy all buffers in the pool, and the pool's slots, so that the pool must be allocated again before it is used; buffers still in circulation are released rather than returned
+        @warning Not thread safe - must only be called while no other thread is accessing the pool
+      */
+      void clear();
+
+      /**
+        Return the number of buffers that the pool can hold
+        @return the pool's capacity; 0 until allocate has been called
+      */
+      size_t capacity() const;
+
+      /**
+        Move a buffer into the pool (into the overflow list if the ring is full)
+        @param aBuffers the buffer; reset if it was moved into the pool, and left unchanged if the pool has not been allocated
+        @return whether the buffer was moved into the pool
+      */
+      bool put ( std::shared_ptr< Buffers >& aBuffers );
+
+      /**
+        Move a buffer out of the pool, creating a new one if the pool is empty
+        @param aBuffers set to the buffer taken from the pool, or to a newly-created buffer
+        @return whether a buffer was taken from the pool, rather than created
+        @warning Must only be called by one thread at a time
+      */
+      bool take ( std::shared_ptr< Buffers >& aBuffers );
+
+    private:
+      /**
+        Replace the ring with one that holds (only) the given buffers
+        @param aBuffers the buffers to move into the ring
+      */
+      void fill ( std::vector< std::shared_ptr< Buffers > >& aBuffers );
+
+      //! Replace the ring with one large enough to also hold the buffers in the overflow list; only called once every buffer is back in the pool
+      void grow();
+
+      //! Move a buffer into the ring, if it is not full
+      bool putIntoRing ( std::shared_ptr< Buffers >& aBuffers );
+
+      //! Move a buffer out of the ring, if it is not empty
+      bool takeFromRing ( std::shared_ptr< Buffers >& aBuffers );
+
+      //! A slot in the pool's ring
+      struct Slot
+      {
+        //! Tells putters and takers whether this slot is free for the current lap around the ring
+        std::atomic< size_t > sequence;
+        //! The buffer stored in the slot
+        std::shared_ptr< Buffers > buffers;
+      };
+
+      //! The ring of slots
+      std::unique_ptr< Slot[] > mSlots;
+      //! The number of slots minus one; the number of slots is always a power of two
+      size_t mMask;
+      //! Position at which the next buffer will be put
+      std::atomic< size_t > mPutPosition;
+      //! Keeps the put and take positions on separate cache lines, since they are updated by different threads
+      char mPadding[64];
+      //! Position from which the next buffer will be taken
+      std::atomic< size_t > mTakePosition;
+
+      //! The size of each buffer's send buffer
+      uint32_t mMaxSendSize;
+      //! The number of buffers that have been created and not yet destroyed by the pool, i.e. those in the pool plus those in circulation; only accessed by the taking thread
+      size_t mNrCreated;
+      //! The number of buffers in the pool (in the ring or the overflow list); only incremented once a buffer has been completely put
+      std::atomic< size_t > mNrPooled;
+
+      //! Mutex for the overflow list
+      std::mutex mOverflowMutex;
+      //! Buffers put into the pool while the ring was full
+      std::vector< std::shared_ptr< Buffers > > mOverflow;
+      //! The size of the overflow list, so that it can be checked without locking the mutex
+      std::atomic< size_t > mNrOverflow;
+  };
+
+}
+
+#endif
@@ -41,6 +41,7 @@
 
 
 #include <deque>
+#include <memory>           // for shared_ptr
 #include <stdint.h>         // for uint32_t, uint8_t
 #include <utility>          // for pair
 #include <vector>           // for vector
@@ -102,6 +103,15 @@ namespace uhal
       */
       uint8_t* send ( const uint8_t* aPtr , const uint32_t& aSize );
 
+      /**
+      	Helper function to add a block of memory to the send buffer by reference, rather than by copy; the transport sends the bytes directly from that memory
+      	The space is still reserved in the contiguous send buffer (but left unwritten), so that offsets into the send buffer match offsets into the packet as sent
+      	@param aPtr a pointer to the start of the memory to be sent
+      	@param aSize the number of bytes to be sent
+      	@param aOwner an object which keeps the memory alive until this buffer has been cleared
+      */
+      void send ( const uint8_t* aPtr , const uint32_t& aSize , const std::shared_ptr< const void >& aOwner );
+
       /**
       	Helper function to add a destination object to the reply queue
       	@param aPtr a pointer to some persistent object which can be written to when the transaction is performed
@@ -147,6 +157,12 @@ namespace uhal
       */
       uint8_t* getSendBuffer();
 
+      /**
+      	Get the contents of the packet to be sent, as a list of contiguous memory segments (an iovec-style gather list); bytes added by reference are taken from the caller's memory, all others from the send buffer
+      	@return a reference to the list of segments, each as a pointer and a number of bytes
+      */
+      const std::vector< std::pair< const uint8_t* , uint32_t > >& getSendSegments();
+
       /**
       	Get a reference to the reply queue
       	@return a reference to the reply queue
@@ -167,15 +183,21 @@ namespace uhal
 
       //! The start location of the memory buffer
       std::vector<uint8_t> mSendBuffer;
+      //! The blocks of memory that have been added to the send buffer by reference, each as an offset into the send buffer, a pointer and a number of bytes
+      std::vector< std::pair< uint32_t , std::pair< const uint8_t* , uint32_t > > > mSendReferences;
+      //! Objects keeping the memory referenced by mSendReferences alive
+      std::vector< std::shared_ptr< const void > > mSendReferenceOwners;
+      //! The gather list returned by getSendSegments
+      std::vector< std::pair< const uint8_t* , uint32_t > > mSendSegments;
       //! The queue of reply destinations
       std::deque< std::pair< uint8_t* , uint32_t > > mReplyBuffer;
 
-      //! Deque holding validated memories so that they are guaranteed to exist when the transaction is performed
-      std::deque< ValHeader > mValHeaders;
-      //! Deque holding validated memories so that they are guaranteed to exist when the transaction is performed
-      std::deque< ValWord< uint32_t > > mUnsignedValWords;
-      //! Deque holding validated memories so that they are guaranteed to exist when the transaction is performed
-      std::deque< ValVector< uint32_t > > mUnsignedValVectors;
+      //! Vector holding validated memories so that they are guaranteed to exist when the transaction is performed (a vector, so that its capacity survives clear() when the buffer is recycled)
+      std::vector< ValHeader > mValHeaders;
+      //! Vector holding validated memories so that they are guaranteed to exist when the transaction is performed
+      std::vector< ValWord< uint32_t > > mUnsignedValWords;
+      //! Vector holding validated memories so that they are guaranteed to exist when the transaction is performed
+      std::vector< ValVector< uint32_t > > mUnsignedValVectors;
   };
 
 }
@@ -52,6 +52,9 @@
 
 namespace uhal
 {
+  // Forward declarations
+  class IOservicePool;
+
   namespace exception
   {
     //! Exception class to handle the case where the protocol requested does not exists in the creator map.
@@ -110,6 +113,19 @@ namespace uhal
       */
       std::shared_ptr<ClientInterface> getClient ( const std::string& aId , const std::string& aUri, const std::vector<std::string>& aUserClientActivationList );
 
+      /**
+        Configure whether the socket-based (UDP & TCP) clients that are created from now on share a pool of I/O threads, or each run their own I/O thread (the default)
+        @param aNrThreads the number of threads in the shared pool; 0 reverts to one I/O thread per client
+        @note Clients which have already been created are unaffected, and keep the pool that they were created with alive
+      */
+      void setSharedIOservicePool ( const size_t aNrThreads );
+
+      /**
+        Return the pool of I/O threads that a newly-created socket-based client should attach to
+        @return a shared pointer to the shared pool if one has been configured, otherwise to a new single-threaded pool that is private to the client
+      */
+      std::shared_ptr<IOservicePool> getIOservicePool() const;
+
       /**
         Method to create an associate between a protocol identifier and a Creator of a particular type
         @param aProtocol the protocol identifier
@@ -198,6 +214,8 @@ namespace uhal
       static std::shared_ptr<ClientFactory> mInstance;
       //! Hash map associating a creator for a particular protocol with a file name
       std::unordered_map< std::string , ClientInfo > mClientMap; //map string name of each protocol to a creator for that protocol
+      //! The pool of I/O threads shared by socket-based clients; null if each client runs its own I/O thread
+      std::shared_ptr<IOservicePool> mSharedIOservicePool;
   };
 
 }
@@ -42,6 +42,9 @@
 
 
 #include <deque>
+#include <exception>
+#include <functional>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <stdint.h>
@@ -52,9 +55,11 @@
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include "uhal/grammars/URI.hpp"
+#include "uhal/BufferPool.hpp"
 #include "uhal/log/exception.hpp"
 #include "uhal/definitions.hpp"
 #include "uhal/ValMem.hpp"
+#include "uhal/ValMemArena.hpp"
 
 
 namespace uhal
@@ -94,6 +99,9 @@ namespace uhal
     UHAL_DEFINE_EXCEPTION_CLASS ( TransportLayerError, "Base exception class covering non-timeout transport-layer-specific errors.")
 
     UHAL_DEFINE_EXCEPTION_CLASS ( InvalidURI, "Exception class for invalid URIs." )
+
+    //! Exception class to handle the case where the transactions of an asynchronous dispatch were discarded before their replies were validated.
+    UHAL_DEFINE_EXCEPTION_CLASS ( DispatchAbandoned, "Exception class to handle the case where the transactions of an asynchronous dispatch were discarded before their replies were validated." )
   }
 
   //! An abstract base class for defining the interface to the various IPbus clients as well as providing the generalized packing functionality
@@ -149,6 +157,13 @@ namespace uhal
       //! Method to dispatch all queued transactions, and wait until all corresponding responses have been received
       void dispatch ();
 
+      /**
+      	Method to dispatch all queued transactions without waiting for the corresponding responses, so that a single thread can drive many clients concurrently
+      	Transactions queued after this call are not covered by the returned future; they are sent by a later dispatch (or dispatchAsync)
+      	@return a future which becomes ready once the responses to all transactions dispatched so far have been validated, or which holds the exception that caused the dispatch to fail
+      */
+      std::future< void > dispatchAsync ();
+
       /**
       	A method to modify the timeout period for any pending or future transactions
         @warning Protected by user mutex, so only for use from user side (not from client code)
@@ -196,6 +211,14 @@ namespace uhal
       */
       ValHeader writeBlock ( const uint32_t& aAddr, const std::vector< uint32_t >& aValues, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
 
+      /**
+      	Write a block of data to a block of registers or a block-write port, taking ownership of the data so that it can be sent without being copied into the send buffers
+      	@param aAddr the address of the register to write
+      	@param aValues the values to write to the registers or a block-write port
+      	@param aMode whether we are writing to a block of registers (INCREMENTAL) or a block-write port (NON_INCREMENTAL)
+      */
+      ValHeader writeBlock ( const uint32_t& aAddr, std::vector< uint32_t >&& aValues, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
+
       /**
       	Read a single, unmasked, unsigned word
       	@param aAddr the address of the register to read
@@ -220,6 +243,17 @@ namespace uhal
       */
       ValVector< uint32_t > readBlock ( const uint32_t& aAddr, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
 
+      /**
+      	Read a block of unsigned data from a block of registers or a block-read port directly into memory owned by the caller, avoiding the allocation and copy made by readBlock
+      	The destination must stay valid, and must not be accessed, until the dispatch that sends this transaction has returned (or thrown); the data is only meaningful if the returned Validated Header is valid
+      	@param aAddr the lowest address in the block of registers or the address of the block-read port
+      	@param aDestination the memory into which the reply data is to be written; must hold at least aSize words
+      	@param aSize the number of words to read
+      	@param aMode whether we are reading from a block of registers (INCREMENTAL) or a block-read port (NON_INCREMENTAL)
+      	@return a Validated Header which will be marked valid once the reply data has been written to the destination
+      */
+      ValHeader readBlockInto ( const uint32_t& aAddr, uint32_t* aDestination, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
+
       /**
       	Read the value of a register, apply the AND-term, apply the OR-term, set the register to this new value and return a copy of the original value to the user
       	@param aAddr the address of the register to read, modify, write
@@ -247,6 +281,12 @@ namespace uhal
       //! Virtual function to dispatch all buffers and block until all replies are received
       virtual void Flush( );
 
+      /**
+        Virtual function to start sending all dispatched buffers, without waiting for the replies
+        @return whether the replies are validated in the background; if not, the replies are only collected by Flush
+      */
+      virtual bool startFlush( );
+
 
       //! Send a byte order transaction
       virtual ValHeader implementBOT( ) = 0;
@@ -266,6 +306,14 @@ namespace uhal
       */
       virtual ValHeader implementWriteBlock ( const uint32_t& aAddr, const std::vector< uint32_t >& aValues, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL ) = 0;
 
+      /**
+      Write a block of data, which is shared with the buffers rather than copied into them, to a block of registers or a block-write port
+      @param aAddr the address of the register to write
+      @param aValues the values to write to the registers or a block-write port
+      @param aMode whether we are writing to a block of registers (INCREMENTAL) or a block-write port (NON_INCREMENTAL)
+      */
+      virtual ValHeader implementWriteBlock ( const uint32_t& aAddr, const std::shared_ptr< const std::vector< uint32_t > >& aValues, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL ) = 0;
+
       /**
       Read a single, masked, unsigned word
       @param aAddr the address of the register to read
@@ -283,6 +331,16 @@ namespace uhal
       */
       virtual ValVector< uint32_t > implementReadBlock ( const uint32_t& aAddr, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL ) = 0;
 
+      /**
+      Read a block of unsigned data from a block of registers or a block-read port into memory owned by the caller
+      @param aAddr the lowest address in the block of registers or the address of the block-read port
+      @param aDestination the memory into which the reply data is to be written
+      @param aSize the number of words to read
+      @param aMode whether we are reading from a block of registers (INCREMENTAL) or a block-read port (NON_INCREMENTAL)
+      @return a Validated Header which will contain the returned IPbus headers
+      */
+      virtual ValHeader implementReadBlockInto ( const uint32_t& aAddr, uint32_t* aDestination, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL ) = 0;
+
 
       /**
       Read the value of a register, apply the AND-term, apply the OR-term, set the register to this new value and return a copy of the new value to the user
@@ -293,6 +351,15 @@ namespace uhal
       */
       virtual ValWord< uint32_t > implementRMWbits ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm ) = 0;
 
+      /**
+      Write a single, masked word to a register, as a read-modify-write of the register's bits
+      @param aAddr the address of the register to write
+      @param aANDterm the AND-term which clears the bits covered by the mask
+      @param aORterm the OR-term containing the shifted, masked value
+      @return a Validated Header which will be marked valid once the write has been acknowledged
+      */
+      virtual ValHeader implementMaskedWrite ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm );
+
       /**
       Read the value of a register, add the addend, set the register to this new value and return a copy of the new value to the user
       @param aAddr the address of the register to read, modify, write
@@ -359,6 +426,12 @@ namespace uhal
       //! Function which is called when an exception is thrown
       virtual void dispatchExceptionHandler();
 
+      /**
+        Function which the transport layer calls when an asynchronous exception is raised, to fail any outstanding asynchronous dispatches
+        @param aExc the exception which caused the dispatch to fail
+      */
+      void failPendingDispatches ( exception::exception& aExc );
+
       /**
         Function to return a buffer to the buffer pool
         @param aBuffers a shared-pointer to a buffer to be returned to the buffer pool
@@ -382,22 +455,37 @@ namespace uhal
 
     private:
       /**
-        If the current buffer is null, allocate a buffer from the buffer pool for it
-        If the buffer pool is empty, create 10 new buffers
+        If the current buffer is null, take a buffer from the buffer pool for it
+        On first use, the pool is filled with enough buffers for the maximum number of packets in flight; if it is empty, a new buffer is created
       */
       void updateCurrentBuffers();
       void deleteBuffers();
 
+      //! Record that a buffer has been passed to implementDispatch
+      void countDispatchedBuffer();
+
+      /**
+        If an asynchronous exception has already been reported through the future returned by dispatchAsync, clean up after it (once), rather than rethrowing it on the next dispatch
+        Transactions queued since the last dispatch are kept
+      */
+      void recoverFromReportedFailure();
+
+      /**
+        Register a function to be called (from whichever thread detects it, with mPendingDispatchMutex locked) whenever a dispatch fails, before the failure is reported
+        @param aHandler the function, which must not block or access this client
+      */
+      void addDispatchFailureHandler ( const std::function< void () >& aHandler );
+
+      //! Call the functions registered through addDispatchFailureHandler; to be called with mPendingDispatchMutex locked
+      void notifyDispatchFailure();
+
 
     private:
       //! A MutEx lock used to make sure the access functions are thread safe
       std::mutex mUserSideMutex;
       
-      //! A MutEx lock used to make sure the access to the buffers is thread safe
-      std::mutex mBufferMutex;
-
       //! A memory pool of buffers which will be dispatched
-      std::deque < std::shared_ptr< Buffers > > mBuffers;
+      BufferPool mBuffers;
 
 #ifdef NO_PREEMPTIVE_DISPATCH
       //! A deque to store buffers pending dispatch for the case where pre-emptive dispatch is disabled
@@ -407,6 +495,30 @@ namespace uhal
       //! A pointer to a buffer-wrapper object
       std::shared_ptr< Buffers > mCurrentBuffers;
 
+      //! A MutEx lock used to protect the bookkeeping of asynchronous dispatches, which is shared with the thread that validates the replies
+      std::mutex mPendingDispatchMutex;
+
+      //! The number of buffers passed to implementDispatch since the last dispatch exception
+      uint64_t mNrDispatchedBuffers;
+
+      //! The number of buffers whose replies have been validated since the last dispatch exception
+      uint64_t mNrValidatedBuffers;
+
+      //! Promises returned by dispatchAsync, each with the number of validated buffers at which it is fulfilled
+      std::deque< std::pair< uint64_t , std::promise< void > > > mPendingDispatches;
+
+      //! The asynchronous exception which has not yet been cleaned up by the dispatch exception handler, if any
+      std::exception_ptr mDispatchFailure;
+
+      //! Whether mDispatchFailure has been reported through the future returned by dispatchAsync
+      bool mDispatchFailureReported;
+
+      //! Functions called whenever a dispatch fails, e.g. to drop values cached on the assumption that queued writes would reach the device
+      std::vector< std::function< void () > > mDispatchFailureHandlers;
+
+      //! The arena from which the validated memories returned by this client are allocated
+      std::shared_ptr< ValMemArena > mValMemArena;
+
       //! the identifier of the target for this client
       std::string mId;
 
@@ -450,6 +562,12 @@ namespace uhal
         @return the maximum size of reply packet
       */
       virtual uint32_t getMaxReplySize() = 0;
+
+      /**
+        Called before the buffers are first allocated (and again once an exception has caused them to be discarded), so that
+        the values returned by getMaxNumberOfBuffers, getMaxSendSize and getMaxReplySize can be obtained from the target
+      */
+      virtual void queryTargetCapacity();
   };
 
 }
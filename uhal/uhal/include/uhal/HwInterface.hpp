@@ -40,13 +40,18 @@
 #define _uhal_HwInterface_hpp_
 
 
+#include <atomic>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <stdint.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "uhal/ClientInterface.hpp" // IWYU pragma: keep
 #include "uhal/Node.hpp"            // IWYU pragma: keep
+#include "uhal/ValMem.hpp"
 
 
 namespace uhal
@@ -92,9 +97,15 @@ namespace uhal
       const std::string& id() const;
 
 
-      //! Make the IPbus client issue a dispatch
+      //! Make the IPbus client issue a dispatch; if this (or any other dispatch by the client) fails, the shadow register cache is invalidated
       void dispatch ();
 
+      /**
+      	Make the IPbus client issue a dispatch without waiting for the replies
+      	@return a future which becomes ready once all replies have been validated, or which holds the exception that caused the dispatch to fail (in which case the shadow register cache has been invalidated)
+      */
+      std::future< void > dispatchAsync ();
+
       /**
       	A method to modify the timeout period for any pending or future transactions
       	@param aTimeoutPeriod the desired timeout period in milliseconds
@@ -146,18 +157,95 @@ namespace uhal
       */
       std::vector<std::string> getNodes ( const std::string& aRegex ) const;
 
+      /**
+      	Drop the cached values of all shadowed registers in a branch of the node tree, so that they are next read from the device
+      	@param aNode the node at the top of the branch
+      */
+      void invalidate ( const Node& aNode );
+
+      //! Drop the cached values of all shadowed registers
+      void invalidate ();
+
+      /**
+      	Queue block reads of all shadowed registers in a branch of the node tree, which replace the cached values once dispatched
+      	@param aNode the node at the top of the branch
+      */
+      void refresh ( const Node& aNode );
+
     private:
+      friend class Node;
+
+      //! The cached value of a shadowed register, which may still be awaiting the reply to a single-word or block read
+      struct ShadowRegister
+      {
+        //! The register value, if known or awaiting the reply to a single-word read
+        ValWord< uint32_t > word;
+        //! A block read containing the register value, if awaiting a refresh
+        ValVector< uint32_t > block;
+        //! The index of the register within the block read
+        uint32_t offset;
+      };
+
+      //! The shadow register cache, shared between copies of a HwInterface since they share the client
+      struct ShadowCache
+      {
+        ShadowCache();
+
+        //! Drop the cached values if a dispatch has failed since they were last dropped; to be called with the mutex locked
+        void dropIfStale();
+
+        //! A mutex protecting the cached values
+        std::mutex mutex;
+        //! The cached values, indexed by register address
+        std::unordered_map< uint32_t , ShadowRegister > registers;
+        //! Set by the client (from whichever thread detects it) when a dispatch fails, since the cached values written through may never have reached the device
+        std::atomic< bool > stale;
+      };
+
       /**
       	A function which sets the HwInterface pointer in the Node to point to this HwInterface
       	@param aNode a Node that is to be claimed
       */
       void claimNode ( Node& aNode );
 
+      /**
+      	Read a shadowed node, returning the cached value if known, and otherwise queuing a read which also updates the cache
+      	@param aNode the node to be read
+      	@return a Validated Memory which wraps the location to which the reply data is to be written
+      */
+      ValWord< uint32_t > readShadowed ( const Node& aNode );
+
+      /**
+      	Write a shadowed node and update the cached value; masked writes to registers whose value is known are composed against the cached value and sent as plain writes
+      	@param aNode the node to be written
+      	@param aValue the value to be written
+      	@return a ValHeader which wraps the location to which the reply data is to be written
+      */
+      ValHeader writeShadowed ( const Node& aNode , const uint32_t& aValue );
+
+      /**
+      	Drop the cached values of a range of registers, e.g. before they are overwritten by a block write
+      	@param aAddr the address of the first register
+      	@param aSize the number of registers
+      */
+      void dropShadowed ( const uint32_t& aAddr , const uint32_t& aSize );
+
+      /**
+      	Retrieve the value of a cached register, if known
+      	@param aRegister the cached register
+      	@param aValue set to the value of the register, if known
+      	@return whether the value of the register is known
+      */
+      static bool getShadowedValue ( ShadowRegister& aRegister , uint32_t& aValue );
+
       //! A shared pointer to the IPbus client through which the transactions will be sent
       std::shared_ptr<ClientInterface> mClientInterface;
 
       //! A node tree
       std::shared_ptr<Node> mNode;
+
+      //! The cached values of registers whose nodes have the "shadow" parameter set (or inherit it)
+      std::shared_ptr<ShadowCache> mShadowCache;
   };
 
 }
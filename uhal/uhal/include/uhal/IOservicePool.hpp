@@ -0,0 +1,107 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+/**
+	@file
+*/
+
+#ifndef _uhal_IOservicePool_hpp_
+#define _uhal_IOservicePool_hpp_
+
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+
+
+namespace uhal
+{
+
+  /**
+    A pool of boost::asio::io_service instances, each run by its own worker thread, onto which socket-based clients attach their sockets and timers.
+    Every client is bound to a single io_service (assigned round-robin), so all of a client's handlers run on the same thread, exactly as they would with a private io_service.
+  */
+  class IOservicePool
+  {
+    public:
+      /**
+        Constructor
+        @param aNrThreads the number of io_service instances (and hence worker threads) in the pool; must be at least 1
+      */
+      IOservicePool ( const size_t aNrThreads );
+
+      IOservicePool ( const IOservicePool& ) = delete;
+      IOservicePool& operator= ( const IOservicePool& ) = delete;
+
+      //! Destructor; stops all io_service instances and joins the worker threads
+      ~IOservicePool();
+
+      /**
+        Return the number of worker threads in the pool
+        @return the number of worker threads in the pool
+      */
+      size_t size() const;
+
+      /**
+        Return the io_service to which the next client should attach (assigned round-robin)
+        @return a reference to one of the pool's io_service instances
+      */
+      boost::asio::io_service& getIOservice();
+
+      /**
+        Run a function on the thread which services an io_service, then block until that function, and every handler which was queued while it ran (e.g. handlers aborted by closing a socket or cancelling a timer), has completed
+        Used by clients to tidy up their asynchronous operations on destruction, since an io_service that is shared with other clients cannot simply be stopped
+        @param aIOservice the io_service on whose thread the function should be run
+        @param aFunction the function to run
+        @warning Must not be called from the thread which services aIOservice
+      */
+      static void drain ( boost::asio::io_service& aIOservice , const std::function< void () >& aFunction );
+
+    private:
+      //! The io_service instances
+      std::vector< std::unique_ptr< boost::asio::io_service > > mIOservices;
+      //! Work objects which stop the io_service instances from returning when they run out of handlers
+      std::vector< std::unique_ptr< boost::asio::io_service::work > > mIOserviceWork;
+      //! The worker threads, one per io_service
+      std::vector< std::thread > mThreads;
+      //! Index of the io_service that will be assigned to the next client
+      std::atomic< size_t > mNextIOservice;
+  };
+
+}
+
+#endif
@@ -42,6 +42,7 @@
 
 
 #include <iterator>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
@@ -279,6 +280,13 @@ namespace uhal
       */
       ValHeader writeBlock ( const std::vector< uint32_t >& aValues ) const;
 
+      /**
+        Write a block of data to a block of registers or a block-write port, taking ownership of the data so that it can be sent without being copied into the send buffers
+        @param aValues the values to write to the registers or a block-write port
+        @return a Validated Header which will contain the returned IPbus header
+      */
+      ValHeader writeBlock ( std::vector< uint32_t >&& aValues ) const;
+
       /**
         Write a block of data to a block of registers or a block-write port
         @param aValues the values to write to the registers or a block-write port
@@ -308,6 +316,15 @@ namespace uhal
       */
       ValVector< uint32_t > readBlockOffset ( const uint32_t& aSize , const uint32_t& aOffset ) const;
 
+      /**
+        Read a block of unsigned data from a block of registers or a block-read port directly into memory owned by the caller, avoiding the allocation and copy made by readBlock
+        The destination must stay valid, and must not be accessed, until the dispatch that sends this transaction has returned (or thrown)
+        @param aDestination the memory into which the reply data is to be written; must hold at least aSize words
+        @param aSize the number of words to read
+        @return a Validated Header which will be marked valid once the reply data has been written to the destination
+      */
+      ValHeader readBlockInto ( uint32_t* aDestination , const uint32_t& aSize ) const;
+
       /**
       	Get the underlying IPbus client
       	@return the IPbus client that will be used to issue a dispatch
@@ -322,59 +339,90 @@ namespace uhal
 
     private:
 
-      std::string getRelativePath(const Node& aAncestor) const;
+      //! The address table properties of a node; immutable once the node tree has been built, so that they can be shared between copies of the tree
+      struct Properties
+      {
+        //! Default properties of an empty node
+        Properties();
 
-      //! Get the full path to the current node
-      void getAncestors ( std::deque< const Node* >& aPath ) const;
+        //! The Unique ID of this node
+        std::string mUid;
 
-    private:
+        //! The register address with which this node is associated
+        uint32_t mPartialAddr;
+        //! The register address with which this node is associated
+        uint32_t mAddr;
 
-      //! The parent hardware interface of which this node is a child (or rather decendent)
-      HwInterface* mHw;
+        //! The mask to be applied if this node is a sub-field, rather than an entire register
+        uint32_t mMask;
+        //! The read/write access permissions of this node
+        defs::NodePermission mPermission;
+        //! Whether the node represents a single register, a block of registers or a block-read/write port
+        defs::BlockReadWriteMode mMode;
+        //! The maximum size available to a block read/write
+        uint32_t mSize;
 
-      //! The Unique ID of this node
-      std::string mUid;
+        //! Optional string which the user can specify
+        std::string mTags;
 
-      //! The register address with which this node is associated
-      uint32_t mPartialAddr;
-      //! The register address with which this node is associated
-      uint32_t mAddr;
+        //! Optional string which the user can specify
+        std::string mDescription;
 
-      //! The mask to be applied if this node is a sub-field, rather than an entire register
-      uint32_t mMask;
-      //! The read/write access permissions of this node
-      defs::NodePermission mPermission;
-      //! Whether the node represents a single register, a block of registers or a block-read/write port
-      defs::BlockReadWriteMode mMode;
-      //! The maximum size available to a block read/write
-      uint32_t mSize;
+        //! The name of the module in which the current node resides
+        std::string mModule;
 
-      //! Optional string which the user can specify
-      std::string mTags;
+        //! Class name used to construct the derived node type
+        std::string mClassName;
 
-      //! Optional string which the user can specify
-      std::string mDescription;
+        //! Additional parameters of the node
+        std::unordered_map< std::string, std::string > mParameters;
 
-      //! The name of the module in which the current node resides
-      std::string mModule;
+        //!  parameters to infer the VHDL address decoding
+        std::unordered_map< std::string, std::string > mFirmwareInfo;
 
-      //! Class name used to construct the derived node type
-      std::string mClassName;
+        //! Helper to assist look-up of a particular child node, given a name; maps the name to the index of the child in mChildren
+        std::unordered_map< std::string , std::size_t > mChildrenMap;
+      };
 
-      //! Additional parameters of the node
-      std::unordered_map< std::string, std::string > mParameters;
+      /**
+        Returns the properties of this node for modification by the node tree builder, first copying them if they are shared with another node
+        @return the properties of this node, owned only by this node
+      */
+      Properties& modifyProperties();
 
-      //!  parameters to infer the VHDL address decoding
-      std::unordered_map< std::string, std::string > mFirmwareInfo;
+      std::string getRelativePath(const Node& aAncestor) const;
+
+      //! Get the full path to the current node
+      void getAncestors ( std::deque< const Node* >& aPath ) const;
+
+      /**
+        Checks that a block write of the specified size is allowed on this node, and drops any shadowed values that it would overwrite
+        @param aSize the number of words to be written
+      */
+      void prepareBlockWrite ( const uint32_t& aSize ) const;
+
+      /**
+        Checks that a block read of the specified size is allowed on this node
+        @param aSize the number of words to be read
+      */
+      void checkBlockRead ( const uint32_t& aSize ) const;
+
+    private:
+
+      //! The parent hardware interface of which this node is a child (or rather decendent)
+      HwInterface* mHw;
+
+      //! Whether single-word reads and writes of this node go through the shadow register cache of the parent hardware interface
+      bool mShadowed;
+
+      //! The properties of the node read from the address table, shared between all copies of the node (e.g. in each device created from the same table)
+      std::shared_ptr< Properties > mProperties;
 
       //! The parent of the current node
       Node* mParent;
 
       //! The direct children of the node
       std::vector< Node* > mChildren;
-
-      //! Helper to assist look-up of a particular child node, given a name
-      std::unordered_map< std::string , Node* > mChildrenMap;
   };
 
   std::ostream& operator<< ( std::ostream& aStr ,  const uhal::Node& aNode );
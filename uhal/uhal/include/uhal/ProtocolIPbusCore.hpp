@@ -43,6 +43,7 @@
 #include <deque>
 #include <functional>
 #include <iosfwd>
+#include <memory>
 #include <stdint.h>
 #include <string>
 #include <utility>
@@ -162,6 +163,14 @@ namespace uhal
       */
       virtual ValHeader implementWriteBlock ( const uint32_t& aAddr, const std::vector< uint32_t >& aValues, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
 
+      /**
+        Write a block of data, which is shared with the buffers rather than copied into them, to a block of registers or a block-write port
+        @param aAddr the address of the register to write
+        @param aValues the values to write to the registers or a block-write port
+        @param aMode whether we are writing to a block of registers (INCREMENTAL) or a block-write port (NON_INCREMENTAL)
+      */
+      virtual ValHeader implementWriteBlock ( const uint32_t& aAddr, const std::shared_ptr< const std::vector< uint32_t > >& aValues, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
+
       /**
         Read a single, masked, unsigned word
         @param aAddr the address of the register to read
@@ -179,6 +188,16 @@ namespace uhal
       */
       virtual ValVector< uint32_t > implementReadBlock ( const uint32_t& aAddr, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
 
+      /**
+        Read a block of unsigned data from a block of registers or a block-read port into memory owned by the caller
+        @param aAddr the lowest address in the block of registers or the address of the block-read port
+        @param aDestination the memory into which the reply data is to be written
+        @param aSize the number of words to read
+        @param aMode whether we are reading from a block of registers (INCREMENTAL) or a block-read port (NON_INCREMENTAL)
+        @return a Validated Header which will contain the returned IPbus headers
+      */
+      virtual ValHeader implementReadBlockInto ( const uint32_t& aAddr, uint32_t* aDestination, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode=defs::INCREMENTAL );
+
       /**
         Read a single, masked, unsigned word from the configuration address space
         @param aAddr the address of the register to read
@@ -196,6 +215,15 @@ namespace uhal
       */
       virtual ValWord< uint32_t > implementRMWbits ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm );
 
+      /**
+        Write a single, masked word to a register; if transaction coalescing is enabled, successive masked writes to the same register are merged into one RMW_BITS transaction
+        @param aAddr the address of the register to write
+        @param aANDterm the AND-term which clears the bits covered by the mask
+        @param aORterm the OR-term containing the shifted, masked value
+        @return a Validated Header which will be marked valid once the write has been acknowledged
+      */
+      virtual ValHeader implementMaskedWrite ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm );
+
       /**
         Read the value of a register, add the addend, set the register to this new value and return a copy of the new value to the user
         @param aAddr the address of the register to read, modify, write
@@ -251,10 +279,86 @@ namespace uhal
 
     private:
 
+      /**
+        Queue the (possibly split) write transactions for a block-write
+        @param aAddr the address of the register to write
+        @param aSource the values to write to the registers or a block-write port
+        @param aSize the number of words to write
+        @param aMode whether we are writing to a block of registers (INCREMENTAL) or a block-write port (NON_INCREMENTAL)
+        @param aOwner an object owning the source memory; if set, large payloads are sent directly from the source memory instead of being copied into the buffers
+        @return a Validated Header which will contain the returned IPbus headers
+      */
+      ValHeader queueWriteBlock ( const uint32_t& aAddr, const uint32_t* aSource, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode, const std::shared_ptr< const void >& aOwner );
+
+      /**
+        Queue the (possibly split) read transactions for a block-read, registering the destination memory directly as the reply location
+        @param aAddr the lowest address in the block of registers or the address of the block-read port
+        @param aDestination the memory into which the reply data is to be written
+        @param aSize the number of words to read
+        @param aMode whether we are reading from a block of registers (INCREMENTAL) or a block-read port (NON_INCREMENTAL)
+        @param aReply the validated memory into which the returned IPbus headers are to be written
+        @return the buffer containing the last of the transactions, which should hold the validated memory
+      */
+      std::shared_ptr< Buffers > queueReadBlock ( const uint32_t& aAddr, uint8_t* aDestination, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode, _ValHeader_& aReply );
+
+      /**
+        If transaction coalescing is enabled, find the last transaction in the current buffer, provided that it is of the given type and that nothing has been queued after it
+        On success the caller must append exactly the specified number of bytes to the send and reply buffers
+        @param aType the type of the transaction
+        @param aSendByteCount the number of bytes that the caller will append to the send buffer
+        @param aReplyByteCount the number of bytes that the caller will append to the reply buffer
+        @return a pointer to the transaction header in the send buffer, or NULL if there is no such transaction or not enough space for the extra bytes
+      */
+      uint32_t* findLastTransaction ( const IPbusTransactionType& aType , const uint32_t& aSendByteCount , const uint32_t& aReplyByteCount );
+
+      /**
+        If transaction coalescing is enabled and the last transaction in the current buffer is a single read or write of the preceding address, extend it by one word
+        On success the caller must append the extra word to the send or reply buffer, exactly as specified by the byte counts
+        @param aType the type of the transaction (READ or WRITE)
+        @param aAddr the address to be read or written
+        @param aSendByteCount the number of bytes that the caller will append to the send buffer
+        @param aReplyByteCount the number of bytes that the caller will append to the reply buffer
+        @return the buffer containing the extended transaction, or NULL if it cannot be extended
+      */
+      Buffers* extendLastTransaction ( const IPbusTransactionType& aType , const uint32_t& aAddr , const uint32_t& aSendByteCount , const uint32_t& aReplyByteCount );
+
+      /**
+        Record a newly queued single-word read or write (or masked write), so that subsequent transactions can be merged into it
+        @param aBuffers the buffer containing the transaction
+        @param aType the type of the transaction (READ, WRITE or RMW_BITS)
+        @param aHeaderOffset the offset of the transaction header in the send buffer
+        @param aAddr the address read or written
+        @param aTransactionId the transaction ID in the header
+      */
+      void recordLastTransaction ( const std::shared_ptr< Buffers >& aBuffers , const IPbusTransactionType& aType , const uint32_t& aHeaderOffset , const uint32_t& aAddr , const uint32_t& aTransactionId );
+
       virtual std::function<void (std::ostream&, const uint8_t&)> getInfoCodeTranslator() = 0;
 
       //! The transaction counter which will be incremented in the sent IPbus headers
       uint32_t mTransactionCounter;
+
+      //! Whether runs of single reads or writes to consecutive addresses are merged into block transactions
+      bool mCoalesceTransactions;
+
+      //! Description of the last queued transaction that further single reads or writes may be merged into
+      struct CoalescableTransaction
+      {
+        //! The buffer holding the transaction; NULL if there is no such transaction
+        const Buffers* buffers;
+        //! The send and reply byte counts of the buffer immediately after the transaction, used to check that nothing has been queued since
+        uint32_t sendCounter;
+        uint32_t replyCounter;
+        //! The offset of the transaction header in the send buffer
+        uint32_t headerOffset;
+        IPbusTransactionType type;
+        uint32_t wordCount;
+        uint32_t transactionId;
+        //! The base address of the transaction
+        uint32_t baseAddr;
+      };
+
+      //! The last queued transaction that further single reads or writes may be merged into
+      CoalescableTransaction mLastTransaction;
   };
 
 
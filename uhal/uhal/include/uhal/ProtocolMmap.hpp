@@ -44,12 +44,16 @@
 
 
 #include <chrono>
+#include <condition_variable>
 #include <deque>                           // for deque
+#include <exception>                       // for exception_ptr
 #include <istream>                         // for istream
 #include <memory>
+#include <mutex>
 #include <stddef.h>                        // for size_t
 #include <stdint.h>                        // for uint32_t, uint8_t
 #include <string>                          // for string
+#include <thread>
 #include <utility>                         // for pair
 #include <vector>                          // for vector
 
@@ -87,7 +91,6 @@ namespace uhal
         const std::vector< std::pair<const uint8_t*, size_t> > mData;
       };
 
-    private:
       class File {
       public:
         File(const std::string& aPath, int aFlags);
@@ -103,6 +106,18 @@ namespace uhal
 
         void read(const uint32_t aAddr, const uint32_t aNrWords, std::vector<uint32_t>& aValues);
 
+        //! Read a single 32-bit word, at the specified word address, from the mapped region
+        uint32_t read(const uint32_t aAddr);
+
+        /**
+          Scatter a contiguous block of 32-bit words, starting at the specified word address, from the mapped region directly into a set of destination buffers
+          @param aAddr the word address of the first word
+          @param aDestinations the destination buffers, which are filled in turn
+          @param aNrBytes the number of bytes to be copied; any destination buffers beyond this are left untouched
+        */
+        void read(const uint32_t aAddr, const std::deque< std::pair<uint8_t*, uint32_t> >& aDestinations, size_t aNrBytes);
+
+        //! Write the concatenation of a list of segments directly into the mapped region, at the specified byte address, using 64-bit stores
         void write(const uint32_t aAddr, const std::vector<std::pair<const uint8_t*, size_t> >& aData);
 
       private:
@@ -114,6 +129,7 @@ namespace uhal
         void* mMmapIOPtr;
       };
 
+    private:
       template <typename T>
       struct HexTo {
         T value;
@@ -152,6 +168,11 @@ namespace uhal
       //! Concrete implementation of the synchronization function to block until all buffers have been sent, all replies received and all data validated
       virtual void Flush( );
 
+      /**
+        Start collecting the replies to all dispatched buffers, without waiting for them
+        @return true if the replies are collected and validated by the completion thread; otherwise false, so that they are instead collected by Flush
+      */
+      virtual bool startFlush( );
 
       //! Function which tidies up this protocol layer in the event of an exception
       virtual void dispatchExceptionHandler();
@@ -185,10 +206,22 @@ namespace uhal
       //! Read next pending reply packet from appropriate page of FPGA-to-host device file, and validate contents
       void read();
 
+      //! Start the thread which collects and validates replies in the background
+      void startCompletionThread();
+
+      //! Stop the completion thread, waiting for it to finish collecting the reply that it is currently waiting for
+      void stopCompletionThread();
+
+      //! Body of the completion thread: collects and validates the replies as soon as their packets have been written, until stopped
+      void runCompletionThread();
+
       bool mConnected;
 
       File mDeviceFile;
 
+      //! The list of segments (header word followed by the send buffer segments) written into the page for the current request, kept to avoid reallocating it for every packet
+      std::vector<std::pair<const uint8_t*, size_t> > mDataToWrite;
+
       std::chrono::microseconds mSleepDuration;
 
       uint32_t mNumberOfPages, mPageSize, mIndexNextPage, mPublishedReplyPageCount, mReadReplyPageCount;
@@ -196,11 +229,28 @@ namespace uhal
       //! The list of buffers still awaiting a reply
       std::deque < std::shared_ptr< Buffers > > mReplyQueue;
 
-      /**
-        A pointer to an exception object for passing exceptions from the worker thread to the main thread.
-        Exceptions must always be created on the heap (i.e. using `new`) and deletion will be handled in the main thread
-      */
-      uhal::exception::exception* mAsynchronousException;
+      //! The page index of each packet still awaiting a reply
+      std::deque < uint32_t > mReplyPages;
+
+      //! Thread which collects and validates replies in the background, if the 'completion_thread' attribute is set (otherwise, replies are collected on the user's thread in implementDispatch and Flush)
+      std::thread mCompletionThread;
+
+      //! A MutEx lock protecting the reply queues and the other state shared with the completion thread
+      std::mutex mTransportLayerMutex;
+
+      //! Notifies the completion thread that a packet has been written, or that it should stop
+      std::condition_variable mPacketWritten;
+
+      //! Notifies the user's thread that replies have been collected, or that the completion thread has caught an exception
+      std::condition_variable mRepliesCollected;
+
+      bool mStopCompletionThread;
+
+      //! The number of packets written whose replies have not yet been validated
+      size_t mNrPendingReplies;
+
+      //! Exception caught by the completion thread, which is rethrown on the user's thread by the next implementDispatch or Flush
+      std::exception_ptr mAsynchronousException;
   };
 
 
@@ -44,12 +44,17 @@
 
 
 #include <chrono>
+#include <condition_variable>
 #include <deque>                           // for deque
+#include <exception>                       // for exception_ptr
 #include <memory>
 #include <mutex>
 #include <stddef.h>                        // for size_t
 #include <stdint.h>                        // for uint32_t, uint8_t
 #include <string>                          // for string
+#include <sys/types.h>                     // for pid_t
+#include <sys/uio.h>                       // for iovec
+#include <thread>
 #include <utility>                         // for pair
 #include <vector>                          // for vector
 
@@ -105,6 +110,20 @@ namespace uhal
 
         void read(const uint32_t aAddr, const uint32_t aNrWords, std::vector<uint32_t>& aValues);
 
+        /**
+          Read a contiguous block of words, starting at the specified word address, directly into a list of destination buffers
+          @param aAddr the word address of the first word
+          @param aData the destination buffers, which are filled in turn
+        */
+        void read(const uint32_t aAddr, const std::vector<std::pair<uint8_t*, size_t> >& aData);
+
+        /**
+          Block until the file is readable (e.g. an interrupt has arrived on an events file), or until the timeout expires
+          @param aTimeout the maximum time to wait
+          @return whether the file is readable
+        */
+        bool waitUntilReadable(const std::chrono::microseconds& aTimeout);
+
         void write(const uint32_t aAddr, const std::vector<uint32_t>& aValues);
 
         void write(const uint32_t aAddr, const uint8_t* const aPtr, const size_t aNrBytes);
@@ -113,17 +132,31 @@ namespace uhal
 
         bool haveLock() const;
 
-        void lock();
+        /**
+          Lock the file (blocking until the lock is available)
+          @param aShared whether to take a shared lock, rather than an exclusive one
+        */
+        void lock(const bool aShared = false);
 
         void unlock();
 
       private:
+        //! Read into the buffers described by mIOVecs, from the specified byte offset; throws unless all bytes are transferred
+        void readAt(const off_t aOffset, const size_t aNrBytes);
+
+        //! Write the buffers described by mIOVecs, at the specified byte offset; throws unless all bytes are transferred
+        void writeAt(const off_t aOffset, const size_t aNrBytes);
+
         std::string mPath;
         int mFd;
         int mFlags;
         bool mLocked;
         size_t mBufferSize;
         char* mBuffer;
+        //! Whether the file supports positioned I/O (pread/pwrite); cleared on the first ESPIPE error, e.g. for named pipes
+        bool mPositionedIO;
+        //! The I/O vector for the current read/write, kept to avoid reallocating it for every packet
+        std::vector<struct iovec> mIOVecs;
       };
 
     private:
@@ -153,6 +186,57 @@ namespace uhal
         bool mSessionActive;
       };
 
+      /**
+        State of the page scheduler, shared via shared memory between all clients of a device that have the 'scheduler' attribute.
+        Each packet is assigned the next page of the device in turn, along with a ticket - the value of the device's published page
+        count just before that packet's reply is published. A page is only reused once its owner has collected the reply.
+        All methods must be called with the IPC mutex locked.
+      */
+      class PageScheduler {
+      public:
+        PageScheduler();
+
+        //! Whether there are no pages whose reply has yet to be collected
+        bool isIdle();
+
+        /**
+          Resynchronise with the device status; must only be called when idle
+          @param aNrPages number of pages in the device
+          @param aNextPageIndex index of the next page to be filled
+          @param aPublishedPageCount number of reply pages published so far
+        */
+        void reset(const uint32_t aNrPages, const uint32_t aNextPageIndex, const uint32_t aPublishedPageCount);
+
+        /**
+          Reserve the next page of the device
+          @param aOwner process ID of the client reserving the page
+          @param aPageIndex set to the index of the page
+          @param aTicket set to the page's ticket
+          @return false if all pages are in use
+        */
+        bool reserve(const pid_t aOwner, uint32_t& aPageIndex, uint32_t& aTicket);
+
+        //! Release a page, once its reply has been collected
+        void release(const uint32_t aPageIndex);
+
+        //! Maximum number of pages in a device
+        static const size_t kMaxNrPages = 1024;
+
+      private:
+        PageScheduler(const PageScheduler&);
+
+        //! Advance mOldestTicket past released pages, also releasing pages whose owner has died if the oldest page is still in use
+        void reclaim();
+
+        uint32_t mNrPages;
+        uint32_t mNextPageIndex;
+        uint32_t mNextTicket;
+        //! Ticket of the oldest page that is still in use (equal to mNextTicket if all pages are free)
+        uint32_t mOldestTicket;
+        //! Process ID of the client using each page (0 if free)
+        pid_t mOwners[kMaxNrPages];
+      };
+
       template <class T>
       class SharedObject {
       public:
@@ -205,6 +289,12 @@ namespace uhal
       //! Concrete implementation of the synchronization function to block until all buffers have been sent, all replies received and all data validated
       virtual void Flush( );
 
+      /**
+        Start collecting the replies to all dispatched buffers, without waiting for them
+        @return true if the replies are collected and validated by the completion thread; otherwise false, so that they are instead collected by Flush
+      */
+      virtual bool startFlush( );
+
       //! Function which tidies up this protocol layer in the event of an exception
       virtual void dispatchExceptionHandler();
 
@@ -236,9 +326,36 @@ namespace uhal
       //! Write request packet to next page in host-to-FPGA device file 
       void write(const std::shared_ptr<Buffers>& aBuffers);
 
-      //! Read next pending reply packet from appropriate page of FPGA-to-host device file, and validate contents
+      /**
+        Block until an interrupt is received via the events file
+        @param aPageIndexToRead index of the page whose reply is awaited (for error messages)
+        @param aEndTime time at which to give up waiting, throwing PCIeTimeout
+      */
+      void waitForInterrupt(const size_t aPageIndexToRead, const SteadyClock_t::time_point& aEndTime);
+
+      //! Read all published reply packets (waiting for at least one) from the FPGA-to-host device file, and validate their contents
       void read();
 
+      /**
+        Read a contiguous run of published reply pages from the FPGA-to-host device file in one transfer, directly into the reply buffers
+        @param aFirstPageIndex index of the first page in the run
+        @param aFirstReplyIndex position, within the reply queue, of the buffers whose reply is in the first page
+        @param aNrPages number of pages in the run
+      */
+      void readPages(const size_t aFirstPageIndex, const size_t aFirstReplyIndex, const size_t aNrPages);
+
+      //! End the session and release the lock on the device file, once all replies of a dispatch have been validated
+      void releaseDevice();
+
+      //! Start the thread which collects and validates replies in the background
+      void startCompletionThread();
+
+      //! Stop the completion thread, waiting for it to finish collecting the replies that it is currently waiting for
+      void stopCompletionThread();
+
+      //! Body of the completion thread: collects and validates the replies as soon as their packets have been written, until stopped
+      void runCompletionThread();
+
       bool mConnected;
 
       //! Host-to-FPGA device file
@@ -249,6 +366,8 @@ namespace uhal
       File mDeviceFileFPGAEvent;
 
       SharedObject<IPCMutex_t> mIPCMutex;
+      //! Page scheduler shared with other clients of the device, if the 'scheduler' attribute is set (otherwise null, and the device is locked from first write to end of dispatch)
+      std::unique_ptr<SharedObject<PageScheduler> > mScheduler;
       bool mIPCExternalSessionActive;
       uint64_t mIPCSessionCount;
 
@@ -258,10 +377,57 @@ namespace uhal
 
       std::chrono::microseconds mSleepDuration;
 
-      uint32_t mNumberOfPages, mMaxInFlight, mPageSize, mMaxPacketSize, mIndexNextPage, mPublishedReplyPageCount, mReadReplyPageCount;
+      //! Whether the status word is polled with the adaptive spin-then-backoff policy, rather than at fixed intervals of mSleepDuration
+      bool mAdaptivePolling;
+
+      //! Moving average of the time spent waiting for each reply to be published, used to size the spin phase of adaptive polling
+      SteadyClock_t::duration mReplyWaitEstimate;
+
+      uint32_t mNumberOfPages, mMaxInFlight, mPageSize, mMaxPacketSize, mIndexNextPage, mPublishedReplyPageCount;
+
+      //! Ticket (value of published page count just before the reply is published) of the next packet; only used without the scheduler
+      uint32_t mNextTicket;
 
       //! The list of buffers still awaiting a reply
       std::deque < std::shared_ptr< Buffers > > mReplyQueue;
+
+      //! The page index and ticket of each packet still awaiting a reply
+      std::deque < std::pair< uint32_t , uint32_t > > mReplyPages;
+
+      //! The destinations of the pages currently being read (header words, reply buffers and gaps), kept to avoid reallocating the list for every read
+      std::vector < std::pair< uint8_t* , size_t > > mReplySegments;
+
+      //! The header words of the pages currently being read
+      std::vector < uint32_t > mReplyPageHeaders;
+
+      //! Scratch space into which the unused parts of pages are read, when several pages are read in one transfer
+      std::vector < uint8_t > mReplyPageGap;
+
+      //! The buffers whose replies have been read, and are being validated
+      std::vector < std::shared_ptr< Buffers > > mValidationQueue;
+
+      //! Thread which collects and validates replies in the background, if the 'completion_thread' attribute is set (otherwise, replies are collected on the user's thread in implementDispatch and Flush)
+      std::thread mCompletionThread;
+
+      //! A MutEx lock protecting the reply queues and the other state shared with the completion thread
+      std::mutex mTransportLayerMutex;
+
+      //! Notifies the completion thread that a packet has been written, or that it should stop
+      std::condition_variable mPacketWritten;
+
+      //! Notifies the user's thread that replies have been collected, or that the completion thread has caught an exception
+      std::condition_variable mRepliesCollected;
+
+      bool mStopCompletionThread;
+
+      //! Whether the device should be released by the completion thread once all replies have been validated (set by startFlush)
+      bool mFlushRequested;
+
+      //! The number of packets written whose replies have not yet been validated
+      size_t mNrPendingReplies;
+
+      //! Exception caught by the completion thread, which is rethrown on the user's thread by the next implementDispatch or Flush
+      std::exception_ptr mAsynchronousException;
   };
 
   std::ostream& operator<<(std::ostream& aStream, const PCIe::PacketFmt& aPacket);
@@ -62,6 +62,8 @@ namespace uhal
 {
   // Forward declarations
   class Buffers;
+  class SharedTCPConnection;
+  class IOservicePool;
   struct URI;
 
 
@@ -121,6 +123,12 @@ namespace uhal
       //! Concrete implementation of the synchronization function to block until all buffers have been sent, all replies received and all data validated
       virtual void Flush( );
 
+      /**
+        Concrete implementation of the function to start sending all dispatched buffers without blocking
+        @return true, since the replies are received and validated by the IO service thread, unless busy-polling (in which case they are collected by Flush)
+      */
+      virtual bool startFlush( );
+
       //! Function which tidies up this protocol layer in the event of an exception
       virtual void dispatchExceptionHandler();
 
@@ -136,9 +144,25 @@ namespace uhal
       */
       uint32_t getMaxReplySize();
 
+      /**
+        Return the maximum number of packets in flight; if sized from the target's status, this is the number of replies that the target keeps
+        @return the maximum number of packets in flight
+      */
+      uint32_t getMaxNumberOfBuffers();
+
+      //! If the 'query_status' URI attribute is set, size the packets and the number of packets in flight from the target's status reply
+      void queryTargetCapacity();
+
       //! Make the TCP connection
       void connect();
 
+      /**
+        Whether the queued buffers should now be sent as a TCP chunk
+        Called with the transport-layer mutex held
+        @return true if no chunk is currently being sent, there is room for more packets in flight, and either enough buffers have been queued or a flush has started
+      */
+      bool isChunkReady ( );
+
       /**
         Initialize performing the next TCP write operation
         In multi-threaded mode, this runs the ASIO async write and exits
@@ -167,6 +191,44 @@ namespace uhal
       */
       void read_callback ( const boost::system::error_code& aErrorCode , std::size_t aBytesTransferred );
 
+      /**
+        Validate the replies to the chunk that has just been received, and then send the next chunk and/or start receiving the replies to the next chunk
+        Called on this client's I/O thread once all of the chunk's replies have been received
+      */
+      void validateReplies ( );
+
+      /**
+        Function which is called by the shared connection's receive loop with each reply from the target, when sharing a ControlHub connection with other clients
+        The reply is passed on to deliverShared if the replies to the current chunk are awaited, and is otherwise kept until they are (or discarded, if left over from a dispatch that failed)
+        @param aData the reply, starting with its ControlHub preamble; NULL if the connection has failed
+        @param aSize the size of the reply
+      */
+      void receiveShared ( const uint8_t* aData , const std::size_t aSize );
+
+      /**
+        Copy a reply received through the shared connection to the final destinations of the next buffer in the current chunk, and run validateReplies on this client's I/O thread once the whole chunk has been received
+        Called with the transport-layer mutex held
+        @param aData the reply, starting with its ControlHub preamble
+        @param aSize the size of the reply
+      */
+      void deliverShared ( const uint8_t* aData , const std::size_t aSize );
+
+      //! In busy-poll mode, apply the 'so_busy_poll' socket option to the newly connected socket
+      void prepareBusyPollSocket ( );
+
+      /**
+        In busy-poll mode, send a packet (as a chunk of its own) from the calling thread, without involving the I/O thread
+        Called with the transport-layer mutex held
+        @param aBuffers the buffer to be sent
+      */
+      void sendBusy ( const std::shared_ptr< Buffers >& aBuffers );
+
+      /**
+        In busy-poll mode, spin on non-blocking receive calls from the calling thread until the reply to the oldest packet in flight arrives, and then validate it
+        Called with the transport-layer mutex held; throws if the reply times out or is invalid
+      */
+      void receiveBusy ( );
+
       //! Function called by the ASIO deadline timer
       void CheckDeadline();
 
@@ -186,23 +248,47 @@ namespace uhal
       //! The maximum UDP payload size (in bytes)
       size_t mMaxPayloadSize;
 
+      //! The maximum payload size set by the 'max_payload_size' URI attribute (0 if not set), which is not exceeded even if the target's MTU allows it
+      size_t mMaxPayloadSizeFromUri;
+
+      //! Whether the maximum payload size and number of packets in flight are taken from the target's status reply
+      bool mSizeFromTargetStatus;
+
+      //! The number of replies that the target keeps (i.e. its number of reply buffers), from its status reply
+      uint32_t mTargetNrBuffers;
+
+      //! The pool of I/O threads that this client is attached to; either shared with other clients, or private to this client
+      std::shared_ptr< IOservicePool > mIOservicePool;
+
       //! The boost::asio::io_service used to create the connections
-      boost::asio::io_service mIOservice;
+      boost::asio::io_service& mIOservice;
 
-      //! A shared pointer to a boost::asio tcp socket through which the operation will be performed
+      //! A shared pointer to a boost::asio tcp socket through which the operation will be performed; never opened if sharing a ControlHub connection with other clients
       boost::asio::ip::tcp::socket mSocket;
 
+      //! The ControlHub connection shared with the other clients in the same group ('shared_connection' URI attribute), if any
+      std::shared_ptr< SharedTCPConnection > mSharedConnection;
+
+      //! The target's IP address and port, in network byte order, by which the shared connection identifies this client's replies
+      std::pair< uint32_t , uint16_t > mSharedTarget;
+
+      //! The number of replies to the current chunk that have been received through the shared connection
+      std::size_t mSharedRepliesReceived;
+
+      //! Replies received through the shared connection before the replies to their chunk were awaited (e.g. while the previous chunk was being validated)
+      std::deque< std::vector< uint8_t > > mSharedEarlyReplies;
+
+      //! The number of replies still to come through the shared connection for packets from a dispatch that has failed, which are discarded
+      std::size_t mSharedRepliesToDiscard;
+
       //! A shared pointer to a boost::asio tcp endpoint - used by the delayed (open-on-first-use) connect
       boost::asio::ip::tcp::resolver::iterator mEndpoint;
 
       //! The mechanism for providing the time-out
       boost::asio::deadline_timer mDeadlineTimer;
 
-      /// Needed when multi-threading to stop the boost::asio::io_service thinking it has nothing to do and so close the socket
-      boost::asio::io_service::work mIOserviceWork;
-
-      //! The Worker thread in Multi-threaded mode
-      std::thread mDispatchThread;
+      //! Set (from the I/O thread) once the client is being destroyed; no new timer waits or socket operations are started after this, since their handlers would outlive this object
+      bool mClosing;
 
       //! A MutEx lock used to make sure the access functions are thread safe
       std::mutex mTransportLayerMutex;
@@ -215,6 +301,23 @@ namespace uhal
       //! Counter of how many writes have been sent, for which no reply has yet been received
       uint32_t mPacketsInFlight;
 
+      //! Whether packets are sent and replies received by the thread that dispatches, spinning rather than sleeping while waiting for replies ('poll=busy' URI attribute)
+      bool mBusyPoll;
+      //! The period (in microseconds) for which the kernel busy-polls the device queue when a receive call finds the socket empty ('so_busy_poll' URI attribute; 0 if not set)
+      uint32_t mKernelBusyPollPeriod;
+
+      //! The number of buffers that are queued before they are sent as a TCP chunk, unless a flush has started ('buffers_per_send' URI attribute; the nr_buffers_per_send template parameter by default)
+      std::size_t mBuffersPerSend;
+      /**
+        Whether the number of buffers in each TCP chunk follows the depth of the dispatch queue ('buffers_per_send=adaptive' URI attribute)
+        @note In this mode buffers are sent straight away while nothing is in flight, so sparse traffic sees no added latency; otherwise they are held until a full chunk has built up, so that bulk traffic is sent in as few chunks as possible
+      */
+      bool mAdaptiveChunking;
+      //! The maximum number of bytes in each TCP chunk, although a chunk always contains at least one buffer ('max_bytes_per_send' URI attribute)
+      std::size_t mMaxBytesPerSend;
+      //! The total number of bytes in the buffers of the dispatch queue
+      std::size_t mDispatchQueueBytes;
+
       //! Boolean specifying whether or not the main thread is within TCP::Flush method. Its value checked by the worker thread to know whether it should wait for more packets before sending onto the TCP socket.
       bool mFlushStarted;
 
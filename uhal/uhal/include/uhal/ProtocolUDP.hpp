@@ -40,6 +40,7 @@
 #define _uhal_ProtocolUDP_hpp_
 
 
+#include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <iostream>
@@ -49,6 +50,8 @@
 #include <thread>
 #include <vector>
 
+#include <sys/socket.h>
+
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ip/udp.hpp>
 #include <boost/asio/deadline_timer.hpp>
@@ -65,6 +68,8 @@ namespace uhal
 {
   // Forward declarations
   class Buffers;
+  class IOservicePool;
+  class SharedUDPSocket;
   struct URI;
 
   namespace exception
@@ -109,6 +114,30 @@ namespace uhal
       //! Destructor
       virtual ~UDP();
 
+      /**
+        Return the number of lost packets (requests or replies) that have been recovered using the IPbus 2.0 status and resend packets
+        @return the number of recovered packet losses
+      */
+      uint64_t getRecoveredPacketLosses();
+
+      /**
+        Return the number of packet losses that could not be recovered within the maximum number of attempts, and so resulted in a timeout
+        @return the number of unrecovered packet losses
+      */
+      uint64_t getFatalPacketLosses();
+
+      /**
+        Return the current limit on the number of packets in flight; unless the 'adaptive_window' URI attribute is set, this is always the maximum number of buffers
+        @return the current limit on the number of packets in flight
+      */
+      uint32_t getWindowSize();
+
+      /**
+        Return the smoothed round-trip time, from sending a packet to receiving its reply (replies to packets that may have been resent to recover losses are not counted)
+        @return the smoothed round-trip time, or zero if no replies have been received yet
+      */
+      std::chrono::microseconds getRoundTripTime();
+
     private:
       /**
       	Send the IPbus buffer to the target, read back the response and call the packing-protocol's validate function
@@ -120,6 +149,12 @@ namespace uhal
       //! Concrete implementation of the synchronization function to block until all buffers have been sent, all replies received and all data validated
       virtual void Flush( );
 
+      /**
+        Concrete implementation of the function to start sending all dispatched buffers without blocking
+        @return true, since the replies are received and validated by the IO service thread, unless busy-polling (in which case they are collected by Flush)
+      */
+      virtual bool startFlush( );
+
       //! Function which tidies up this protocol layer in the event of an exception
       virtual void dispatchExceptionHandler();
 
@@ -135,6 +170,31 @@ namespace uhal
       */
       uint32_t getMaxReplySize();
 
+      /**
+        Return the maximum number of packets in flight; if sized from the target's status, or recovering lost packets, this is given by the number of replies that the target keeps for re-transmission
+        @return the maximum number of packets in flight
+      */
+      uint32_t getMaxNumberOfBuffers();
+
+      //! Return the current limit on the number of packets in flight, without locking the transport-layer mutex
+      uint32_t getPacketsInFlightLimit();
+
+      //! Record that a packet has just been sent, so that the round-trip time can be measured once its reply arrives
+      void recordSend ( );
+
+      /**
+        Record that the reply to the oldest packet in flight has arrived, updating the round-trip time and, if adaptive, the window size
+        Once per round trip, the number of packets queued (at the target or in the network) is estimated from the difference between the expected and actual
+        throughput, as in TCP Vegas; the window grows by one packet if few are queued, and shrinks by one packet if many are, but is only halved by losses and timeouts
+      */
+      void recordReply ( );
+
+      //! Record that a packet or its reply has been lost (or timed out); if adaptive, this halves the window size, at most once per round trip
+      void recordCongestion ( );
+
+      //! If the 'query_status' URI attribute is set, size the packets and the number of packets in flight from the target's status reply
+      void queryTargetCapacity();
+
       //! Set up the UDP socket
       void connect();
 
@@ -166,9 +226,108 @@ namespace uhal
       */
       void read_callback ( const boost::system::error_code& aErrorCode , std::size_t aBytesTransferred );
 
+      /**
+        Callback function which is called once the reply can be read from the socket, when receiving it directly into its final destinations
+        This receives the reply using recvmsg with the scatter list in mReplySegments, and then calls read_callback
+        @param aErrorCode the error code with which the ASIO wait operation completed
+      */
+      void readInPlace_callback ( const boost::system::error_code& aErrorCode );
+
+      /**
+        Function which is called by the shared socket's receive loop with each datagram received from the target, when sharing a socket with other clients
+        The datagram is dropped unless its headers match those of the oldest packet still awaiting its reply (so that a late reply to a packet sent before a timeout is not taken for the reply to a later packet)
+        Otherwise it is passed on to deliverShared if a reply is awaited, and is kept until the next reply is awaited if not
+        @param aData the contents of the datagram
+        @param aSize the size of the datagram
+      */
+      void receiveShared ( const uint8_t* aData , const std::size_t aSize );
+
+      /**
+        Copy a datagram received through the shared socket to the final destinations of the awaited reply, and then run read_callback on this client's I/O thread
+        Called with the transport-layer mutex held
+        @param aData the contents of the datagram
+        @param aSize the size of the datagram
+      */
+      void deliverShared ( const uint8_t* aData , const std::size_t aSize );
+
+      /**
+        Return the headers which identify an IPbus 2.0 packet sent through the shared socket, and its reply
+        @param aData the contents of the packet or reply
+        @param aSize the size of the packet or reply
+        @return the packet header, and the first transaction header without its word count and info code (or 0, if there are no transactions)
+      */
+      static std::pair< uint32_t , uint32_t > getSharedReplyKey ( const uint8_t* aData , const std::size_t aSize );
+
+      /**
+        In batched mode, send as many of the queued buffers as the number of packets in flight allows, using a single sendmmsg call
+        Called from the I/O thread, with the transport-layer mutex held
+      */
+      void writeBatch ( );
+
+      //! In batched mode, wait (asynchronously) for replies to arrive on the socket
+      void readBatch ( );
+
+      /**
+        Callback function which is called once replies can be read from the socket in batched mode
+        This receives all waiting replies using a single recvmmsg call, matches them to the buffers awaiting a reply, and validates them
+        @param aErrorCode the error code with which the ASIO wait operation completed
+      */
+      void readBatch_callback ( const boost::system::error_code& aErrorCode );
+
+      //! In busy-poll mode, apply the 'so_busy_poll' socket option to the newly opened socket
+      void prepareBusyPollSocket ( );
+
+      /**
+        In busy-poll mode, send a packet from the calling thread, without involving the I/O thread
+        Called with the transport-layer mutex held
+        @param aBuffers the buffer to be sent
+      */
+      void sendBusy ( const std::shared_ptr< Buffers >& aBuffers );
+
+      /**
+        In busy-poll mode, spin on non-blocking receive calls from the calling thread until the reply to the oldest packet in flight arrives, and then validate it
+        Called with the transport-layer mutex held; throws if the reply times out or is invalid
+      */
+      void receiveBusy ( );
+
       //! Function called by the ASIO deadline timer
       void CheckDeadline();
 
+      /**
+        Return the period allowed for each attempt at receiving a reply; if recovering lost packets, the timeout period is shared between the attempts
+        @return the period allowed for each attempt at receiving a reply
+      */
+      boost::posix_time::time_duration getAttemptTimeoutPeriod();
+
+      /**
+        Synchronously query the target's status, to find its MTU, the packet ID that it next expects and the number of replies that it keeps for re-transmission
+        Called before the first packet is sent with a new socket, when no asynchronous operations are in progress
+      */
+      void queryTargetStatus();
+
+      //! Send a status request to the target, as the first step in recovering from a lost packet
+      void sendStatusRequest();
+
+      /**
+        Check the packet header of a datagram received while recovering lost packets is enabled. Status replies are used to recover the lost packets; stale or out-of-order replies are discarded.
+        @param aBytesTransferred the size of the datagram in mReplyMemory
+        @return whether the datagram is the reply to the packet currently awaiting a reply
+      */
+      bool isExpectedReply ( const std::size_t aBytesTransferred );
+
+      /**
+        Re-send the lost requests, and request re-transmission of the lost replies, for all packets awaiting a reply
+        @param aNextExpectedId the ID of the next control packet expected by the target, from its status reply
+      */
+      void recover ( const uint16_t aNextExpectedId );
+
+      /**
+        Extract the packet ID from the IPbus 2.0 packet header at the start of a buffer's send data
+        @param aBuffers the buffer
+        @return the packet ID
+      */
+      static uint16_t getPacketId ( const std::shared_ptr< Buffers >& aBuffers );
+
       /**
         Function to set the value of a variable associated with a BOOST conditional-variable and then notify that conditional variable
         @param aValue a value to which to update the variable associated with a BOOST conditional-variable
@@ -182,30 +341,56 @@ namespace uhal
       //! The maximum UDP payload size (in bytes)
       size_t mMaxPayloadSize;
 
+      //! The maximum UDP payload size set by the 'max_payload_size' URI attribute (0 if not set), which is not exceeded even if the target's MTU allows it
+      size_t mMaxPayloadSizeFromUri;
+
+      //! Whether the maximum payload size and number of packets in flight are taken from the target's status reply
+      bool mSizeFromTargetStatus;
+
+      //! The pool of I/O threads that this client is attached to; either shared with other clients, or private to this client
+      std::shared_ptr< IOservicePool > mIOservicePool;
+
       //! The boost::asio::io_service used to create the connections
-      boost::asio::io_service mIOservice;
+      boost::asio::io_service& mIOservice;
 
-      //! A shared pointer to a boost::asio udp socket through which the operation will be performed
+      //! A shared pointer to a boost::asio udp socket through which the operation will be performed; never opened if sharing a socket with other clients
       boost::asio::ip::udp::socket mSocket;
 
+      //! The socket shared with the other clients in the same group ('shared_socket' URI attribute), if any
+      std::shared_ptr< SharedUDPSocket > mSharedSocket;
+
+      //! Whether a reply is awaited from the shared socket's receive loop
+      bool mSharedReceivePending;
+
+      //! Datagrams received through the shared socket before their reply was awaited (e.g. while the previous reply was being validated)
+      std::deque< std::vector< uint8_t > > mSharedEarlyReplies;
+
+      //! The headers (from getSharedReplyKey) of the packets sent through the shared socket whose replies have not yet been received, oldest first
+      std::deque< std::pair< uint32_t , uint32_t > > mSharedAwaitedReplies;
+
       //! A shared pointer to a boost::asio udp endpoint - used in the ASIO send and receive functions (UDP has no concept of a connection)
       boost::asio::ip::udp::endpoint mEndpoint;
 
       //! The mechanism for providing the time-out
       boost::asio::deadline_timer mDeadlineTimer;
 
+      //! Set (from the I/O thread) once the client is being destroyed; no new timer waits or socket operations are started after this, since their handlers would outlive this object
+      bool mClosing;
+
       /**
         A block of memory into which we write replies, before copying them to their final destination
-        @note This should not be necessary and was, for a while, removed, with the buffer sequence created, instead, pointing to the final destinations
-        @note Tom Williams, however believes that there is a problem with scatter-gather operations of size>64 with the UDP and so has reverted it -- see https://svnweb.cern.ch/trac/cactus/ticket/259#comment:17
+        @note Replies are normally received directly into their final destinations (see mReplySegments); this is only used for replies with more than IOV_MAX destinations, when recovering lost packets (since the next datagram may not be the awaited reply), and in batched mode
+        @note Scatter-gather operations of size>64 were found to fail with ASIO (see https://svnweb.cern.ch/trac/cactus/ticket/259#comment:17), since ASIO only passes the first 64 buffers of a sequence to the kernel; hence recvmsg is used directly for the in-place receive
+        @note In batched mode, this holds one reply per packet in flight
       */
       std::vector<uint8_t> mReplyMemory;
 
-      //! Needed when multi-threading to stop the boost::asio::io_service thinking it has nothing to do and so close the socket
-      boost::asio::io_service::work mIOserviceWork;
+      //! The scatter list for receiving the awaited reply directly into its final destinations
+      std::vector< iovec > mReplySegments;
+
+      //! Whether the awaited reply is being received directly into its final destinations, rather than into mReplyMemory
+      bool mReplyInPlace;
 
-      //! The Worker thread in Multi-threaded mode
-      std::thread mDispatchThread;
 
       //! A MutEx lock used to make sure the access functions are thread safe
       std::mutex mTransportLayerMutex;
@@ -215,9 +400,48 @@ namespace uhal
       //! The list of buffers still awaiting a reply
       std::deque < std::shared_ptr< Buffers > > mReplyQueue;
 
+      //! Whether packets are sent and replies received in batches, using one sendmmsg/recvmmsg call for all queued packets/waiting replies ('batch' URI attribute)
+      bool mBatched;
+      //! Whether a batched send has been posted to the I/O thread, but has not yet run
+      bool mBatchSendPosted;
+      //! Whether a wait for replies is in progress in batched mode
+      bool mBatchReceivePending;
+      //! The message headers passed to sendmmsg/recvmmsg in batched mode
+      std::vector< mmsghdr > mBatchMessages;
+      //! The scatter-gather lists referenced by mBatchMessages
+      std::vector< iovec > mBatchSegments;
+      //! The buffers whose replies were received by the last recvmmsg call, with the index of each reply in mBatchMessages
+      std::vector< std::pair< std::shared_ptr< Buffers > , std::size_t > > mBatchReplies;
+
+      //! Whether packets are sent and replies received by the thread that dispatches, spinning rather than sleeping while waiting for replies ('poll=busy' URI attribute)
+      bool mBusyPoll;
+      //! The period (in microseconds) for which the kernel busy-polls the device queue when a receive call finds the socket empty ('so_busy_poll' URI attribute; 0 if not set)
+      uint32_t mKernelBusyPollPeriod;
+
       //! Counter of how many writes have been sent, for which no reply has yet been received
       uint32_t mPacketsInFlight;
 
+      //! Whether the number of packets in flight is adapted to the measured round-trip time and to packet losses ('adaptive_window' URI attribute)
+      bool mAdaptiveWindow;
+      //! The current limit on the number of packets in flight, if adaptive; grows by one packet per reply up to mSlowStartThreshold, and by at most one packet per round trip beyond it
+      double mWindow;
+      //! The window size up to which the window grows quickly; set to half of the window size whenever it is halved, and to the window size once packets start to queue
+      double mSlowStartThreshold;
+      //! The times at which the packets in flight were sent, oldest first; a default-constructed time if no round-trip time is to be measured for the packet (since it may have been resent)
+      std::deque< std::chrono::steady_clock::time_point > mSendTimes;
+      //! The smoothed round-trip time, in microseconds (0 until the first reply arrives)
+      double mSmoothedRtt;
+      //! The base round-trip time, in microseconds: the smallest measured since the last exception, unless more than 10 seconds old (0 until the first reply arrives)
+      double mMinRtt;
+      //! The time at which the base round-trip time was measured
+      std::chrono::steady_clock::time_point mMinRttTime;
+      //! The smallest round-trip time measured in the current round trip, in microseconds
+      double mRoundMinRtt;
+      //! The time at which the current round trip ends, and the window is next compared with the number of packets queued
+      std::chrono::steady_clock::time_point mRoundEnd;
+      //! The time at which the window size was last reduced
+      std::chrono::steady_clock::time_point mLastWindowReduction;
+
       //! A mutex for use by the conditional variable
       std::mutex mConditionalVariableMutex;
       //! A conditional variable for blocking the main thread until the variable with which it is associated is set correctly
@@ -236,6 +460,27 @@ namespace uhal
       */
       uhal::exception::exception* mAsynchronousException;
 
+      //! The maximum number of attempts at recovering a lost packet using the IPbus 2.0 status and resend packets; 0 disables recovery
+      uint32_t mMaxRecoveryAttempts;
+
+      //! The number of recovery attempts made so far for the packet currently awaiting a reply
+      uint32_t mRecoveryAttempts;
+
+      //! The ID to be used in the next control packet sent to the target; 0 if the client still has to query the target's status
+      uint16_t mNextPacketId;
+
+      //! The number of replies that the target keeps for re-transmission, from its status reply
+      uint32_t mTargetReplyHistoryDepth;
+
+      //! The MTU (in bytes) of the target's network interface, from its status reply
+      uint32_t mTargetMtu;
+
+      //! The number of lost packets that have been recovered
+      uint64_t mRecoveredPacketLosses;
+
+      //! The number of lost packets that could not be recovered
+      uint64_t mFatalPacketLosses;
+
   };
 
 
@@ -0,0 +1,235 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+/**
+	@file
+*/
+
+#ifndef _uhal_SharedTCPConnection_hpp_
+#define _uhal_SharedTCPConnection_hpp_
+
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include "uhal/ClientInterface.hpp"
+#include "uhal/log/exception.hpp"
+
+
+namespace uhal
+{
+  // Forward declarations
+  class IOservicePool;
+
+  namespace exception
+  {
+    //! Exception class to handle the case where two clients sharing a ControlHub connection communicate with the same target.
+    UHAL_DEFINE_DERIVED_EXCEPTION_CLASS ( SharedControlHubTargetInUse , TransportLayerError , "Exception class to handle the case where two clients sharing a ControlHub connection communicate with the same target." )
+  }
+
+  /**
+    A TCP connection to the ControlHub which is shared by a group of ControlHub clients, so that a large number of targets can be controlled without one connection per client.
+    Each client queues whole TCP chunks, containing only its own packets, without waiting for them to be sent; the chunks are sent, one at a time, from a single I/O thread, on which a receive loop splits each chunk that it receives into the replies for individual packets, and passes each reply to the client which has attached to the target named in the reply's preamble.
+    The ControlHub returns the replies from each target in the order in which the requests were sent, so each client receives its replies in order.
+  */
+  class SharedTCPConnection
+  {
+    public:
+      /**
+        Function which is called (from the receive loop's I/O thread) with each reply from a client's target, starting with the reply's ControlHub preamble
+        Called with a NULL pointer if the connection fails, since any replies that are still awaited will then never arrive
+      */
+      typedef std::function< void ( const uint8_t* , std::size_t ) > Receiver;
+
+      /**
+        Return a connection shared by a group of clients, creating it if no other client in the group currently uses it
+        @param aGroup the name of the group
+        @param aHostname the ControlHub's hostname
+        @param aPort the ControlHub's port
+        @param aPoolSize the number of connections that the group spreads its clients across
+        @return the connection for the calling client; successive calls cycle through the pool
+      */
+      static std::shared_ptr< SharedTCPConnection > get ( const std::string& aGroup , const std::string& aHostname , const std::string& aPort , const uint32_t aPoolSize );
+
+      SharedTCPConnection ( const SharedTCPConnection& ) = delete;
+      SharedTCPConnection& operator= ( const SharedTCPConnection& ) = delete;
+
+      //! Destructor; stops the receive loop and closes the connection
+      ~SharedTCPConnection();
+
+      /**
+        Start passing the replies from a target to a client
+        @param aIPaddress the target's IP address, in network byte order (as in the ControlHub preamble)
+        @param aPort the target's port, in network byte order (as in the ControlHub preamble)
+        @param aReceiver the function to which the replies are passed
+        @throw exception::SharedControlHubTargetInUse if another client has already attached to the same target
+      */
+      void attach ( const uint32_t aIPaddress , const uint16_t aPort , const Receiver& aReceiver );
+
+      /**
+        Stop passing the replies from a target to a client; once this returns, the client's receiver is no longer running, and will not be called again
+        @param aIPaddress the target's IP address, in network byte order
+        @param aPort the target's port, in network byte order
+      */
+      void detach ( const uint32_t aIPaddress , const uint16_t aPort );
+
+      /**
+        Copy a TCP chunk into the send queue, and return without waiting for it to be sent; the chunk is sent from the I/O thread, first connecting to the ControlHub if needed
+        If the chunk cannot be sent, or it is not sent in full within the timeout, the connection fails, so every receiver is called with a NULL pointer
+        @param aSegments the gather list for the chunk, including its byte-count header
+        @param aTimeout the time allowed for the chunk to be sent, once it reaches the front of the queue
+      */
+      void send ( const std::vector< boost::asio::const_buffer >& aSegments , const boost::posix_time::time_duration& aTimeout );
+
+    private:
+      /**
+        Constructor
+        @param aName the name of the connection, for log messages
+        @param aHostname the ControlHub's hostname
+        @param aPort the ControlHub's port
+      */
+      SharedTCPConnection ( const std::string& aName , const std::string& aHostname , const std::string& aPort );
+
+      //! Send the chunk at the front of the send queue, first connecting to the ControlHub if needed; called on the I/O thread whenever no chunk is being sent
+      void sendNext();
+
+      //! Start the ASIO async write of the chunk being sent
+      void sendChunk();
+
+      //! Start making the TCP connection; called on the I/O thread once the previous connection (if any) has failed
+      void connect();
+
+      /**
+        Callback function which is called upon completion of the ASIO async connect; starts the receive loop, and then sends the queued chunks
+        @param aErrorCode the error code with which the ASIO operation completed
+      */
+      void connect_callback ( const boost::system::error_code& aErrorCode );
+
+      /**
+        Callback function which is called upon completion of the ASIO async write of a chunk; sends the next chunk
+        @param aErrorCode the error code with which the ASIO operation completed
+      */
+      void send_callback ( const boost::system::error_code& aErrorCode );
+
+      //! Callback function which is called when the send timer expires; fails the connection if the chunk being sent has not been sent in full
+      void sendTimeout_callback();
+
+      //! Start receiving the byte-count header of the next chunk
+      void receive();
+
+      /**
+        Callback function which is called upon completion of the ASIO async read of a chunk's byte-count header; receives the rest of the chunk
+        @param aErrorCode the error code with which the ASIO operation completed
+      */
+      void receiveHeader_callback ( const boost::system::error_code& aErrorCode );
+
+      /**
+        Callback function which is called upon completion of the ASIO async read of a chunk; passes each reply in the chunk to the client which attached to its target, and then receives the next chunk
+        @param aErrorCode the error code with which the ASIO operation completed
+      */
+      void receiveChunk_callback ( const boost::system::error_code& aErrorCode );
+
+      /**
+        Close the connection following an error, unless it has already failed; the connection is re-made for the next queued chunk
+        @param aErrorCode the error code with which the ASIO operation completed
+      */
+      void fail ( const boost::system::error_code& aErrorCode );
+
+      //! Close the socket, drop the chunks waiting to be sent, and tell all clients that their outstanding replies will not arrive
+      void abandon();
+
+      //! The name of the connection, for log messages
+      std::string mName;
+
+      //! The pool of I/O threads that the receive loop is attached to
+      std::shared_ptr< IOservicePool > mIOservicePool;
+
+      //! The io_service which runs the receive loop
+      boost::asio::io_service& mIOservice;
+
+      //! The ControlHub's endpoints
+      boost::asio::ip::tcp::resolver::iterator mEndpoint;
+
+      //! The shared connection
+      boost::asio::ip::tcp::socket mSocket;
+
+      //! Set (from the I/O thread) once the connection is being destroyed, so that the receive loop stops
+      bool mClosing;
+
+      //! Set (on the I/O thread) once the connection has failed; the connection is re-made for the next queued chunk
+      bool mFailed;
+
+      //! The chunks waiting to be sent, each with the time allowed for sending it; only used on the I/O thread, so that chunks from different clients are not interleaved
+      std::deque< std::pair< std::shared_ptr< std::vector< uint8_t > > , boost::posix_time::time_duration > > mSendQueue;
+
+      //! The chunk being sent (or waiting for the connection to be made), if any; only used on the I/O thread
+      std::shared_ptr< std::vector< uint8_t > > mChunkBeingSent;
+
+      //! The timer which limits the time taken to send each chunk
+      boost::asio::deadline_timer mSendTimer;
+
+      //! The byte-count header of the chunk being received
+      uint32_t mReplyByteCounter;
+
+      //! The memory into which chunks are received
+      std::vector< uint8_t > mReceiveMemory;
+
+      //! A mutex protecting the map of receivers; held while a receiver runs, so that detach can wait for it to finish
+      std::mutex mReceiversMutex;
+
+      //! The function to which the replies from each target are passed, indexed by the target's IP address and port
+      std::map< std::pair< uint32_t , uint16_t > , Receiver > mReceivers;
+
+      //! A mutex protecting the registry of connections
+      static std::mutex mRegistryMutex;
+
+      //! The connections currently in use, indexed by group name, ControlHub endpoint and position in the group's pool
+      static std::map< std::string , std::weak_ptr< SharedTCPConnection > > mRegistry;
+
+      //! The number of clients that have picked a connection from each group's pool, so that successive clients cycle through it
+      static std::map< std::string , uint32_t > mPoolCounters;
+  };
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+/**
+	@file
+*/
+
+#ifndef _uhal_SharedUDPSocket_hpp_
+#define _uhal_SharedUDPSocket_hpp_
+
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#include "uhal/ClientInterface.hpp"
+#include "uhal/log/exception.hpp"
+
+
+namespace uhal
+{
+  // Forward declarations
+  class IOservicePool;
+
+  namespace exception
+  {
+    //! Exception class to handle the case where two clients sharing a UDP socket communicate with the same target.
+    UHAL_DEFINE_DERIVED_EXCEPTION_CLASS ( SharedUdpEndpointInUse , TransportLayerError , "Exception class to handle the case where two clients sharing a UDP socket communicate with the same target." )
+  }
+
+  /**
+    A UDP socket which is shared by a group of UDP clients, so that a large number of targets can be controlled without one socket (and hence one file descriptor, socket buffer and port) per client.
+    Datagrams are sent from the calling thread; a single receive loop, running on one I/O thread, passes each datagram that it receives to the client which has attached to the datagram's source address and port.
+  */
+  class SharedUDPSocket
+  {
+    public:
+      //! Function which is called (from the receive loop's I/O thread) with the contents of each datagram received from a client's target
+      typedef std::function< void ( const uint8_t* , std::size_t ) > Receiver;
+
+      /**
+        Return the socket shared by a group of clients, creating it if no other client in the group currently uses it
+        @param aGroup the name of the group
+        @return the socket shared by the group
+      */
+      static std::shared_ptr< SharedUDPSocket > get ( const std::string& aGroup );
+
+      SharedUDPSocket ( const SharedUDPSocket& ) = delete;
+      SharedUDPSocket& operator= ( const SharedUDPSocket& ) = delete;
+
+      //! Destructor; stops the receive loop and closes the socket
+      ~SharedUDPSocket();
+
+      /**
+        Start passing the datagrams received from a target to a client
+        @param aEndpoint the target's address and port
+        @param aReceiver the function to which the datagrams are passed
+        @throw exception::SharedUdpEndpointInUse if another client has already attached to the same target
+      */
+      void attach ( const boost::asio::ip::udp::endpoint& aEndpoint , const Receiver& aReceiver );
+
+      /**
+        Stop passing the datagrams received from a target to a client; once this returns, the client's receiver is no longer running, and will not be called again
+        @param aEndpoint the target's address and port
+      */
+      void detach ( const boost::asio::ip::udp::endpoint& aEndpoint );
+
+      /**
+        Send a datagram (from the calling thread)
+        @param aSegments the gather list for the datagram's contents
+        @param aEndpoint the target's address and port
+        @param aErrorCode set to the error that occurred, if the datagram could not be sent
+        @return the number of bytes sent
+      */
+      std::size_t send ( const std::vector< std::pair< const uint8_t* , uint32_t > >& aSegments , const boost::asio::ip::udp::endpoint& aEndpoint , boost::system::error_code& aErrorCode );
+
+    private:
+      /**
+        Constructor
+        @param aGroup the name of the group of clients which share the socket
+      */
+      SharedUDPSocket ( const std::string& aGroup );
+
+      //! Start receiving the next datagram
+      void receive();
+
+      /**
+        Callback function which is called upon completion of the ASIO async receive; passes the datagram to the client which attached to its source, and then receives the next one
+        @param aErrorCode the error code with which the ASIO operation completed
+        @param aBytesTransferred the size of the datagram
+      */
+      void receive_callback ( const boost::system::error_code& aErrorCode , std::size_t aBytesTransferred );
+
+      //! The name of the group of clients which share the socket
+      std::string mGroup;
+
+      //! The pool of I/O threads that the receive loop is attached to
+      std::shared_ptr< IOservicePool > mIOservicePool;
+
+      //! The io_service which runs the receive loop
+      boost::asio::io_service& mIOservice;
+
+      //! The shared socket
+      boost::asio::ip::udp::socket mSocket;
+
+      //! Set (from the I/O thread) once the socket is being destroyed, so that the receive loop stops
+      bool mClosing;
+
+      //! The source address and port of the datagram being received
+      boost::asio::ip::udp::endpoint mSender;
+
+      //! The memory into which datagrams are received, large enough for any UDP payload
+      std::vector< uint8_t > mReceiveMemory;
+
+      //! A mutex protecting the map of receivers; held while a receiver runs, so that detach can wait for it to finish
+      std::mutex mReceiversMutex;
+
+      //! The function to which the datagrams from each target are passed
+      std::map< boost::asio::ip::udp::endpoint , Receiver > mReceivers;
+
+      //! A mutex protecting the registry of sockets
+      static std::mutex mRegistryMutex;
+
+      //! The sockets currently in use, indexed by group name
+      static std::map< std::string , std::weak_ptr< SharedUDPSocket > > mRegistry;
+  };
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+
+namespace uhal
+{
+
+  template< typename T >
+  ArenaAllocator< T >::ArenaAllocator() noexcept
+  {
+  }
+
+
+  template< typename T >
+  ArenaAllocator< T >::ArenaAllocator ( const std::shared_ptr< ValMemArena >& aArena ) noexcept :
+    mArena ( aArena )
+  {
+  }
+
+
+  template< typename T >
+  template< typename U >
+  ArenaAllocator< T >::ArenaAllocator ( const ArenaAllocator< U >& aAllocator ) noexcept :
+    mArena ( aAllocator.mArena )
+  {
+  }
+
+
+  template< typename T >
+  T* ArenaAllocator< T >::allocate ( const std::size_t aNrObjects )
+  {
+    if ( mArena )
+    {
+      return static_cast< T* > ( mArena->allocate ( aNrObjects * sizeof ( T ) ) );
+    }
+
+    return static_cast< T* > ( ::operator new ( aNrObjects * sizeof ( T ) ) );
+  }
+
+
+  template< typename T >
+  void ArenaAllocator< T >::deallocate ( T* aPtr , const std::size_t aNrObjects ) noexcept
+  {
+    if ( mArena )
+    {
+      mArena->deallocate ( aPtr , aNrObjects * sizeof ( T ) );
+    }
+    else
+    {
+      ::operator delete ( aPtr );
+    }
+  }
+
+
+  template< typename T >
+  template< typename U , typename... Args >
+  void ArenaAllocator< T >::construct ( U* aPtr , Args&&... aArgs )
+  {
+    ::new ( static_cast< void* > ( aPtr ) ) U ( std::forward< Args > ( aArgs )... );
+  }
+
+
+  template< typename T >
+  template< typename U >
+  void ArenaAllocator< T >::destroy ( U* aPtr )
+  {
+    aPtr->~U();
+  }
+
+
+  template< typename T >
+  template< typename U >
+  bool ArenaAllocator< T >::operator== ( const ArenaAllocator< U >& aAllocator ) const noexcept
+  {
+    return mArena == aAllocator.mArena;
+  }
+
+
+  template< typename T >
+  template< typename U >
+  bool ArenaAllocator< T >::operator!= ( const ArenaAllocator< U >& aAllocator ) const noexcept
+  {
+    return mArena != aAllocator.mArena;
+  }
+
+}
@@ -49,6 +49,7 @@
 
 #include "uhal/log/exception.hpp"
 #include "uhal/definitions.hpp"
+#include "uhal/ValMemArena.hpp"
 
 
 
@@ -81,17 +82,20 @@ namespace uhal
       //! A flag for marking whether the data is actually valid
       bool valid;
       //! The IPbus header associated with the transaction that returned this data
-      std::deque<uint32_t> IPbusHeaders;
+      std::deque< uint32_t , ArenaAllocator< uint32_t > > IPbusHeaders;
 
     protected:
       //! Make ValHeader a friend since it is the only class that should be able to create an instance this struct
       friend class ValHeader;
+      //! Make ArenaAllocator a friend so that clients can create instances of this struct in their arena
+      template< typename U > friend class ArenaAllocator;
       /**
         Constructor
         Private, since this struct should only be used by the ValHeader
         @param aValid an initial validity
+        @param aAllocator the allocator for the IPbus header storage
       */
-      _ValHeader_ ( const bool& aValid );
+      _ValHeader_ ( const bool& aValid , const ArenaAllocator< uint32_t >& aAllocator = ArenaAllocator< uint32_t >() );
   };
 
 
@@ -109,14 +113,17 @@ namespace uhal
     protected:
       //! Make ValWord a friend since it is the only class that should be able to create an instance this struct
       friend class ValWord<T>;
+      //! Make ArenaAllocator a friend so that clients can create instances of this struct in their arena
+      template< typename U > friend class ArenaAllocator;
       /**
         Constructor
         Private, since this struct should only be used by the ValWord
         @param aValue an initial value
         @param aValid an initial validity
         @param aMask a mask value
+        @param aAllocator the allocator for the IPbus header storage
       */
-      _ValWord_ ( const T& aValue , const bool& aValid , const uint32_t aMask );
+      _ValWord_ ( const T& aValue , const bool& aValid , const uint32_t aMask , const ArenaAllocator< uint32_t >& aAllocator = ArenaAllocator< uint32_t >() );
   };
 
 
@@ -131,6 +138,8 @@ namespace uhal
     protected:
       //! Make ValVector a friend since it is the only class that should be able to create an instance this struct
       friend class ValVector<T>;
+      //! Make ArenaAllocator a friend so that clients can create instances of this struct in their arena
+      template< typename U > friend class ArenaAllocator;
       /**
         Constructor
         Private, since this struct should only be used by the ValVector
@@ -138,6 +147,14 @@ namespace uhal
         @param aValid an initial validity
       */
       _ValVector_ ( const std::vector<T>& aValue , const bool& aValid );
+      /**
+        Constructor
+        Private, since this struct should only be used by the ValVector
+        @param aSize the initial size of the block (entries are value-initialized)
+        @param aValid an initial validity
+        @param aAllocator the allocator for the IPbus header storage
+      */
+      _ValVector_ ( const uint32_t& aSize , const bool& aValid , const ArenaAllocator< uint32_t >& aAllocator );
   };
 
 
@@ -178,6 +195,12 @@ namespace uhal
       void valid ( bool aValid );
 
     protected:
+      /**
+        Constructor wrapping existing members, used by clients to create validated memories in their arena
+        @param aMembers the underlying memory
+      */
+      ValHeader ( const std::shared_ptr< _ValHeader_ >& aMembers );
+
       //! A shared pointer to a _ValWord_ struct, so that every copy of this ValWord points to the same underlying memory
       std::shared_ptr< _ValHeader_ > mMembers;
   };
@@ -261,6 +284,12 @@ namespace uhal
       void mask ( const uint32_t& aMask );
 
     private:
+      /**
+        Constructor wrapping existing members, used by clients to create validated memories in their arena
+        @param aMembers the underlying memory
+      */
+      ValWord ( const std::shared_ptr< _ValWord_<T> >& aMembers );
+
       //! A shared pointer to a _ValWord_ struct, so that every copy of this ValWord points to the same underlying memory
       std::shared_ptr< _ValWord_<T> > mMembers;
 
@@ -400,6 +429,12 @@ namespace uhal
       void value ( const std::vector<T>& aValue );
 
     private:
+      /**
+        Constructor wrapping existing members, used by clients to create validated memories in their arena
+        @param aMembers the underlying memory
+      */
+      ValVector ( const std::shared_ptr< _ValVector_<T> >& aMembers );
+
       //! A shared pointer to a _ValVector_ struct, so that every copy of this ValVector points to the same underlying memory
       std::shared_ptr< _ValVector_<T> > mMembers;
 
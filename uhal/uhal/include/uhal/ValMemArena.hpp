@@ -0,0 +1,183 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+/**
+	@file
+*/
+
+#ifndef _uhal_ValMemArena_hpp_
+#define _uhal_ValMemArena_hpp_
+
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+namespace uhal
+{
+
+  /**
+    A slab allocator for the small objects that back the validated memories (the _ValHeader_/_ValWord_/_ValVector_ structs, their shared_ptr control blocks and their IPbus header storage)
+    Blocks are carved from large slabs and recycled through per-size-class free lists, so that queuing a transaction does not normally touch the heap.
+    Allocation must only be performed by one thread at a time (clients allocate under their user-side mutex), but blocks may be freed from any thread, since validated memories can outlive the dispatch and be handed between threads.
+  */
+  class ValMemArena
+  {
+    public:
+      ValMemArena();
+
+      ValMemArena ( const ValMemArena& ) = delete;
+      ValMemArena& operator= ( const ValMemArena& ) = delete;
+
+      //! Destructor; returns all slabs to the heap
+      ~ValMemArena();
+
+      /**
+        Allocate a block of memory
+        @param aSize the number of bytes required
+        @return a pointer to the block; blocks larger than the biggest size class come directly from the heap
+      */
+      void* allocate ( const std::size_t aSize );
+
+      /**
+        Return a block of memory to the arena
+        @param aPtr a pointer to the block
+        @param aSize the number of bytes that were requested when the block was allocated
+      */
+      void deallocate ( void* aPtr , const std::size_t aSize );
+
+    private:
+      //! Header overlaid on each free block, linking it into a free list
+      struct FreeBlock
+      {
+        FreeBlock* next;
+      };
+
+      //! Granularity of the size classes, in bytes
+      static const std::size_t kSizeClassGranularity = 64;
+      //! Number of size classes; larger requests bypass the arena
+      static const std::size_t kNrSizeClasses = 16;
+      //! Size of each slab, in bytes
+      static const std::size_t kSlabSize = 64 * 1024;
+
+      //! Blocks that are free for re-use, per size class; only accessed by the allocating thread
+      FreeBlock* mFreeBlocks[kNrSizeClasses];
+      //! Blocks that have been freed since the allocating thread last collected them, per size class; pushed by any thread
+      std::atomic< FreeBlock* > mReturnedBlocks[kNrSizeClasses];
+      //! The slabs from which blocks are carved
+      std::vector< char* > mSlabs;
+      //! Next unused byte in the current slab
+      char* mSlabPosition;
+      //! End of the current slab
+      char* mSlabEnd;
+  };
+
+
+  /**
+    A standard allocator which takes its memory from a ValMemArena, and holds a reference to that arena so that the arena outlives every object allocated from it
+    A default-constructed allocator is not associated with an arena, and falls back to the heap
+  */
+  template< typename T >
+  class ArenaAllocator
+  {
+      template< typename U > friend class ArenaAllocator;
+
+    public:
+      //! The type of object allocated
+      typedef T value_type;
+
+      //! Default constructor; memory will come from the heap
+      ArenaAllocator() noexcept;
+
+      /**
+        Constructor
+        @param aArena the arena from which memory will be allocated
+      */
+      explicit ArenaAllocator ( const std::shared_ptr< ValMemArena >& aArena ) noexcept;
+
+      /**
+        Converting constructor, sharing the same arena
+        @param aAllocator an allocator for another type
+      */
+      template< typename U >
+      ArenaAllocator ( const ArenaAllocator< U >& aAllocator ) noexcept;
+
+      /**
+        Allocate memory for a number of objects
+        @param aNrObjects the number of objects
+        @return a pointer to the memory
+      */
+      T* allocate ( const std::size_t aNrObjects );
+
+      /**
+        Free memory that was allocated by this allocator (or one equal to it)
+        @param aPtr a pointer to the memory
+        @param aNrObjects the number of objects that the memory was allocated for
+      */
+      void deallocate ( T* aPtr , const std::size_t aNrObjects ) noexcept;
+
+      /**
+        Construct an object in allocated memory; defined here so that the validated memory structs, whose constructors are not public, can befriend this allocator
+        @param aPtr a pointer to the memory
+        @param aArgs the constructor arguments
+      */
+      template< typename U , typename... Args >
+      void construct ( U* aPtr , Args&&... aArgs );
+
+      /**
+        Destroy an object in allocated memory
+        @param aPtr a pointer to the object
+      */
+      template< typename U >
+      void destroy ( U* aPtr );
+
+      template< typename U >
+      bool operator== ( const ArenaAllocator< U >& aAllocator ) const noexcept;
+
+      template< typename U >
+      bool operator!= ( const ArenaAllocator< U >& aAllocator ) const noexcept;
+
+    private:
+      //! The arena from which memory is allocated (null to use the heap)
+      std::shared_ptr< ValMemArena > mArena;
+  };
+
+}
+
+
+#include "uhal/TemplateDefinitions/ValMemArena.hxx"
+
+#endif
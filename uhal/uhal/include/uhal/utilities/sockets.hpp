@@ -0,0 +1,91 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+/**
+	@file
+*/
+
+#ifndef _uhal_utilities_sockets_hpp_
+#define _uhal_utilities_sockets_hpp_
+
+
+#include <chrono>
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <boost/system/error_code.hpp>
+
+
+namespace uhal
+{
+  namespace utilities
+  {
+    /**
+      Receive one datagram by spinning on non-blocking receive calls (yielding the CPU between them), rather than sleeping until the kernel wakes the thread
+      @param aSocket the socket's file descriptor
+      @param aSegments the segments into which the datagram is scattered
+      @param aNrSegments the number of segments (no more than IOV_MAX)
+      @param aDeadline the time at which to give up, reporting boost::asio::error::timed_out
+      @param aErrorCode set if the receive failed
+      @return the number of bytes received
+    */
+    std::size_t busyReceive ( const int aSocket , iovec* aSegments , const std::size_t aNrSegments , const std::chrono::steady_clock::time_point& aDeadline , boost::system::error_code& aErrorCode );
+
+    /**
+      Send or receive the full contents of a list of segments by spinning on non-blocking system calls, picking up where each partial transfer left off (as needed for stream sockets)
+      @param aSocket the socket's file descriptor
+      @param aSegments the segments to be sent or filled; modified to describe the untransferred remainder
+      @param aSend whether to send (rather than receive)
+      @param aDeadline the time at which to give up, reporting boost::asio::error::timed_out
+      @param aErrorCode set if the transfer failed, including boost::asio::error::eof if the peer closed the connection
+      @param aDestination the destination address, for sends on unconnected datagram sockets
+      @param aDestinationSize the size of the destination address
+      @return the number of bytes transferred
+    */
+    std::size_t busyTransfer ( const int aSocket , std::vector< iovec >& aSegments , const bool aSend , const std::chrono::steady_clock::time_point& aDeadline , boost::system::error_code& aErrorCode , const sockaddr* aDestination = NULL , const socklen_t aDestinationSize = 0 );
+
+    /**
+      Ask the kernel to busy-poll the device queue for the given period when a receive call finds a socket empty (SO_BUSY_POLL)
+      @param aSocket the socket's file descriptor
+      @param aPeriod the busy-poll period in microseconds
+      @return the error reported by setsockopt, if any (e.g. if not permitted)
+    */
+    boost::system::error_code setKernelBusyPoll ( const int aSocket , const uint32_t aPeriod );
+  }
+}
+
+
+#endif
@@ -0,0 +1,290 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/BufferPool.hpp"
+
+
+#include <algorithm>
+#include <iterator>
+
+
+#include "uhal/Buffers.hpp"
+
+
+namespace uhal
+{
+
+  BufferPool::BufferPool() :
+    mMask ( 0 ),
+    mPutPosition ( 0 ),
+    mTakePosition ( 0 ),
+    mMaxSendSize ( 0 ),
+    mNrCreated ( 0 ),
+    mNrPooled ( 0 ),
+    mNrOverflow ( 0 )
+  {
+  }
+
+
+  BufferPool::~BufferPool()
+  {
+  }
+
+
+  void BufferPool::allocate ( const size_t aCapacity , const uint32_t aMaxSendSize )
+  {
+    mMaxSendSize = aMaxSendSize;
+
+    std::vector< std::shared_ptr< Buffers > > lBuffers;
+    lBuffers.reserve ( aCapacity );
+
+    for ( size_t i = 0; i < aCapacity; i++ )
+    {
+      lBuffers.push_back ( std::shared_ptr< Buffers > ( new Buffers ( aMaxSendSize ) ) );
+    }
+
+    mNrCreated = aCapacity;
+    fill ( lBuffers );
+  }
+
+
+  void BufferPool::clear()
+  {
+    {
+      std::lock_guard<std::mutex> lLock ( mOverflowMutex );
+      mOverflow.clear();
+      mNrOverflow.store ( 0 , std::memory_order_relaxed );
+    }
+
+    mSlots.reset();
+    mMask = 0;
+    mPutPosition.store ( 0 , std::memory_order_relaxed );
+    mTakePosition.store ( 0 , std::memory_order_relaxed );
+    mNrCreated = 0;
+    mNrPooled.store ( 0 , std::memory_order_relaxed );
+  }
+
+
+  size_t BufferPool::capacity() const
+  {
+    return mSlots ? mMask + 1 : 0;
+  }
+
+
+  bool BufferPool::put ( std::shared_ptr< Buffers >& aBuffers )
+  {
+    if ( ! mSlots )
+    {
+      return false;
+    }
+
+    if ( ! putIntoRing ( aBuffers ) )
+    {
+      std::lock_guard<std::mutex> lLock ( mOverflowMutex );
+      mOverflow.push_back ( std::move ( aBuffers ) );
+      aBuffers.reset();
+      mNrOverflow.store ( mOverflow.size() , std::memory_order_relaxed );
+    }
+
+    // Only counted once the buffer is completely in the pool, so that take() knows no other thread is still accessing the ring
+    mNrPooled.fetch_add ( 1 , std::memory_order_release );
+    return true;
+  }
+
+
+  bool BufferPool::take ( std::shared_ptr< Buffers >& aBuffers )
+  {
+    // If every buffer is in the pool then no other thread can be putting one, so the ring can safely be replaced
+    if ( mNrOverflow.load ( std::memory_order_relaxed ) && ( mNrPooled.load ( std::memory_order_acquire ) == mNrCreated ) )
+    {
+      grow();
+    }
+
+    if ( takeFromRing ( aBuffers ) )
+    {
+      mNrPooled.fetch_sub ( 1 , std::memory_order_relaxed );
+      return true;
+    }
+
+    if ( mNrOverflow.load ( std::memory_order_relaxed ) )
+    {
+      std::lock_guard<std::mutex> lLock ( mOverflowMutex );
+
+      if ( ! mOverflow.empty() )
+      {
+        aBuffers = std::move ( mOverflow.back() );
+        mOverflow.pop_back();
+        mNrOverflow.store ( mOverflow.size() , std::memory_order_relaxed );
+        mNrPooled.fetch_sub ( 1 , std::memory_order_relaxed );
+        return true;
+      }
+    }
+
+    aBuffers.reset ( new Buffers ( mMaxSendSize ) );
+    mNrCreated++;
+    return false;
+  }
+
+
+  void BufferPool::fill ( std::vector< std::shared_ptr< Buffers > >& aBuffers )
+  {
+    size_t lNrSlots ( 1 );
+
+    while ( lNrSlots < aBuffers.size() )
+    {
+      lNrSlots <<= 1;
+    }
+
+    mSlots.reset ( new Slot[lNrSlots] );
+    mMask = lNrSlots - 1;
+    mTakePosition.store ( 0 , std::memory_order_relaxed );
+    mPutPosition.store ( aBuffers.size() , std::memory_order_relaxed );
+
+    // The first aBuffers.size() slots hold a buffer; any remaining slots (from rounding up) start empty
+    for ( size_t i = 0; i < lNrSlots; i++ )
+    {
+      if ( i < aBuffers.size() )
+      {
+        mSlots[i].buffers = std::move ( aBuffers.at ( i ) );
+        mSlots[i].sequence.store ( i + 1 , std::memory_order_relaxed );
+      }
+      else
+      {
+        mSlots[i].sequence.store ( i , std::memory_order_relaxed );
+      }
+    }
+
+    mNrPooled.store ( aBuffers.size() , std::memory_order_relaxed );
+    std::atomic_thread_fence ( std::memory_order_release );
+  }
+
+
+  void BufferPool::grow()
+  {
+    std::vector< std::shared_ptr< Buffers > > lBuffers;
+    lBuffers.reserve ( mNrCreated );
+    std::shared_ptr< Buffers > lBuffer;
+
+    while ( takeFromRing ( lBuffer ) )
+    {
+      lBuffers.push_back ( std::move ( lBuffer ) );
+    }
+
+    {
+      std::lock_guard<std::mutex> lLock ( mOverflowMutex );
+      std::move ( mOverflow.begin() , mOverflow.end() , std::back_inserter ( lBuffers ) );
+      mOverflow.clear();
+      mNrOverflow.store ( 0 , std::memory_order_relaxed );
+    }
+
+    fill ( lBuffers );
+  }
+
+
+  bool BufferPool::putIntoRing ( std::shared_ptr< Buffers >& aBuffers )
+  {
+    size_t lPosition ( mPutPosition.load ( std::memory_order_relaxed ) );
+    Slot* lSlot;
+
+    while ( true )
+    {
+      lSlot = &mSlots[ lPosition & mMask ];
+      const size_t lSequence ( lSlot->sequence.load ( std::memory_order_acquire ) );
+      const ptrdiff_t lDifference ( ptrdiff_t ( lSequence ) - ptrdiff_t ( lPosition ) );
+
+      if ( lDifference == 0 )
+      {
+        // Slot is empty on this lap; claim it
+        if ( mPutPosition.compare_exchange_weak ( lPosition , lPosition + 1 , std::memory_order_relaxed ) )
+        {
+          break;
+        }
+      }
+      else if ( lDifference < 0 )
+      {
+        // Slot still holds a buffer from the previous lap, i.e. the pool is full
+        return false;
+      }
+      else
+      {
+        lPosition = mPutPosition.load ( std::memory_order_relaxed );
+      }
+    }
+
+    lSlot->buffers = std::move ( aBuffers );
+    aBuffers.reset();
+    lSlot->sequence.store ( lPosition + 1 , std::memory_order_release );
+    return true;
+  }
+
+
+  bool BufferPool::takeFromRing ( std::shared_ptr< Buffers >& aBuffers )
+  {
+    if ( ! mSlots )
+    {
+      return false;
+    }
+
+    size_t lPosition ( mTakePosition.load ( std::memory_order_relaxed ) );
+    Slot* lSlot;
+
+    while ( true )
+    {
+      lSlot = &mSlots[ lPosition & mMask ];
+      const size_t lSequence ( lSlot->sequence.load ( std::memory_order_acquire ) );
+      const ptrdiff_t lDifference ( ptrdiff_t ( lSequence ) - ptrdiff_t ( lPosition + 1 ) );
+
+      if ( lDifference == 0 )
+      {
+        // Slot holds a buffer on this lap; claim it
+        if ( mTakePosition.compare_exchange_weak ( lPosition , lPosition + 1 , std::memory_order_relaxed ) )
+        {
+          break;
+        }
+      }
+      else if ( lDifference < 0 )
+      {
+        // Slot has not been filled on this lap, i.e. the pool is empty
+        return false;
+      }
+      else
+      {
+        lPosition = mTakePosition.load ( std::memory_order_relaxed );
+      }
+    }
+
+    aBuffers = std::move ( lSlot->buffers );
+    lSlot->sequence.store ( lPosition + mMask + 1 , std::memory_order_release );
+    return true;
+  }
+
+}
@@ -72,6 +72,19 @@ namespace uhal
   }
 
 
+  void Buffers::send ( const uint8_t* aPtr , const uint32_t& aSize , const std::shared_ptr< const void >& aOwner )
+  {
+    mSendReferences.push_back ( std::make_pair ( mSendCounter , std::make_pair ( aPtr , aSize ) ) );
+
+    if ( mSendReferenceOwners.empty() || ( mSendReferenceOwners.back() != aOwner ) )
+    {
+      mSendReferenceOwners.push_back ( aOwner );
+    }
+
+    mSendCounter += aSize;
+  }
+
+
   void Buffers::receive ( uint8_t* aPtr , const uint32_t& aSize )
   {
     mReplyBuffer.push_back ( std::make_pair ( aPtr , aSize ) );
@@ -98,6 +111,30 @@ namespace uhal
     return &mSendBuffer[0];
   }
 
+  const std::vector< std::pair< const uint8_t* , uint32_t > >& Buffers::getSendSegments()
+  {
+    mSendSegments.clear();
+    uint32_t lOffset ( 0 );
+
+    for ( const auto& lReference : mSendReferences )
+    {
+      if ( lReference.first != lOffset )
+      {
+        mSendSegments.push_back ( std::make_pair ( &mSendBuffer[0] + lOffset , lReference.first - lOffset ) );
+      }
+
+      mSendSegments.push_back ( lReference.second );
+      lOffset = lReference.first + lReference.second.second;
+    }
+
+    if ( mSendCounter != lOffset )
+    {
+      mSendSegments.push_back ( std::make_pair ( &mSendBuffer[0] + lOffset , mSendCounter - lOffset ) );
+    }
+
+    return mSendSegments;
+  }
+
   std::deque< std::pair< uint8_t* , uint32_t > >& Buffers::getReplyBuffer()
   {
     return mReplyBuffer;
@@ -122,6 +159,8 @@ namespace uhal
     mSendCounter = 0 ;
     mReplyCounter = 0 ;
     mReplyBuffer.clear();
+    mSendReferences.clear();
+    mSendReferenceOwners.clear();
     mValHeaders.clear();
     mUnsignedValWords.clear();
     mUnsignedValVectors.clear();
@@ -37,6 +37,7 @@
 #include <boost/spirit/include/qi.hpp>
 
 #include "uhal/grammars/URIGrammar.hpp"
+#include "uhal/IOservicePool.hpp"
 #include "uhal/ProtocolUDP.hpp"
 #include "uhal/ProtocolTCP.hpp"
 #include "uhal/ProtocolIPbus.hpp"
@@ -139,5 +140,29 @@ namespace uhal
     return lIt->second.creator->create ( aId , lUri );
   }
 
+
+  void ClientFactory::setSharedIOservicePool ( const size_t aNrThreads )
+  {
+    if ( aNrThreads == 0 )
+    {
+      log ( Info() , "Socket-based clients will each run their own I/O thread" );
+      mSharedIOservicePool.reset();
+    }
+    else
+    {
+      log ( Info() , "Socket-based clients will share a pool of " , Integer ( aNrThreads ) , " I/O threads" );
+      mSharedIOservicePool.reset ( new IOservicePool ( aNrThreads ) );
+    }
+  }
+
+
+  std::shared_ptr<IOservicePool> ClientFactory::getIOservicePool() const
+  {
+    if ( mSharedIOservicePool )
+      return mSharedIOservicePool;
+
+    return std::make_shared<IOservicePool> ( 1 );
+  }
+
 }
 
@@ -40,6 +40,7 @@
 #include "uhal/Buffers.hpp"
 #include "uhal/log/LogLevels.hpp"                              // for BaseLo...
 #include "uhal/log/log_inserters.integer.hpp"                  // for Integer
+#include "uhal/log/log_inserters.quote.hpp"                    // for Quote
 #include "uhal/log/log.hpp"
 #include "uhal/utilities/bits.hpp"
 
@@ -52,6 +53,10 @@ namespace uhal
 #ifdef NO_PREEMPTIVE_DISPATCH
     mNoPreemptiveDispatchBuffers(),
 #endif
+    mNrDispatchedBuffers ( 0 ),
+    mNrValidatedBuffers ( 0 ),
+    mDispatchFailureReported ( false ),
+    mValMemArena ( std::make_shared< ValMemArena >() ),
     mId ( aId ),
     mTimeoutPeriod ( aTimeoutPeriod ),
     mUri ( aUri ),
@@ -65,6 +70,10 @@ namespace uhal
 #ifdef NO_PREEMPTIVE_DISPATCH
     mNoPreemptiveDispatchBuffers(),
 #endif
+    mNrDispatchedBuffers ( 0 ),
+    mNrValidatedBuffers ( 0 ),
+    mDispatchFailureReported ( false ),
+    mValMemArena ( std::make_shared< ValMemArena >() ),
     mId ( ),
     mTimeoutPeriod ( boost::posix_time::pos_infin ),
     mUri ( ),
@@ -78,6 +87,10 @@ namespace uhal
 #ifdef NO_PREEMPTIVE_DISPATCH
     mNoPreemptiveDispatchBuffers(),
 #endif
+    mNrDispatchedBuffers ( 0 ),
+    mNrValidatedBuffers ( 0 ),
+    mDispatchFailureReported ( false ),
+    mValMemArena ( std::make_shared< ValMemArena >() ),
     mId ( aClientInterface.mId ),
     mTimeoutPeriod ( aClientInterface.mTimeoutPeriod ),
     mUri ( aClientInterface.mUri ),
@@ -146,6 +159,8 @@ namespace uhal
 
     try
     {
+      recoverFromReportedFailure();
+
 #ifdef NO_PREEMPTIVE_DISPATCH
       log ( Info() , "mNoPreemptiveDispatchBuffers.size() = " , Integer ( mNoPreemptiveDispatchBuffers.size() ) );
 
@@ -153,13 +168,11 @@ namespace uhal
       {
         this->predispatch ( lBuffer );
         this->implementDispatch ( lBuffer ); //responsibility for lBuffer passed to the implementDispatch function
+        countDispatchedBuffer();
         lBuffer.reset();
       }
 
-      {
-        std::lock_guard<std::mutex> lLock ( mBufferMutex );
-        mNoPreemptiveDispatchBuffers.clear();
-      }
+      mNoPreemptiveDispatchBuffers.clear();
 
       this->Flush();
 #endif
@@ -168,6 +181,7 @@ namespace uhal
       {
         this->predispatch ( mCurrentBuffers );
         this->implementDispatch ( mCurrentBuffers ); //responsibility for mCurrentBuffers passed to the implementDispatch function
+        countDispatchedBuffer();
         mCurrentBuffers.reset();
         this->Flush();
       }
@@ -180,10 +194,85 @@ namespace uhal
   }
 
 
+  std::future< void > ClientInterface::dispatchAsync ()
+  {
+    std::lock_guard<std::mutex> lLock ( mUserSideMutex );
+
+    std::promise< void > lPromise;
+    std::future< void > lFuture ( lPromise.get_future() );
+
+    try
+    {
+      recoverFromReportedFailure();
+
+#ifdef NO_PREEMPTIVE_DISPATCH
+      for (auto& lBuffer: mNoPreemptiveDispatchBuffers)
+      {
+        this->predispatch ( lBuffer );
+        this->implementDispatch ( lBuffer ); //responsibility for lBuffer passed to the implementDispatch function
+        countDispatchedBuffer();
+        lBuffer.reset();
+      }
+
+      mNoPreemptiveDispatchBuffers.clear();
+#endif
+
+      if ( mCurrentBuffers )
+      {
+        this->predispatch ( mCurrentBuffers );
+        this->implementDispatch ( mCurrentBuffers ); //responsibility for mCurrentBuffers passed to the implementDispatch function
+        countDispatchedBuffer();
+        mCurrentBuffers.reset();
+      }
+
+      // Transport layers which only collect the replies when asked to must do so now, so this call blocks in the same way as dispatch
+      if ( ! this->startFlush() )
+      {
+        this->Flush();
+      }
+    }
+    catch ( ... )
+    {
+      this->dispatchExceptionHandler();
+      lPromise.set_exception ( std::current_exception() );
+      return lFuture;
+    }
+
+    std::lock_guard<std::mutex> lPendingLock ( mPendingDispatchMutex );
+
+    if ( mDispatchFailure )
+    {
+      lPromise.set_exception ( mDispatchFailure );
+      mDispatchFailureReported = true;
+    }
+    else if ( mNrValidatedBuffers == mNrDispatchedBuffers )
+    {
+      lPromise.set_value();
+    }
+    else
+    {
+      mPendingDispatches.push_back ( std::make_pair ( mNrDispatchedBuffers , std::move ( lPromise ) ) );
+    }
+
+    return lFuture;
+  }
+
+
   void ClientInterface::Flush ()
   {}
 
 
+  bool ClientInterface::startFlush ()
+  {
+    return false;
+  }
+
+
+  void ClientInterface::queryTargetCapacity ()
+  {
+  }
+
+
   exception::exception* ClientInterface::validate ( std::shared_ptr< Buffers > aBuffers )
   {
     exception::exception* lRet = this->validate ( aBuffers->getSendBuffer() ,
@@ -195,6 +284,15 @@ namespace uhal
     if ( !lRet )
     {
       aBuffers->validate ();
+
+      std::lock_guard<std::mutex> lLock ( mPendingDispatchMutex );
+      mNrValidatedBuffers++;
+
+      while ( mPendingDispatches.size() && mPendingDispatches.front().first <= mNrValidatedBuffers )
+      {
+        mPendingDispatches.front().second.set_value();
+        mPendingDispatches.pop_front();
+      }
     }
 
     returnBufferToPool ( aBuffers );
@@ -219,11 +317,9 @@ namespace uhal
 
   void ClientInterface::returnBufferToPool ( std::shared_ptr< Buffers >& aBuffers )
   {
-    std::lock_guard<std::mutex> lLock ( mBufferMutex );
-
-    if ( aBuffers )
+    // If the pool has not been allocated, the buffer is simply released
+    if ( aBuffers && ! mBuffers.put ( aBuffers ) )
     {
-      mBuffers.push_back ( aBuffers );
       aBuffers.reset();
     }
   }
@@ -231,13 +327,8 @@ namespace uhal
 
   void ClientInterface::returnBufferToPool ( std::deque< std::shared_ptr< Buffers > >& aBuffers )
   {
-    std::lock_guard<std::mutex> lLock ( mBufferMutex );
-
     for (auto& lBuf : aBuffers)
-    {
-      if (lBuf)
-        mBuffers.push_back(lBuf);
-    }
+      returnBufferToPool ( lBuf );
 
     aBuffers.clear();
   }
@@ -245,13 +336,8 @@ namespace uhal
 
   void ClientInterface::returnBufferToPool ( std::vector< std::shared_ptr<Buffers> >& aBuffers )
   {
-    std::lock_guard<std::mutex> lLock ( mBufferMutex );
-
     for (auto& lBuf: aBuffers)
-    {
-      if (lBuf)
-        mBuffers.push_back (lBuf);
-    }
+      returnBufferToPool ( lBuf );
 
     aBuffers.clear();
   }
@@ -259,17 +345,9 @@ namespace uhal
 
   void ClientInterface::returnBufferToPool ( std::deque< std::vector< std::shared_ptr<Buffers> > >& aBuffers )
   {
-    std::lock_guard<std::mutex> lLock ( mBufferMutex );
-
     for ( std::deque < std::vector < std::shared_ptr< Buffers > > >::iterator lIt1 = aBuffers.begin(); lIt1 != aBuffers.end(); ++lIt1 )
     {
-      for ( std::vector< std::shared_ptr<Buffers> >::iterator lIt2 = lIt1->begin(); lIt2 != lIt1->end(); ++lIt2 )
-      {
-        if ( *lIt2 )
-        {
-          mBuffers.push_back ( *lIt2 );
-        }
-      }
+      returnBufferToPool ( *lIt1 );
     }
 
     aBuffers.clear();
@@ -307,8 +385,10 @@ namespace uhal
 
     try
     {
+      recoverFromReportedFailure();
       this->predispatch ( mCurrentBuffers );
       this->implementDispatch ( mCurrentBuffers );
+      countDispatchedBuffer();
       mCurrentBuffers.reset();
     }
     catch ( ... )
@@ -340,21 +420,21 @@ namespace uhal
   {
     if ( ! mCurrentBuffers )
     {
+      // Size the pool on first use (and after an exception has cleared it, since the target may have changed), as the maximum
+      // number of packets in flight is only known by the derived class; no buffers are in circulation at this point, so no
+      // other thread can be accessing the pool
+      if ( mBuffers.capacity() == 0 )
       {
-        std::lock_guard<std::mutex> lLock ( mBufferMutex );
-
-        if ( mBuffers.size() == 0 )
-        {
-          for ( uint32_t i=0; i!=10; ++i )
-          {
-            mBuffers.push_back ( std::shared_ptr< Buffers > ( new Buffers ( this->getMaxSendSize() ) ) );
-          }
-        }
+        this->queryTargetCapacity();
+        mBuffers.allocate ( this->getMaxNumberOfBuffers() + 2 , this->getMaxSendSize() );
+      }
 
-        mCurrentBuffers = mBuffers.front();
-        mBuffers.pop_front();
-        mCurrentBuffers->clear();
+      if ( ! mBuffers.take ( mCurrentBuffers ) )
+      {
+        log ( Debug() , "Buffer pool for client with URI " , mUriString , " was empty; created new buffer" );
       }
+
+      mCurrentBuffers->clear();
       this->preamble ( mCurrentBuffers );
     }
   }
@@ -362,45 +442,143 @@ namespace uhal
 
   void ClientInterface::deleteBuffers()
   {
-    std::lock_guard<std::mutex> lLock ( mBufferMutex );
-    mBuffers.clear();
-
+    // The transport layer has already returned its buffers and stopped accessing the pool (e.g. in dispatchExceptionHandler),
+    // so it can be cleared, along with its slots; it is then re-sized from the target when next used
 #ifdef NO_PREEMPTIVE_DISPATCH
-    mNoPreemptiveDispatchBuffers.clear();
+    returnBufferToPool ( mNoPreemptiveDispatchBuffers );
 #endif
 
-    if ( mCurrentBuffers )
+    returnBufferToPool ( mCurrentBuffers );
+    mBuffers.clear();
+  }
+
+
+  void ClientInterface::countDispatchedBuffer()
+  {
+    std::lock_guard<std::mutex> lLock ( mPendingDispatchMutex );
+    mNrDispatchedBuffers++;
+  }
+
+
+  void ClientInterface::recoverFromReportedFailure()
+  {
     {
-      mCurrentBuffers.reset();
+      std::lock_guard<std::mutex> lLock ( mPendingDispatchMutex );
+
+      if ( ! mDispatchFailureReported )
+      {
+        return;
+      }
+    }
+
+    log ( Info() , "Cleaning up after exception reported by asynchronous dispatch for client with URI " , Quote ( mUriString ) );
+    std::shared_ptr< Buffers > lCurrentBuffers;
+    lCurrentBuffers.swap ( mCurrentBuffers );
+    this->dispatchExceptionHandler();
+    mCurrentBuffers.swap ( lCurrentBuffers );
+  }
+
+
+  void ClientInterface::addDispatchFailureHandler ( const std::function< void () >& aHandler )
+  {
+    std::lock_guard<std::mutex> lLock ( mPendingDispatchMutex );
+    mDispatchFailureHandlers.push_back ( aHandler );
+  }
+
+
+  void ClientInterface::notifyDispatchFailure()
+  {
+    for ( const auto& lHandler : mDispatchFailureHandlers )
+    {
+      lHandler();
+    }
+  }
+
+
+  void ClientInterface::failPendingDispatches ( exception::exception& aExc )
+  {
+    std::lock_guard<std::mutex> lLock ( mPendingDispatchMutex );
+    notifyDispatchFailure();
+
+    if ( ! mDispatchFailure )
+    {
+      try
+      {
+        aExc.throwAsDerivedType();
+      }
+      catch ( ... )
+      {
+        mDispatchFailure = std::current_exception();
+      }
+    }
+
+    // If no future is waiting for it, the exception is instead rethrown by the next dispatch, as usual
+    if ( mPendingDispatches.size() )
+    {
+      mDispatchFailureReported = true;
     }
 
+    for ( auto& lPending : mPendingDispatches )
+    {
+      lPending.second.set_exception ( mDispatchFailure );
+    }
+
+    mPendingDispatches.clear();
   }
 
 
   void ClientInterface::dispatchExceptionHandler()
   {
+    {
+      std::lock_guard<std::mutex> lLock ( mPendingDispatchMutex );
+      notifyDispatchFailure();
+
+      if ( mPendingDispatches.size() )
+      {
+        std::exception_ptr lFailure ( mDispatchFailure ? mDispatchFailure : std::current_exception() );
+
+        if ( ! lFailure )
+        {
+          lFailure = std::make_exception_ptr ( exception::DispatchAbandoned() );
+        }
+
+        for ( auto& lPending : mPendingDispatches )
+        {
+          lPending.second.set_exception ( lFailure );
+        }
+
+        mPendingDispatches.clear();
+      }
+
+      // Any buffers in flight are discarded, so start counting afresh
+      mNrDispatchedBuffers = 0;
+      mNrValidatedBuffers = 0;
+      mDispatchFailure = std::exception_ptr();
+      mDispatchFailureReported = false;
+    }
+
     deleteBuffers();
   }
 
 
   std::pair < ValHeader , _ValHeader_* > ClientInterface::CreateValHeader()
   {
-    ValHeader lReply;
-    return std::make_pair ( lReply , & ( * ( lReply.mMembers ) ) );
+    std::shared_ptr< _ValHeader_ > lMembers ( std::allocate_shared< _ValHeader_ > ( ArenaAllocator< _ValHeader_ > ( mValMemArena ) , false , ArenaAllocator< uint32_t > ( mValMemArena ) ) );
+    return std::make_pair ( ValHeader ( lMembers ) , lMembers.get() );
   }
 
 
   std::pair < ValWord<uint32_t> , _ValWord_<uint32_t>* > ClientInterface::CreateValWord ( const uint32_t& aValue , const uint32_t& aMask )
   {
-    ValWord<uint32_t> lReply ( aValue , aMask );
-    return std::make_pair ( lReply , & ( * ( lReply.mMembers ) ) );
+    std::shared_ptr< _ValWord_<uint32_t> > lMembers ( std::allocate_shared< _ValWord_<uint32_t> > ( ArenaAllocator< _ValWord_<uint32_t> > ( mValMemArena ) , aValue , false , aMask , ArenaAllocator< uint32_t > ( mValMemArena ) ) );
+    return std::make_pair ( ValWord<uint32_t> ( lMembers ) , lMembers.get() );
   }
 
 
   std::pair < ValVector<uint32_t> , _ValVector_<uint32_t>* > ClientInterface::CreateValVector ( const uint32_t& aSize )
   {
-    ValVector<uint32_t> lReply ( aSize );
-    return std::make_pair ( lReply , & ( * ( lReply.mMembers ) ) );
+    std::shared_ptr< _ValVector_<uint32_t> > lMembers ( std::allocate_shared< _ValVector_<uint32_t> > ( ArenaAllocator< _ValVector_<uint32_t> > ( mValMemArena ) , aSize , false , ArenaAllocator< uint32_t > ( mValMemArena ) ) );
+    return std::make_pair ( ValVector<uint32_t> ( lMembers ) , lMembers.get() );
   }
 
 
@@ -438,7 +616,13 @@ namespace uhal
       throw lExc;
     }
 
-    return ( ValHeader ) ( implementRMWbits ( aAddr , ~aMask , lBitShiftedSource & aMask ) );
+    return implementMaskedWrite ( aAddr , ~aMask , lBitShiftedSource & aMask );
+  }
+
+
+  ValHeader ClientInterface::implementMaskedWrite ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm )
+  {
+    return ( ValHeader ) ( implementRMWbits ( aAddr , aANDterm , aORterm ) );
   }
 
 
@@ -447,6 +631,14 @@ namespace uhal
     std::lock_guard<std::mutex> lLock ( mUserSideMutex );
     return implementWriteBlock ( aAddr, aSource, aMode );
   }
+
+
+  ValHeader ClientInterface::writeBlock ( const uint32_t& aAddr, std::vector< uint32_t >&& aSource, const defs::BlockReadWriteMode& aMode )
+  {
+    std::shared_ptr< const std::vector< uint32_t > > lSource ( std::make_shared< std::vector< uint32_t > > ( std::move ( aSource ) ) );
+    std::lock_guard<std::mutex> lLock ( mUserSideMutex );
+    return implementWriteBlock ( aAddr, lSource, aMode );
+  }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 
@@ -470,6 +662,13 @@ namespace uhal
     std::lock_guard<std::mutex> lLock ( mUserSideMutex );
     return implementReadBlock ( aAddr, aSize, aMode );
   }
+
+
+  ValHeader ClientInterface::readBlockInto ( const uint32_t& aAddr, uint32_t* aDestination, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode )
+  {
+    std::lock_guard<std::mutex> lLock ( mUserSideMutex );
+    return implementReadBlockInto ( aAddr, aDestination, aSize, aMode );
+  }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 
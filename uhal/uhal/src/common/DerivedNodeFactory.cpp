@@ -72,11 +72,11 @@ namespace uhal
 
   Node* DerivedNodeFactory::convertToClassType ( Node* aNode )
   {
-    std::unordered_map< std::string , std::shared_ptr<CreatorInterface> >::const_iterator lIt = mCreators.find ( aNode->mClassName );
+    std::unordered_map< std::string , std::shared_ptr<CreatorInterface> >::const_iterator lIt = mCreators.find ( aNode->mProperties->mClassName );
 
     if ( lIt == mCreators.end() )
     {
-      log ( Warning , "Class " , Quote ( aNode->mClassName ) , " is unknown to the NodeTreeBuilder class factory. A plain node will be returned instead." );
+      log ( Warning , "Class " , Quote ( aNode->mProperties->mClassName ) , " is unknown to the NodeTreeBuilder class factory. A plain node will be returned instead." );
 
       if ( mCreators.size() )
       {
@@ -34,10 +34,12 @@
 
 
 #include <deque>
+#include <map>
 #include <memory>
 
 #include "uhal/ClientInterface.hpp"
 #include "uhal/Node.hpp"
+#include "uhal/utilities/bits.hpp"
 
 
 namespace uhal
@@ -45,16 +47,28 @@ namespace uhal
 
   HwInterface::HwInterface ( const std::shared_ptr<ClientInterface>& aClientInterface , const std::shared_ptr< Node >& aNode ) :
     mClientInterface ( aClientInterface ),
-    mNode ( aNode )
+    mNode ( aNode ),
+    mShadowCache ( new ShadowCache() )
   {
     claimNode ( *mNode );
     mClientInterface->mNode = mNode;
+
+    // Dispatch failures (including those of automatic dispatches, and those reported through dispatchAsync) mark the cache as stale; the
+    // client only holds a weak reference to it, since it is owned by this HwInterface and its copies
+    std::weak_ptr< ShadowCache > lShadowCache ( mShadowCache );
+    mClientInterface->addDispatchFailureHandler ( [lShadowCache] () {
+      if ( std::shared_ptr< ShadowCache > lCache = lShadowCache.lock() )
+      {
+        lCache->stale = true;
+      }
+    } );
   }
 
 
   HwInterface::HwInterface ( const HwInterface& otherHw ) :
     mClientInterface ( otherHw.mClientInterface ),
-    mNode ( otherHw.mNode->clone() )
+    mNode ( otherHw.mNode->clone() ),
+    mShadowCache ( otherHw.mShadowCache )
   {
     claimNode ( *mNode );
     mClientInterface->mNode = mNode;
@@ -70,6 +84,23 @@ namespace uhal
   {
     aNode.mHw = this;
 
+    // A node is shadowed if its "shadow" parameter is set, or if it inherits this from its parent; ports are never shadowed
+    std::unordered_map< std::string, std::string >::const_iterator lIt ( aNode.mProperties->mParameters.find ( "shadow" ) );
+
+    if ( lIt != aNode.mProperties->mParameters.end() )
+    {
+      aNode.mShadowed = ( lIt->second == "1" ) || ( lIt->second == "true" );
+    }
+    else
+    {
+      aNode.mShadowed = ( aNode.mParent != NULL ) && aNode.mParent->mShadowed;
+    }
+
+    if ( aNode.mProperties->mMode == defs::NON_INCREMENTAL )
+    {
+      aNode.mShadowed = false;
+    }
+
     for (Node* lChild: aNode.mChildren)
       claimNode ( *lChild );
   }
@@ -104,6 +135,12 @@ namespace uhal
   }
 
 
+  std::future< void > HwInterface::dispatchAsync ()
+  {
+    return mClientInterface->dispatchAsync ();
+  }
+
+
   const std::string& HwInterface::id() const
   {
     return mClientInterface->id();
@@ -150,6 +187,183 @@ namespace uhal
     return mNode->getNodes ( aRegex );
   }
 
-}
 
 
+  void HwInterface::invalidate ( const Node& aNode )
+  {
+    std::lock_guard<std::mutex> lLock ( mShadowCache->mutex );
+    mShadowCache->dropIfStale();
+
+    for ( Node::const_iterator lIt = aNode.begin(); lIt != aNode.end(); lIt++ )
+    {
+      if ( lIt->mShadowed )
+      {
+        mShadowCache->registers.erase ( lIt->mProperties->mAddr );
+      }
+    }
+  }
+
+
+  void HwInterface::invalidate ()
+  {
+    std::lock_guard<std::mutex> lLock ( mShadowCache->mutex );
+    mShadowCache->stale = false;
+    mShadowCache->registers.clear();
+  }
+
+
+  void HwInterface::refresh ( const Node& aNode )
+  {
+    // Only registers which can be read are refreshed; the cached values of write-only registers are simply dropped
+    std::map< uint32_t , bool > lAddresses;
+
+    for ( Node::const_iterator lIt = aNode.begin(); lIt != aNode.end(); lIt++ )
+    {
+      if ( lIt->mShadowed )
+      {
+        bool& lReadable ( lAddresses.insert ( std::make_pair ( lIt->mProperties->mAddr , true ) ).first->second );
+        lReadable = lReadable && ( lIt->mProperties->mPermission & defs::READ );
+      }
+    }
+
+    std::lock_guard<std::mutex> lLock ( mShadowCache->mutex );
+    mShadowCache->dropIfStale();
+
+    // Runs of consecutive readable registers are each re-read with a single block read
+    for ( std::map< uint32_t , bool >::const_iterator lIt = lAddresses.begin(); lIt != lAddresses.end(); )
+    {
+      if ( ! lIt->second )
+      {
+        mShadowCache->registers.erase ( lIt->first );
+        ++lIt;
+        continue;
+      }
+
+      std::map< uint32_t , bool >::const_iterator lEnd ( lIt );
+      uint32_t lSize ( 0 );
+
+      for ( ; ( lEnd != lAddresses.end() ) && lEnd->second && ( lEnd->first == lIt->first + lSize ); ++lEnd, ++lSize )
+      {
+      }
+
+      ValVector< uint32_t > lBlock ( mClientInterface->readBlock ( lIt->first , lSize , defs::INCREMENTAL ) );
+
+      for ( uint32_t i = 0; i != lSize; ++i, ++lIt )
+      {
+        ShadowRegister& lRegister ( mShadowCache->registers[ lIt->first ] );
+        lRegister.word = ValWord< uint32_t >();
+        lRegister.block = lBlock;
+        lRegister.offset = i;
+      }
+    }
+  }
+
+
+  ValWord< uint32_t > HwInterface::readShadowed ( const Node& aNode )
+  {
+    std::lock_guard<std::mutex> lLock ( mShadowCache->mutex );
+    mShadowCache->dropIfStale();
+    std::unordered_map< uint32_t , ShadowRegister >::iterator lIt ( mShadowCache->registers.find ( aNode.mProperties->mAddr ) );
+    uint32_t lValue;
+
+    if ( ( lIt != mShadowCache->registers.end() ) && getShadowedValue ( lIt->second , lValue ) )
+    {
+      ValWord< uint32_t > lWord ( lValue , aNode.mProperties->mMask );
+      lWord.valid ( true );
+      return lWord;
+    }
+
+    // Not cached (or an earlier read failed), so read the full register into the cache, and the masked field for the caller
+    ShadowRegister& lRegister ( mShadowCache->registers[ aNode.mProperties->mAddr ] );
+    lRegister.word = mClientInterface->read ( aNode.mProperties->mAddr );
+    lRegister.block = ValVector< uint32_t >();
+
+    if ( aNode.mProperties->mMask == defs::NOMASK )
+    {
+      return lRegister.word;
+    }
+
+    return mClientInterface->read ( aNode.mProperties->mAddr , aNode.mProperties->mMask );
+  }
+
+
+  ValHeader HwInterface::writeShadowed ( const Node& aNode , const uint32_t& aValue )
+  {
+    std::lock_guard<std::mutex> lLock ( mShadowCache->mutex );
+    mShadowCache->dropIfStale();
+    ShadowRegister& lRegister ( mShadowCache->registers[ aNode.mProperties->mAddr ] );
+    uint32_t lValue ( aValue );
+
+    if ( aNode.mProperties->mMask != defs::NOMASK )
+    {
+      const uint32_t lShiftSize ( utilities::TrailingRightBits ( aNode.mProperties->mMask ) );
+      const uint32_t lBitShiftedSource ( aValue << lShiftSize );
+
+      // If the register's value is not known yet (or the value does not fit the mask, in which case the client throws), fall back to a RMW, then re-read the register
+      if ( ( ( lBitShiftedSource >> lShiftSize ) != aValue ) || ( lBitShiftedSource & ~aNode.mProperties->mMask ) || ! getShadowedValue ( lRegister , lValue ) )
+      {
+        ValHeader lHeader ( mClientInterface->write ( aNode.mProperties->mAddr , aValue , aNode.mProperties->mMask ) );
+        lRegister.word = mClientInterface->read ( aNode.mProperties->mAddr );
+        lRegister.block = ValVector< uint32_t >();
+        return lHeader;
+      }
+
+      lValue = ( lValue & ~aNode.mProperties->mMask ) | lBitShiftedSource;
+    }
+
+    ValHeader lHeader ( mClientInterface->write ( aNode.mProperties->mAddr , lValue ) );
+    lRegister.word = ValWord< uint32_t > ( lValue );
+    lRegister.word.valid ( true );
+    lRegister.block = ValVector< uint32_t >();
+    return lHeader;
+  }
+
+
+  void HwInterface::dropShadowed ( const uint32_t& aAddr , const uint32_t& aSize )
+  {
+    std::lock_guard<std::mutex> lLock ( mShadowCache->mutex );
+
+    for ( uint32_t i = 0; i != aSize; ++i )
+    {
+      mShadowCache->registers.erase ( aAddr + i );
+    }
+  }
+
+
+  HwInterface::ShadowCache::ShadowCache() :
+    stale ( false )
+  {
+  }
+
+
+  void HwInterface::ShadowCache::dropIfStale()
+  {
+    if ( stale.exchange ( false ) )
+    {
+      registers.clear();
+    }
+  }
+
+
+  bool HwInterface::getShadowedValue ( ShadowRegister& aRegister , uint32_t& aValue )
+  {
+    if ( aRegister.word.valid() )
+    {
+      aValue = aRegister.word.value();
+      return true;
+    }
+
+    if ( aRegister.block.valid() )
+    {
+      // Keep the value, rather than the whole block read
+      aValue = aRegister.block.at ( aRegister.offset );
+      aRegister.word = ValWord< uint32_t > ( aValue );
+      aRegister.word.valid ( true );
+      aRegister.block = ValVector< uint32_t >();
+      return true;
+    }
+
+    return false;
+  }
+
+}
@@ -0,0 +1,106 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/IOservicePool.hpp"
+
+
+#include <algorithm>
+#include <exception>
+#include <future>
+
+
+namespace uhal
+{
+
+  IOservicePool::IOservicePool ( const size_t aNrThreads ) :
+    mNextIOservice ( 0 )
+  {
+    for ( size_t i = 0; i < std::max< size_t > ( aNrThreads , 1 ); i++ )
+    {
+      mIOservices.emplace_back ( new boost::asio::io_service() );
+      mIOserviceWork.emplace_back ( new boost::asio::io_service::work ( *mIOservices.back() ) );
+    }
+
+    for ( const auto& lIOservice : mIOservices )
+    {
+      boost::asio::io_service& lRef ( *lIOservice );
+      mThreads.emplace_back ( [&lRef] () { lRef.run(); } );
+    }
+  }
+
+
+  IOservicePool::~IOservicePool()
+  {
+    mIOserviceWork.clear();
+
+    for ( const auto& lIOservice : mIOservices )
+      lIOservice->stop();
+
+    for ( auto& lThread : mThreads )
+      lThread.join();
+  }
+
+
+  size_t IOservicePool::size() const
+  {
+    return mIOservices.size();
+  }
+
+
+  boost::asio::io_service& IOservicePool::getIOservice()
+  {
+    return *mIOservices.at ( mNextIOservice++ % mIOservices.size() );
+  }
+
+
+  void IOservicePool::drain ( boost::asio::io_service& aIOservice , const std::function< void () >& aFunction )
+  {
+    // Each io_service is run by a single thread, so handlers execute in the order that they were queued;
+    // hence, once the second handler has run, so have any that were queued by aFunction
+    std::promise< void > lDone;
+    aIOservice.post ( [&aIOservice, &aFunction, &lDone] () {
+      try
+      {
+        aFunction();
+      }
+      catch ( ... )
+      {
+        lDone.set_exception ( std::current_exception() );
+        return;
+      }
+
+      aIOservice.post ( [&lDone] () { lDone.set_value(); } );
+    } );
+    lDone.get_future().get();
+  }
+
+}
@@ -50,72 +50,35 @@ namespace uhal
 
   Node::Node ( )  :
     mHw ( NULL ),
-    mUid ( "" ),
-    mPartialAddr ( 0x00000000 ),
-    mAddr ( 0x00000000 ),
-    mMask ( defs::NOMASK ),
-    mPermission ( defs::READWRITE ),
-    mMode ( defs::HIERARCHICAL ),
-    mSize ( 0x00000001 ),
-    mTags ( "" ),
-    mDescription ( "" ),
-    mModule ( "" ),
-    mClassName ( "" ),
-    mParameters ( ),
-    mFirmwareInfo( ),
+    mShadowed ( false ),
+    mProperties ( std::make_shared<Properties>() ),
     mParent ( NULL ),
-    mChildren ( ),
-    mChildrenMap ( )
+    mChildren ( )
   {
   }
 
 
   Node::Node ( const Node& aNode )  :
     mHw ( aNode.mHw ),
-    mUid ( aNode.mUid ),
-    mPartialAddr ( aNode.mPartialAddr ),
-    mAddr ( aNode.mAddr ),
-    mMask ( aNode.mMask ),
-    mPermission ( aNode.mPermission ),
-    mMode ( aNode.mMode ),
-    mSize ( aNode.mSize ),
-    mTags ( aNode.mTags ),
-    mDescription ( aNode.mDescription ),
-    mModule ( aNode.mModule ),
-    mClassName ( aNode.mClassName ),
-    mParameters ( aNode.mParameters ),
-    mFirmwareInfo ( aNode.mFirmwareInfo ),
+    mShadowed ( aNode.mShadowed ),
+    mProperties ( aNode.mProperties ),
     mParent ( NULL ),
-    mChildren ( ),
-    mChildrenMap ( )
+    mChildren ( )
   {
     mChildren.reserve(aNode.mChildren.size());
     for (Node* lChild : aNode.mChildren)
       mChildren.push_back (lChild->clone());
 
     for (Node* lChild : mChildren)
-    {
       lChild->mParent = this;
-      mChildrenMap.insert ( std::make_pair ( lChild->mUid , lChild ) );
-    }
   }
 
 
   Node& Node::operator= ( const Node& aNode )
   {
     mHw = aNode.mHw;
-    mUid = aNode.mUid ;
-    mPartialAddr = aNode.mPartialAddr;
-    mAddr = aNode.mAddr;
-    mMask = aNode.mMask;
-    mPermission = aNode.mPermission;
-    mMode = aNode.mMode;
-    mSize = aNode.mSize;
-    mTags = aNode.mTags;
-    mDescription = aNode.mDescription;
-    mModule = aNode.mModule;
-    mClassName = aNode.mClassName;
-    mParameters = aNode.mParameters;
+    mShadowed = aNode.mShadowed;
+    mProperties = aNode.mProperties;
 
     for (Node* lChild: mChildren)
     {
@@ -127,17 +90,13 @@ namespace uhal
     }
 
     mChildren.clear();
-    mChildrenMap.clear();
 
     mChildren.reserve(aNode.mChildren.size());
     for (Node* lNode: aNode.mChildren)
       mChildren.push_back ( lNode->clone() );
 
     for (Node* lNode: mChildren)
-    {
       lNode->mParent = this;
-      mChildrenMap.insert ( std::make_pair ( lNode->mUid , lNode ) );
-    }
 
     return *this;
   }
@@ -149,6 +108,36 @@ namespace uhal
   }
 
 
+  Node::Properties::Properties ( )  :
+    mUid ( "" ),
+    mPartialAddr ( 0x00000000 ),
+    mAddr ( 0x00000000 ),
+    mMask ( defs::NOMASK ),
+    mPermission ( defs::READWRITE ),
+    mMode ( defs::HIERARCHICAL ),
+    mSize ( 0x00000001 ),
+    mTags ( "" ),
+    mDescription ( "" ),
+    mModule ( "" ),
+    mClassName ( "" ),
+    mParameters ( ),
+    mFirmwareInfo ( ),
+    mChildrenMap ( )
+  {
+  }
+
+
+  Node::Properties& Node::modifyProperties()
+  {
+    if ( mProperties.use_count() > 1 )
+    {
+      mProperties = std::make_shared<Properties> ( *mProperties );
+    }
+
+    return *mProperties;
+  }
+
+
   Node::~Node()
   {
     for (Node* lNode: mChildren)
@@ -161,7 +150,6 @@ namespace uhal
     }
 
     mChildren.clear();
-    mChildrenMap.clear();
   }
 
 
@@ -190,7 +178,7 @@ namespace uhal
 
   const std::string& Node::getId() const
   {
-    return mUid;
+    return mProperties->mUid;
   }
 
 
@@ -202,9 +190,9 @@ namespace uhal
 
     for (const Node* lNode: lPath)
     {
-      if ( lNode->mUid.size() )
+      if ( lNode->mProperties->mUid.size() )
       {
-        lRet += lNode->mUid;
+        lRet += lNode->mProperties->mUid;
         lRet += ".";
       }
     }
@@ -226,9 +214,9 @@ namespace uhal
 
     for (std::deque< const Node* >::iterator lIt ( std::find(lPath.begin(), lPath.end(), &aAncestor) + 1 ) ; lIt != lPath.end() ; ++lIt )
     {
-      if ( ( **lIt ).mUid.size() )
+      if ( ( **lIt ).mProperties->mUid.size() )
       {
-        lRet += ( **lIt ).mUid;
+        lRet += ( **lIt ).mProperties->mUid;
         lRet += ".";
       }
     }
@@ -255,61 +243,61 @@ namespace uhal
 
   const uint32_t& Node::getAddress() const
   {
-    return mAddr;
+    return mProperties->mAddr;
   }
 
 
   const uint32_t& Node::getMask() const
   {
-    return mMask;
+    return mProperties->mMask;
   }
 
 
   const defs::BlockReadWriteMode& Node::getMode() const
   {
-    return mMode;
+    return mProperties->mMode;
   }
 
 
   const uint32_t& Node::getSize() const
   {
-    return mSize;
+    return mProperties->mSize;
   }
 
 
   const defs::NodePermission& Node::getPermission() const
   {
-    return mPermission;
+    return mProperties->mPermission;
   }
 
 
   const std::string& Node::getTags() const
   {
-    return mTags;
+    return mProperties->mTags;
   }
 
 
   const std::string& Node::getDescription() const
   {
-    return mDescription;
+    return mProperties->mDescription;
   }
 
 
   const std::string& Node::getModule() const
   {
-    return mModule;
+    return mProperties->mModule;
   }
 
 
   const std::unordered_map< std::string, std::string >& Node::getParameters() const
   {
-    return mParameters;
+    return mProperties->mParameters;
   }
 
 
   const std::unordered_map< std::string, std::string >& Node::getFirmwareInfo() const
   {
-    return mFirmwareInfo;
+    return mProperties->mFirmwareInfo;
   }
 
 
@@ -319,7 +307,7 @@ namespace uhal
 
     aStr << std::setfill ( '0' ) << std::uppercase;
     aStr << '\n' << std::string ( aIndent , ' ' ) << "+ ";
-    aStr << "Node \"" << mUid << "\", ";
+    aStr << "Node \"" << mProperties->mUid << "\", ";
 
     if ( &typeid ( *this ) != &typeid ( Node ) )
     {
@@ -336,62 +324,62 @@ namespace uhal
       aStr << "\", ";
     }
 
-    switch ( mMode )
+    switch ( mProperties->mMode )
     {
       case defs::SINGLE:
         aStr << "SINGLE register, "
-             << std::hex << "Address 0x" << std::setw ( 8 ) << mAddr << ", "
-             << std::hex << "Mask 0x" << std::setw ( 8 ) << mMask << ", "
-             << "Permissions " << ( mPermission&defs::READ?'r':'-' ) << ( mPermission&defs::WRITE?'w':'-' ) ;
+             << std::hex << "Address 0x" << std::setw ( 8 ) << mProperties->mAddr << ", "
+             << std::hex << "Mask 0x" << std::setw ( 8 ) << mProperties->mMask << ", "
+             << "Permissions " << ( mProperties->mPermission&defs::READ?'r':'-' ) << ( mProperties->mPermission&defs::WRITE?'w':'-' ) ;
         break;
       case defs::INCREMENTAL:
         aStr << "INCREMENTAL block, "
-             << std::dec << "Size " << mSize << ", "
-             << std::hex << "Addresses [0x" << std::setw ( 8 ) << mAddr << "-" << std::setw ( 8 ) << ( mAddr+mSize-1 ) << "], "
-             << "Permissions " << ( mPermission&defs::READ?'r':'-' ) << ( mPermission&defs::WRITE?'w':'-' ) ;
+             << std::dec << "Size " << mProperties->mSize << ", "
+             << std::hex << "Addresses [0x" << std::setw ( 8 ) << mProperties->mAddr << "-" << std::setw ( 8 ) << ( mProperties->mAddr+mProperties->mSize-1 ) << "], "
+             << "Permissions " << ( mProperties->mPermission&defs::READ?'r':'-' ) << ( mProperties->mPermission&defs::WRITE?'w':'-' ) ;
         break;
       case defs::NON_INCREMENTAL:
         aStr << "NON-INCREMENTAL block, ";
 
-        if ( mSize != 1 )
+        if ( mProperties->mSize != 1 )
         {
-          aStr << std::dec << "Size " << mSize << ", ";
+          aStr << std::dec << "Size " << mProperties->mSize << ", ";
         }
 
-        aStr << std::hex << "Address 0x"  << std::setw ( 8 ) << mAddr << ", "
-             << "Permissions " << ( mPermission&defs::READ?'r':'-' ) << ( mPermission&defs::WRITE?'w':'-' ) ;
+        aStr << std::hex << "Address 0x"  << std::setw ( 8 ) << mProperties->mAddr << ", "
+             << "Permissions " << ( mProperties->mPermission&defs::READ?'r':'-' ) << ( mProperties->mPermission&defs::WRITE?'w':'-' ) ;
         break;
       case defs::HIERARCHICAL:
-        aStr << std::hex << "Address 0x" << std::setw ( 8 ) << mAddr;
+        aStr << std::hex << "Address 0x" << std::setw ( 8 ) << mProperties->mAddr;
         break;
     }
 
-    if ( mTags.size() )
+    if ( mProperties->mTags.size() )
     {
-      aStr << ", Tags \"" << mTags << "\"";
+      aStr << ", Tags \"" << mProperties->mTags << "\"";
     }
 
-    if ( mDescription.size() )
+    if ( mProperties->mDescription.size() )
     {
-      aStr << ", Description \"" << mDescription << "\"";
+      aStr << ", Description \"" << mProperties->mDescription << "\"";
     }
 
-    if ( mModule.size() )
+    if ( mProperties->mModule.size() )
     {
-      aStr << ", Module \"" << mModule << "\"";
+      aStr << ", Module \"" << mProperties->mModule << "\"";
     }
 
-    if ( mClassName.size() )
+    if ( mProperties->mClassName.size() )
     {
-      aStr << ", Class Name \"" << mClassName << "\"";
+      aStr << ", Class Name \"" << mProperties->mClassName << "\"";
     }
 
-    if ( mParameters.size() )
+    if ( mProperties->mParameters.size() )
     {
       aStr << ", Parameters: ";
       std::unordered_map<std::string, std::string>::const_iterator lIt;
 
-      for ( lIt = mParameters.begin(); lIt != mParameters.end(); ++lIt )
+      for ( lIt = mProperties->mParameters.begin(); lIt != mProperties->mParameters.end(); ++lIt )
       {
         aStr << lIt->first << "=" << lIt->second << ";";
       }
@@ -422,10 +410,10 @@ namespace uhal
 
     do {
       lDotIdx = aId.find('.', lStartIdx);
-      std::unordered_map< std::string , Node* >::const_iterator lIt = lDescendant->mChildrenMap.find ( aId.substr(lStartIdx, lDotIdx - lStartIdx) );
+      std::unordered_map< std::string , std::size_t >::const_iterator lIt = lDescendant->mProperties->mChildrenMap.find ( aId.substr(lStartIdx, lDotIdx - lStartIdx) );
 
-      if (lIt != lDescendant->mChildrenMap.end()) {
-        lDescendant = lIt->second;
+      if (lIt != lDescendant->mProperties->mChildrenMap.end()) {
+        lDescendant = lDescendant->mChildren.at ( lIt->second );
       }
       else if (lDescendant == this) {
         exception::NoBranchFoundWithGivenUID lExc;
@@ -485,15 +473,19 @@ namespace uhal
 
   ValHeader  Node::write ( const uint32_t& aValue ) const
   {
-    if ( mPermission & defs::WRITE )
+    if ( mProperties->mPermission & defs::WRITE )
     {
-      if ( mMask == defs::NOMASK )
+      if ( mShadowed && ( ( mProperties->mMask == defs::NOMASK ) || ( mProperties->mPermission & defs::READ ) ) )
       {
-        return mHw->getClient().write ( mAddr , aValue );
+        return mHw->writeShadowed ( *this , aValue );
       }
-      else if ( mPermission & defs::READ )
+      else if ( mProperties->mMask == defs::NOMASK )
       {
-        return mHw->getClient().write ( mAddr , aValue , mMask );
+        return mHw->getClient().write ( mProperties->mAddr , aValue );
+      }
+      else if ( mProperties->mPermission & defs::READ )
+      {
+        return mHw->getClient().write ( mProperties->mAddr , aValue , mProperties->mMask );
       }
       else // Masked write-only register
       {
@@ -509,9 +501,9 @@ namespace uhal
   }
 
 
-  ValHeader  Node::writeBlock ( const std::vector< uint32_t >& aValues ) const // , const defs::BlockReadWriteMode& aMode )
+  void Node::prepareBlockWrite ( const uint32_t& aSize ) const
   {
-    if ( ( mMode == defs::SINGLE ) && ( aValues.size() != 1 ) ) //We allow the user to call a bulk access of size=1 to a single register
+    if ( ( mProperties->mMode == defs::SINGLE ) && ( aSize != 1 ) ) //We allow the user to call a bulk access of size=1 to a single register
     {
       exception::BulkTransferOnSingleRegister lExc;
       log ( lExc , "Bulk Transfer requested on single register node " , Quote ( this->getPath() ) );
@@ -519,37 +511,51 @@ namespace uhal
       throw lExc;
     }
 
-    if ( ( mSize != 1 ) && ( aValues.size() >mSize ) )
+    if ( ( mProperties->mSize != 1 ) && ( aSize >mProperties->mSize ) )
     {
       exception::BulkTransferRequestedTooLarge lExc;
       log ( lExc , "Requested bulk write of greater size than the specified endpoint size of node ", Quote ( this->getPath() ) );
       throw lExc;
     }
 
-    if ( mPermission & defs::WRITE )
-    {
-      return mHw->getClient().writeBlock ( mAddr , aValues , mMode ); //aMode );
-    }
-    else
+    if ( not ( mProperties->mPermission & defs::WRITE ) )
     {
       exception::WriteAccessDenied lExc;
       log ( lExc , "Node " , Quote ( this->getPath() ) , ": permissions denied write access" );
       throw lExc;
     }
-    
+
+    if ( mShadowed )
+    {
+      mHw->dropShadowed ( mProperties->mAddr , aSize );
+    }
+  }
+
+
+  ValHeader  Node::writeBlock ( const std::vector< uint32_t >& aValues ) const // , const defs::BlockReadWriteMode& aMode )
+  {
+    prepareBlockWrite ( aValues.size() );
+    return mHw->getClient().writeBlock ( mProperties->mAddr , aValues , mProperties->mMode ); //aMode );
+  }
+
+
+  ValHeader  Node::writeBlock ( std::vector< uint32_t >&& aValues ) const
+  {
+    prepareBlockWrite ( aValues.size() );
+    return mHw->getClient().writeBlock ( mProperties->mAddr , std::move ( aValues ) , mProperties->mMode );
   }
 
 
   ValHeader  Node::writeBlockOffset ( const std::vector< uint32_t >& aValues , const uint32_t& aOffset ) const // , const defs::BlockReadWriteMode& aMode )
   {
-    if ( mMode == defs::NON_INCREMENTAL )
+    if ( mProperties->mMode == defs::NON_INCREMENTAL )
     {
       exception::BulkTransferOffsetRequestedForFifo lExc;
       log ( lExc , "Bulk Transfer Offset requested for non-incremental node " , Quote ( this->getPath() ) );
       throw lExc;
     }
 
-    if ( mMode == defs::SINGLE ) //We allow the user to call a bulk access of size=1 to a single register
+    if ( mProperties->mMode == defs::SINGLE ) //We allow the user to call a bulk access of size=1 to a single register
     {
       exception::BulkTransferOffsetRequestedForSingleRegister lExc;
       log ( lExc , "Bulk Transfer with offset requested on single register node " , Quote ( this->getPath() ) );
@@ -557,16 +563,21 @@ namespace uhal
       throw lExc;
     }
 
-    if ( (aValues.size()+aOffset) > mSize )
+    if ( (aValues.size()+aOffset) > mProperties->mSize )
     {
       exception::BulkTransferRequestedTooLarge lExc;
       log ( lExc , "Requested bulk write size and offset would overflow the specified endpoint node ", Quote ( this->getPath() ) );
       throw lExc;
     }
 
-    if ( mPermission & defs::WRITE )
+    if ( mProperties->mPermission & defs::WRITE )
     {
-      return mHw->getClient().writeBlock ( mAddr+aOffset , aValues , mMode ); //aMode );
+      if ( mShadowed )
+      {
+        mHw->dropShadowed ( mProperties->mAddr+aOffset , aValues.size() );
+      }
+
+      return mHw->getClient().writeBlock ( mProperties->mAddr+aOffset , aValues , mProperties->mMode ); //aMode );
     }
     else
     {
@@ -580,15 +591,19 @@ namespace uhal
 
   ValWord< uint32_t > Node::read() const
   {
-    if ( mPermission & defs::READ )
+    if ( mProperties->mPermission & defs::READ )
     {
-      if ( mMask == defs::NOMASK )
+      if ( mShadowed )
+      {
+        return mHw->readShadowed ( *this );
+      }
+      else if ( mProperties->mMask == defs::NOMASK )
       {
-        return mHw->getClient().read ( mAddr );
+        return mHw->getClient().read ( mProperties->mAddr );
       }
       else
       {
-        return mHw->getClient().read ( mAddr , mMask );
+        return mHw->getClient().read ( mProperties->mAddr , mProperties->mMask );
       }
     }
 
@@ -599,9 +614,9 @@ namespace uhal
   }
 
 
-  ValVector< uint32_t > Node::readBlock ( const uint32_t& aSize ) const //, const defs::BlockReadWriteMode& aMode )
+  void Node::checkBlockRead ( const uint32_t& aSize ) const
   {
-    if ( ( mMode == defs::SINGLE ) && ( aSize != 1 ) ) //We allow the user to call a bulk access of size=1 to a single register
+    if ( ( mProperties->mMode == defs::SINGLE ) && ( aSize != 1 ) ) //We allow the user to call a bulk access of size=1 to a single register
     {
       exception::BulkTransferOnSingleRegister lExc;
       log ( lExc , "Bulk Transfer requested on single register node ", Quote ( this->getPath() ) );
@@ -609,37 +624,39 @@ namespace uhal
       throw lExc;
     }
 
-    if ( ( mSize != 1 ) && ( aSize>mSize ) )
+    if ( ( mProperties->mSize != 1 ) && ( aSize>mProperties->mSize ) )
     {
       exception::BulkTransferRequestedTooLarge lExc;
       log ( lExc , "Requested bulk read of greater size than the specified endpoint size of node " , Quote ( this->getPath() ) );
       throw lExc;
     }
 
-    if ( mPermission & defs::READ )
-    {
-      return mHw->getClient().readBlock ( mAddr , aSize , mMode ); //aMode );
-    }
-    else
+    if ( not ( mProperties->mPermission & defs::READ ) )
     {
       exception::ReadAccessDenied lExc;
       log ( lExc , "Node " , Quote ( this->getPath() ) , ": permissions denied read access" );
       throw lExc;
     }
-    
+  }
+
+
+  ValVector< uint32_t > Node::readBlock ( const uint32_t& aSize ) const //, const defs::BlockReadWriteMode& aMode )
+  {
+    checkBlockRead ( aSize );
+    return mHw->getClient().readBlock ( mProperties->mAddr , aSize , mProperties->mMode ); //aMode );
   }
 
 
   ValVector< uint32_t > Node::readBlockOffset ( const uint32_t& aSize , const uint32_t& aOffset ) const //, const defs::BlockReadWriteMode& aMode )
   {
-    if ( mMode == defs::NON_INCREMENTAL )
+    if ( mProperties->mMode == defs::NON_INCREMENTAL )
     {
       exception::BulkTransferOffsetRequestedForFifo lExc;
       log ( lExc , "Bulk Transfer offset requested for non-incremental node " , Quote ( this->getPath() ) );
       throw lExc;
     }
 
-    if ( mMode == defs::SINGLE ) //We do not allow the user to use an offset from a single register
+    if ( mProperties->mMode == defs::SINGLE ) //We do not allow the user to use an offset from a single register
     {
       exception::BulkTransferOffsetRequestedForSingleRegister lExc;
       log ( lExc , "Bulk Transfer with offset requested on single register node ", Quote ( this->getPath() ) );
@@ -647,16 +664,16 @@ namespace uhal
       throw lExc;
     }
 
-    if ( (aSize+aOffset) > mSize )
+    if ( (aSize+aOffset) > mProperties->mSize )
     {
       exception::BulkTransferRequestedTooLarge lExc;
       log ( lExc , "Requested bulk read size and offset would overflow the specified endpoint node " , Quote ( this->getPath() ) );
       throw lExc;
     }
 
-    if ( mPermission & defs::READ )
+    if ( mProperties->mPermission & defs::READ )
     {
-      return mHw->getClient().readBlock ( mAddr+aOffset , aSize , mMode ); //aMode );
+      return mHw->getClient().readBlock ( mProperties->mAddr+aOffset , aSize , mProperties->mMode ); //aMode );
     }
     else
     {
@@ -668,6 +685,13 @@ namespace uhal
   }
 
 
+  ValHeader Node::readBlockInto ( uint32_t* aDestination , const uint32_t& aSize ) const
+  {
+    checkBlockRead ( aSize );
+    return mHw->getClient().readBlockInto ( mProperties->mAddr , aDestination , aSize , mProperties->mMode );
+  }
+
+
   ClientInterface& Node::getClient() const
   {
     return mHw->getClient();
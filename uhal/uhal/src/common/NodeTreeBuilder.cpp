@@ -33,6 +33,7 @@
 #include "uhal/NodeTreeBuilder.hpp"
 
 
+#include <algorithm>
 #include <chrono>
 #include <functional>
 
@@ -263,9 +264,9 @@ namespace uhal
     //setMask( aXmlNode , lNode );
     setModeAndSize ( aXmlNode , lNode );
     addChildren ( aXmlNode , lNode );
-    log ( Debug() , lNode->mUid , " built by " , __PRETTY_FUNCTION__ );
+    log ( Debug() , lNode->mProperties->mUid , " built by " , __PRETTY_FUNCTION__ );
 
-    if ( lNode->mClassName.size() )
+    if ( lNode->mProperties->mClassName.size() )
     {
       return DerivedNodeFactory::getInstance().convertToClassType ( lNode );
     }
@@ -292,9 +293,9 @@ namespace uhal
     //setMask( aXmlNode , lNode );
     //setModeAndSize( aXmlNode , lNode );
     //addChildren( aXmlNode , lNode );
-    log ( Debug() , lNode->mUid , " built by " , __PRETTY_FUNCTION__ );
+    log ( Debug() , lNode->mProperties->mUid , " built by " , __PRETTY_FUNCTION__ );
 
-    if ( lNode->mClassName.size() )
+    if ( lNode->mProperties->mClassName.size() )
     {
       return DerivedNodeFactory::getInstance().convertToClassType ( lNode );
     }
@@ -327,7 +328,7 @@ namespace uhal
     setMask ( aXmlNode , lNode );
     //setModeAndSize( aXmlNode , lNode );
     //addChildren( aXmlNode , lNode );
-    log ( Debug() , lNode->mUid , " built by " , __PRETTY_FUNCTION__ );
+    log ( Debug() , lNode->mProperties->mUid , " built by " , __PRETTY_FUNCTION__ );
     return lNode;
   }
 
@@ -336,7 +337,8 @@ namespace uhal
 
   void NodeTreeBuilder::setUid ( const bool& aRequireId , const pugi::xml_node& aXmlNode , Node* aNode )
   {
-    const bool lHasId = uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mIdAttribute , aNode->mUid );
+    Node::Properties& lProperties ( aNode->modifyProperties() );
+    const bool lHasId = uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mIdAttribute , lProperties.mUid );
 
     if ( aRequireId and ( not lHasId ) )
     {
@@ -346,35 +348,38 @@ namespace uhal
 
     if ( lHasId )
     {
-      if ( aNode->mUid.empty() )
+      if ( lProperties.mUid.empty() )
         throw exception::NodeAttributeIncorrectValue("Invalid node ID specified (empty)");
-      else if ( aNode->mUid.find('.') != std::string::npos )
-        throw exception::NodeAttributeIncorrectValue("Invalid node ID '" + aNode->mUid + "' specified (contains dots)");
-      else if ( ( aNode->mUid.at(0) == ' ' ) or ( aNode->mUid.at(aNode->mUid.size()-1) == ' ' ) )
-        throw exception::NodeAttributeIncorrectValue("Invalid node ID '" + aNode->mUid + "' specified (contains spaces)");
+      else if ( lProperties.mUid.find('.') != std::string::npos )
+        throw exception::NodeAttributeIncorrectValue("Invalid node ID '" + lProperties.mUid + "' specified (contains dots)");
+      else if ( ( lProperties.mUid.at(0) == ' ' ) or ( lProperties.mUid.at(lProperties.mUid.size()-1) == ' ' ) )
+        throw exception::NodeAttributeIncorrectValue("Invalid node ID '" + lProperties.mUid + "' specified (contains spaces)");
     }
   }
 
   void NodeTreeBuilder::setAddr ( const pugi::xml_node& aXmlNode , Node* aNode )
   {
+    Node::Properties& lProperties ( aNode->modifyProperties() );
     //Address is an optional attribute for hierarchical addressing
     uint32_t lAddr ( 0 );
     uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mAddressAttribute , lAddr );
-    aNode->mPartialAddr |= lAddr;
+    lProperties.mPartialAddr |= lAddr;
   }
 
 
   void NodeTreeBuilder::setClassName ( const pugi::xml_node& aXmlNode , Node* aNode )
   {
+    Node::Properties& lProperties ( aNode->modifyProperties() );
     //Address is an optional attribute for hierarchical addressing
     std::string lClassStr;
     uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mClassAttribute , lClassStr );
 
-    aNode->mClassName = lClassStr;
+    lProperties.mClassName = lClassStr;
   }
 
   void NodeTreeBuilder::setPars ( const pugi::xml_node& aXmlNode , Node* aNode )
   {
+    Node::Properties& lProperties ( aNode->modifyProperties() );
     std::string lParsStr;
     //get attribute from xml file as string
     uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mParametersAttribute , lParsStr );
@@ -388,59 +393,63 @@ namespace uhal
       boost::spirit::qi::phrase_parse ( lBegin , lEnd , mNodeTreeParametersGrammar , boost::spirit::ascii::space , lPars );
       // Update the parameters map
       // Add to lPars those previously defined (module node)
-      lPars.insert ( aNode->mParameters.begin(), aNode->mParameters.end() );
+      lPars.insert ( lProperties.mParameters.begin(), lProperties.mParameters.end() );
       // Swap the containers
-      aNode->mParameters.swap ( lPars );
+      lProperties.mParameters.swap ( lPars );
     }
   }
 
   void NodeTreeBuilder::setTags ( const pugi::xml_node& aXmlNode , Node* aNode )
   {
+    Node::Properties& lProperties ( aNode->modifyProperties() );
     std::string lStr;
     //Tags is an optional attribute to allow the user to add a description to a node
     uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mTagsAttribute , lStr );
 
-    if ( lStr.size() && aNode->mTags.size() )
+    if ( lStr.size() && lProperties.mTags.size() )
     {
-      aNode->mTags += "[";
-      aNode->mTags += lStr;
-      aNode->mTags += "]";
+      lProperties.mTags += "[";
+      lProperties.mTags += lStr;
+      lProperties.mTags += "]";
     }
-    else if ( lStr.size() && !aNode->mTags.size() )
+    else if ( lStr.size() && !lProperties.mTags.size() )
     {
-      aNode->mTags = lStr;
+      lProperties.mTags = lStr;
     }
   }
 
 
   void NodeTreeBuilder::setDescription ( const pugi::xml_node& aXmlNode , Node* aNode )
   {
+    Node::Properties& lProperties ( aNode->modifyProperties() );
     std::string lStr;
     //Tags is an optional attribute to allow the user to add a description to a node
     uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mDescriptionAttribute , lStr );
 
-    if ( lStr.size() && aNode->mDescription.size() )
+    if ( lStr.size() && lProperties.mDescription.size() )
     {
-      aNode->mDescription += "[";
-      aNode->mDescription += lStr;
-      aNode->mDescription += "]";
+      lProperties.mDescription += "[";
+      lProperties.mDescription += lStr;
+      lProperties.mDescription += "]";
     }
-    else if ( lStr.size() && !aNode->mDescription.size() )
+    else if ( lStr.size() && !lProperties.mDescription.size() )
     {
-      aNode->mDescription = lStr;
+      lProperties.mDescription = lStr;
     }
   }
 
   void NodeTreeBuilder::setModule ( const pugi::xml_node& , Node* aNode )
   {
+    Node::Properties& lProperties ( aNode->modifyProperties() );
     if ( mFileCallStack.size() )
     {
-      aNode->mModule = mFileCallStack.back( ).string();
+      lProperties.mModule = mFileCallStack.back( ).string();
     }
   }
 
   void NodeTreeBuilder::setPermissions ( const pugi::xml_node& aXmlNode , Node* aNode )
   {
+    Node::Properties& lProperties ( aNode->modifyProperties() );
     //Permissions is an optional attribute for specifying read/write permissions
     std::string lPermissionAttr;
 
@@ -449,23 +458,25 @@ namespace uhal
       const defs::NodePermission* const lPermission = mPermissionsLut.find(lPermissionAttr.c_str());
       if (lPermission == NULL)
       {
-        throw exception::NodeAttributeIncorrectValue("Permission attribute for node with ID '" + aNode->mUid + "' has incorrect value '" + lPermissionAttr + "'");
+        throw exception::NodeAttributeIncorrectValue("Permission attribute for node with ID '" + lProperties.mUid + "' has incorrect value '" + lPermissionAttr + "'");
       }
       else
-        aNode->mPermission = *lPermission;
+        lProperties.mPermission = *lPermission;
     }
   }
 
 
   void NodeTreeBuilder::setMask ( const pugi::xml_node& aXmlNode , Node* aNode )
   {
+    Node::Properties& lProperties ( aNode->modifyProperties() );
     //Tags is an optional attribute to allow the user to add a description to a node
-    uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mMaskAttribute , aNode->mMask );
+    uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mMaskAttribute , lProperties.mMask );
   }
 
 
   void NodeTreeBuilder::setModeAndSize ( const pugi::xml_node& aXmlNode , Node* aNode )
   {
+    Node::Properties& lProperties ( aNode->modifyProperties() );
     //Mode is an optional attribute for specifying whether a block is incremental, non-incremental or a single register
     std::string lModeAttr;
 
@@ -474,39 +485,40 @@ namespace uhal
       const defs::BlockReadWriteMode* const lMode = mModeLut.find(lModeAttr.c_str());
       if (lMode == NULL)
       {
-        throw exception::NodeAttributeIncorrectValue("Mode attribute for node with ID '" + aNode->mUid + "' has incorrect value '" + lModeAttr + "'");
+        throw exception::NodeAttributeIncorrectValue("Mode attribute for node with ID '" + lProperties.mUid + "' has incorrect value '" + lModeAttr + "'");
       }
       else
-        aNode->mMode = *lMode;
+        lProperties.mMode = *lMode;
 
-      if ( aNode->mMode == defs::INCREMENTAL )
+      if ( lProperties.mMode == defs::INCREMENTAL )
       {
         //If a block is incremental it requires a size attribute
-        if ( ! uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mSizeAttribute , aNode->mSize ) )
+        if ( ! uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mSizeAttribute , lProperties.mSize ) )
         {
           exception::IncrementalNodeRequiresSizeAttribute lExc;
-          log ( lExc , "Node " , Quote ( aNode->mUid ) , " has type " , Quote ( "INCREMENTAL" ) , ", which requires a " , Quote ( NodeTreeBuilder::mSizeAttribute ) , " attribute" );
+          log ( lExc , "Node " , Quote ( lProperties.mUid ) , " has type " , Quote ( "INCREMENTAL" ) , ", which requires a " , Quote ( NodeTreeBuilder::mSizeAttribute ) , " attribute" );
           throw lExc;
         }
       }
-      else if ( aNode->mMode == defs::NON_INCREMENTAL )
+      else if ( lProperties.mMode == defs::NON_INCREMENTAL )
       {
         //If a block is non-incremental, then a size attribute is recommended
-        if ( ! uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mSizeAttribute , aNode->mSize ) )
+        if ( ! uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mSizeAttribute , lProperties.mSize ) )
         {
-          log ( Notice() , "Node " , Quote ( aNode->mUid ) , " has type " , Quote ( "NON_INCREMENTAL" ) , " but does not have a " , Quote ( NodeTreeBuilder::mSizeAttribute ) , " attribute. This is not necessarily a problem, but if there is a limit to the size of the read/write operation from this port, then please consider adding this attribute for the sake of safety." );
+          log ( Notice() , "Node " , Quote ( lProperties.mUid ) , " has type " , Quote ( "NON_INCREMENTAL" ) , " but does not have a " , Quote ( NodeTreeBuilder::mSizeAttribute ) , " attribute. This is not necessarily a problem, but if there is a limit to the size of the read/write operation from this port, then please consider adding this attribute for the sake of safety." );
         }
       }
     }
     else if ( not aXmlNode.attribute ( NodeTreeBuilder::mSizeAttribute.c_str() ).empty() )
     {
-      log ( Warning() , "Invalid combination of attributes for node " , Quote ( aNode->mUid ) , ": Size attribute specified, but mode missing, hence size ignored. Please specify mode here or remove the size attribute. Address table parser will throw an exception for this in future releases.");
+      log ( Warning() , "Invalid combination of attributes for node " , Quote ( lProperties.mUid ) , ": Size attribute specified, but mode missing, hence size ignored. Please specify mode here or remove the size attribute. Address table parser will throw an exception for this in future releases.");
     }
 
   }
 
   void NodeTreeBuilder::setFirmwareInfo ( const pugi::xml_node& aXmlNode , Node* aNode )
   {
+    Node::Properties& lProperties ( aNode->modifyProperties() );
     //Address is an optional attribute for hierarchical addressing
     std::string lFwInfoStr;
     uhal::utilities::GetXMLattribute<false> ( aXmlNode , NodeTreeBuilder::mFirmwareInfo , lFwInfoStr );
@@ -518,11 +530,11 @@ namespace uhal
       std::string::const_iterator lEnd ( lFwInfoStr.end() );
       NodeTreeFirmwareInfoAttribute lFwInfo;
       boost::spirit::qi::phrase_parse ( lBegin , lEnd , mNodeTreeFirmwareInfoAttributeGrammar , boost::spirit::ascii::space , lFwInfo );
-      aNode->mFirmwareInfo.insert ( make_pair ( "type",lFwInfo.mType ) );
+      lProperties.mFirmwareInfo.insert ( make_pair ( "type",lFwInfo.mType ) );
 
       if ( lFwInfo.mArguments.size() )
       {
-        aNode->mFirmwareInfo.insert ( lFwInfo.mArguments.begin() , lFwInfo.mArguments.end() );
+        lProperties.mFirmwareInfo.insert ( lFwInfo.mArguments.begin() , lFwInfo.mArguments.end() );
       }
     }
   }
@@ -532,12 +544,12 @@ namespace uhal
   {
     pugi::xml_node lXmlNode = aXmlNode.child ( "node" );
 
-    if ( aNode->mMode == defs::NON_INCREMENTAL )
+    if ( aNode->mProperties->mMode == defs::NON_INCREMENTAL )
     {
       if ( lXmlNode )
       {
         exception::BlockAccessNodeCannotHaveChild lExc;
-        log ( lExc , "Block access nodes are not allowed to have child nodes, but the node " , Quote ( aNode->mUid ) , " has a child node in the address table" );
+        log ( lExc , "Block access nodes are not allowed to have child nodes, but the node " , Quote ( aNode->mProperties->mUid ) , " has a child node in the address table" );
         throw lExc;
       }
     }
@@ -547,19 +559,16 @@ namespace uhal
       {
         aNode->mChildren.push_back ( mNodeParser ( lXmlNode ) );
       }
-
-      for (const auto& lChild: aNode->mChildren)
-        aNode->mChildrenMap.insert ( std::make_pair ( lChild->mUid , lChild ) );
     }
   }
 
   void NodeTreeBuilder::calculateHierarchicalAddresses ( Node* aNode , const uint32_t& aAddr )
   {
-    if ( aNode->mMode == defs::HIERARCHICAL )
+    if ( aNode->mProperties->mMode == defs::HIERARCHICAL )
     {
       if ( aNode->mChildren.size() == 0 )
       {
-        aNode->mMode = defs::SINGLE;
+        aNode->modifyProperties().mMode = defs::SINGLE;
       }
       else
       {
@@ -568,7 +577,7 @@ namespace uhal
 
         for (Node* lChild: aNode->mChildren)
         {
-          if ( lChild->mMask == defs::NOMASK )
+          if ( lChild->mProperties->mMask == defs::NOMASK )
             lAllMasked = false;
 
           // else
@@ -579,26 +588,26 @@ namespace uhal
 
         // if( lAnyMasked && !lAllMasked )
         // {
-        // log ( Error() , "Both masked and unmasked children found in branch " , Quote ( aNode->mUid ) );
+        // log ( Error() , "Both masked and unmasked children found in branch " , Quote ( aNode->mProperties->mUid ) );
         // throw exception::// BothMaskedAndUnmaskedChildren();
         // }
 
         if ( lAllMasked )
         {
-          aNode->mMode = defs::SINGLE;
+          aNode->modifyProperties().mMode = defs::SINGLE;
         }
       }
     }
 
-    if ( aNode->mMode == defs::INCREMENTAL )
+    if ( aNode->mProperties->mMode == defs::INCREMENTAL )
     {
-      uint64_t lTopAddr ( ( uint64_t ) ( aNode->mPartialAddr ) + ( uint64_t ) ( aNode->mSize-1 ) );
+      uint64_t lTopAddr ( ( uint64_t ) ( aNode->mProperties->mPartialAddr ) + ( uint64_t ) ( aNode->mProperties->mSize-1 ) );
 
       //Check that the requested block size does not extend outside register space
       if ( lTopAddr >> 32 )
       {
         exception::ArraySizeExceedsRegisterBound lExc;
-        log ( lExc , "A block size of " , Integer ( aNode->mSize ) , " and a base address of " , Integer ( aNode->mAddr , IntFmt<hex,fixed>() ) , " exceeds bounds of address space" );
+        log ( lExc , "A block size of " , Integer ( aNode->mProperties->mSize ) , " and a base address of " , Integer ( aNode->mProperties->mAddr , IntFmt<hex,fixed>() ) , " exceeds bounds of address space" );
         throw lExc;
       }
 
@@ -606,29 +615,54 @@ namespace uhal
             //Test for overlap with parent
             if ( ( uint32_t ) ( lTopAddr ) & aAddr ) //should set the most significant bit of the child address and then AND this with the parent address
             {
-              log ( Warning() , "The partial address of the top register in the current branch, " , Quote ( aNode->mUid ) , " , (" , Integer ( ( uint32_t ) ( lTopAddr ) , IntFmt<hex,fixed>() ) , ") overlaps with the partial address of the parent branch (" , Integer ( aAddr , IntFmt<hex,fixed>() ) , "). This might contradict the hierarchical design principal. For now this is a warning, but in the future this may be upgraded to throw an exception." );
+              log ( Warning() , "The partial address of the top register in the current branch, " , Quote ( aNode->mProperties->mUid ) , " , (" , Integer ( ( uint32_t ) ( lTopAddr ) , IntFmt<hex,fixed>() ) , ") overlaps with the partial address of the parent branch (" , Integer ( aAddr , IntFmt<hex,fixed>() ) , "). This might contradict the hierarchical design principal. For now this is a warning, but in the future this may be upgraded to throw an exception." );
             }
 
           }
           else
           {
             //Test for overlap with parent
-            if ( aNode->mPartialAddr & aAddr ) //should set the most significant bit of the child address and then AND this with the parent address
+            if ( aNode->mProperties->mPartialAddr & aAddr ) //should set the most significant bit of the child address and then AND this with the parent address
             {
-              log ( Warning() , "The partial address of the top register in the current branch, " , Quote ( aNode->mUid ) , " , (" , Integer ( aNode->mPartialAddr , IntFmt<hex,fixed>() ) , ") overlaps with the partial address of the parent branch (" , Integer ( aAddr , IntFmt<hex,fixed>() ) , "). This might contradict the hierarchical design principal. For now this is a warning, but in the future this may be upgraded to throw an exception." );
+              log ( Warning() , "The partial address of the top register in the current branch, " , Quote ( aNode->mProperties->mUid ) , " , (" , Integer ( aNode->mProperties->mPartialAddr , IntFmt<hex,fixed>() ) , ") overlaps with the partial address of the parent branch (" , Integer ( aAddr , IntFmt<hex,fixed>() ) , "). This might contradict the hierarchical design principal. For now this is a warning, but in the future this may be upgraded to throw an exception." );
             }
       */
     }
 
-    aNode->mAddr = aNode->mPartialAddr + aAddr;
+    // Properties shared with another tree (i.e. those of a module's nodes) are only copied if the address differs
+    const uint32_t lAddr ( aNode->mProperties->mPartialAddr + aAddr );
+
+    if ( aNode->mProperties->mAddr != lAddr )
+    {
+      aNode->modifyProperties().mAddr = lAddr;
+    }
 
     for (Node* lChild: aNode->mChildren)
     {
       lChild->mParent = aNode;
-      calculateHierarchicalAddresses ( lChild , aNode->mAddr );
+      calculateHierarchicalAddresses ( lChild , aNode->mProperties->mAddr );
+    }
+
+    std::stable_sort ( aNode->mChildren.begin() , aNode->mChildren.end() , detail::compareNodeAddr );
+
+    bool lChildrenMapValid ( aNode->mProperties->mChildrenMap.size() == aNode->mChildren.size() );
+
+    for ( size_t i = 0; lChildrenMapValid && ( i < aNode->mChildren.size() ); i++ )
+    {
+      std::unordered_map< std::string , std::size_t >::const_iterator lIt = aNode->mProperties->mChildrenMap.find ( aNode->mChildren.at ( i )->mProperties->mUid );
+      lChildrenMapValid = ( lIt != aNode->mProperties->mChildrenMap.end() ) && ( lIt->second == i );
     }
 
-    std::sort ( aNode->mChildren.begin() , aNode->mChildren.end() , detail::compareNodeAddr );
+    if ( ! lChildrenMapValid )
+    {
+      std::unordered_map< std::string , std::size_t >& lChildrenMap ( aNode->modifyProperties().mChildrenMap );
+      lChildrenMap.clear();
+
+      for ( size_t i = 0; i < aNode->mChildren.size(); i++ )
+      {
+        lChildrenMap.insert ( std::make_pair ( aNode->mChildren.at ( i )->mProperties->mUid , i ) );
+      }
+    }
   }
 
 
@@ -117,8 +117,23 @@ namespace uhal
 
   IPbusCore::IPbusCore ( const std::string& aId, const URI& aUri , const boost::posix_time::time_duration& aTimeoutPeriod ) :
     ClientInterface ( aId , aUri , aTimeoutPeriod ),
-    mTransactionCounter ( 0x00000000 )
-  {}
+    mTransactionCounter ( 0x00000000 ),
+    mCoalesceTransactions ( false ),
+    mLastTransaction ( )
+  {
+    // Extract value of 'coalesce' attribute, if present
+    for (const auto& lArg : aUri.mArguments) {
+      if (lArg.first == "coalesce") {
+        try {
+          mCoalesceTransactions = boost::lexical_cast<bool>(lArg.second);
+        }
+        catch (const boost::bad_lexical_cast&) {
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\"");
+        }
+        log (Info(), "Client with URI ", Quote(this->uri()), ": Coalescing of single reads/writes to consecutive addresses ", (mCoalesceTransactions ? "enabled" : "disabled"));
+      }
+    }
+  }
 
 
   IPbusCore::~IPbusCore()
@@ -247,9 +262,25 @@ namespace uhal
           lNrReplyBytesValidated += aReplyStartIt->second;
           aReplyStartIt++;
           break;
-        case R_A_I:
         case NI_READ:
         case READ:
+        {
+          // The payload of a read is written to one location, or (if single reads were coalesced) to one location per word
+          uint32_t lPayloadByteCount ( 0 );
+          lNrReplyBytesValidated += aReplyStartIt->second;
+          aReplyStartIt++;
+
+          do
+          {
+            lPayloadByteCount += aReplyStartIt->second;
+            aReplyStartIt++;
+          }
+          while ( ( lPayloadByteCount < ( lSendWordCount << 2 ) ) && ( aReplyEndIt - aReplyStartIt != 0 ) );
+
+          lNrReplyBytesValidated += lPayloadByteCount;
+          break;
+        }
+        case R_A_I:
         case CONFIG_SPACE_READ:
         case RMW_SUM:
         case RMW_BITS:
@@ -293,6 +324,15 @@ namespace uhal
   ValHeader IPbusCore::implementWrite ( const uint32_t& aAddr, const uint32_t& aSource )
   {
     log ( Debug() , "Write " , Integer ( aSource , IntFmt<hex,fixed>() ) , " to address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+
+    if ( Buffers* lBuffers = extendLastTransaction ( WRITE , aAddr , 1 << 2 , 0 ) )
+    {
+      lBuffers->send ( aSource );
+      std::pair < ValHeader , _ValHeader_* > lReply ( CreateValHeader() );
+      lBuffers->add ( lReply.first );
+      return lReply.first;
+    }
+
     // IPbus packet format is:
     // HEADER
     // BASE ADDRESS
@@ -304,7 +344,9 @@ namespace uhal
     uint32_t lSendBytesAvailable;
     uint32_t  lReplyBytesAvailable;
     std::shared_ptr< Buffers > lBuffers = checkBufferSpace ( lSendByteCount , lReplyByteCount , lSendBytesAvailable , lReplyBytesAvailable );
-    lBuffers->send ( implementCalculateHeader ( WRITE , 1 , mTransactionCounter++ , requestTransactionInfoCode()
+    const uint32_t lHeaderOffset ( lBuffers->sendCounter() );
+    const uint32_t lTransactionId ( mTransactionCounter++ );
+    lBuffers->send ( implementCalculateHeader ( WRITE , 1 , lTransactionId , requestTransactionInfoCode()
                                               ) );
     lBuffers->send ( aAddr );
     lBuffers->send ( aSource );
@@ -312,6 +354,7 @@ namespace uhal
     lReply.second->IPbusHeaders.push_back ( 0 );
     lBuffers->add ( lReply.first );
     lBuffers->receive ( lReply.second->IPbusHeaders.back() );
+    recordLastTransaction ( lBuffers , WRITE , lHeaderOffset , aAddr , lTransactionId );
     return lReply.first;
   }
 
@@ -319,6 +362,22 @@ namespace uhal
   ValHeader IPbusCore::implementWriteBlock ( const uint32_t& aAddr, const std::vector< uint32_t >& aSource, const defs::BlockReadWriteMode& aMode )
   {
     log ( Debug() , "Write block of size " , Integer ( aSource.size() ) , " to address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+    return queueWriteBlock ( aAddr , aSource.empty() ? NULL : & ( aSource.at ( 0 ) ) , aSource.size() , aMode , std::shared_ptr< const void >() );
+  }
+
+
+  ValHeader IPbusCore::implementWriteBlock ( const uint32_t& aAddr, const std::shared_ptr< const std::vector< uint32_t > >& aSource, const defs::BlockReadWriteMode& aMode )
+  {
+    log ( Debug() , "Write block of size " , Integer ( aSource->size() ) , " to address " , Integer ( aAddr , IntFmt<hex,fixed>() ) , " without copying" );
+    return queueWriteBlock ( aAddr , aSource->empty() ? NULL : & ( aSource->at ( 0 ) ) , aSource->size() , aMode , aSource );
+  }
+
+
+  ValHeader IPbusCore::queueWriteBlock ( const uint32_t& aAddr, const uint32_t* aSource, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode, const std::shared_ptr< const void >& aOwner )
+  {
+    // Payloads shorter than this are still copied, since an extra segment in the gather list costs more than the copy
+    // (must be well below the largest transaction payload, 255 words for IPbus 2.0, for any payload to be referenced)
+    const uint32_t lMinReferencedPayloadByteCount ( 512 );
     // IPbus packet format is:
     // HEADER
     // BASE ADDRESS
@@ -332,11 +391,13 @@ namespace uhal
     uint32_t lSendBytesAvailable;
     uint32_t  lReplyBytesAvailable;
     IPbusTransactionType lType ( ( aMode == defs::INCREMENTAL ) ? WRITE : NI_WRITE );
-    int32_t lPayloadByteCount ( aSource.size() << 2 );
-    uint8_t* lSourcePtr ( ( uint8_t* ) ( aSource.empty() ? NULL : & ( aSource.at ( 0 ) ) ) );
+    int32_t lPayloadByteCount ( aSize << 2 );
+    const uint8_t* lSourcePtr ( ( const uint8_t* ) ( aSource ) );
     uint32_t lAddr ( aAddr );
     std::pair < ValHeader , _ValHeader_* > lReply ( CreateValHeader() );
     std::shared_ptr< Buffers > lBuffers;
+    // Payloads sent from the source memory leave stale bytes in the send buffer, which must not be mistaken for a transaction that can be extended
+    mLastTransaction.buffers = NULL;
 
     do
     {
@@ -345,9 +406,16 @@ namespace uhal
 
       lBuffers->send ( implementCalculateHeader ( lType , lSendBytesAvailableForPayload>>2 , mTransactionCounter++ , requestTransactionInfoCode() ) );
       lBuffers->send ( lAddr );
-      if ( aSource.size() > 0 )
+      if ( aSize > 0 )
       {
-        lBuffers->send ( lSourcePtr , lSendBytesAvailableForPayload );
+        if ( aOwner && ( lSendBytesAvailableForPayload >= lMinReferencedPayloadByteCount ) )
+        {
+          lBuffers->send ( lSourcePtr , lSendBytesAvailableForPayload , aOwner );
+        }
+        else
+        {
+          lBuffers->send ( lSourcePtr , lSendBytesAvailableForPayload );
+        }
         lSourcePtr += lSendBytesAvailableForPayload;
         lPayloadByteCount -= lSendBytesAvailableForPayload;
       }
@@ -372,6 +440,15 @@ namespace uhal
   ValWord< uint32_t > IPbusCore::implementRead ( const uint32_t& aAddr, const uint32_t& aMask )
   {
     log ( Debug() , "Read one unsigned word from address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+
+    if ( Buffers* lBuffers = extendLastTransaction ( READ , aAddr , 0 , 1 << 2 ) )
+    {
+      std::pair < ValWord<uint32_t> , _ValWord_<uint32_t>* > lReply ( CreateValWord ( 0 , aMask ) );
+      lBuffers->add ( lReply.first );
+      lBuffers->receive ( lReply.second->value );
+      return lReply.first;
+    }
+
     // IPbus packet format is:
     // HEADER
     // BASE ADDRESS
@@ -383,7 +460,9 @@ namespace uhal
     uint32_t lSendBytesAvailable;
     uint32_t  lReplyBytesAvailable;
     std::shared_ptr< Buffers > lBuffers = checkBufferSpace ( lSendByteCount , lReplyByteCount , lSendBytesAvailable , lReplyBytesAvailable );
-    lBuffers->send ( implementCalculateHeader ( READ , 1 , mTransactionCounter++ , requestTransactionInfoCode()
+    const uint32_t lHeaderOffset ( lBuffers->sendCounter() );
+    const uint32_t lTransactionId ( mTransactionCounter++ );
+    lBuffers->send ( implementCalculateHeader ( READ , 1 , lTransactionId , requestTransactionInfoCode()
                                               ) );
     lBuffers->send ( aAddr );
     std::pair < ValWord<uint32_t> , _ValWord_<uint32_t>* > lReply ( CreateValWord ( 0 , aMask ) );
@@ -391,6 +470,7 @@ namespace uhal
     lReply.second->IPbusHeaders.push_back ( 0 );
     lBuffers->receive ( lReply.second->IPbusHeaders.back() );
     lBuffers->receive ( lReply.second->value );
+    recordLastTransaction ( lBuffers , READ , lHeaderOffset , aAddr , lTransactionId );
     return lReply.first;
   }
 
@@ -398,6 +478,26 @@ namespace uhal
   ValVector< uint32_t > IPbusCore::implementReadBlock ( const uint32_t& aAddr, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode )
   {
     log ( Debug() , "Read unsigned block of size " , Integer ( aSize ) , " from address " , Integer ( aAddr , IntFmt<hex,fixed>() ) );
+    std::pair < ValVector<uint32_t> , _ValVector_<uint32_t>* > lReply ( CreateValVector ( aSize ) );
+    uint8_t* lReplyPtr = ( uint8_t* ) ( aSize == 0 ? NULL : & ( lReply.second->value.at(0) ) );
+    std::shared_ptr< Buffers > lBuffers ( queueReadBlock ( aAddr , lReplyPtr , aSize , aMode , *lReply.second ) );
+    lBuffers->add ( lReply.first ); //we store the valmem in the last chunk so that, if the reply is split over many chunks, the valmem is guaranteed to still exist when the other chunks come back...
+    return lReply.first;
+  }
+
+
+  ValHeader IPbusCore::implementReadBlockInto ( const uint32_t& aAddr, uint32_t* aDestination, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode )
+  {
+    log ( Debug() , "Read unsigned block of size " , Integer ( aSize ) , " from address " , Integer ( aAddr , IntFmt<hex,fixed>() ) , " into caller-provided memory" );
+    std::pair < ValHeader , _ValHeader_* > lReply ( CreateValHeader() );
+    std::shared_ptr< Buffers > lBuffers ( queueReadBlock ( aAddr , ( uint8_t* ) ( aDestination ) , aSize , aMode , *lReply.second ) );
+    lBuffers->add ( lReply.first ); //as for implementReadBlock, the valmem lives in the last chunk
+    return lReply.first;
+  }
+
+
+  std::shared_ptr< Buffers > IPbusCore::queueReadBlock ( const uint32_t& aAddr, uint8_t* aDestination, const uint32_t& aSize, const defs::BlockReadWriteMode& aMode, _ValHeader_& aReply )
+  {
     // IPbus packet format is:
     // HEADER
     // BASE ADDRESS
@@ -410,8 +510,7 @@ namespace uhal
     uint32_t lReplyHeaderByteCount ( 1 << 2 );
     uint32_t lSendBytesAvailable;
     uint32_t  lReplyBytesAvailable;
-    std::pair < ValVector<uint32_t> , _ValVector_<uint32_t>* > lReply ( CreateValVector ( aSize ) );
-    uint8_t* lReplyPtr = ( uint8_t* ) ( aSize == 0 ? NULL : & ( lReply.second->value.at(0) ) );
+    uint8_t* lReplyPtr ( aDestination );
     IPbusTransactionType lType ( ( aMode == defs::INCREMENTAL ) ? READ : NI_READ );
     int32_t lPayloadByteCount ( aSize << 2 );
     uint32_t lAddr ( aAddr );
@@ -424,8 +523,8 @@ namespace uhal
       lBuffers->send ( implementCalculateHeader ( lType , lReplyBytesAvailableForPayload>>2 , mTransactionCounter++ , requestTransactionInfoCode()
                                                 ) );
       lBuffers->send ( lAddr );
-      lReply.second->IPbusHeaders.push_back ( 0 );
-      lBuffers->receive ( lReply.second->IPbusHeaders.back() );
+      aReply.IPbusHeaders.push_back ( 0 );
+      lBuffers->receive ( aReply.IPbusHeaders.back() );
       lBuffers->receive ( lReplyPtr , lReplyBytesAvailableForPayload );
       lReplyPtr += lReplyBytesAvailableForPayload;
       lPayloadByteCount -= lReplyBytesAvailableForPayload;
@@ -437,8 +536,7 @@ namespace uhal
     }
     while ( lPayloadByteCount > 0 );
 
-    lBuffers->add ( lReply.first ); //we store the valmem in the last chunk so that, if the reply is split over many chunks, the valmem is guaranteed to still exist when the other chunks come back...
-    return lReply.first;
+    return lBuffers;
   }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -499,6 +597,29 @@ namespace uhal
     lBuffers->receive ( lReply.second->value );
     return lReply.first;
   }
+
+
+  ValHeader IPbusCore::implementMaskedWrite ( const uint32_t& aAddr , const uint32_t& aANDterm , const uint32_t& aORterm )
+  {
+    if ( aAddr == mLastTransaction.baseAddr )
+    {
+      if ( uint32_t* lTransaction = findLastTransaction ( RMW_BITS , 0 , 0 ) )
+      {
+        log ( Debug() , "Merging masked write (and=" , Integer ( aANDterm , IntFmt<hex,fixed>() ) , ", or=" , Integer ( aORterm , IntFmt<hex,fixed>() ) , ") to address " , Integer ( aAddr , IntFmt<hex,fixed>() ) , " into preceding RMW-bits transaction" );
+        // Applying ( and1 , or1 ) then ( and2 , or2 ) is equivalent to applying ( and1 & and2 , ( or1 & and2 ) | or2 )
+        lTransaction[2] &= aANDterm;
+        lTransaction[3] = ( lTransaction[3] & aANDterm ) | aORterm;
+        std::pair < ValHeader , _ValHeader_* > lReply ( CreateValHeader() );
+        mCurrentBuffers->add ( lReply.first );
+        return lReply.first;
+      }
+    }
+
+    ValHeader lReply ( implementRMWbits ( aAddr , aANDterm , aORterm ) );
+    // The transaction is now the last in the current buffer; unlike one queued by rmw_bits, its returned value is never seen, so later masked writes can be folded into it
+    recordLastTransaction ( mCurrentBuffers , RMW_BITS , mCurrentBuffers->sendCounter() - ( 4 << 2 ) , aAddr , mTransactionCounter - 1 );
+    return lReply;
+  }
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 
@@ -531,9 +652,79 @@ namespace uhal
   //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 
+  uint32_t* IPbusCore::findLastTransaction ( const IPbusTransactionType& aType , const uint32_t& aSendByteCount , const uint32_t& aReplyByteCount )
+  {
+    if ( ( ! mCoalesceTransactions ) || ( ! mCurrentBuffers ) || ( mCurrentBuffers.get() != mLastTransaction.buffers ) )
+    {
+      return NULL;
+    }
+
+    Buffers& lBuffers ( *mCurrentBuffers );
+
+    // The transaction can only be modified if nothing else has been queued since, and there is room for any extra words
+    if ( ( aType != mLastTransaction.type ) ||
+         ( lBuffers.sendCounter() != mLastTransaction.sendCounter ) ||
+         ( lBuffers.replyCounter() != mLastTransaction.replyCounter ) ||
+         ( lBuffers.sendCounter() + aSendByteCount > this->getMaxSendSize() ) ||
+         ( lBuffers.replyCounter() + aReplyByteCount > this->getMaxReplySize() ) )
+    {
+      return NULL;
+    }
+
+    // The buffer may have been dispatched and reused since the transaction was queued, so check it is still there
+    uint32_t* lTransaction ( reinterpret_cast< uint32_t* > ( lBuffers.getSendBuffer() + mLastTransaction.headerOffset ) );
+
+    if ( ( lTransaction[0] != implementCalculateHeader ( aType , mLastTransaction.wordCount , mLastTransaction.transactionId , requestTransactionInfoCode() ) ) ||
+         ( lTransaction[1] != mLastTransaction.baseAddr ) )
+    {
+      return NULL;
+    }
+
+    mLastTransaction.sendCounter += aSendByteCount;
+    mLastTransaction.replyCounter += aReplyByteCount;
+    return lTransaction;
+  }
+
+
+  Buffers* IPbusCore::extendLastTransaction ( const IPbusTransactionType& aType , const uint32_t& aAddr , const uint32_t& aSendByteCount , const uint32_t& aReplyByteCount )
+  {
+    if ( ( aAddr != mLastTransaction.baseAddr + mLastTransaction.wordCount ) || ( mLastTransaction.wordCount >= getMaxTransactionWordCount() ) )
+    {
+      return NULL;
+    }
+
+    uint32_t* lTransaction ( findLastTransaction ( aType , aSendByteCount , aReplyByteCount ) );
+
+    if ( ! lTransaction )
+    {
+      return NULL;
+    }
+
+    log ( Debug() , "Merging transaction at address " , Integer ( aAddr , IntFmt<hex,fixed>() ) , " into preceding transaction" );
+    mLastTransaction.wordCount++;
+    lTransaction[0] = implementCalculateHeader ( aType , mLastTransaction.wordCount , mLastTransaction.transactionId , requestTransactionInfoCode() );
+    return mCurrentBuffers.get();
+  }
+
+
+  void IPbusCore::recordLastTransaction ( const std::shared_ptr< Buffers >& aBuffers , const IPbusTransactionType& aType , const uint32_t& aHeaderOffset , const uint32_t& aAddr , const uint32_t& aTransactionId )
+  {
+    mLastTransaction.buffers = aBuffers.get();
+    mLastTransaction.sendCounter = aBuffers->sendCounter();
+    mLastTransaction.replyCounter = aBuffers->replyCounter();
+    mLastTransaction.headerOffset = aHeaderOffset;
+    mLastTransaction.type = aType;
+    mLastTransaction.wordCount = 1;
+    mLastTransaction.transactionId = aTransactionId;
+    mLastTransaction.baseAddr = aAddr;
+  }
+  //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+
   void IPbusCore::dispatchExceptionHandler()
   {
-    mTransactionCounter = 0;
+    // The transaction counter carries on from where it was, so that a late reply to a packet sent before the exception has different transaction IDs from those sent after it
+    mLastTransaction.buffers = NULL;
     ClientInterface::dispatchExceptionHandler();
   }
 
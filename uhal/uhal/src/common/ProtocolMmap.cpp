@@ -204,49 +204,92 @@ void Mmap::File::read(const uint32_t aAddr, const uint32_t aNrWords, std::vector
 }
 
 
-void Mmap::File::write(const uint32_t aAddr, const std::vector<std::pair<const uint8_t*, size_t> >& aData)
+uint32_t Mmap::File::read(const uint32_t aAddr)
 {
   if (mFd == -1)
     open();
 
-  size_t lNrBytes = 0;
-  for (size_t i = 0; i < aData.size(); i++)
-    lNrBytes += aData.at(i).second;
+  return *reinterpret_cast<const volatile uint32_t*>(static_cast<uint8_t*>(mMmapIOPtr) + off_t(4*aAddr));
+}
 
-  assert((lNrBytes % 4) == 0);
 
-  char *allocated = NULL;
-  posix_memalign((void **)&allocated, 4096/*alignment*/, lNrBytes + 4096);
-  if (allocated == NULL) {
-    exception::MmapCommunicationError lExc;
-    log(lExc, "Failed to allocate ", Integer(lNrBytes + 4096), " bytes in File::write/2 function");
-    throw lExc;
-  }
+void Mmap::File::read(const uint32_t aAddr, const std::deque< std::pair<uint8_t*, uint32_t> >& aDestinations, size_t aNrBytes)
+{
+  if (mFd == -1)
+    open();
 
-  // data to write to register address
-  char* buffer = allocated;
-  size_t lNrBytesCopied = 0;
-  for (size_t i = 0; i < aData.size(); i++) {
-    memcpy(buffer + lNrBytesCopied, aData.at(i).first, aData.at(i).second);
-    lNrBytesCopied += aData.at(i).second;
+  const volatile uint32_t* lVirtAddr = reinterpret_cast<const volatile uint32_t*>(static_cast<uint8_t*>(mMmapIOPtr) + off_t(4*aAddr));
+
+  // Words are loaded from the mapped region one at a time; a word that straddles two destination buffers is split between them
+  uint32_t lWord = 0;
+  size_t lNrBytesLeftInWord = 0;
+  for (const auto& lDestination : aDestinations) {
+    if (aNrBytes == 0)
+      break;
+
+    uint8_t* lPtr = lDestination.first;
+    uint8_t* const lEnd = lPtr + std::min(size_t(lDestination.second), aNrBytes);
+    aNrBytes -= (lEnd - lPtr);
+
+    for (; (lNrBytesLeftInWord > 0) and (lPtr != lEnd); lNrBytesLeftInWord--)
+      *lPtr++ = reinterpret_cast<const uint8_t*>(&lWord)[4 - lNrBytesLeftInWord];
+
+    for (; (lEnd - lPtr) >= 4; lPtr += 4) {
+      const uint32_t lValue = *lVirtAddr++;
+      memcpy(lPtr, &lValue, 4);
+    }
+
+    if (lPtr != lEnd) {
+      lWord = *lVirtAddr++;
+      for (lNrBytesLeftInWord = 4; lPtr != lEnd; lNrBytesLeftInWord--)
+        *lPtr++ = reinterpret_cast<const uint8_t*>(&lWord)[4 - lNrBytesLeftInWord];
+    }
   }
+}
+
 
-//  memcpy(aMmapBaseAddress + aAddr, buffer, lNrBytes);
-  lNrBytesCopied = 0;
-  while (lNrBytesCopied < lNrBytes) {
-    char* lSrcPtr = buffer + lNrBytesCopied;
-    char* lVirtAddr = static_cast<char*>(mMmapIOPtr) + aAddr + lNrBytesCopied;
-    if ((lNrBytes - lNrBytesCopied) >= 8) {
-      *((uint64_t*) lVirtAddr) = *(uint64_t*) lSrcPtr;
-      lNrBytesCopied += 8;
+void Mmap::File::write(const uint32_t aAddr, const std::vector<std::pair<const uint8_t*, size_t> >& aData)
+{
+  if (mFd == -1)
+    open();
+
+  volatile uint64_t* lVirtAddr = reinterpret_cast<volatile uint64_t*>(static_cast<uint8_t*>(mMmapIOPtr) + aAddr);
+
+  // The segments are serialised straight into the mapped region as a sequence of 64-bit stores; a store that straddles
+  // two segments is assembled from both of them
+  uint64_t lWord = 0;
+  uint8_t* const lWordBytes = reinterpret_cast<uint8_t*>(&lWord);
+  size_t lNrBytesInWord = 0;
+  size_t lNrBytes = 0;
+  for (const auto& lSegment : aData) {
+    const uint8_t* lPtr = lSegment.first;
+    const uint8_t* const lEnd = lPtr + lSegment.second;
+    lNrBytes += lSegment.second;
+
+    for (; (lNrBytesInWord > 0) and (lPtr != lEnd); lPtr++) {
+      lWordBytes[lNrBytesInWord++] = *lPtr;
+      if (lNrBytesInWord == 8) {
+        *lVirtAddr++ = lWord;
+        lNrBytesInWord = 0;
+      }
     }
-    else if ((lNrBytes - lNrBytesCopied) >= 4) {
-      *((uint64_t*) lVirtAddr) = uint64_t(*(uint32_t*) lSrcPtr);
-      lNrBytesCopied += 4;
+
+    for (; (lEnd - lPtr) >= 8; lPtr += 8) {
+      memcpy(&lWord, lPtr, 8);
+      *lVirtAddr++ = lWord;
     }
+
+    for (; lPtr != lEnd; lPtr++)
+      lWordBytes[lNrBytesInWord++] = *lPtr;
   }
 
-  free(allocated);
+  assert((lNrBytes % 4) == 0);
+
+  // As before, a trailing 32-bit word is written as a zero-extended 64-bit store
+  if (lNrBytesInWord > 0) {
+    memset(lWordBytes + lNrBytesInWord, 0, 8 - lNrBytesInWord);
+    *lVirtAddr = lWord;
+  }
 }
 
 
@@ -261,9 +304,11 @@ Mmap::Mmap ( const std::string& aId, const URI& aUri ) :
   mIndexNextPage(0),
   mPublishedReplyPageCount(0),
   mReadReplyPageCount(0),
-  mAsynchronousException ( NULL )
+  mStopCompletionThread(false),
+  mNrPendingReplies(0)
 {
   mSleepDuration = std::chrono::microseconds(50);
+  bool lUseCompletionThread = false;
 
   for (const auto& lArg: aUri.mArguments) {
     if (lArg.first == "sleep") {
@@ -276,15 +321,28 @@ Mmap::Mmap ( const std::string& aId, const URI& aUri ) :
       mDeviceFile.setOffset(lOffset);
       log (Notice(), "mmap client with URI ", Quote (uri()), " : Address offset set to ", Integer(lOffset, IntFmt<hex>()));
     }
+    else if (lArg.first == "completion_thread") {
+      lUseCompletionThread = true;
+      log (Notice() , "mmap client with URI ", Quote (uri()), " : Collecting and validating replies in a background thread, overlapping with the writing of further packets");
+    }
+    else if (lArg.first == "coalesce") {
+      // Handled by IPbusCore
+    }
     else {
       log (Warning() , "Unknown attribute ", Quote (lArg.first), " used in URI ", Quote(uri()));
     }
   }
+
+  if (lUseCompletionThread)
+    startCompletionThread();
 }
 
 
 Mmap::~Mmap()
 {
+  if (mCompletionThread.joinable())
+    stopCompletionThread();
+
   disconnect();
 }
 
@@ -296,7 +354,16 @@ void Mmap::implementDispatch ( std::shared_ptr< Buffers > aBuffers )
   if ( ! mConnected )
     connect();
 
-  if ( mReplyQueue.size() == mNumberOfPages )
+  if (mCompletionThread.joinable()) {
+    // The replies are collected by the completion thread, so only need to wait here if all pages are in use
+    std::unique_lock<std::mutex> lLock(mTransportLayerMutex);
+    while ((mReplyQueue.size() == mNumberOfPages) and (not mAsynchronousException))
+      mRepliesCollected.wait(lLock);
+
+    if (mAsynchronousException)
+      std::rethrow_exception(mAsynchronousException);
+  }
+  else if ( mReplyQueue.size() == mNumberOfPages )
     read();
   write(aBuffers);
 }
@@ -305,21 +372,47 @@ void Mmap::implementDispatch ( std::shared_ptr< Buffers > aBuffers )
 void Mmap::Flush( )
 {
   log(Debug(), "mmap client (URI: ", Quote(uri()), ") : Flush method called");
+  if (mCompletionThread.joinable()) {
+    std::unique_lock<std::mutex> lLock(mTransportLayerMutex);
+    while ((mNrPendingReplies > 0) and (not mAsynchronousException))
+      mRepliesCollected.wait(lLock);
+
+    if (mAsynchronousException)
+      std::rethrow_exception(mAsynchronousException);
+    return;
+  }
+
   while ( !mReplyQueue.empty() )
     read();
 
 }
 
 
+bool Mmap::startFlush( )
+{
+  return mCompletionThread.joinable();
+}
+
+
 void Mmap::dispatchExceptionHandler()
 {
   // FIXME: Adapt to PCIe implementation
   log(Notice(), "mmap client ", Quote(id()), " (URI: ", Quote(uri()), ") : closing device files since exception detected");
 
+  const bool lUseCompletionThread = mCompletionThread.joinable();
+  if (lUseCompletionThread)
+    stopCompletionThread();
+
   ClientInterface::returnBufferToPool ( mReplyQueue );
+  mReplyPages.clear();
+  mNrPendingReplies = 0;
+  mAsynchronousException = std::exception_ptr();
   disconnect();
 
   InnerProtocol::dispatchExceptionHandler();
+
+  if (lUseCompletionThread)
+    startCompletionThread();
 }
 
 
@@ -383,21 +476,32 @@ void Mmap::write(const std::shared_ptr<Buffers>& aBuffers)
   log (Info(), "mmap client ", Quote(id()), " (URI: ", Quote(uri()), ") : writing ", Integer(aBuffers->sendCounter() / 4), "-word packet to page ", Integer(mIndexNextPage), " in ", Quote(mDeviceFile.getPath()));
 
   const uint32_t lHeaderWord = (0x10000 | (((aBuffers->sendCounter() / 4) - 1) & 0xFFFF));
-  std::vector<std::pair<const uint8_t*, size_t> > lDataToWrite;
-  lDataToWrite.push_back( std::make_pair(reinterpret_cast<const uint8_t*>(&lHeaderWord), sizeof lHeaderWord) );
-  lDataToWrite.push_back( std::make_pair(aBuffers->getSendBuffer(), aBuffers->sendCounter()) );
-  mDeviceFile.write(mIndexNextPage * 4 * mPageSize, lDataToWrite);
+  mDataToWrite.clear();
+  mDataToWrite.push_back( std::make_pair(reinterpret_cast<const uint8_t*>(&lHeaderWord), sizeof lHeaderWord) );
+  for (const auto& lSegment : aBuffers->getSendSegments())
+    mDataToWrite.push_back( std::make_pair(lSegment.first, size_t(lSegment.second)) );
+  mDeviceFile.write(mIndexNextPage * 4 * mPageSize, mDataToWrite);
 
-  log (Debug(), "Wrote " , Integer((aBuffers->sendCounter() / 4) + 1), " 32-bit words at address " , Integer(mIndexNextPage * 4 * mPageSize), " ... ", PacketFmt(lDataToWrite));
+  log (Debug(), "Wrote " , Integer((aBuffers->sendCounter() / 4) + 1), " 32-bit words at address " , Integer(mIndexNextPage * 4 * mPageSize), " ... ", PacketFmt(mDataToWrite));
 
+  {
+    std::lock_guard<std::mutex> lLock(mTransportLayerMutex);
+    mReplyQueue.push_back(aBuffers);
+    mReplyPages.push_back(mIndexNextPage);
+    mNrPendingReplies++;
+  }
+  mPacketWritten.notify_one();
   mIndexNextPage = (mIndexNextPage + 1) % mNumberOfPages;
-  mReplyQueue.push_back(aBuffers);
 }
 
 
 void Mmap::read()
 {
-  const size_t lPageIndexToRead = (mIndexNextPage - mReplyQueue.size() + mNumberOfPages) % mNumberOfPages;
+  // The queues are locked whenever they are accessed, since the user's thread adds packets to them while the completion thread is reading
+  std::unique_lock<std::mutex> lLock(mTransportLayerMutex);
+  const size_t lPageIndexToRead = mReplyPages.front();
+  std::shared_ptr<Buffers> lBuffers = mReplyQueue.front();
+  lLock.unlock();
   SteadyClock_t::time_point lStartTime = SteadyClock_t::now();
 
   if (mReadReplyPageCount == mPublishedReplyPageCount)
@@ -405,11 +509,8 @@ void Mmap::read()
     uint32_t lHwPublishedPageCount = 0x0;
 
     while ( true ) {
-      std::vector<uint32_t> lValues;
-      // FIXME : Improve by simply adding dmaWrite method that takes uint32_t ref as argument (or returns uint32_t)
-      mDeviceFile.read(0, 4, lValues);
-      lHwPublishedPageCount = lValues.at(3);
-      log (Info(), "Read status info from addr 0 (", Integer(lValues.at(0)), ", ", Integer(lValues.at(1)), ", ", Integer(lValues.at(2)), ", ", Integer(lValues.at(3)), "): ", PacketFmt((const uint8_t*)lValues.data(), 4 * lValues.size()));
+      lHwPublishedPageCount = mDeviceFile.read(3);
+      log (Debug(), "Read published reply page count from addr 3: ", Integer(lHwPublishedPageCount));
 
       if (lHwPublishedPageCount != mPublishedReplyPageCount) {
         mPublishedReplyPageCount = lHwPublishedPageCount;
@@ -431,54 +532,96 @@ void Mmap::read()
     log(Info(), "mmap client ", Quote(id()), " (URI: ", Quote(uri()), ") : Reading page ", Integer(lPageIndexToRead), " (published count ", Integer(lHwPublishedPageCount), ", surpasses required, ", Integer(mReadReplyPageCount + 1), ")");
   }
   mReadReplyPageCount++;
-  
-  // PART 1 : Read the page
-  std::shared_ptr<Buffers> lBuffers = mReplyQueue.front();
-  mReplyQueue.pop_front();
-
-  uint32_t lNrWordsToRead(lBuffers->replyCounter() >> 2);
-  lNrWordsToRead += 1;
- 
-  std::vector<uint32_t> lPageContents;
-  mDeviceFile.read(4 + lPageIndexToRead * mPageSize, lNrWordsToRead , lPageContents);
-  log (Debug(), "Read " , Integer(lNrWordsToRead), " 32-bit words from address " , Integer(4 + lPageIndexToRead * 4 * mPageSize), " ... ", PacketFmt((const uint8_t*)lPageContents.data(), 4 * lPageContents.size()));
 
-  // PART 2 : Transfer to reply buffer
-  const std::deque< std::pair< uint8_t* , uint32_t > >& lReplyBuffers ( lBuffers->getReplyBuffer() );
-  size_t lNrWordsInPacket = (lPageContents.at(0) >> 16) + (lPageContents.at(0) & 0xFFFF);
+  // PART 1 : Scatter the page contents directly into the reply buffers
+  const uint32_t lPageHeader = mDeviceFile.read(4 + lPageIndexToRead * mPageSize);
+  size_t lNrWordsInPacket = (lPageHeader >> 16) + (lPageHeader & 0xFFFF);
   if (lNrWordsInPacket != (lBuffers->replyCounter() >> 2))
     log (Warning(), "Expected reply packet to contain ", Integer(lBuffers->replyCounter() >> 2), " words, but it actually contains ", Integer(lNrWordsInPacket), " words");
 
-  size_t lNrBytesCopied = 0;
-  for (const auto& lBuffers: lReplyBuffers)
-  {
-    // Don't copy more of page than was written to, for cases when less data received than expected
-    if ( lNrBytesCopied >= 4*lNrWordsInPacket)
-      break;
-
-    size_t lNrBytesToCopy = std::min( lBuffers.second , uint32_t(4*lNrWordsInPacket - lNrBytesCopied) );
-    memcpy ( lBuffers.first, &lPageContents.at(1 + (lNrBytesCopied / 4)), lNrBytesToCopy );
-    lNrBytesCopied += lNrBytesToCopy;
-  }
+  // Don't copy more of page than was written to, for cases when less data received than expected
+  const size_t lNrBytesToCopy = std::min(size_t(lBuffers->replyCounter()), 4 * lNrWordsInPacket);
+  mDeviceFile.read(5 + lPageIndexToRead * mPageSize, lBuffers->getReplyBuffer(), lNrBytesToCopy);
+  log (Debug(), "Read " , Integer(lNrBytesToCopy / 4), " 32-bit words from address " , Integer(5 + lPageIndexToRead * mPageSize), " directly into reply buffers");
 
+  // The page may only be reused once its contents have been read
+  lLock.lock();
+  mReplyQueue.pop_front();
+  mReplyPages.pop_front();
+  lLock.unlock();
+  mRepliesCollected.notify_all();
 
-  // PART 3 : Validate the packet contents
+  // PART 2 : Validate the packet contents
+  uhal::exception::exception* lExc = NULL;
   try
   {
-    if ( uhal::exception::exception* lExc = ClientInterface::validate ( lBuffers ) ) //Control of the pointer has been passed back to the client interface
-    {
-      mAsynchronousException = lExc;
-    }
+    lExc = ClientInterface::validate ( lBuffers ); //Control of the pointer has been passed back to the client interface
   }
   catch ( exception::exception& aExc )
   {
-    mAsynchronousException = new exception::ValidationError ();
-    log ( *mAsynchronousException , "Exception caught during reply validation for mmap device with URI " , Quote ( this->uri() ) , "; what returned: " , Quote ( aExc.what() ) );
+    lExc = new exception::ValidationError ();
+    log ( *lExc , "Exception caught during reply validation for mmap device with URI " , Quote ( this->uri() ) , "; what returned: " , Quote ( aExc.what() ) );
+  }
+
+  if ( lExc )
+  {
+    lExc->throwAsDerivedType();
   }
 
-  if ( mAsynchronousException )
+  lLock.lock();
+  mNrPendingReplies--;
+}
+
+
+
+void Mmap::startCompletionThread()
+{
+  mStopCompletionThread = false;
+  mCompletionThread = std::thread(&Mmap::runCompletionThread, this);
+}
+
+
+void Mmap::stopCompletionThread()
+{
   {
-    mAsynchronousException->throwAsDerivedType();
+    std::lock_guard<std::mutex> lLock(mTransportLayerMutex);
+    mStopCompletionThread = true;
+  }
+  mPacketWritten.notify_one();
+  mCompletionThread.join();
+}
+
+
+void Mmap::runCompletionThread()
+{
+  std::unique_lock<std::mutex> lLock(mTransportLayerMutex);
+  while (true) {
+    // After an exception, the pending replies are left for the dispatch exception handler to discard
+    while ((not mStopCompletionThread) and (mReplyQueue.empty() or mAsynchronousException))
+      mPacketWritten.wait(lLock);
+
+    if (mStopCompletionThread)
+      return;
+
+    lLock.unlock();
+    std::exception_ptr lException;
+    try {
+      read();
+    }
+    catch (exception::exception& aExc) {
+      lException = std::current_exception();
+      ClientInterface::failPendingDispatches(aExc);
+    }
+    catch (const std::exception& aExc) {
+      exception::MmapCommunicationError lExc;
+      log(lExc, "Exception caught while collecting replies for mmap device with URI ", Quote(uri()), "; what returned: ", Quote(aExc.what()));
+      lException = std::make_exception_ptr(lExc);
+      ClientInterface::failPendingDispatches(lExc);
+    }
+    lLock.lock();
+
+    mAsynchronousException = lException;
+    mRepliesCollected.notify_all();
   }
 }
 
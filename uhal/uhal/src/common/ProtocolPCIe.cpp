@@ -50,6 +50,8 @@
 #include <fcntl.h>
 #include <iomanip>                                          // for operator<<
 #include <iostream>                                         // for operator<<
+#include <poll.h>
+#include <signal.h>                                         // for kill
 #include <sys/file.h>
 #include <sys/stat.h>
 #include <stdlib.h>                                         // for size_t, free
@@ -73,6 +75,28 @@
 namespace uhal {
 
 
+namespace {
+
+//! Bounds on the spin phase of adaptive polling, i.e. the time for which the status word is read back-to-back before sleeping between reads
+const std::chrono::microseconds kMinSpinDuration(10), kMaxSpinDuration(200);
+
+//! Time initially assumed to be spent waiting for each reply, before any replies have been received
+const std::chrono::microseconds kInitialReplyWaitEstimate(20);
+
+//! Minimum size for data in a single segment to be transferred directly to/from that segment; smaller data, and data in several
+//! segments, are copied through the file's buffer. (Whether the XDMA driver advances the card address across the iovecs of one
+//! vectored system call has not been checked on hardware, so several segments are never passed to the device in one call.)
+const size_t kMinDirectSegmentSize(4096);
+
+//! Whether the reply with the specified ticket has been published, given the device's published page count (which may wrap around)
+bool isPublished(const uint32_t aPublishedPageCount, const uint32_t aTicket)
+{
+  return int32_t(aPublishedPageCount - aTicket) > 0;
+}
+
+}
+
+
 PCIe::PacketFmt::PacketFmt(const uint8_t* const aPtr, const size_t aNrBytes) :
   mData(1, std::pair<const uint8_t*, size_t>(aPtr, aNrBytes))
 {}
@@ -113,7 +137,8 @@ PCIe::File::File(const std::string& aPath, int aFlags) :
   mFlags(aFlags),
   mLocked(false),
   mBufferSize(0),
-  mBuffer(NULL)
+  mBuffer(NULL),
+  mPositionedIO(true)
 {
 }
 
@@ -195,28 +220,94 @@ void PCIe::File::read(const uint32_t aAddr, const uint32_t aNrWords, std::vector
 
   createBuffer(4 * aNrWords);
 
-  /* select AXI MM address */
-  off_t off = lseek(mFd, 4*aAddr, SEEK_SET);
-  if ( off != off_t(4 * aAddr)) {
-    exception::PCIeCommunicationError lExc;
-    log(lExc, "Offset returned by lseek, ", Integer(off), ", does not match that requested, ", Integer(4*aAddr), " (in preparation for read of ", Integer(aNrWords), " words)");
-    throw lExc;
+  /* read data from AXI MM into buffer using SGDMA */
+  mIOVecs.resize(1);
+  mIOVecs.at(0).iov_base = mBuffer;
+  mIOVecs.at(0).iov_len = 4 * aNrWords;
+  readAt(4 * aAddr, 4 * aNrWords);
+
+  aValues.insert(aValues.end(), reinterpret_cast<uint32_t*>(mBuffer), reinterpret_cast<uint32_t*>(mBuffer)+ aNrWords);
+}
+
+
+void PCIe::File::read(const uint32_t aAddr, const std::vector<std::pair<uint8_t*, size_t> >& aData)
+{
+  if (mFd == -1)
+    open();
+
+  size_t lNrBytes = 0;
+  for (size_t i = 0; i < aData.size(); i++)
+    lNrBytes += aData.at(i).second;
+
+  if ((aData.size() == 1) and (lNrBytes >= kMinDirectSegmentSize)) {
+    /* read data from AXI MM directly into the destination buffer using SGDMA */
+    mIOVecs.resize(1);
+    mIOVecs.at(0).iov_base = aData.at(0).first;
+    mIOVecs.at(0).iov_len = lNrBytes;
+    readAt(4 * aAddr, lNrBytes);
+    return;
   }
 
+  createBuffer(lNrBytes);
+
   /* read data from AXI MM into buffer using SGDMA */
-  int rc = ::read(mFd, mBuffer, 4*aNrWords);
+  mIOVecs.resize(1);
+  mIOVecs.at(0).iov_base = mBuffer;
+  mIOVecs.at(0).iov_len = lNrBytes;
+  readAt(4 * aAddr, lNrBytes);
+
+  size_t lNrBytesCopied = 0;
+  for (size_t i = 0; i < aData.size(); i++) {
+    memcpy(aData.at(i).first, mBuffer + lNrBytesCopied, aData.at(i).second);
+    lNrBytesCopied += aData.at(i).second;
+  }
+}
+
+
+void PCIe::File::readAt(const off_t aOffset, const size_t aNrBytes)
+{
+  ssize_t rc = -1;
+  if (mPositionedIO) {
+    rc = ::preadv(mFd, mIOVecs.data(), mIOVecs.size(), aOffset);
+    // Named pipes (e.g. used by the dummy hardware) don't support positioned reads
+    if ((rc == -1) and (errno == ESPIPE))
+      mPositionedIO = false;
+  }
+  if (not mPositionedIO)
+    rc = ::readv(mFd, mIOVecs.data(), mIOVecs.size());
+
   if (rc == -1) {
     exception::PCIeCommunicationError lExc;
-    log(lExc, "Read of ", Integer(4*aNrWords), " bytes at address ", Integer(4 * aAddr), " failed! errno=", Integer(errno), ", meaning ", Quote (strerror(errno)));
+    log(lExc, "Read of ", Integer(aNrBytes), " bytes at address ", Integer(aOffset), " failed! errno=", Integer(errno), ", meaning ", Quote (strerror(errno)));
     throw lExc;
   }
-  else if (size_t(rc) < 4*aNrWords) {
+  else if (size_t(rc) < aNrBytes) {
     exception::PCIeCommunicationError lExc;
-    log(lExc, "Only ", Integer(rc), " bytes transferred in read of ", Integer(4*aNrWords), " bytes at address ", Integer(4 * aAddr));
+    log(lExc, "Only ", Integer(rc), " bytes transferred in read of ", Integer(aNrBytes), " bytes at address ", Integer(aOffset));
     throw lExc;
   }
+}
 
-  aValues.insert(aValues.end(), reinterpret_cast<uint32_t*>(mBuffer), reinterpret_cast<uint32_t*>(mBuffer)+ aNrWords);
+
+bool PCIe::File::waitUntilReadable(const std::chrono::microseconds& aTimeout)
+{
+  if (mFd == -1)
+    open();
+
+  struct pollfd lPollFd;
+  lPollFd.fd = mFd;
+  lPollFd.events = POLLIN;
+  lPollFd.revents = 0;
+
+  // poll's timeout is in milliseconds, so round up to avoid returning early
+  const int rc = ::poll(&lPollFd, 1, (aTimeout.count() + 999) / 1000);
+  if ((rc == -1) and (errno != EINTR)) {
+    exception::PCIeCommunicationError lExc;
+    log(lExc, "Poll on file ", Quote(mPath), " failed! errno=", Integer(errno), ", meaning ", Quote (strerror(errno)));
+    throw lExc;
+  }
+
+  return (rc > 0);
 }
 
 
@@ -233,34 +324,11 @@ void PCIe::File::write(const uint32_t aAddr, const uint8_t* const aPtr, const si
 
   assert((aNrBytes % 4) == 0);
 
-  createBuffer(aNrBytes);
-
-  // data to write to register address
-  memcpy(mBuffer, aPtr, aNrBytes);
-
-  /* select AXI MM address */
-  off_t off = lseek(mFd, aAddr, SEEK_SET);
-  if ( off != off_t(aAddr)) {
-    struct stat st;
-    if (fstat(mFd, &st) or (not S_ISFIFO(st.st_mode))) {
-      exception::PCIeCommunicationError lExc;
-      log(lExc, "Offset returned by lseek, ", Integer(off), ", does not match that requested, ", Integer(aAddr), " (in preparation for write of ", Integer(aNrBytes), " bytes)");
-      throw lExc;
-    }
-  }
-
-  /* write buffer to AXI MM address using SGDMA */
-  int rc = ::write(mFd, mBuffer, aNrBytes);
-  if (rc == -1) {
-    exception::PCIeCommunicationError lExc;
-    log(lExc, "Write of ", Integer(aNrBytes), " bytes at address ", Integer(aAddr), " failed! errno=", Integer(errno), ", meaning ", Quote (strerror(errno)));
-    throw lExc;
-  }
-  else if (size_t(rc) < aNrBytes) {
-    exception::PCIeCommunicationError lExc;
-    log(lExc, "Only ", Integer(rc), " bytes transferred in write of ", Integer(aNrBytes), " bytes at address ", Integer(aAddr));
-    throw lExc;
-  }
+  /* write data to AXI MM address using SGDMA */
+  mIOVecs.resize(1);
+  mIOVecs.at(0).iov_base = const_cast<uint8_t*>(aPtr);
+  mIOVecs.at(0).iov_len = aNrBytes;
+  writeAt(aAddr, aNrBytes);
 }
 
 
@@ -275,36 +343,51 @@ void PCIe::File::write(const uint32_t aAddr, const std::vector<std::pair<const u
 
   assert((lNrBytes % 4) == 0);
 
-  createBuffer(lNrBytes);
+  if ((aData.size() == 1) and (lNrBytes >= kMinDirectSegmentSize)) {
+    mIOVecs.resize(1);
+    mIOVecs.at(0).iov_base = const_cast<uint8_t*>(aData.at(0).first);
+    mIOVecs.at(0).iov_len = lNrBytes;
+  }
+  else {
+    // Several or small segments, so gather the data into the buffer
+    createBuffer(lNrBytes);
+
+    size_t lNrBytesCopied = 0;
+    for (size_t i = 0; i < aData.size(); i++) {
+      memcpy(mBuffer + lNrBytesCopied, aData.at(i).first, aData.at(i).second);
+      lNrBytesCopied += aData.at(i).second;
+    }
 
-  // data to write to register address
-  size_t lNrBytesCopied = 0;
-  for (size_t i = 0; i < aData.size(); i++) {
-    memcpy(mBuffer + lNrBytesCopied, aData.at(i).first, aData.at(i).second);
-    lNrBytesCopied += aData.at(i).second;
+    mIOVecs.resize(1);
+    mIOVecs.at(0).iov_base = mBuffer;
+    mIOVecs.at(0).iov_len = lNrBytes;
   }
 
-  /* select AXI MM address */
-  off_t off = lseek(mFd, aAddr, SEEK_SET);
-  if ( off != off_t(aAddr)) {
-    struct stat st;
-    if (fstat(mFd, &st) or (not S_ISFIFO(st.st_mode))) {
-      exception::PCIeCommunicationError lExc;
-      log(lExc, "Offset returned by lseek, ", Integer(off), ", does not match that requested, ", Integer(aAddr), " (in preparation for write of ", Integer(lNrBytes), " bytes)");
-      throw lExc;
-    }
+  /* write data to AXI MM address using SGDMA */
+  writeAt(aAddr, lNrBytes);
+}
+
+
+void PCIe::File::writeAt(const off_t aOffset, const size_t aNrBytes)
+{
+  ssize_t rc = -1;
+  if (mPositionedIO) {
+    rc = ::pwritev(mFd, mIOVecs.data(), mIOVecs.size(), aOffset);
+    // Named pipes (e.g. used by the dummy hardware) don't support positioned writes
+    if ((rc == -1) and (errno == ESPIPE))
+      mPositionedIO = false;
   }
+  if (not mPositionedIO)
+    rc = ::writev(mFd, mIOVecs.data(), mIOVecs.size());
 
-  /* write buffer to AXI MM address using SGDMA */
-  int rc = ::write(mFd, mBuffer, lNrBytes);
   if (rc == -1) {
     exception::PCIeCommunicationError lExc;
-    log(lExc, "Write of ", Integer(lNrBytes), " bytes at address ", Integer(aAddr), " failed! errno=", Integer(errno), ", meaning ", Quote (strerror(errno)));
+    log(lExc, "Write of ", Integer(aNrBytes), " bytes at address ", Integer(aOffset), " failed! errno=", Integer(errno), ", meaning ", Quote (strerror(errno)));
     throw lExc;
   }
-  else if (size_t(rc) < lNrBytes) {
+  else if (size_t(rc) < aNrBytes) {
     exception::PCIeCommunicationError lExc;
-    log(lExc, "Only ", Integer(rc), " bytes transferred in write of ", Integer(lNrBytes), " bytes at address ", Integer(aAddr));
+    log(lExc, "Only ", Integer(rc), " bytes transferred in write of ", Integer(aNrBytes), " bytes at address ", Integer(aOffset));
     throw lExc;
   }
 }
@@ -316,9 +399,9 @@ bool PCIe::File::haveLock() const
 }
 
 
-void PCIe::File::lock()
+void PCIe::File::lock(const bool aShared)
 {
-  if ( flock(mFd, LOCK_EX) == -1 ) {
+  if ( flock(mFd, aShared ? LOCK_SH : LOCK_EX) == -1 ) {
     exception::MutexError lExc;
     log(lExc, "Failed to lock device file ", Quote(mPath), "; errno=", Integer(errno), ", meaning ", Quote (strerror(errno)));
     throw lExc;
@@ -429,10 +512,85 @@ void PCIe::RobustMutex::endSession()
 
 
 
+const size_t PCIe::PageScheduler::kMaxNrPages;
+
+
+PCIe::PageScheduler::PageScheduler() :
+  mNrPages(0),
+  mNextPageIndex(0),
+  mNextTicket(0),
+  mOldestTicket(0)
+{
+  std::fill(mOwners, mOwners + kMaxNrPages, 0);
+}
+
+
+bool PCIe::PageScheduler::isIdle()
+{
+  reclaim();
+  return (mOldestTicket == mNextTicket);
+}
+
+
+void PCIe::PageScheduler::reset(const uint32_t aNrPages, const uint32_t aNextPageIndex, const uint32_t aPublishedPageCount)
+{
+  mNrPages = aNrPages;
+  mNextPageIndex = aNextPageIndex;
+  mNextTicket = aPublishedPageCount;
+  mOldestTicket = aPublishedPageCount;
+  std::fill(mOwners, mOwners + kMaxNrPages, 0);
+}
+
+
+bool PCIe::PageScheduler::reserve(const pid_t aOwner, uint32_t& aPageIndex, uint32_t& aTicket)
+{
+  reclaim();
+  if ((mNextTicket - mOldestTicket) >= mNrPages)
+    return false;
+
+  aPageIndex = mNextPageIndex;
+  aTicket = mNextTicket;
+  mOwners[mNextPageIndex] = aOwner;
+  mNextPageIndex = (mNextPageIndex + 1) % mNrPages;
+  mNextTicket++;
+  return true;
+}
+
+
+void PCIe::PageScheduler::release(const uint32_t aPageIndex)
+{
+  mOwners[aPageIndex] = 0;
+}
+
+
+void PCIe::PageScheduler::reclaim()
+{
+  bool lCheckedOwner = false;
+  while (mOldestTicket != mNextTicket) {
+    const uint32_t lPageIndex = (mNextPageIndex + mNrPages - (mNextTicket - mOldestTicket)) % mNrPages;
+    if (mOwners[lPageIndex] == 0)
+      mOldestTicket++;
+    else if (lCheckedOwner)
+      break;
+    else {
+      // Release all pages of a client whose process has died, so that they don't block the other clients forever
+      lCheckedOwner = true;
+      const pid_t lOwner = mOwners[lPageIndex];
+      if ((kill(lOwner, 0) == -1) and (errno == ESRCH)) {
+        log(Warning(), "Releasing PCIe pages reserved by process ", Integer(lOwner), ", which has died");
+        std::replace(mOwners, mOwners + mNrPages, lOwner, pid_t(0));
+      }
+    }
+  }
+}
+
+
+
+
 template <class T>
 PCIe::SharedObject<T>::SharedObject(const std::string& aName) :
   mName(aName),
-  mSharedMem(boost::interprocess::open_or_create, aName.c_str(), 1024, 0x0, boost::interprocess::permissions(0666)),
+  mSharedMem(boost::interprocess::open_or_create, aName.c_str(), sizeof(T) + 1024, 0x0, boost::interprocess::permissions(0666)),
   mObj(mSharedMem.find_or_construct<T>(boost::interprocess::unique_instance)())
 {
 }
@@ -476,13 +634,18 @@ PCIe::PCIe ( const std::string& aId, const URI& aUri ) :
   mIPCMutex(getSharedMemName(mDeviceFileHostToFPGA.getPath())),
   mXdma7seriesWorkaround(false),
   mUseInterrupt(false),
+  mAdaptivePolling(true),
+  mReplyWaitEstimate(kInitialReplyWaitEstimate),
   mNumberOfPages(0),
   mMaxInFlight(0),
   mPageSize(0),
   mMaxPacketSize(0),
   mIndexNextPage(0),
   mPublishedReplyPageCount(0),
-  mReadReplyPageCount(0)
+  mNextTicket(0),
+  mStopCompletionThread(false),
+  mFlushRequested(false),
+  mNrPendingReplies(0)
 {
   if ( aUri.mHostname.find(",") == std::string::npos ) {
     exception::PCIeInitialisationError lExc;
@@ -496,6 +659,7 @@ PCIe::PCIe ( const std::string& aId, const URI& aUri ) :
   }
 
   mSleepDuration = std::chrono::microseconds(mUseInterrupt ? 0 : 50);
+  bool lUseCompletionThread = false;
 
   for (const auto& lArg: aUri.mArguments) {
     if (lArg.first == "events") {
@@ -511,6 +675,7 @@ PCIe::PCIe ( const std::string& aId, const URI& aUri ) :
     }
     else if (lArg.first == "sleep") {
       mSleepDuration = std::chrono::microseconds(boost::lexical_cast<size_t>(lArg.second));
+      mAdaptivePolling = false;
       log (Notice() , "PCIe client with URI ", Quote (uri()), " : Inter-poll-/-interrupt sleep duration set to ", boost::lexical_cast<size_t>(lArg.second), " us by URI 'sleep' attribute");
     }
     else if (lArg.first == "max_in_flight") {
@@ -525,14 +690,38 @@ PCIe::PCIe ( const std::string& aId, const URI& aUri ) :
       mXdma7seriesWorkaround = true;
       log (Notice() , "PCIe client with URI ", Quote (uri()), " : Adjusting size of PCIe reads to a few fixed sizes as workaround for 7-series xdma firmware bug");
     }
+    else if (lArg.first == "scheduler") {
+      if (not mScheduler)
+        mScheduler.reset(new SharedObject<PageScheduler>(getSharedMemName(mDeviceFileHostToFPGA.getPath()) + "::scheduler"));
+      log (Notice() , "PCIe client with URI ", Quote (uri()), " : Sharing pages of device with other clients via scheduler, rather than locking the device for each dispatch");
+    }
+    else if (lArg.first == "completion_thread") {
+      lUseCompletionThread = true;
+      log (Notice() , "PCIe client with URI ", Quote (uri()), " : Collecting and validating replies in a background thread, overlapping with the writing of further packets");
+    }
+    else if (lArg.first == "coalesce") {
+      // Handled by IPbusCore
+    }
     else
       log (Warning() , "Unknown attribute ", Quote (lArg.first), " used in URI ", Quote(uri()));
   }
+
+  // An interrupt is only delivered to one of the clients waiting on the events file, so the others would miss their replies
+  if (mScheduler and mUseInterrupt) {
+    log (Warning() , "PCIe client with URI ", Quote (uri()), " : Ignoring 'events' attribute, since interrupts cannot be shared between clients using the scheduler; polling status instead");
+    mUseInterrupt = false;
+  }
+
+  if (lUseCompletionThread)
+    startCompletionThread();
 }
 
 
 PCIe::~PCIe()
 {
+  if (mCompletionThread.joinable())
+    stopCompletionThread();
+
   disconnect();
 }
 
@@ -544,7 +733,17 @@ void PCIe::implementDispatch ( std::shared_ptr< Buffers > aBuffers )
   if ( ! mConnected )
     connect();
 
-  if ( mReplyQueue.size() == mMaxInFlight )
+  if (mCompletionThread.joinable()) {
+    // The replies are collected by the completion thread, so only need to wait here if all pages are in use
+    std::unique_lock<std::mutex> lLock(mTransportLayerMutex);
+    mFlushRequested = false;
+    while ((mReplyQueue.size() == mMaxInFlight) and (not mAsynchronousException))
+      mRepliesCollected.wait(lLock);
+
+    if (mAsynchronousException)
+      std::rethrow_exception(mAsynchronousException);
+  }
+  else if ( mReplyQueue.size() == mMaxInFlight )
     read();
   write(aBuffers);
 }
@@ -553,13 +752,39 @@ void PCIe::implementDispatch ( std::shared_ptr< Buffers > aBuffers )
 void PCIe::Flush( )
 {
   log(Debug(), "PCIe client (URI: ", Quote(uri()), ") : Flush method called");
+  if (mCompletionThread.joinable()) {
+    std::unique_lock<std::mutex> lLock(mTransportLayerMutex);
+    while ((mNrPendingReplies > 0) and (not mAsynchronousException))
+      mRepliesCollected.wait(lLock);
+
+    if (mAsynchronousException)
+      std::rethrow_exception(mAsynchronousException);
+
+    mFlushRequested = false;
+    if (mDeviceFileHostToFPGA.haveLock())
+      releaseDevice();
+    return;
+  }
+
   while ( !mReplyQueue.empty() )
     read();
 
-  mDeviceFileHostToFPGA.unlock();
+  releaseDevice();
+}
 
-  IPCScopedLock_t lLockGuard(*mIPCMutex);
-  mIPCMutex->endSession();
+
+bool PCIe::startFlush( )
+{
+  if (not mCompletionThread.joinable())
+    return false;
+
+  // If replies are still pending, the completion thread releases the device once it has validated them
+  std::lock_guard<std::mutex> lLock(mTransportLayerMutex);
+  if (mNrPendingReplies > 0)
+    mFlushRequested = true;
+  else if (mDeviceFileHostToFPGA.haveLock() and (not mAsynchronousException))
+    releaseDevice();
+  return true;
 }
 
 
@@ -567,13 +792,31 @@ void PCIe::dispatchExceptionHandler()
 {
   log(Notice(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : closing device files since exception detected");
 
+  const bool lUseCompletionThread = mCompletionThread.joinable();
+  if (lUseCompletionThread)
+    stopCompletionThread();
+
   ClientInterface::returnBufferToPool ( mReplyQueue );
+  ClientInterface::returnBufferToPool ( mValidationQueue );
+
+  if (mScheduler) {
+    IPCScopedLock_t lLockGuard(*mIPCMutex);
+    for (const auto& lPage : mReplyPages)
+      (*mScheduler)->release(lPage.first);
+  }
+  mReplyPages.clear();
+  mNrPendingReplies = 0;
+  mFlushRequested = false;
+  mAsynchronousException = std::exception_ptr();
 
   mDeviceFileHostToFPGA.unlock();
 
   disconnect();
 
   InnerProtocol::dispatchExceptionHandler();
+
+  if (lUseCompletionThread)
+    startCompletionThread();
 }
 
 
@@ -614,6 +857,10 @@ void PCIe::connect(IPCScopedLock_t& aGuard)
 
   std::vector<uint32_t> lValues;
   mDeviceFileFPGAToHost.read(0x0, 4, lValues);
+
+  // The status can only be trusted by the scheduler when no pages are in use, since other clients may be awaiting replies
+  if (mScheduler and (lValues.at(0) <= PageScheduler::kMaxNrPages) and (lValues.at(2) < lValues.at(0)) and (*mScheduler)->isIdle())
+    (*mScheduler)->reset(lValues.at(0), lValues.at(2), lValues.at(3));
   aGuard.unlock();
   log ( Debug(), "Read status info (", Integer(lValues.at(0)), ", ", Integer(lValues.at(1)), ", ", Integer(lValues.at(2)), ", ", Integer(lValues.at(3)), "): ", PacketFmt((const uint8_t*)lValues.data(), 4 * lValues.size()));
 
@@ -625,7 +872,7 @@ void PCIe::connect(IPCScopedLock_t& aGuard)
     mMaxPacketSize = mPageSize - 1;
   mIndexNextPage = lValues.at(2);
   mPublishedReplyPageCount = lValues.at(3);
-  mReadReplyPageCount = mPublishedReplyPageCount;
+  mNextTicket = mPublishedReplyPageCount;
 
   if (lValues.at(1) > 0xFFFF) {
     exception::PCIeInitialisationError lExc;
@@ -639,12 +886,15 @@ void PCIe::connect(IPCScopedLock_t& aGuard)
     throw lExc;
   }
 
+  if (mScheduler and (mNumberOfPages > PageScheduler::kMaxNrPages)) {
+    exception::PCIeInitialisationError lExc;
+    log (lExc, "Number of pages, ", Integer(mNumberOfPages), ", reported in device file ", Quote(mDeviceFileFPGAToHost.getPath()), " exceeds maximum supported by scheduler, ", Integer(PageScheduler::kMaxNrPages));
+    throw lExc;
+  }
+
   log ( Debug() , "PCIe client is opening device file " , Quote ( mDeviceFileHostToFPGA.getPath() ) , " (client-to-device)" );
   mDeviceFileHostToFPGA.open();
 
-  mDeviceFileFPGAToHost.createBuffer(4 * mPageSize);
-  mDeviceFileHostToFPGA.createBuffer(4 * mPageSize);
-
   if (mUseInterrupt)
     mDeviceFileFPGAEvent.open();
 
@@ -664,7 +914,20 @@ void PCIe::disconnect()
 
 void PCIe::write(const std::shared_ptr<Buffers>& aBuffers)
 {
-  if (not mDeviceFileHostToFPGA.haveLock()) {
+  if (mScheduler and (not mDeviceFileHostToFPGA.haveLock())) {
+    // Shared lock, so that clients with the scheduler can use the device concurrently, but clients without it cannot
+    mDeviceFileHostToFPGA.lock(true);
+
+    IPCScopedLock_t lGuard(*mIPCMutex);
+    // Clients without the scheduler must re-read status info before their next dispatch
+    mIPCMutex->startSession();
+    mIPCMutex->endSession();
+
+    // Other clients may have used the device without the scheduler since it was last in use
+    if ((*mScheduler)->isIdle())
+      connect(lGuard);
+  }
+  else if (not mDeviceFileHostToFPGA.haveLock()) {
     mDeviceFileHostToFPGA.lock();
 
     IPCScopedLock_t lGuard(*mIPCMutex);
@@ -678,138 +941,342 @@ void PCIe::write(const std::shared_ptr<Buffers>& aBuffers)
     }
   }
 
-  log (Info(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : writing ", Integer(aBuffers->sendCounter() / 4), "-word packet to page ", Integer(mIndexNextPage), " in ", Quote(mDeviceFileHostToFPGA.getPath()));
-
   const uint32_t lHeaderWord = (0x10000 | (((aBuffers->sendCounter() / 4) - 1) & 0xFFFF));
   std::vector<std::pair<const uint8_t*, size_t> > lDataToWrite;
   lDataToWrite.push_back( std::make_pair(reinterpret_cast<const uint8_t*>(&lHeaderWord), sizeof lHeaderWord) );
-  lDataToWrite.push_back( std::make_pair(aBuffers->getSendBuffer(), aBuffers->sendCounter()) );
+  for (const auto& lSegment : aBuffers->getSendSegments())
+    lDataToWrite.push_back( std::make_pair(lSegment.first, size_t(lSegment.second)) );
+
+  uint32_t lPageIndex = mIndexNextPage;
+  uint32_t lTicket = mNextTicket;
+  if (mScheduler) {
+    const SteadyClock_t::time_point lEndTime = SteadyClock_t::now() + std::chrono::microseconds(getBoostTimeoutPeriod().total_microseconds());
+    while (true) {
+      // The page is written with the IPC mutex still locked, so that the device receives the pages in order
+      IPCScopedLock_t lGuard(*mIPCMutex);
+      if ((*mScheduler)->reserve(getpid(), lPageIndex, lTicket)) {
+        log (Info(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : writing ", Integer(aBuffers->sendCounter() / 4), "-word packet to page ", Integer(lPageIndex), " (ticket ", Integer(lTicket), ") in ", Quote(mDeviceFileHostToFPGA.getPath()));
+        mDeviceFileHostToFPGA.write(lPageIndex * 4 * mPageSize, lDataToWrite);
+        break;
+      }
+      lGuard.unlock();
+
+      // All pages are in use; collecting this client's replies frees pages, otherwise must wait for other clients (or for the completion thread)
+      if ((not mCompletionThread.joinable()) and (not mReplyQueue.empty()))
+        read();
+      else if (SteadyClock_t::now() > lEndTime) {
+        exception::PCIeTimeout lExc;
+        log(lExc, "No page of PCIe device '" + mDeviceFileHostToFPGA.getPath() + "' became free within timeout period (all in use by other clients)");
+        throw lExc;
+      }
+      else
+        std::this_thread::yield();
+    }
+  }
+  else {
+    log (Info(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : writing ", Integer(aBuffers->sendCounter() / 4), "-word packet to page ", Integer(lPageIndex), " in ", Quote(mDeviceFileHostToFPGA.getPath()));
+    IPCScopedLock_t lGuard(*mIPCMutex);
+    mDeviceFileHostToFPGA.write(lPageIndex * 4 * mPageSize, lDataToWrite);
+    mIndexNextPage = (mIndexNextPage + 1) % mNumberOfPages;
+    mNextTicket++;
+  }
+  log (Debug(), "Wrote " , Integer((aBuffers->sendCounter() / 4) + 1), " 32-bit words at address " , Integer(lPageIndex * 4 * mPageSize), " ... ", PacketFmt(lDataToWrite));
 
-  IPCScopedLock_t lGuard(*mIPCMutex);
-  mDeviceFileHostToFPGA.write(mIndexNextPage * 4 * mPageSize, lDataToWrite);
-  log (Debug(), "Wrote " , Integer((aBuffers->sendCounter() / 4) + 1), " 32-bit words at address " , Integer(mIndexNextPage * 4 * mPageSize), " ... ", PacketFmt(lDataToWrite));
+  {
+    std::lock_guard<std::mutex> lLock(mTransportLayerMutex);
+    mReplyQueue.push_back(aBuffers);
+    mReplyPages.push_back(std::make_pair(lPageIndex, lTicket));
+    mNrPendingReplies++;
+  }
+  mPacketWritten.notify_one();
+}
+
+
+void PCIe::waitForInterrupt(const size_t aPageIndexToRead, const SteadyClock_t::time_point& aEndTime)
+{
+  std::vector<uint32_t> lRxEvent;
+  // wait for interrupt; block until events file node is readable (or timeout expires), then read it to see if user interrupt has come
+  while (true) {
+    const SteadyClock_t::time_point lNow = SteadyClock_t::now();
+    if (lNow > aEndTime) {
+      exception::PCIeTimeout lExc;
+      log(lExc, "Next page (index ", Integer(aPageIndexToRead), " count ", Integer(mPublishedReplyPageCount+1), ") of PCIe device '" + mDeviceFileHostToFPGA.getPath() + "' is not ready after timeout period");
+      throw lExc;
+    }
+
+    log(Debug(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : Waiting for interrupt");
+    if (not mDeviceFileFPGAEvent.waitUntilReadable(std::chrono::duration_cast<std::chrono::microseconds>(aEndTime - lNow)))
+      continue;
+
+    mDeviceFileFPGAEvent.read(0, 1, lRxEvent);
+    if (lRxEvent.at(0) == 1) {
+      break;
+    }
+    lRxEvent.clear();
+
+    log(Debug(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : No interrupt in events file; sleeping for ", mSleepDuration.count(), "us");
+    if (mSleepDuration > std::chrono::microseconds(0))
+      std::this_thread::sleep_for( mSleepDuration );
 
-  mIndexNextPage = (mIndexNextPage + 1) % mNumberOfPages;
-  mReplyQueue.push_back(aBuffers);
+  } // end of while (true)
+
+  log(Debug(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : Interrupt received while waiting for page ", Integer(aPageIndexToRead));
 }
 
 
 void PCIe::read()
 {
-  const size_t lPageIndexToRead = (mIndexNextPage - mReplyQueue.size() + mNumberOfPages) % mNumberOfPages;
+  // The queues are locked whenever they are accessed, since the user's thread adds packets to them while the completion thread is reading
+  std::unique_lock<std::mutex> lLock(mTransportLayerMutex);
+  const size_t lPageIndexToRead = mReplyPages.front().first;
+  const uint32_t lTicket = mReplyPages.front().second;
+  lLock.unlock();
   SteadyClock_t::time_point lStartTime = SteadyClock_t::now();
 
-  if (mReadReplyPageCount == mPublishedReplyPageCount)
+  if (not isPublished(mPublishedReplyPageCount, lTicket))
   {
-    if (mUseInterrupt)
-    {
-      std::vector<uint32_t> lRxEvent;
-      // wait for interrupt; read events file node to see if user interrupt has come
-      while (true) {
-        mDeviceFileFPGAEvent.read(0, 1, lRxEvent);
-        if (lRxEvent.at(0) == 1) {
-          break;
-        }
-        lRxEvent.clear();
-
-        if (SteadyClock_t::now() - lStartTime > std::chrono::microseconds(getBoostTimeoutPeriod().total_microseconds())) {
-          exception::PCIeTimeout lExc;
-          log(lExc, "Next page (index ", Integer(lPageIndexToRead), " count ", Integer(mPublishedReplyPageCount+1), ") of PCIe device '" + mDeviceFileHostToFPGA.getPath() + "' is not ready after timeout period");
-          throw lExc;
-        }
-
-        log(Debug(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : Waiting for interrupt; sleeping for ", mSleepDuration.count(), "us");
+    const SteadyClock_t::time_point lEndTime = lStartTime + std::chrono::microseconds(getBoostTimeoutPeriod().total_microseconds());
+    uint32_t lHwPublishedPageCount = 0x0;
+
+    // Adaptive polling: read the status back-to-back (yielding the CPU in between) for up to twice the typical recent wait, then
+    // sleep between reads, doubling the sleep duration each time up to the 'sleep' duration
+    const SteadyClock_t::time_point lSpinEndTime = lStartTime + std::max<SteadyClock_t::duration>(kMinSpinDuration, std::min<SteadyClock_t::duration>(2 * mReplyWaitEstimate, kMaxSpinDuration));
+    std::chrono::microseconds lBackoffDuration(1);
+
+    std::vector<uint32_t> lValues;
+    while ( true ) {
+      if (mUseInterrupt)
+        waitForInterrupt(lPageIndexToRead, lEndTime);
+
+      // Interrupts may be coalesced, so the status is read even after an interrupt to find how many pages have been published
+      // FIXME : Improve by simply adding fileWrite method that takes uint32_t ref as argument (or returns uint32_t)
+      IPCScopedLock_t lGuard(*mIPCMutex);
+      mDeviceFileFPGAToHost.read(0, (mXdma7seriesWorkaround ? 8 : 4), lValues);
+      lGuard.unlock();
+      lHwPublishedPageCount = lValues.at(3);
+      log (Debug(), "Read status info from addr 0 (", Integer(lValues.at(0)), ", ", Integer(lValues.at(1)), ", ", Integer(lValues.at(2)), ", ", Integer(lValues.at(3)), "): ", PacketFmt((const uint8_t*)lValues.data(), 4 * lValues.size()));
+
+      mPublishedReplyPageCount = lHwPublishedPageCount;
+      if (isPublished(mPublishedReplyPageCount, lTicket))
+        break;
+      // FIXME: Throw if published page count is invalid number
+
+      const SteadyClock_t::time_point lNow = SteadyClock_t::now();
+      if (lNow > lEndTime) {
+        exception::PCIeTimeout lExc;
+        log(lExc, "Next page (index ", Integer(lPageIndexToRead), " count ", Integer(lTicket+1), ") of PCIe device '" + mDeviceFileHostToFPGA.getPath() + "' is not ready after timeout period");
+        throw lExc;
+      }
+
+      if (mUseInterrupt)
+        log(Debug(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : Page index ", Integer(lPageIndexToRead), " not yet published after interrupt; waiting for next interrupt");
+      else if (not mAdaptivePolling) {
+        log(Debug(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : Trying to read page index ", Integer(lPageIndexToRead), " = count ", Integer(lTicket+1), "; published page count is ", Integer(lHwPublishedPageCount), "; sleeping for ", mSleepDuration.count(), "us");
         if (mSleepDuration > std::chrono::microseconds(0))
           std::this_thread::sleep_for( mSleepDuration );
+      }
+      else if (lNow < lSpinEndTime)
+        std::this_thread::yield();
+      else {
+        log(Debug(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : Trying to read page index ", Integer(lPageIndexToRead), " = count ", Integer(lTicket+1), "; published page count is ", Integer(lHwPublishedPageCount), "; sleeping for ", lBackoffDuration.count(), "us");
+        std::this_thread::sleep_for( lBackoffDuration );
+        lBackoffDuration = std::min(2 * lBackoffDuration, std::max(mSleepDuration, std::chrono::microseconds(1)));
+      }
+      lValues.clear();
+    }
+
+    // Exponentially-weighted moving average, with weight 1/8 for the latest wait
+    if (mAdaptivePolling and not mUseInterrupt)
+      mReplyWaitEstimate += ((SteadyClock_t::now() - lStartTime) - mReplyWaitEstimate) / 8;
+
+    log(Info(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : Reading from page ", Integer(lPageIndexToRead), " (published count ", Integer(lHwPublishedPageCount), ", surpasses required, ", Integer(lTicket + 1), ")");
+  }
 
-      } // end of while (true)
+  // PART 1 : Read all published pages, with one read per run of adjacent pages (i.e. at most two reads, where the ring of pages
+  // wraps around, unless other clients' pages are interleaved via the scheduler)
+  lLock.lock();
+  size_t lNrPagesToRead = 1;
+  while ((lNrPagesToRead < mReplyPages.size()) and isPublished(mPublishedReplyPageCount, mReplyPages.at(lNrPagesToRead).second))
+    lNrPagesToRead++;
+  mReplyPageHeaders.assign(lNrPagesToRead, 0);
+
+  for (size_t i = 0; i < lNrPagesToRead; ) {
+    size_t lNrPagesInRun = 1;
+    while ((i + lNrPagesInRun < lNrPagesToRead) and (mReplyPages.at(i + lNrPagesInRun).first == mReplyPages.at(i).first + lNrPagesInRun))
+      lNrPagesInRun++;
+    readPages(mReplyPages.at(i).first, i, lNrPagesInRun);
+    i += lNrPagesInRun;
+  }
 
-      log(Info(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : Reading page ", Integer(lPageIndexToRead), " (interrupt received)");
+  if (mScheduler) {
+    IPCScopedLock_t lGuard(*mIPCMutex);
+    for (size_t i = 0; i < lNrPagesToRead; i++)
+      (*mScheduler)->release(mReplyPages.at(i).first);
+  }
+  mReplyPages.erase(mReplyPages.begin(), mReplyPages.begin() + lNrPagesToRead);
+  mValidationQueue.assign(mReplyQueue.begin(), mReplyQueue.begin() + lNrPagesToRead);
+  mReplyQueue.erase(mReplyQueue.begin(), mReplyQueue.begin() + lNrPagesToRead);
+  lLock.unlock();
+  mRepliesCollected.notify_all();
+
+  // PART 2 : Validate the packet contents
+  for (auto& lValidationQueueEntry : mValidationQueue)
+  {
+    // Each buffer is taken from the queue as it is validated, so that the buffers remaining in the queue after an exception are those not yet returned to the pool
+    std::shared_ptr<Buffers> lBuffers;
+    lBuffers.swap(lValidationQueueEntry);
+
+    uhal::exception::exception* lExc = NULL;
+    try
+    {
+      lExc = ClientInterface::validate ( lBuffers );
     }
-    else
+    catch ( exception::exception& aExc )
     {
-      uint32_t lHwPublishedPageCount = 0x0;
-
-      std::vector<uint32_t> lValues;
-      while ( true ) {
-        // FIXME : Improve by simply adding fileWrite method that takes uint32_t ref as argument (or returns uint32_t)
-        IPCScopedLock_t lGuard(*mIPCMutex);
-        mDeviceFileFPGAToHost.read(0, (mXdma7seriesWorkaround ? 8 : 4), lValues);
-        lHwPublishedPageCount = lValues.at(3);
-        log (Debug(), "Read status info from addr 0 (", Integer(lValues.at(0)), ", ", Integer(lValues.at(1)), ", ", Integer(lValues.at(2)), ", ", Integer(lValues.at(3)), "): ", PacketFmt((const uint8_t*)lValues.data(), 4 * lValues.size()));
-
-        if (lHwPublishedPageCount != mPublishedReplyPageCount) {
-          mPublishedReplyPageCount = lHwPublishedPageCount;
-          break;
-        }
-        // FIXME: Throw if published page count is invalid number
-
-        if (SteadyClock_t::now() - lStartTime > std::chrono::microseconds(getBoostTimeoutPeriod().total_microseconds())) {
-          exception::PCIeTimeout lExc;
-          log(lExc, "Next page (index ", Integer(lPageIndexToRead), " count ", Integer(mPublishedReplyPageCount+1), ") of PCIe device '" + mDeviceFileHostToFPGA.getPath() + "' is not ready after timeout period");
-          throw lExc;
-        }
-
-        log(Debug(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : Trying to read page index ", Integer(lPageIndexToRead), " = count ", Integer(mReadReplyPageCount+1), "; published page count is ", Integer(lHwPublishedPageCount), "; sleeping for ", mSleepDuration.count(), "us");
-        if (mSleepDuration > std::chrono::microseconds(0))
-          std::this_thread::sleep_for( mSleepDuration );
-        lValues.clear();
-      }
+      exception::ValidationError lExc2;
+      log ( lExc2 , "Exception caught during reply validation for PCIe device with URI " , Quote ( this->uri() ) , "; what returned: " , Quote ( aExc.what() ) );
+      throw lExc2;
+    }
 
-      log(Info(), "PCIe client ", Quote(id()), " (URI: ", Quote(uri()), ") : Reading page ", Integer(lPageIndexToRead), " (published count ", Integer(lHwPublishedPageCount), ", surpasses required, ", Integer(mReadReplyPageCount + 1), ")");
+    if (lExc != NULL)
+      lExc->throwAsDerivedType();
+  }
+  mValidationQueue.clear();
+
+  lLock.lock();
+  mNrPendingReplies -= lNrPagesToRead;
+}
+
+
+void PCIe::readPages(const size_t aFirstPageIndex, const size_t aFirstReplyIndex, const size_t aNrPages)
+{
+  // Build the list of destinations: each page's header word goes into mReplyPageHeaders, the reply into its buffers, and the
+  // unused remainder of each page (before the next one) into mReplyPageGap
+  mReplySegments.clear();
+  uint32_t lNrWordsToRead = 0;
+  for (size_t i = 0; i < aNrPages; i++)
+  {
+    const size_t lNrGapBytes = 4 * (i * mPageSize - lNrWordsToRead);
+    if (lNrGapBytes > 0) {
+      if (mReplyPageGap.size() < lNrGapBytes)
+        mReplyPageGap.resize(4 * mPageSize);
+      mReplySegments.push_back( std::make_pair(mReplyPageGap.data(), lNrGapBytes) );
+      lNrWordsToRead = i * mPageSize;
     }
+
+    Buffers& lBuffers = *mReplyQueue.at(aFirstReplyIndex + i);
+    mReplySegments.push_back( std::make_pair(reinterpret_cast<uint8_t*>(&mReplyPageHeaders.at(aFirstReplyIndex + i)), size_t(4)) );
+    for (const auto& lBuffer: lBuffers.getReplyBuffer())
+      mReplySegments.push_back( std::make_pair(lBuffer.first, size_t(lBuffer.second)) );
+    lNrWordsToRead += 1 + (lBuffers.replyCounter() >> 2);
   }
-  mReadReplyPageCount++;
-  
-  // PART 1 : Read the page
-  std::shared_ptr<Buffers> lBuffers = mReplyQueue.front();
-  mReplyQueue.pop_front();
 
-  uint32_t lNrWordsToRead(lBuffers->replyCounter() >> 2);
-  if(mXdma7seriesWorkaround and (lNrWordsToRead % 32 == 0 || lNrWordsToRead % 32 == 28 || lNrWordsToRead < 4))
+  // The 7-series workaround reads extra words for transfers of certain lengths
+  const uint32_t lNrWordsAfterHeader = lNrWordsToRead - 1;
+  if(mXdma7seriesWorkaround and (lNrWordsAfterHeader % 32 == 0 || lNrWordsAfterHeader % 32 == 28 || lNrWordsAfterHeader < 4)) {
+    if (mReplyPageGap.size() < 16)
+      mReplyPageGap.resize(std::max<size_t>(16, 4 * mPageSize));
+    mReplySegments.push_back( std::make_pair(mReplyPageGap.data(), size_t(16)) );
     lNrWordsToRead += 4;
-  lNrWordsToRead += 1;
- 
-  std::vector<uint32_t> lPageContents;
+  }
+
   IPCScopedLock_t lGuard(*mIPCMutex);
-  mDeviceFileFPGAToHost.read(4 + lPageIndexToRead * mPageSize, lNrWordsToRead , lPageContents);
+  mDeviceFileFPGAToHost.read(4 + aFirstPageIndex * mPageSize, mReplySegments);
   lGuard.unlock();
-  log (Debug(), "Read " , Integer(lNrWordsToRead), " 32-bit words from address " , Integer(4 + lPageIndexToRead * 4 * mPageSize), " ... ", PacketFmt((const uint8_t*)lPageContents.data(), 4 * lPageContents.size()));
+  log (Debug(), "Read " , Integer(lNrWordsToRead), " 32-bit words (", Integer(aNrPages), " pages) from address " , Integer(4 * (4 + aFirstPageIndex * mPageSize)));
 
-  // PART 2 : Transfer to reply buffer
-  const std::deque< std::pair< uint8_t* , uint32_t > >& lReplyBuffers ( lBuffers->getReplyBuffer() );
-  size_t lNrWordsInPacket = (lPageContents.at(0) >> 16) + (lPageContents.at(0) & 0xFFFF);
-  if (lNrWordsInPacket != (lBuffers->replyCounter() >> 2))
-    log (Warning(), "Expected reply packet to contain ", Integer(lBuffers->replyCounter() >> 2), " words, but it actually contains ", Integer(lNrWordsInPacket), " words");
-
-  size_t lNrBytesCopied = 0;
-  for (const auto& lBuffer: lReplyBuffers)
+  // Check the length of each packet, clearing any reply buffer contents beyond its end, for cases when less data received than expected
+  for (size_t i = 0; i < aNrPages; i++)
   {
-    // Don't copy more of page than was written to, for cases when less data received than expected
-    if ( lNrBytesCopied >= 4*lNrWordsInPacket)
-      break;
+    Buffers& lBuffers = *mReplyQueue.at(aFirstReplyIndex + i);
+    const uint32_t lHeaderWord = mReplyPageHeaders.at(aFirstReplyIndex + i);
+    const size_t lNrWordsInPacket = (lHeaderWord >> 16) + (lHeaderWord & 0xFFFF);
+    log (Debug(), "Page ", Integer(aFirstPageIndex + i), " header ", Integer(lHeaderWord, IntFmt<hex,fixed>()), ", reply ... ", PacketFmt(std::vector< std::pair<const uint8_t*, size_t> >(lBuffers.getReplyBuffer().begin(), lBuffers.getReplyBuffer().end())));
+
+    if (lNrWordsInPacket != (lBuffers.replyCounter() >> 2))
+      log (Warning(), "Expected reply packet to contain ", Integer(lBuffers.replyCounter() >> 2), " words, but it actually contains ", Integer(lNrWordsInPacket), " words");
 
-    size_t lNrBytesToCopy = std::min( lBuffer.second , uint32_t(4*lNrWordsInPacket - lNrBytesCopied) );
-    memcpy ( lBuffer.first, &lPageContents.at(1 + (lNrBytesCopied / 4)), lNrBytesToCopy );
-    lNrBytesCopied += lNrBytesToCopy;
+    size_t lNrBytesSkipped = 0;
+    for (const auto& lBuffer: lBuffers.getReplyBuffer())
+    {
+      if ( lNrBytesSkipped + lBuffer.second > 4*lNrWordsInPacket ) {
+        const size_t lOffset = (lNrBytesSkipped >= 4*lNrWordsInPacket ? 0 : 4*lNrWordsInPacket - lNrBytesSkipped);
+        memset ( lBuffer.first + lOffset, 0, lBuffer.second - lOffset );
+      }
+      lNrBytesSkipped += lBuffer.second;
+    }
   }
+}
 
 
-  // PART 3 : Validate the packet contents
-  uhal::exception::exception* lExc = NULL;
-  try
-  {
-    lExc = ClientInterface::validate ( lBuffers );
+
+void PCIe::releaseDevice()
+{
+  // End the session before releasing the device file lock, since otherwise the session started by the next client to take
+  // the lock could be marked inactive, leading other clients to trust status info read during that session
+  if (not mScheduler) {
+    IPCScopedLock_t lLockGuard(*mIPCMutex);
+    mIPCMutex->endSession();
+    lLockGuard.unlock();
   }
-  catch ( exception::exception& aExc )
+
+  mDeviceFileHostToFPGA.unlock();
+}
+
+
+void PCIe::startCompletionThread()
+{
+  mStopCompletionThread = false;
+  mCompletionThread = std::thread(&PCIe::runCompletionThread, this);
+}
+
+
+void PCIe::stopCompletionThread()
+{
   {
-    exception::ValidationError lExc2;
-    log ( lExc2 , "Exception caught during reply validation for PCIe device with URI " , Quote ( this->uri() ) , "; what returned: " , Quote ( aExc.what() ) );
-    throw lExc2;
+    std::lock_guard<std::mutex> lLock(mTransportLayerMutex);
+    mStopCompletionThread = true;
   }
+  mPacketWritten.notify_one();
+  mCompletionThread.join();
+}
+
+
+void PCIe::runCompletionThread()
+{
+  std::unique_lock<std::mutex> lLock(mTransportLayerMutex);
+  while (true) {
+    // After an exception, the pending replies are left for the dispatch exception handler to discard
+    while ((not mStopCompletionThread) and (mReplyQueue.empty() or mAsynchronousException))
+      mPacketWritten.wait(lLock);
+
+    if (mStopCompletionThread)
+      return;
 
-  if (lExc != NULL)
-    lExc->throwAsDerivedType();
+    lLock.unlock();
+    std::exception_ptr lException;
+    try {
+      read();
+    }
+    catch (exception::exception& aExc) {
+      lException = std::current_exception();
+      ClientInterface::failPendingDispatches(aExc);
+    }
+    catch (const std::exception& aExc) {
+      exception::PCIeCommunicationError lExc;
+      log(lExc, "Exception caught while collecting replies for PCIe device with URI ", Quote(uri()), "; what returned: ", Quote(aExc.what()));
+      lException = std::make_exception_ptr(lExc);
+      ClientInterface::failPendingDispatches(lExc);
+    }
+    lLock.lock();
+
+    mAsynchronousException = lException;
+    if (mFlushRequested and (mNrPendingReplies == 0) and (not mAsynchronousException)) {
+      releaseDevice();
+      mFlushRequested = false;
+    }
+    mRepliesCollected.notify_all();
+  }
 }
 
 
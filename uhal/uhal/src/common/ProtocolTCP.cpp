@@ -33,9 +33,15 @@
 #include "uhal/ProtocolTCP.hpp"
 
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <limits>
 #include <mutex>
 #include <sys/time.h>
+#include <type_traits>
+#include <arpa/inet.h>
+#include <poll.h>
 
 #include <boost/asio/connect.hpp>
 #include <boost/asio/write.hpp>
@@ -44,7 +50,9 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "uhal/Buffers.hpp"
+#include "uhal/ClientFactory.hpp"
 #include "uhal/grammars/URI.hpp"
+#include "uhal/IOservicePool.hpp"
 #include "uhal/IPbusInspector.hpp"
 #include "uhal/log/LogLevels.hpp"
 #include "uhal/log/log.hpp"
@@ -53,41 +61,172 @@
 #include "uhal/log/log_inserters.type.hpp"
 #include "uhal/ProtocolIPbus.hpp"
 #include "uhal/ProtocolControlHub.hpp"
+#include "uhal/SharedTCPConnection.hpp"
+#include "uhal/utilities/sockets.hpp"
 
 
 namespace uhal
 {
 
+  namespace
+  {
+    //! Whether a TCP chunk may contain more than one IPbus packet, which is only the case for the ControlHub (where each packet carries its own preamble)
+    template < typename InnerProtocol >
+    struct SupportsMultiPacketChunks : std::false_type {};
+
+    template < typename IPbusProtocol >
+    struct SupportsMultiPacketChunks< ControlHub< IPbusProtocol > > : std::true_type {};
+  }
+
+
   template < typename InnerProtocol , std::size_t nr_buffers_per_send >
   TCP< InnerProtocol, nr_buffers_per_send >::TCP ( const std::string& aId, const URI& aUri ) :
     InnerProtocol ( aId , aUri ),
     mMaxPayloadSize (350 * 4),
-    mIOservice ( ),
+    mMaxPayloadSizeFromUri ( 0 ),
+    mSizeFromTargetStatus ( false ),
+    mTargetNrBuffers ( 0 ),
+    mIOservicePool ( ClientFactory::getInstance().getIOservicePool() ),
+    mIOservice ( mIOservicePool->getIOservice() ),
     mSocket ( mIOservice ),
+    mSharedConnection ( ),
+    mSharedTarget ( 0 , 0 ),
+    mSharedRepliesReceived ( 0 ),
+    mSharedEarlyReplies ( ),
+    mSharedRepliesToDiscard ( 0 ),
     mEndpoint ( boost::asio::ip::tcp::resolver ( mIOservice ).resolve ( boost::asio::ip::tcp::resolver::query ( aUri.mHostname , aUri.mPort ) ) ),
     mDeadlineTimer ( mIOservice ),
-    mIOserviceWork ( mIOservice ),
-    mDispatchThread ( [this] () { mIOservice.run(); } ),
+    mClosing ( false ),
     mDispatchQueue(),
     mReplyQueue(),
     mPacketsInFlight ( 0 ),
+    mBusyPoll ( false ),
+    mKernelBusyPollPeriod ( 0 ),
+    mBuffersPerSend ( nr_buffers_per_send ),
+    mAdaptiveChunking ( false ),
+    mMaxBytesPerSend ( 0 ),
+    mDispatchQueueBytes ( 0 ),
     mFlushStarted ( false ),
     mFlushDone ( true ),
     mAsynchronousException ( NULL )
   {
-    mDeadlineTimer.async_wait ([this] (const boost::system::error_code&) { this->CheckDeadline(); });
+    std::string lSharedConnectionGroup;
+    uint32_t lConnectionPoolSize ( 1 );
 
     // Extract value of 'max_payload_size' attribute, if present
     for (const auto& lArg : aUri.mArguments) {
       if (lArg.first == "max_payload_size") {
         try {
           mMaxPayloadSize = boost::lexical_cast<size_t>(lArg.second);
+          mMaxPayloadSizeFromUri = mMaxPayloadSize;
         }
         catch (const boost::bad_lexical_cast&) {
           throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\"");
         }
         log (Info(), "Client with URI ", Quote(this->uri()), ": Maximum UDP payload size set to ", std::to_string(mMaxPayloadSize), " bytes");
       }
+      else if (lArg.first == "query_status") {
+        if (not std::is_same< InnerProtocol , IPbus< 2 , 0 > >::value)
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"" + lArg.first + "\" is only supported for IPbus 2.0");
+
+        try {
+          mSizeFromTargetStatus = boost::lexical_cast<bool>(lArg.second);
+        }
+        catch (const boost::bad_lexical_cast&) {
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\"");
+        }
+      }
+      else if (lArg.first == "poll") {
+        if (lArg.second != "busy" && lArg.second != "event")
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\" (expected \"busy\" or \"event\")");
+
+        mBusyPoll = (lArg.second == "busy");
+      }
+      else if (lArg.first == "so_busy_poll") {
+        try {
+          mKernelBusyPollPeriod = boost::lexical_cast<uint32_t>(lArg.second);
+        }
+        catch (const boost::bad_lexical_cast&) {
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\"");
+        }
+      }
+      else if (lArg.first == "buffers_per_send" || lArg.first == "max_bytes_per_send") {
+        if (not SupportsMultiPacketChunks< InnerProtocol >::value)
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"" + lArg.first + "\" is only supported for the ControlHub");
+
+        if (lArg.first == "buffers_per_send" && lArg.second == "adaptive") {
+          mAdaptiveChunking = true;
+          continue;
+        }
+
+        std::size_t lValue ( 0 );
+        try {
+          lValue = boost::lexical_cast<std::size_t>(lArg.second);
+        }
+        catch (const boost::bad_lexical_cast&) {
+        }
+
+        if (lValue == 0)
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\"");
+
+        if (lArg.first == "buffers_per_send")
+          mBuffersPerSend = lValue;
+        else
+          mMaxBytesPerSend = lValue;
+      }
+      else if (lArg.first == "shared_connection" || lArg.first == "connection_pool") {
+        if (not SupportsMultiPacketChunks< InnerProtocol >::value)
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"" + lArg.first + "\" is only supported for the ControlHub");
+
+        if (lArg.first == "shared_connection") {
+          lSharedConnectionGroup = lArg.second;
+          continue;
+        }
+
+        try {
+          lConnectionPoolSize = boost::lexical_cast<uint32_t>(lArg.second);
+        }
+        catch (const boost::bad_lexical_cast&) {
+          lConnectionPoolSize = 0;
+        }
+
+        if (lConnectionPoolSize == 0)
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\"");
+      }
+    }
+
+    if ( lSharedConnectionGroup.empty() && ( lConnectionPoolSize > 1 ) )
+      throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"connection_pool\" requires \"shared_connection\"");
+
+    // In busy-poll mode, the calling thread receives the replies by itself, rather than having them passed on by the shared connection's receive loop
+    if ( ! lSharedConnectionGroup.empty() && mBusyPoll )
+      throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"shared_connection\" cannot be used together with \"poll=busy\"");
+
+    if ( ( mKernelBusyPollPeriod > 0 ) && ! mBusyPoll )
+      throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"so_busy_poll\" requires \"poll=busy\"");
+
+    if ( mMaxBytesPerSend == 0 )
+      mMaxBytesPerSend = ( mAdaptiveChunking ? 65536 : std::numeric_limits<std::size_t>::max() );
+
+    // Nothing may throw once attached to the shared connection, since the destructor (which detaches) would not run
+    if ( ! lSharedConnectionGroup.empty() )
+    {
+      // The shared connection identifies replies by the target IP address and port in their ControlHub preamble
+      const std::pair< uint32_t , uint16_t > lTarget ( ExtractTargetID ( aUri ) );
+      mSharedTarget = std::make_pair ( htonl ( lTarget.first ) , htons ( lTarget.second ) );
+      mSharedConnection = SharedTCPConnection::get ( lSharedConnectionGroup , aUri.mHostname , aUri.mPort , lConnectionPoolSize );
+      mSharedConnection->attach ( mSharedTarget.first , mSharedTarget.second , [this] (const uint8_t* aData, std::size_t aSize) { this->receiveShared(aData, aSize); } );
+      log (Info(), "Client with URI ", Quote(this->uri()), ": Sharing ControlHub connection with other clients in group ", Quote(lSharedConnectionGroup));
+    }
+
+    // In busy-poll mode no asynchronous operations are started, so the socket must not be closed by the deadline timer
+    if ( mBusyPoll )
+    {
+      log (Info(), "Client with URI ", Quote(this->uri()), ": Replies will be collected by the dispatching thread, busy-polling the socket");
+    }
+    else
+    {
+      mDeadlineTimer.async_wait ([this] (const boost::system::error_code&) { this->CheckDeadline(); });
     }
   }
 
@@ -97,13 +236,21 @@ namespace uhal
   {
     try
     {
-      mSocket.close();
+      // Once detached, the shared connection's receive loop no longer passes replies to this client
+      if ( mSharedConnection )
+      {
+        mSharedConnection->detach ( mSharedTarget.first , mSharedTarget.second );
+      }
 
-      while ( mSocket.is_open() )
-        {}
+      // The io_service may be shared with other clients, so rather than stopping it, close the socket and cancel the
+      // timer from the I/O thread, and wait for the resulting (aborted) handlers to run before this object disappears
+      IOservicePool::drain ( mIOservice , [this] () {
+        std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+        mClosing = true;
+        mSocket.close();
+        mDeadlineTimer.cancel();
+      } );
 
-      mIOservice.stop();
-      mDispatchThread.join();
       ClientInterface::returnBufferToPool ( mDispatchQueue );
       for (size_t i = 0; i < mReplyQueue.size(); i++)
         ClientInterface::returnBufferToPool ( mReplyQueue.at(i).first );
@@ -128,15 +275,28 @@ namespace uhal
       mAsynchronousException->throwAsDerivedType();
     }
 
-    if ( ! mSocket.is_open() )
+    if ( ! mSharedConnection && ! mSocket.is_open() )
     {
       connect();
     }
 
+    if ( mBusyPoll )
+    {
+      // The reply to the oldest packet in flight is collected before sending another if the target's reply buffers are all in use
+      while ( mPacketsInFlight >= this->getMaxNumberOfBuffers() )
+      {
+        receiveBusy();
+      }
+
+      sendBusy ( aBuffers );
+      return;
+    }
+
     mFlushStarted = false;
     mDispatchQueue.push_back ( aBuffers );
+    mDispatchQueueBytes += aBuffers->sendCounter();
 
-    if ( mDispatchBuffers.empty() && ( mDispatchQueue.size() >= nr_buffers_per_send ) && ( mPacketsInFlight < this->getMaxNumberOfBuffers() ) )
+    if ( isChunkReady() )
     {
       write ( );
     }
@@ -157,6 +317,80 @@ namespace uhal
   }
 
 
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  uint32_t TCP< InnerProtocol , nr_buffers_per_send >::getMaxNumberOfBuffers()
+  {
+    if ( mSizeFromTargetStatus && ( mTargetNrBuffers > 0 ) )
+    {
+      return mTargetNrBuffers;
+    }
+
+    return InnerProtocol::getMaxNumberOfBuffers();
+  }
+
+
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  void TCP< InnerProtocol , nr_buffers_per_send >::queryTargetCapacity()
+  {
+    if ( ! mSizeFromTargetStatus )
+    {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+
+    if ( ! mSocket.is_open() )
+    {
+      connect();
+    }
+
+    // No asynchronous operations are in progress, so the status packet (preceded by its byte count, as for any chunk in the TCP stream) can be sent and its reply read synchronously
+    std::vector<uint32_t> lRequest ( 17 , 0x00000000 );
+    lRequest.at ( 0 ) = htonl ( 64 );
+    lRequest.at ( 1 ) = htonl ( 0x200000F1 );
+    std::vector<uint32_t> lReply ( 17 , 0x00000000 );
+    std::size_t lBytesTransferred ( 0 );
+    boost::system::error_code lErrorCode;
+    boost::asio::write ( mSocket , boost::asio::buffer ( lRequest ) , lErrorCode );
+
+    pollfd lPollFd;
+    lPollFd.fd = mSocket.native_handle();
+    lPollFd.events = POLLIN;
+
+    while ( ( ! lErrorCode ) && ( lBytesTransferred < 68 ) && ( ::poll ( &lPollFd , 1 , this->getBoostTimeoutPeriod().total_milliseconds() ) > 0 ) )
+    {
+      lBytesTransferred += mSocket.read_some ( boost::asio::buffer ( reinterpret_cast<uint8_t*> ( lReply.data() ) + lBytesTransferred , 68 - lBytesTransferred ) , lErrorCode );
+    }
+
+    if ( lErrorCode || ( lBytesTransferred < 68 ) || ( ntohl ( lReply.at ( 0 ) ) != 64 ) || ( ntohl ( lReply.at ( 1 ) ) != 0x200000F1 ) )
+    {
+      mSocket.close();
+      exception::TcpTimeout lExc;
+      log ( lExc , "No valid reply to status request sent to TCP server with URI: " , this->uri() );
+      throw lExc;
+    }
+
+    const uint32_t lMtu ( ntohl ( lReply.at ( 2 ) ) );
+    mTargetNrBuffers = ntohl ( lReply.at ( 3 ) );
+
+    // The MTU covers the IPv4 and TCP headers (40 bytes) as well as the IPbus packet, which must be a whole number of 32-bit words
+    const size_t lMaxPayloadSize ( ( lMtu > 40 ? lMtu - 40 : 0 ) & ~size_t ( 3 ) );
+
+    if ( lMaxPayloadSize < 64 )
+    {
+      log ( Warning() , "Ignoring implausible MTU (" , Integer ( lMtu ) , " bytes) in status reply from TCP server with URI " , Quote ( this->uri() ) );
+    }
+    else
+    {
+      // Re-calculated from the URI's value each time, since the target's MTU may have changed since it was last queried
+      mMaxPayloadSize = ( mMaxPayloadSizeFromUri == 0 ) ? lMaxPayloadSize : std::min ( lMaxPayloadSize , mMaxPayloadSizeFromUri );
+    }
+
+    log ( Info() , "TCP server with URI " , Quote ( this->uri() ) , " has an MTU of " , Integer ( lMtu ) , " bytes and " , Integer ( mTargetNrBuffers ) ,
+          " reply buffers; using a maximum payload size of " , Integer ( mMaxPayloadSize ) , " bytes, with up to " , Integer ( getMaxNumberOfBuffers() ) , " packets in flight" );
+  }
+
+
   template < typename InnerProtocol , std::size_t nr_buffers_per_send >
   void TCP< InnerProtocol , nr_buffers_per_send >::connect()
   {
@@ -194,6 +428,12 @@ namespace uhal
     }
 
     mSocket.set_option ( boost::asio::ip::tcp::no_delay ( true ) );
+
+    if ( mBusyPoll )
+    {
+      prepareBusyPollSocket();
+    }
+
     //    boost::asio::socket_base::non_blocking_io lNonBlocking ( true );
     //    mSocket.io_control ( lNonBlocking );
     log ( Info() , "TCP connection succeeded" );
@@ -201,24 +441,58 @@ namespace uhal
 
 
 
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  bool TCP< InnerProtocol , nr_buffers_per_send >::isChunkReady ( )
+  {
+    if ( ! mDispatchBuffers.empty() || mDispatchQueue.empty() || ( mPacketsInFlight >= this->getMaxNumberOfBuffers() ) )
+    {
+      return false;
+    }
+
+    if ( mFlushStarted )
+    {
+      return true;
+    }
+
+    if ( mAdaptiveChunking )
+    {
+      return ( mPacketsInFlight == 0 ) || ( mDispatchQueueBytes >= mMaxBytesPerSend ) || ( mPacketsInFlight + mDispatchQueue.size() >= this->getMaxNumberOfBuffers() );
+    }
+
+    return ( mDispatchQueue.size() >= mBuffersPerSend );
+  }
+
+
+
   template < typename InnerProtocol , std::size_t nr_buffers_per_send >
   void TCP< InnerProtocol , nr_buffers_per_send >::write ( )
   {
+    if ( mClosing )
+      return;
+
     NotifyConditionalVariable ( false );
 
     std::vector< boost::asio::const_buffer > lAsioSendBuffer;
     lAsioSendBuffer.push_back ( boost::asio::const_buffer ( &mSendByteCounter , 4 ) );
     mSendByteCounter = 0;
-    std::size_t lNrBuffersToSend = std::min ( mDispatchQueue.size(), nr_buffers_per_send );
+
+    // In adaptive mode, the chunk takes as many of the queued buffers as can be in flight at once
+    const uint32_t lMaxNumberOfBuffers ( this->getMaxNumberOfBuffers() );
+    const std::size_t lMaxBuffersToSend ( mAdaptiveChunking ? std::max < std::size_t > ( lMaxNumberOfBuffers > mPacketsInFlight ? lMaxNumberOfBuffers - mPacketsInFlight : 0 , 1 ) : mBuffersPerSend );
+    const std::size_t lNrBuffersToSend = std::min ( mDispatchQueue.size(), lMaxBuffersToSend );
     mDispatchBuffers.reserve ( lNrBuffersToSend );
 
-    for ( std::size_t i = 0; i < lNrBuffersToSend; i++ )
+    while ( ( mDispatchBuffers.size() < lNrBuffersToSend ) && ( mDispatchBuffers.empty() || ( mSendByteCounter + mDispatchQueue.front()->sendCounter() <= mMaxBytesPerSend ) ) )
     {
       mDispatchBuffers.push_back ( mDispatchQueue.front() );
       mDispatchQueue.pop_front();
       const std::shared_ptr<Buffers>& lBuffer = mDispatchBuffers.back();
       mSendByteCounter += lBuffer->sendCounter();
-      lAsioSendBuffer.push_back ( boost::asio::const_buffer ( lBuffer->getSendBuffer() , lBuffer->sendCounter() ) );
+      mDispatchQueueBytes -= lBuffer->sendCounter();
+      for ( const auto& lSegment : lBuffer->getSendSegments() )
+      {
+        lAsioSendBuffer.push_back ( boost::asio::const_buffer ( lSegment.first , lSegment.second ) );
+      }
     }
 
     log ( Debug() , "Sending " , Integer ( mSendByteCounter ) , " bytes from ", Integer ( mDispatchBuffers.size() ), " buffers" );
@@ -233,7 +507,18 @@ namespace uhal
       mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
     }
 
-    boost::asio::async_write ( mSocket , lAsioSendBuffer , [&] (const boost::system::error_code& e, std::size_t n) { this->write_callback(e, n); });
+    if ( mSharedConnection )
+    {
+      // The chunk is copied into the connection's send queue, so it is complete as far as this client is concerned; if it cannot be sent, the connection fails, and receiveShared reports the error
+      const std::size_t lBytesQueued ( boost::asio::buffer_size ( lAsioSendBuffer ) );
+      mSharedConnection->send ( lAsioSendBuffer , this->getBoostTimeoutPeriod() );
+      mIOservice.post ( [this, lBytesQueued] () { this->write_callback(boost::system::error_code(), lBytesQueued); } );
+    }
+    else
+    {
+      boost::asio::async_write ( mSocket , lAsioSendBuffer , [&] (const boost::system::error_code& e, std::size_t n) { this->write_callback(e, n); });
+    }
+
     mPacketsInFlight += mDispatchBuffers.size();
 
     SteadyClock_t::time_point lNow = SteadyClock_t::now();
@@ -312,7 +597,7 @@ namespace uhal
 
     mDispatchBuffers.clear();
 
-    if ( ( mDispatchQueue.size() >= (mFlushStarted ? 1 : nr_buffers_per_send) ) && ( mPacketsInFlight < this->getMaxNumberOfBuffers() ) )
+    if ( isChunkReady() )
     {
       write();
     }
@@ -323,6 +608,9 @@ namespace uhal
   template < typename InnerProtocol , std::size_t nr_buffers_per_send >
   void TCP< InnerProtocol , nr_buffers_per_send >::read ( )
   {
+    if ( mClosing )
+      return;
+
     std::vector< boost::asio::mutable_buffer > lAsioReplyBuffer;
     lAsioReplyBuffer.push_back ( boost::asio::mutable_buffer ( &mReplyByteCounter , 4 ) );
     log ( Debug() , "Getting reply byte counter" );
@@ -336,6 +624,20 @@ namespace uhal
       mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
     }
 
+    if ( mSharedConnection )
+    {
+      // The shared connection's receive loop passes the replies to receiveShared, which copies them directly to their final destinations
+      mSharedRepliesReceived = 0;
+
+      while ( mSharedEarlyReplies.size() && ( mSharedRepliesReceived < mReplyBuffers.first.size() ) )
+      {
+        deliverShared ( mSharedEarlyReplies.front().data() , mSharedEarlyReplies.front().size() );
+        mSharedEarlyReplies.pop_front();
+      }
+
+      return;
+    }
+
     boost::asio::async_read ( mSocket , lAsioReplyBuffer ,  boost::asio::transfer_exactly ( 4 ), [&] (const boost::system::error_code& e, std::size_t n) { this->read_callback(e, n); });
     SteadyClock_t::time_point lNow = SteadyClock_t::now();
     if (mLastRecvQueued > SteadyClock_t::time_point())
@@ -483,7 +785,14 @@ namespace uhal
       return;
     }
 
+    validateReplies();
+  }
+
+
 
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  void TCP< InnerProtocol , nr_buffers_per_send >::validateReplies ( )
+  {
     for (const auto& lBuf: mReplyBuffers.first)
     {
       try
@@ -522,7 +831,7 @@ namespace uhal
       mReplyBuffers.first.clear();
     }
 
-    if ( mDispatchBuffers.empty() && ( mDispatchQueue.size() >= (mFlushStarted ? 1 : nr_buffers_per_send) ) && ( mPacketsInFlight < this->getMaxNumberOfBuffers() ) )
+    if ( isChunkReady() )
     {
       write();
     }
@@ -536,11 +845,213 @@ namespace uhal
 
 
 
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  void TCP< InnerProtocol , nr_buffers_per_send >::receiveShared ( const uint8_t* aData , const std::size_t aSize )
+  {
+    std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+
+    if ( ! aData )
+    {
+      // Any replies that are still awaited will never arrive
+      mSharedRepliesToDiscard = 0;
+
+      if ( mPacketsInFlight && ! mAsynchronousException )
+      {
+        mAsynchronousException = new exception::ASIOTcpError();
+        log ( *mAsynchronousException , "Shared connection to ControlHub failed with replies outstanding for URI: " , this->uri() );
+        NotifyConditionalVariable ( true );
+      }
+
+      return;
+    }
+
+    if ( mSharedRepliesToDiscard > 0 )
+    {
+      log ( Debug() , "Discarding reply to failed dispatch from ControlHub for URI " , Quote ( this->uri() ) );
+      mSharedRepliesToDiscard--;
+    }
+    else if ( mReplyBuffers.first.size() > mSharedRepliesReceived )
+    {
+      deliverShared ( aData , aSize );
+    }
+    else if ( mPacketsInFlight > mSharedRepliesReceived + mSharedEarlyReplies.size() )
+    {
+      mSharedEarlyReplies.push_back ( std::vector< uint8_t > ( aData , aData + aSize ) );
+    }
+    else
+    {
+      log ( Debug() , "Discarding unexpected " , Integer ( aSize ) , "-byte reply from ControlHub for URI " , Quote ( this->uri() ) );
+    }
+  }
+
+
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  void TCP< InnerProtocol , nr_buffers_per_send >::deliverShared ( const uint8_t* aData , const std::size_t aSize )
+  {
+    std::size_t lNrBytesCopied ( 0 );
+
+    for ( const auto& lBuffer : mReplyBuffers.first.at ( mSharedRepliesReceived )->getReplyBuffer() )
+    {
+      // Don't copy more than was received, for cases when less data received than expected
+      if ( lNrBytesCopied >= aSize )
+        break;
+
+      const std::size_t lNrBytesToCopy ( std::min < std::size_t > ( lBuffer.second , aSize - lNrBytesCopied ) );
+      memcpy ( lBuffer.first , aData + lNrBytesCopied , lNrBytesToCopy );
+      lNrBytesCopied += lNrBytesToCopy;
+    }
+
+    if ( ++mSharedRepliesReceived == mReplyBuffers.first.size() )
+    {
+      mIOservice.post ( [this] () { this->validateReplies(); } );
+    }
+  }
+
+
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  void TCP< InnerProtocol , nr_buffers_per_send >::prepareBusyPollSocket ( )
+  {
+    if ( mKernelBusyPollPeriod > 0 )
+    {
+      const boost::system::error_code lErrorCode ( utilities::setKernelBusyPoll ( mSocket.native_handle() , mKernelBusyPollPeriod ) );
+
+      if ( lErrorCode )
+      {
+        log ( Warning() , "Could not set SO_BUSY_POLL for TCP socket with URI " , Quote ( this->uri() ) , " (error " , Quote ( lErrorCode.message() ) , "); only the client will busy-poll" );
+      }
+    }
+  }
+
+
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  void TCP< InnerProtocol , nr_buffers_per_send >::sendBusy ( const std::shared_ptr< Buffers >& aBuffers )
+  {
+    // As for any chunk in the TCP stream, the packet is preceded by its byte count
+    uint32_t lSendByteCounter ( htonl ( aBuffers->sendCounter() ) );
+    std::vector< iovec > lSegments ( 1 , iovec { &lSendByteCounter , 4 } );
+
+    for ( const auto& lSegment : aBuffers->getSendSegments() )
+    {
+      iovec lSegmentIovec = { const_cast<uint8_t*> ( lSegment.first ) , lSegment.second };
+      lSegments.push_back ( lSegmentIovec );
+    }
+
+    log ( Debug() , "Sending " , Integer ( aBuffers->sendCounter() ) , " bytes from 1 buffer" );
+    boost::system::error_code lErrorCode;
+    const SteadyClock_t::time_point lNow ( SteadyClock_t::now() );
+    const std::size_t lBytesTransferred ( utilities::busyTransfer ( mSocket.native_handle() , lSegments , true ,
+                                          lNow + std::chrono::milliseconds ( this->getBoostTimeoutPeriod().total_milliseconds() ) , lErrorCode ) );
+
+    // The buffer is owned by the reply queue from now on, so that it is returned to the pool if anything goes wrong
+    mReplyQueue.push_back ( std::make_pair ( std::vector< std::shared_ptr< Buffers > > ( 1 , aBuffers ) , lNow ) );
+    mPacketsInFlight++;
+
+    if ( lErrorCode == boost::asio::error::timed_out )
+    {
+      exception::TcpTimeout lExc;
+      log ( lExc , "Timeout (" , Integer ( this->getBoostTimeoutPeriod().total_milliseconds() ) , " milliseconds) occurred for send to ",
+            ( this->uri().find ( "chtcp-" ) == 0 ? "ControlHub" : "TCP server" ) , " with URI: ", this->uri() );
+      throw lExc;
+    }
+    else if ( lErrorCode || ( lBytesTransferred != ( aBuffers->sendCounter() + 4 ) ) )
+    {
+      exception::ASIOTcpError lExc;
+      log ( lExc , "Error ", Quote ( lErrorCode.message() ) , " encountered during send to ",
+            ( this->uri().find ( "chtcp-" ) == 0 ? "ControlHub" : "TCP server" ) , " with URI: " , this->uri() ,
+            " (" , Integer ( lBytesTransferred ) , " of " , Integer ( aBuffers->sendCounter() + 4 ) , " bytes sent)" );
+      throw lExc;
+    }
+  }
+
+
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  void TCP< InnerProtocol , nr_buffers_per_send >::receiveBusy ( )
+  {
+    std::shared_ptr< Buffers > lBuffers ( mReplyQueue.front().first.front() );
+    const SteadyClock_t::time_point lDeadline ( SteadyClock_t::now() + std::chrono::milliseconds ( this->getBoostTimeoutPeriod().total_milliseconds() ) );
+
+    uint32_t lReplyByteCounter ( 0 );
+    std::vector< iovec > lSegments ( 1 , iovec { &lReplyByteCounter , 4 } );
+    boost::system::error_code lErrorCode;
+    std::size_t lBytesTransferred ( utilities::busyTransfer ( mSocket.native_handle() , lSegments , false , lDeadline , lErrorCode ) );
+    lReplyByteCounter = ntohl ( lReplyByteCounter );
+    log ( Debug() , "Byte Counter says " , Integer ( lReplyByteCounter ) , " bytes are coming" );
+
+    if ( ! lErrorCode )
+    {
+      if ( lReplyByteCounter > lBuffers->replyCounter() )
+      {
+        exception::ASIOTcpError lExc;
+        log ( lExc , "Expected at most " , Integer ( lBuffers->replyCounter() ) , " bytes in chunk from " ,
+              ( this->uri().find ( "chtcp-" ) == 0 ? "ControlHub" : "TCP server" ) , " with URI " , Quote ( this->uri() ) ,
+              ", but byte counter says " , Integer ( lReplyByteCounter ) , " bytes are coming" );
+        throw lExc;
+      }
+
+      // The reply is received directly into its final destinations, stopping at the end of the chunk if it is shorter than expected
+      lSegments.clear();
+      std::size_t lRemaining ( lReplyByteCounter );
+
+      for ( const auto& lBuffer : lBuffers->getReplyBuffer() )
+      {
+        const std::size_t lNrBytes ( std::min < std::size_t > ( lBuffer.second , lRemaining ) );
+        lSegments.push_back ( iovec { lBuffer.first , lNrBytes } );
+        lRemaining -= lNrBytes;
+      }
+
+      lBytesTransferred = utilities::busyTransfer ( mSocket.native_handle() , lSegments , false , lDeadline , lErrorCode );
+    }
+
+    if ( lErrorCode == boost::asio::error::timed_out )
+    {
+      exception::TcpTimeout lExc;
+      log ( lExc , "Timeout (" , Integer ( this->getBoostTimeoutPeriod().total_milliseconds() ) , " ms) occurred for receive from ",
+            ( this->uri().find ( "chtcp-" ) == 0 ? "ControlHub" : "TCP server" ) , " with URI '", this->uri(), "'. ",
+            Integer(mPacketsInFlight), " packets in flight" );
+      throw lExc;
+    }
+    else if ( lErrorCode )
+    {
+      exception::ASIOTcpError lExc;
+      log ( lExc , "Error ", Quote ( lErrorCode.message() ) , " encountered during receive from ",
+            ( this->uri().find ( "chtcp-" ) == 0 ? "ControlHub" : "TCP server" ) , " with URI: " , this->uri() ,
+            " (" , Integer ( lBytesTransferred ) , " bytes received)" );
+      throw lExc;
+    }
+
+    mRTTStats.add ( mReplyQueue.front().second , SteadyClock_t::now() );
+    mReplyQueue.pop_front();
+    mPacketsInFlight--;
+
+    exception::exception* lExc ( NULL );
+
+    try
+    {
+      lExc = ClientInterface::validate ( lBuffers ); //Control of the pointer has been passed back to the client interface
+    }
+    catch ( exception::exception& aExc )
+    {
+      lExc = new exception::ValidationError ();
+      log ( *lExc , "Exception caught during reply validation for TCP device with URI " , Quote ( this->uri() ) , "; what returned: " , Quote ( aExc.what() ) );
+    }
+
+    if ( lExc )
+    {
+      // Like asynchronous exceptions, this is deleted by dispatchExceptionHandler once the transport layer has been tidied up
+      mAsynchronousException = lExc;
+      lExc->throwAsDerivedType();
+    }
+  }
+
+
   template < typename InnerProtocol , std::size_t nr_buffers_per_send >
   void TCP< InnerProtocol , nr_buffers_per_send >::CheckDeadline()
   {
     std::lock_guard<std::mutex> lLock ( this->mTransportLayerMutex );
 
+    if ( mClosing )
+      return;
+
     // Check whether the deadline has passed. We compare the deadline against the current time since a new asynchronous operation may have moved the deadline before this actor had a chance to run.
     if ( mDeadlineTimer.expires_at() <= boost::asio::deadline_timer::traits_type::now() )
     {
@@ -554,8 +1065,21 @@ namespace uhal
         log ( Debug() , "Closing TCP socket for device with URI " , Quote ( this->uri() ) , " since no communication in 60 seconds" );
       }
 
-      // The deadline has passed. The socket is closed so that any outstanding asynchronous operations are cancelled.
-      mSocket.close();
+      if ( mSharedConnection )
+      {
+        // There is no socket to close; the replies still to come through the shared connection are discarded once the dispatch has failed
+        if ( mReplyBuffers.first.size() && ! mAsynchronousException )
+        {
+          mAsynchronousException = new exception::TcpTimeout();
+          log ( *mAsynchronousException , "Timeout (" , Integer ( this->getBoostTimeoutPeriod().total_milliseconds() ) , " milliseconds) occurred for receive from ControlHub with URI: ", this->uri() );
+          NotifyConditionalVariable ( true );
+        }
+      }
+      else
+      {
+        // The deadline has passed. The socket is closed so that any outstanding asynchronous operations are cancelled.
+        mSocket.close();
+      }
       // There is no longer an active deadline. The expiry is set to positive infinity so that the actor takes no action until a new deadline is set.
       mDeadlineTimer.expires_at ( boost::posix_time::pos_infin );
     }
@@ -568,16 +1092,20 @@ namespace uhal
   template < typename InnerProtocol , std::size_t nr_buffers_per_send >
   void TCP< InnerProtocol , nr_buffers_per_send >::Flush( )
   {
+    if ( mBusyPoll )
     {
       std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
-      mFlushStarted = true;
 
-      if ( mDispatchQueue.size() && mDispatchBuffers.empty() )
+      while ( mReplyQueue.size() )
       {
-        write();
+        receiveBusy();
       }
+
+      return;
     }
 
+    startFlush();
+
     WaitOnConditionalVariable();
 
     std::lock_guard<std::mutex> lLock ( mTransportLayerMutex ); 
@@ -589,6 +1117,21 @@ namespace uhal
   }
 
 
+  template < typename InnerProtocol , std::size_t nr_buffers_per_send >
+  bool TCP< InnerProtocol , nr_buffers_per_send >::startFlush( )
+  {
+    std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+    mFlushStarted = true;
+
+    if ( mDispatchQueue.size() && mDispatchBuffers.empty() )
+    {
+      write();
+    }
+
+    return ! mBusyPoll;
+  }
+
+
   template < typename InnerProtocol , std::size_t nr_buffers_per_send >
   void TCP< InnerProtocol , nr_buffers_per_send >::dispatchExceptionHandler()
   {
@@ -615,9 +1158,18 @@ namespace uhal
       mAsynchronousException = NULL;
     }
 
+    // The ControlHub replies to every packet that it has received, even if the target does not, so replies still to come for this dispatch must not be mistaken for replies to the next one
+    if ( mSharedConnection )
+    {
+      mSharedRepliesToDiscard += mPacketsInFlight - std::min < std::size_t > ( mPacketsInFlight , mSharedRepliesReceived + mSharedEarlyReplies.size() );
+      mSharedRepliesReceived = 0;
+      mSharedEarlyReplies.clear();
+    }
+
     ClientInterface::returnBufferToPool ( mDispatchQueue );
       for (size_t i = 0; i < mReplyQueue.size(); i++)
         ClientInterface::returnBufferToPool ( mReplyQueue.at(i).first );
+    mDispatchQueueBytes = 0;
     mPacketsInFlight = 0;
     ClientInterface::returnBufferToPool ( mDispatchBuffers );
     ClientInterface::returnBufferToPool ( mReplyBuffers.first );
@@ -637,6 +1189,11 @@ namespace uhal
       mFlushDone = aValue;
     }
     mConditionalVariable.notify_one();
+
+    if ( aValue && mAsynchronousException )
+    {
+      ClientInterface::failPendingDispatches ( *mAsynchronousException );
+    }
   }
 
   template < typename InnerProtocol , std::size_t nr_buffers_per_send >
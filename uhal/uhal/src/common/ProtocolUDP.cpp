@@ -33,10 +33,20 @@
 #include "uhal/ProtocolUDP.hpp"
 
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
 #include <exception>
+#include <limits>
 #include <mutex>
+#include <type_traits>
 #include <utility>
 
+#include <arpa/inet.h>
+#include <poll.h>
+
 #include <boost/asio/connect.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/asio/read.hpp>
@@ -50,7 +60,11 @@
 #include "uhal/log/log.hpp"
 #include "uhal/grammars/URI.hpp"
 #include "uhal/Buffers.hpp"
+#include "uhal/ClientFactory.hpp"
+#include "uhal/IOservicePool.hpp"
 #include "uhal/ProtocolIPbus.hpp"
+#include "uhal/SharedUDPSocket.hpp"
+#include "uhal/utilities/sockets.hpp"
 
 
 namespace uhal
@@ -59,37 +73,168 @@ namespace uhal
   UDP< InnerProtocol >::UDP ( const std::string& aId, const URI& aUri ) :
     InnerProtocol ( aId , aUri ),
     mMaxPayloadSize (350 * 4),
-    mIOservice ( ),
-    mSocket ( mIOservice , boost::asio::ip::udp::endpoint ( boost::asio::ip::udp::v4(), 0 ) ),
+    mMaxPayloadSizeFromUri ( 0 ),
+    mSizeFromTargetStatus ( false ),
+    mIOservicePool ( ClientFactory::getInstance().getIOservicePool() ),
+    mIOservice ( mIOservicePool->getIOservice() ),
+    mSocket ( mIOservice ),
+    mSharedReceivePending ( false ),
     mEndpoint ( *boost::asio::ip::udp::resolver ( mIOservice ).resolve ( boost::asio::ip::udp::resolver::query ( boost::asio::ip::udp::v4() , aUri.mHostname , aUri.mPort ) ) ),
     mDeadlineTimer ( mIOservice ),
+    mClosing ( false ),
     mReplyMemory ( ),
-    mIOserviceWork ( mIOservice ),
-    mDispatchThread ( [this] () { mIOservice.run(); } ),
+    mReplySegments ( ),
+    mReplyInPlace ( false ),
     mDispatchQueue(),
     mReplyQueue(),
+    mBatched ( false ),
+    mBatchSendPosted ( false ),
+    mBatchReceivePending ( false ),
+    mBusyPoll ( false ),
+    mKernelBusyPollPeriod ( 0 ),
     mPacketsInFlight ( 0 ),
+    mAdaptiveWindow ( false ),
+    mWindow ( 1 ),
+    mSlowStartThreshold ( std::numeric_limits<double>::max() ),
+    mSendTimes ( ),
+    mSmoothedRtt ( 0 ),
+    mMinRtt ( 0 ),
+    mMinRttTime ( ),
+    mRoundMinRtt ( 0 ),
+    mRoundEnd ( ),
+    mLastWindowReduction ( ),
     mFlushDone ( true ),
-    mAsynchronousException ( NULL )
+    mAsynchronousException ( NULL ),
+    mMaxRecoveryAttempts ( 0 ),
+    mRecoveryAttempts ( 0 ),
+    mNextPacketId ( 0 ),
+    mTargetReplyHistoryDepth ( 0 ),
+    mTargetMtu ( 0 ),
+    mRecoveredPacketLosses ( 0 ),
+    mFatalPacketLosses ( 0 )
   {
-    mDeadlineTimer.async_wait ([this] (const boost::system::error_code&) { this->CheckDeadline(); });
-
     // Extract value of 'max_payload_size' attribute, if present
     for (const auto& lArg : aUri.mArguments) {
       if (lArg.first == "max_payload_size") {
         try {
           mMaxPayloadSize = boost::lexical_cast<size_t>(lArg.second);
+          mMaxPayloadSizeFromUri = mMaxPayloadSize;
         }
         catch (const boost::bad_lexical_cast&) {
           throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\"");
         }
         log (Info(), "Client with URI ", Quote(this->uri()), ": Maximum UDP payload size set to ", std::to_string(mMaxPayloadSize), " bytes");
       }
+      else if (lArg.first == "max_recovery_attempts") {
+        if (not std::is_same< InnerProtocol , IPbus< 2 , 0 > >::value)
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"" + lArg.first + "\" is only supported for IPbus 2.0");
+
+        try {
+          mMaxRecoveryAttempts = boost::lexical_cast<uint32_t>(lArg.second);
+        }
+        catch (const boost::bad_lexical_cast&) {
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\"");
+        }
+        log (Info(), "Client with URI ", Quote(this->uri()), ": Lost packets will be recovered using up to ", std::to_string(mMaxRecoveryAttempts), " status/resend attempts");
+      }
+      else if (lArg.first == "query_status") {
+        if (not std::is_same< InnerProtocol , IPbus< 2 , 0 > >::value)
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"" + lArg.first + "\" is only supported for IPbus 2.0");
+
+        try {
+          mSizeFromTargetStatus = boost::lexical_cast<bool>(lArg.second);
+        }
+        catch (const boost::bad_lexical_cast&) {
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\"");
+        }
+      }
+      else if (lArg.first == "batch") {
+        try {
+          mBatched = boost::lexical_cast<bool>(lArg.second);
+        }
+        catch (const boost::bad_lexical_cast&) {
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\"");
+        }
+      }
+      else if (lArg.first == "adaptive_window") {
+        if (not std::is_same< InnerProtocol , IPbus< 2 , 0 > >::value)
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"" + lArg.first + "\" is only supported for IPbus 2.0");
+
+        try {
+          mAdaptiveWindow = boost::lexical_cast<bool>(lArg.second);
+        }
+        catch (const boost::bad_lexical_cast&) {
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\"");
+        }
+      }
+      else if (lArg.first == "shared_socket") {
+        // Replies received through the shared socket are matched to their packets by the IPbus 2.0 packet header and transaction ID
+        if (not std::is_same< InnerProtocol , IPbus< 2 , 0 > >::value)
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"" + lArg.first + "\" is only supported for IPbus 2.0");
+
+        mSharedSocket = SharedUDPSocket::get(lArg.second);
+        log (Info(), "Client with URI ", Quote(this->uri()), ": Sharing UDP socket with other clients in group ", Quote(lArg.second));
+      }
+      else if (lArg.first == "poll") {
+        if (lArg.second != "busy" && lArg.second != "event")
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\" (expected \"busy\" or \"event\")");
+
+        mBusyPoll = (lArg.second == "busy");
+      }
+      else if (lArg.first == "so_busy_poll") {
+        try {
+          mKernelBusyPollPeriod = boost::lexical_cast<uint32_t>(lArg.second);
+        }
+        catch (const boost::bad_lexical_cast&) {
+          throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Invalid value, \"" + lArg.second + "\", specified for attribute \"" + lArg.first + "\"");
+        }
+      }
+      else if (lArg.first == "coalesce") {
+        // Handled by IPbusCore
+      }
       else
         throw exception::InvalidURI("Client URI \"" + this->uri() + "\" has unexpected attribute \"" + lArg.first + "\"");
     }
 
+    // Recovery of lost packets relies on receiving one reply at a time
+    if ( mBatched && ( mMaxRecoveryAttempts > 0 ) )
+      throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attributes \"batch\" and \"max_recovery_attempts\" cannot be used together");
+
+    // These features read the client's own socket directly, so are not available when sharing a socket
+    if ( mSharedSocket && ( mBatched || ( mMaxRecoveryAttempts > 0 ) || mSizeFromTargetStatus ) )
+      throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"shared_socket\" cannot be used together with \"batch\", \"max_recovery_attempts\" or \"query_status\"");
+
+    // In busy-poll mode, the calling thread sends and receives by itself, so cannot hand over to the I/O thread for lost packet recovery or batching
+    if ( mBusyPoll && ( mBatched || ( mMaxRecoveryAttempts > 0 ) || mSharedSocket ) )
+      throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"poll=busy\" cannot be used together with \"batch\", \"max_recovery_attempts\" or \"shared_socket\"");
+
+    if ( ( mKernelBusyPollPeriod > 0 ) && ! mBusyPoll )
+      throw exception::InvalidURI("Client URI \"" + this->uri() + "\": Attribute \"so_busy_poll\" requires \"poll=busy\"");
+
+    if ( mBusyPoll )
+      log (Info(), "Client with URI ", Quote(this->uri()), ": Replies will be collected by the dispatching thread, busy-polling the socket");
+
     mReplyMemory.resize(mMaxPayloadSize + 20, 0x00000000);
+
+    if ( mSharedSocket )
+    {
+      mSharedSocket->attach ( mEndpoint , [this] (const uint8_t* aData, std::size_t aSize) { this->receiveShared(aData, aSize); } );
+    }
+    else
+    {
+      mSocket.open ( boost::asio::ip::udp::v4() );
+      mSocket.bind ( boost::asio::ip::udp::endpoint ( boost::asio::ip::udp::v4(), 0 ) );
+    }
+
+    // In busy-poll mode no asynchronous operations are started, so the socket must not be closed by the deadline timer
+    if ( mBusyPoll )
+    {
+      prepareBusyPollSocket();
+    }
+    else
+    {
+      mDeadlineTimer.async_wait ([this] (const boost::system::error_code&) { this->CheckDeadline(); });
+    }
   }
 
 
@@ -98,13 +243,21 @@ namespace uhal
   {
     try
     {
-      mSocket.close();
+      // Once detached, the shared socket's receive loop no longer passes datagrams to this client
+      if ( mSharedSocket )
+      {
+        mSharedSocket->detach ( mEndpoint );
+      }
 
-      while ( mSocket.is_open() )
-        {}
+      // The io_service may be shared with other clients, so rather than stopping it, close the socket and cancel the
+      // timer from the I/O thread, and wait for the resulting (aborted) handlers to run before this object disappears
+      IOservicePool::drain ( mIOservice , [this] () {
+        std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+        mClosing = true;
+        mSocket.close();
+        mDeadlineTimer.cancel();
+      } );
 
-      mIOservice.stop();
-      mDispatchThread.join();
       std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
       ClientInterface::returnBufferToPool ( mDispatchQueue );
       ClientInterface::returnBufferToPool ( mReplyQueue );
@@ -128,13 +281,65 @@ namespace uhal
       mAsynchronousException->throwAsDerivedType();
     }
 
-    if ( ! mSocket.is_open() )
+    if ( ! mSharedSocket && ! mSocket.is_open() )
     {
       connect();
     }
 
+    if ( mMaxRecoveryAttempts > 0 )
+    {
+      if ( mNextPacketId == 0 )
+      {
+        queryTargetStatus();
+      }
+
+      // Recovery relies on the target tracking packet IDs, so replace the (non-reliable) ID 0 in the packet header
+      uint32_t* lPacketHeader ( reinterpret_cast<uint32_t*> ( aBuffers->getSendBuffer() ) );
+      *lPacketHeader = ( *lPacketHeader & 0xFF0000FF ) | ( uint32_t ( mNextPacketId ) << 8 );
+      mNextPacketId = ( mNextPacketId == 0xFFFF ? 1 : mNextPacketId + 1 );
+    }
+
+    if ( mBusyPoll )
+    {
+      // The reply to the oldest packet in flight is collected before sending another if the target's reply buffers are all in use
+      while ( mPacketsInFlight >= getPacketsInFlightLimit() )
+      {
+        receiveBusy();
+      }
+
+      sendBusy ( aBuffers );
+      return;
+    }
+
+    if ( mBatched )
+    {
+      // Buffers dispatched before the I/O thread gets round to sending are sent together
+      mDispatchQueue.push_back ( aBuffers );
+
+      if ( ! mBatchSendPosted )
+      {
+        mBatchSendPosted = true;
+        NotifyConditionalVariable ( false );
+        mIOservice.post ( [this] () {
+          std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+          mBatchSendPosted = false;
+
+          if ( mAsynchronousException )
+            return;
+
+          writeBatch();
+
+          if ( mDispatchQueue.empty() && mReplyQueue.empty() )
+          {
+            NotifyConditionalVariable ( true );
+          }
+        } );
+      }
+
+      return;
+    }
 
-    if ( mDispatchBuffers || mPacketsInFlight == this->getMaxNumberOfBuffers() )
+    if ( mDispatchBuffers || mPacketsInFlight >= getPacketsInFlightLimit() )
     {
       mDispatchQueue.push_back ( aBuffers );
     }
@@ -160,12 +365,228 @@ namespace uhal
   }
 
 
+  template < typename InnerProtocol >
+  uint32_t UDP< InnerProtocol >::getMaxNumberOfBuffers()
+  {
+    if ( mSizeFromTargetStatus && ( mTargetReplyHistoryDepth > 0 ) )
+    {
+      return mTargetReplyHistoryDepth;
+    }
+
+    if ( ( mMaxRecoveryAttempts > 0 ) && ( mTargetReplyHistoryDepth > 0 ) )
+    {
+      return std::min ( InnerProtocol::getMaxNumberOfBuffers() , mTargetReplyHistoryDepth );
+    }
+
+    return InnerProtocol::getMaxNumberOfBuffers();
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::queryTargetCapacity()
+  {
+    if ( ! mSizeFromTargetStatus )
+    {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+
+    if ( ! mSocket.is_open() )
+    {
+      connect();
+    }
+
+    queryTargetStatus();
+
+    // The MTU covers the IPv4 and UDP headers (28 bytes) as well as the IPbus packet, which must be a whole number of 32-bit words
+    const size_t lMaxPayloadSize ( std::min < size_t > ( mTargetMtu > 28 ? mTargetMtu - 28 : 0 , 65507 ) & ~size_t ( 3 ) );
+
+    if ( lMaxPayloadSize < 64 )
+    {
+      log ( Warning() , "Ignoring implausible MTU (" , Integer ( mTargetMtu ) , " bytes) in status reply from UDP target with URI " , Quote ( this->uri() ) );
+    }
+    else
+    {
+      // Re-calculated from the URI's value each time, since the target's MTU may have changed since it was last queried
+      mMaxPayloadSize = ( mMaxPayloadSizeFromUri == 0 ) ? lMaxPayloadSize : std::min ( lMaxPayloadSize , mMaxPayloadSizeFromUri );
+    }
+
+    mReplyMemory.resize ( mMaxPayloadSize + 20 , 0x00000000 );
+    log ( Info() , "UDP target with URI " , Quote ( this->uri() ) , " has an MTU of " , Integer ( mTargetMtu ) , " bytes and " , Integer ( mTargetReplyHistoryDepth ) ,
+          " reply buffers; using a maximum payload size of " , Integer ( mMaxPayloadSize ) , " bytes, with up to " , Integer ( getMaxNumberOfBuffers() ) , " packets in flight" );
+  }
+
+
+  template < typename InnerProtocol >
+  uint32_t UDP< InnerProtocol >::getPacketsInFlightLimit()
+  {
+    const uint32_t lMaxNumberOfBuffers ( this->getMaxNumberOfBuffers() );
+
+    if ( ! mAdaptiveWindow )
+    {
+      return lMaxNumberOfBuffers;
+    }
+
+    return std::max < uint32_t > ( std::min < uint32_t > ( uint32_t ( mWindow ) , lMaxNumberOfBuffers ) , 1 );
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::recordSend ( )
+  {
+    mSendTimes.push_back ( std::chrono::steady_clock::now() );
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::recordReply ( )
+  {
+    // The base round-trip time is re-measured after this period, so that a lasting change of route is followed
+    const std::chrono::seconds lMinRttLifetime ( 10 );
+    // Thresholds on the estimated number of this client's packets queued at the target or in the network, as in TCP Vegas:
+    // slow start ends above the first; beyond it, the window grows below the second, and shrinks above the third
+    const double lSlowStartQueuedPackets ( 1 );
+    const double lMinQueuedPackets ( 2 );
+    const double lMaxQueuedPackets ( 4 );
+
+    if ( mSendTimes.empty() )
+    {
+      return;
+    }
+
+    const std::chrono::steady_clock::time_point lNow ( std::chrono::steady_clock::now() );
+
+    if ( mSendTimes.front() != std::chrono::steady_clock::time_point() )
+    {
+      // Smoothed as in TCP (RFC 6298)
+      const double lRtt ( std::chrono::duration<double, std::micro> ( lNow - mSendTimes.front() ).count() );
+      mSmoothedRtt = ( mSmoothedRtt == 0 ? lRtt : 0.875 * mSmoothedRtt + 0.125 * lRtt );
+      mRoundMinRtt = ( mRoundMinRtt == 0 ? lRtt : std::min ( mRoundMinRtt , lRtt ) );
+
+      if ( ( mMinRtt == 0 ) || ( lRtt <= mMinRtt ) || ( lNow - mMinRttTime > lMinRttLifetime ) )
+      {
+        mMinRtt = lRtt;
+        mMinRttTime = lNow;
+      }
+    }
+
+    // The replies only show whether a larger window would be useful if the window is currently limiting the packets in flight
+    const bool lWindowLimited ( mSendTimes.size() >= getPacketsInFlightLimit() );
+    mSendTimes.pop_front();
+
+    if ( ! mAdaptiveWindow )
+    {
+      return;
+    }
+
+    const double lMaxWindow ( this->getMaxNumberOfBuffers() );
+
+    if ( lNow >= mRoundEnd )
+    {
+      // Once per round trip, the throughput expected from the window at the base round-trip time is compared with the throughput
+      // achieved over the last round trip; multiplied by the base round-trip time, the difference is the number of packets queued
+      if ( ( mMinRtt > 0 ) && ( mRoundMinRtt > 0 ) )
+      {
+        const double lExpectedRate ( mWindow / mMinRtt );
+        const double lActualRate ( mWindow / mRoundMinRtt );
+        const double lQueuedPackets ( ( lExpectedRate - lActualRate ) * mMinRtt );
+
+        if ( lQueuedPackets > lMaxQueuedPackets )
+        {
+          mWindow = std::max ( mWindow - 1 , 1.0 );
+          mSlowStartThreshold = std::min ( mSlowStartThreshold , mWindow );
+        }
+        else if ( mWindow < mSlowStartThreshold )
+        {
+          if ( lQueuedPackets > lSlowStartQueuedPackets )
+          {
+            mSlowStartThreshold = mWindow;
+          }
+        }
+        else if ( ( lQueuedPackets < lMinQueuedPackets ) && lWindowLimited )
+        {
+          mWindow = std::min ( mWindow + 1 , lMaxWindow );
+        }
+      }
+
+      mRoundEnd = lNow + std::chrono::microseconds ( uint64_t ( mSmoothedRtt ) );
+      mRoundMinRtt = 0;
+    }
+    else if ( ( mWindow < mSlowStartThreshold ) && lWindowLimited )
+    {
+      mWindow = std::min ( mWindow + 1 , lMaxWindow );
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::recordCongestion ( )
+  {
+    const std::chrono::steady_clock::time_point lNow ( std::chrono::steady_clock::now() );
+
+    // Packets that were already in flight when the window was last reduced may be delayed or lost for the same reason, so are ignored
+    if ( ! mAdaptiveWindow || ( lNow - mLastWindowReduction < std::chrono::microseconds ( uint64_t ( mSmoothedRtt ) ) ) )
+    {
+      return;
+    }
+
+    mSlowStartThreshold = std::max ( mWindow / 2 , 1.0 );
+    mWindow = mSlowStartThreshold;
+    mLastWindowReduction = lNow;
+    // The number of packets queued is next estimated from round-trip times measured with the reduced window
+    mRoundEnd = lNow + std::chrono::microseconds ( uint64_t ( mSmoothedRtt ) );
+    mRoundMinRtt = 0;
+    log ( Debug() , "Reduced window for UDP target with URI " , Quote ( this->uri() ) , " to " , Integer ( getPacketsInFlightLimit() ) , " packets in flight" );
+  }
+
+
+  template < typename InnerProtocol >
+  uint32_t UDP< InnerProtocol >::getWindowSize()
+  {
+    std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+    return getPacketsInFlightLimit();
+  }
+
+
+  template < typename InnerProtocol >
+  std::chrono::microseconds UDP< InnerProtocol >::getRoundTripTime()
+  {
+    std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+    return std::chrono::microseconds ( uint64_t ( mSmoothedRtt ) );
+  }
+
+
+  template < typename InnerProtocol >
+  uint64_t UDP< InnerProtocol >::getRecoveredPacketLosses()
+  {
+    std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+    return mRecoveredPacketLosses;
+  }
+
+
+  template < typename InnerProtocol >
+  uint64_t UDP< InnerProtocol >::getFatalPacketLosses()
+  {
+    std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+    return mFatalPacketLosses;
+  }
+
+
   template < typename InnerProtocol >
   void UDP< InnerProtocol >::connect()
   {
     log ( Info() , "Creating new UDP socket for device " , Quote ( this->uri() ) , ", as it appears to have been closed..." );
     //mSocket = boost::asio::ip::udp::socket ( mIOservice , boost::asio::ip::udp::endpoint ( boost::asio::ip::udp::v4(), 0 ) );
     mSocket.open ( boost::asio::ip::udp::v4() );
+
+    if ( mBusyPoll )
+    {
+      prepareBusyPollSocket();
+    }
+
+    // The target's state is unknown to a new socket, so query its status before the next packet is sent
+    mNextPacketId = 0;
     //    boost::asio::socket_base::non_blocking_io lNonBlocking ( true );
     //    mSocket.io_control ( lNonBlocking );
     log ( Info() , "UDP socket created successfully." );
@@ -175,6 +596,9 @@ namespace uhal
   template < typename InnerProtocol >
   void UDP< InnerProtocol >::write ( )
   {
+    if ( mClosing )
+      return;
+
     NotifyConditionalVariable ( false );
 
     if ( !mDispatchBuffers )
@@ -184,18 +608,34 @@ namespace uhal
     }
 
     std::vector< boost::asio::const_buffer > lAsioSendBuffer;
-    lAsioSendBuffer.push_back ( boost::asio::const_buffer ( mDispatchBuffers->getSendBuffer() , mDispatchBuffers->sendCounter() ) );
+    for ( const auto& lSegment : mDispatchBuffers->getSendSegments() )
+    {
+      lAsioSendBuffer.push_back ( boost::asio::const_buffer ( lSegment.first , lSegment.second ) );
+    }
     log ( Debug() , "Sending " , Integer ( mDispatchBuffers->sendCounter() ) , " bytes" );
-    mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
+    mDeadlineTimer.expires_from_now ( getAttemptTimeoutPeriod() );
 
     // Patch for suspected bug in using boost asio with boost python; see https://svnweb.cern.ch/trac/cactus/ticket/323#comment:7
     while ( mDeadlineTimer.expires_from_now() < boost::posix_time::microseconds ( 600 ) )
     {
       log ( Debug() , "Resetting deadline timer since it just got set to strange value, likely due to a bug within boost (expires_from_now was: ", mDeadlineTimer.expires_from_now() , ")." );
-      mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
+      mDeadlineTimer.expires_from_now ( getAttemptTimeoutPeriod() );
+    }
+
+    if ( mSharedSocket )
+    {
+      // The datagram is sent immediately, but write_callback still runs on this client's I/O thread, as if the send were asynchronous
+      mSharedAwaitedReplies.push_back ( getSharedReplyKey ( mDispatchBuffers->getSendBuffer() , mDispatchBuffers->sendCounter() ) );
+      boost::system::error_code lErrorCode;
+      const std::size_t lBytesTransferred ( mSharedSocket->send ( mDispatchBuffers->getSendSegments() , mEndpoint , lErrorCode ) );
+      mIOservice.post ( [this, lErrorCode, lBytesTransferred] () { this->write_callback(lErrorCode, lBytesTransferred); } );
+    }
+    else
+    {
+      mSocket.async_send_to ( lAsioSendBuffer , mEndpoint , [&] (const boost::system::error_code& e, std::size_t n) { this->write_callback(e, n); });
     }
 
-    mSocket.async_send_to ( lAsioSendBuffer , mEndpoint , [&] (const boost::system::error_code& e, std::size_t n) { this->write_callback(e, n); });
+    recordSend();
     mPacketsInFlight++;
   }
 
@@ -253,7 +693,7 @@ namespace uhal
       read ( );
     }
 
-    if ( mDispatchQueue.size() && mPacketsInFlight != this->getMaxNumberOfBuffers() )
+    if ( mDispatchQueue.size() && mPacketsInFlight < getPacketsInFlightLimit() )
     {
       mDispatchBuffers = mDispatchQueue.front();
       mDispatchQueue.pop_front();
@@ -269,6 +709,9 @@ namespace uhal
   template < typename InnerProtocol >
   void UDP< InnerProtocol >::read ( )
   {
+    if ( mClosing )
+      return;
+
     if ( !mReplyBuffers )
     {
       log ( Error() , __PRETTY_FUNCTION__ , " called when 'mReplyBuffers' was NULL" );
@@ -276,61 +719,139 @@ namespace uhal
       return;
     }
 
-    std::vector<boost::asio::mutable_buffer> lAsioReplyBuffer ( 1 , boost::asio::mutable_buffer ( & ( mReplyMemory.at ( 0 ) ) , mReplyBuffers->replyCounter() ) );
+    // When recovering lost packets, the next datagram may be a status reply, or a reply to a different packet, so it is received into
+    // mReplyMemory and accepted whatever its size; otherwise, unless there are too many destinations for one recvmsg call, the reply
+    // is received directly into its final destinations
+    mReplyInPlace = ( mMaxRecoveryAttempts == 0 ) && ( mReplyBuffers->getReplyBuffer().size() <= IOV_MAX );
     log ( Debug() , "Expecting " , Integer ( mReplyBuffers->replyCounter() ) , " bytes in reply." );
-    mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
+    mDeadlineTimer.expires_from_now ( getAttemptTimeoutPeriod() );
 
     // Patch for suspected bug in using boost asio with boost python; see https://svnweb.cern.ch/trac/cactus/ticket/323#comment:7
     while ( mDeadlineTimer.expires_from_now() < boost::posix_time::microseconds ( 600 ) )
     {
       log ( Debug() , "Resetting deadline timer since it just got set to strange value, likely due to a bug within boost (expires_from_now was: ", mDeadlineTimer.expires_from_now() , ")." );
-      mDeadlineTimer.expires_from_now ( this->getBoostTimeoutPeriod() );
+      mDeadlineTimer.expires_from_now ( getAttemptTimeoutPeriod() );
     }
 
-    mSocket.async_receive ( lAsioReplyBuffer , 0 , [&] (const boost::system::error_code& e, std::size_t n) { this->read_callback(e, n); });
-  }
-
-
-  template < typename InnerProtocol >
-  void UDP< InnerProtocol >::read_callback ( const boost::system::error_code& aErrorCode , std::size_t aBytesTransferred )
-  {
+    if ( mSharedSocket )
     {
-      std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
-      if ( mAsynchronousException )
+      // The shared socket's receive loop passes the reply to receiveShared, which copies it directly to its final destinations
+      mReplyInPlace = true;
+
+      if ( mSharedEarlyReplies.size() )
       {
-        NotifyConditionalVariable ( true );
-        return;
+        deliverShared ( mSharedEarlyReplies.front().data() , mSharedEarlyReplies.front().size() );
+        mSharedEarlyReplies.pop_front();
       }
-
-      if ( mDeadlineTimer.expires_at () == boost::posix_time::pos_infin )
+      else
       {
-        mAsynchronousException = new exception::UdpTimeout();
-        log ( *mAsynchronousException , "Timeout (" , Integer ( this->getBoostTimeoutPeriod().total_milliseconds() ) , " milliseconds) occurred for UDP receive from target with URI: ", this->uri() );
-
-        if ( aErrorCode && aErrorCode != boost::asio::error::operation_aborted )
-        {
-          log ( *mAsynchronousException , "ASIO reported an error: " , Quote ( aErrorCode.message() ) );
-        }
-
-        NotifyConditionalVariable ( true );
-        return;
+        mSharedReceivePending = true;
       }
-    }
 
-    if ( !mReplyBuffers )
-    {
-      log ( Error() , __PRETTY_FUNCTION__ , " called when 'mReplyBuffers' was NULL" );
       return;
     }
 
-    if ( aBytesTransferred != mReplyBuffers->replyCounter() )
+    if ( mReplyInPlace )
     {
-      log ( Error() , "Expected " , Integer ( mReplyBuffers->replyCounter() ) , "-byte UDP payload from target " , Quote ( this->uri() ) , ", but only received " , Integer ( aBytesTransferred ) , " bytes. Validating returned data to work out where error occurred." );
-    }
+      mReplySegments.clear();
 
-    if ( aErrorCode && ( aErrorCode != boost::asio::error::eof ) )
-    {
-      mSocket.close();
+      for ( const auto& lBuffer : mReplyBuffers->getReplyBuffer() )
+      {
+        iovec lSegment = { lBuffer.first , lBuffer.second };
+        mReplySegments.push_back ( lSegment );
+      }
+
+      mSocket.async_wait ( boost::asio::ip::udp::socket::wait_read , [this] (const boost::system::error_code& e) { this->readInPlace_callback(e); } );
+      return;
+    }
+
+    const std::size_t lReplySize ( mMaxRecoveryAttempts > 0 ? mReplyMemory.size() : mReplyBuffers->replyCounter() );
+    std::vector<boost::asio::mutable_buffer> lAsioReplyBuffer ( 1 , boost::asio::mutable_buffer ( & ( mReplyMemory.at ( 0 ) ) , lReplySize ) );
+    mSocket.async_receive ( lAsioReplyBuffer , 0 , [&] (const boost::system::error_code& e, std::size_t n) { this->read_callback(e, n); });
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::readInPlace_callback ( const boost::system::error_code& aErrorCode )
+  {
+    if ( aErrorCode )
+    {
+      read_callback ( aErrorCode , 0 );
+      return;
+    }
+
+    msghdr lMessage = msghdr();
+    lMessage.msg_iov = mReplySegments.data();
+    lMessage.msg_iovlen = mReplySegments.size();
+    const ssize_t lResult ( ::recvmsg ( mSocket.native_handle() , &lMessage , MSG_DONTWAIT ) );
+
+    if ( ( lResult < 0 ) && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) )
+    {
+      // Spurious wake-up; wait for the reply again
+      mSocket.async_wait ( boost::asio::ip::udp::socket::wait_read , [this] (const boost::system::error_code& e) { this->readInPlace_callback(e); } );
+    }
+    else if ( lResult < 0 )
+    {
+      read_callback ( boost::system::error_code ( errno , boost::system::system_category() ) , 0 );
+    }
+    else
+    {
+      read_callback ( aErrorCode , lResult );
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::read_callback ( const boost::system::error_code& aErrorCode , std::size_t aBytesTransferred )
+  {
+    {
+      std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+      if ( mAsynchronousException )
+      {
+        NotifyConditionalVariable ( true );
+        return;
+      }
+
+      if ( mDeadlineTimer.expires_at () == boost::posix_time::pos_infin )
+      {
+        mAsynchronousException = new exception::UdpTimeout();
+        log ( *mAsynchronousException , "Timeout (" , Integer ( this->getBoostTimeoutPeriod().total_milliseconds() ) , " milliseconds) occurred for UDP receive from target with URI: ", this->uri() );
+
+        if ( aErrorCode && aErrorCode != boost::asio::error::operation_aborted )
+        {
+          log ( *mAsynchronousException , "ASIO reported an error: " , Quote ( aErrorCode.message() ) );
+        }
+
+        NotifyConditionalVariable ( true );
+        return;
+      }
+    }
+
+    if ( !mReplyBuffers )
+    {
+      log ( Error() , __PRETTY_FUNCTION__ , " called when 'mReplyBuffers' was NULL" );
+      return;
+    }
+
+    if ( ( mMaxRecoveryAttempts > 0 ) && ! aErrorCode )
+    {
+      std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+
+      if ( ! isExpectedReply ( aBytesTransferred ) )
+      {
+        read();
+        return;
+      }
+    }
+
+    if ( aBytesTransferred != mReplyBuffers->replyCounter() )
+    {
+      log ( Error() , "Expected " , Integer ( mReplyBuffers->replyCounter() ) , "-byte UDP payload from target " , Quote ( this->uri() ) , ", but only received " , Integer ( aBytesTransferred ) , " bytes. Validating returned data to work out where error occurred." );
+    }
+
+    if ( aErrorCode && ( aErrorCode != boost::asio::error::eof ) )
+    {
+      mSocket.close();
 
       std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
       mAsynchronousException = new exception::ASIOUdpError();
@@ -346,6 +867,10 @@ namespace uhal
 
     for (const auto& lBuffer: lReplyBuffers)
     {
+      // Nothing to copy if the reply was received directly into its final destinations
+      if ( mReplyInPlace )
+        break;
+
       // Don't copy more of mReplyMemory than was written to, for cases when less data received than expected
       if ( static_cast<uint32_t> ( lReplyBuf - ( & mReplyMemory.at ( 0 ) ) ) >= aBytesTransferred )
         break;
@@ -389,9 +914,10 @@ namespace uhal
       mReplyBuffers.reset();
     }
 
+    recordReply();
     mPacketsInFlight--;
 
-    if ( !mDispatchBuffers && mDispatchQueue.size() && mPacketsInFlight != this->getMaxNumberOfBuffers() )
+    if ( !mDispatchBuffers && mDispatchQueue.size() && mPacketsInFlight < getPacketsInFlightLimit() )
     {
       mDispatchBuffers = mDispatchQueue.front();
       mDispatchQueue.pop_front();
@@ -407,6 +933,504 @@ namespace uhal
 
 
 
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::receiveShared ( const uint8_t* aData , const std::size_t aSize )
+  {
+    std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+
+    // The target replies to packets in the order in which they were sent, so anything other than the reply to the oldest packet awaiting one is stale
+    if ( mSharedAwaitedReplies.empty() || ( getSharedReplyKey ( aData , aSize ) != mSharedAwaitedReplies.front() ) )
+    {
+      log ( Debug() , "Discarding unexpected " , Integer ( aSize ) , "-byte datagram from UDP target with URI " , Quote ( this->uri() ) );
+      return;
+    }
+
+    mSharedAwaitedReplies.pop_front();
+
+    if ( mSharedReceivePending && mReplyBuffers )
+    {
+      mSharedReceivePending = false;
+      deliverShared ( aData , aSize );
+    }
+    else
+    {
+      mSharedEarlyReplies.push_back ( std::vector< uint8_t > ( aData , aData + aSize ) );
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::deliverShared ( const uint8_t* aData , const std::size_t aSize )
+  {
+    std::size_t lNrBytesCopied ( 0 );
+
+    for ( const auto& lBuffer : mReplyBuffers->getReplyBuffer() )
+    {
+      // Don't copy more than was received, for cases when less data received than expected
+      if ( lNrBytesCopied >= aSize )
+        break;
+
+      const std::size_t lNrBytesToCopy ( std::min < std::size_t > ( lBuffer.second , aSize - lNrBytesCopied ) );
+      memcpy ( lBuffer.first , aData + lNrBytesCopied , lNrBytesToCopy );
+      lNrBytesCopied += lNrBytesToCopy;
+    }
+
+    mIOservice.post ( [this, aSize] () { this->read_callback(boost::system::error_code(), aSize); } );
+  }
+
+
+  template < typename InnerProtocol >
+  std::pair< uint32_t , uint32_t > UDP< InnerProtocol >::getSharedReplyKey ( const uint8_t* aData , const std::size_t aSize )
+  {
+    std::pair< uint32_t , uint32_t > lKey ( 0 , 0 );
+
+    if ( aSize >= 4 )
+      memcpy ( &lKey.first , aData , 4 );
+
+    // The reply's transaction header has the same protocol version, transaction ID and type as the request's
+    if ( aSize >= 8 )
+    {
+      memcpy ( &lKey.second , aData + 4 , 4 );
+      lKey.second &= 0xFFFF00F0;
+    }
+
+    return lKey;
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::writeBatch ( )
+  {
+    if ( mClosing || ! mSocket.is_open() )
+      return;
+
+    const uint32_t lLimit ( getPacketsInFlightLimit() );
+    const std::size_t lNrPackets ( std::min < std::size_t > ( mDispatchQueue.size() , mPacketsInFlight < lLimit ? lLimit - mPacketsInFlight : 0 ) );
+
+    if ( lNrPackets == 0 )
+      return;
+
+    mBatchMessages.assign ( lNrPackets , mmsghdr() );
+    mBatchSegments.clear();
+
+    for ( std::size_t i = 0; i < lNrPackets; i++ )
+    {
+      for ( const auto& lSegment : mDispatchQueue.at ( i )->getSendSegments() )
+      {
+        iovec lSegmentIovec = { const_cast<uint8_t*> ( lSegment.first ) , lSegment.second };
+        mBatchSegments.push_back ( lSegmentIovec );
+      }
+
+      mBatchMessages.at ( i ).msg_hdr.msg_iovlen = mDispatchQueue.at ( i )->getSendSegments().size();
+    }
+
+    iovec* lSegments ( mBatchSegments.data() );
+
+    for ( mmsghdr& lMessage : mBatchMessages )
+    {
+      lMessage.msg_hdr.msg_name = mEndpoint.data();
+      lMessage.msg_hdr.msg_namelen = mEndpoint.size();
+      lMessage.msg_hdr.msg_iov = lSegments;
+      lSegments += lMessage.msg_hdr.msg_iovlen;
+    }
+
+    log ( Debug() , "Sending " , Integer ( lNrPackets ) , " packets in one batch" );
+    mDeadlineTimer.expires_from_now ( getAttemptTimeoutPeriod() );
+
+    pollfd lPollFd;
+    lPollFd.fd = mSocket.native_handle();
+    lPollFd.events = POLLOUT;
+    std::size_t lNrSent ( 0 );
+
+    while ( lNrSent < lNrPackets )
+    {
+      const int lResult ( ::sendmmsg ( mSocket.native_handle() , & mBatchMessages.at ( lNrSent ) , lNrPackets - lNrSent , 0 ) );
+
+      if ( lResult > 0 )
+      {
+        lNrSent += lResult;
+      }
+      else if ( ( lResult < 0 ) && ( errno == EAGAIN || errno == EWOULDBLOCK ) && ( ::poll ( &lPollFd , 1 , getAttemptTimeoutPeriod().total_milliseconds() ) > 0 ) )
+      {
+        // The socket's send buffer was full; it now has space again
+      }
+      else if ( ( lResult < 0 ) && ( errno == EINTR ) )
+      {
+      }
+      else
+      {
+        const int lErrno ( errno );
+        mSocket.close();
+        exception::ASIOUdpError* lExc = new exception::ASIOUdpError();
+        log ( *lExc , "Error ", Quote ( strerror ( lErrno ) ) , " encountered during batched send of " , Integer ( lNrPackets - lNrSent ) , " packets to UDP target with URI: " , this->uri() );
+        mAsynchronousException = lExc;
+        NotifyConditionalVariable ( true );
+        return;
+      }
+    }
+
+    for ( std::size_t i = 0; i < lNrPackets; i++ )
+    {
+      mReplyQueue.push_back ( mDispatchQueue.front() );
+      mDispatchQueue.pop_front();
+      recordSend();
+    }
+
+    mPacketsInFlight += lNrPackets;
+
+    if ( ! mBatchReceivePending )
+    {
+      readBatch();
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::readBatch ( )
+  {
+    if ( mClosing )
+      return;
+
+    mBatchReceivePending = true;
+    mSocket.async_wait ( boost::asio::ip::udp::socket::wait_read , [this] (const boost::system::error_code& e) { this->readBatch_callback(e); } );
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::readBatch_callback ( const boost::system::error_code& aErrorCode )
+  {
+    {
+      std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+      mBatchReceivePending = false;
+
+      if ( mAsynchronousException )
+      {
+        NotifyConditionalVariable ( true );
+        return;
+      }
+
+      if ( mDeadlineTimer.expires_at () == boost::posix_time::pos_infin )
+      {
+        mAsynchronousException = new exception::UdpTimeout();
+        log ( *mAsynchronousException , "Timeout (" , Integer ( this->getBoostTimeoutPeriod().total_milliseconds() ) , " milliseconds) occurred for UDP receive from target with URI: ", this->uri() );
+        NotifyConditionalVariable ( true );
+        return;
+      }
+
+      if ( aErrorCode == boost::asio::error::operation_aborted )
+      {
+        // The socket was closed by the exception handler; if it has since been re-opened for new packets, wait for their replies
+        if ( mReplyQueue.size() && mSocket.is_open() )
+        {
+          readBatch();
+        }
+
+        return;
+      }
+
+      if ( aErrorCode )
+      {
+        mSocket.close();
+        mAsynchronousException = new exception::ASIOUdpError();
+        log ( *mAsynchronousException , "Error ", Quote ( aErrorCode.message() ) , " encountered while waiting for replies from UDP target with URI: " , this->uri() );
+        NotifyConditionalVariable ( true );
+        return;
+      }
+
+      const std::size_t lNrReplies ( mReplyQueue.size() );
+
+      if ( lNrReplies == 0 )
+        return;
+
+      const std::size_t lSlotSize ( mMaxPayloadSize + 20 );
+
+      if ( mReplyMemory.size() < lNrReplies * lSlotSize )
+      {
+        mReplyMemory.resize ( lNrReplies * lSlotSize , 0x00000000 );
+      }
+
+      mBatchMessages.assign ( lNrReplies , mmsghdr() );
+      mBatchSegments.resize ( lNrReplies );
+
+      for ( std::size_t i = 0; i < lNrReplies; i++ )
+      {
+        mBatchSegments.at ( i ).iov_base = & mReplyMemory.at ( i * lSlotSize );
+        mBatchSegments.at ( i ).iov_len = lSlotSize;
+        mBatchMessages.at ( i ).msg_hdr.msg_iov = & mBatchSegments.at ( i );
+        mBatchMessages.at ( i ).msg_hdr.msg_iovlen = 1;
+      }
+
+      const int lResult ( ::recvmmsg ( mSocket.native_handle() , mBatchMessages.data() , lNrReplies , MSG_DONTWAIT , NULL ) );
+
+      if ( lResult < 0 )
+      {
+        if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
+        {
+          readBatch();
+          return;
+        }
+
+        const int lErrno ( errno );
+        mSocket.close();
+        mAsynchronousException = new exception::ASIOUdpError();
+        log ( *mAsynchronousException , "Error ", Quote ( strerror ( lErrno ) ) , " encountered during batched receive from UDP target with URI: " , this->uri() );
+        NotifyConditionalVariable ( true );
+        return;
+      }
+
+      log ( Debug() , "Received " , Integer ( lResult ) , " of " , Integer ( lNrReplies ) , " awaited replies in one batch" );
+      mDeadlineTimer.expires_from_now ( getAttemptTimeoutPeriod() );
+      mBatchReplies.clear();
+
+      for ( int i = 0; i < lResult; i++ )
+      {
+        // The replies arrive in the order that the packets were sent; for IPbus 2.0, stale datagrams are recognised by their packet header
+        const uint8_t* lReply ( & mReplyMemory.at ( i * lSlotSize ) );
+
+        if ( std::is_same< InnerProtocol , IPbus< 2 , 0 > >::value &&
+             ( ( mBatchMessages.at ( i ).msg_len < 4 ) || ( memcmp ( lReply , mReplyQueue.front()->getSendBuffer() , 4 ) != 0 ) ) )
+        {
+          log ( Debug() , "Discarding " , Integer ( mBatchMessages.at ( i ).msg_len ) , "-byte datagram from UDP target with URI " , Quote ( this->uri() ) ,
+                ", since awaiting reply to packet " , Integer ( getPacketId ( mReplyQueue.front() ) ) );
+          continue;
+        }
+
+        mBatchReplies.push_back ( std::make_pair ( mReplyQueue.front() , std::size_t ( i ) ) );
+        mReplyQueue.pop_front();
+      }
+    }
+
+    // As for single replies, the data is validated without holding the transport-layer mutex
+    const std::size_t lSlotSize ( mMaxPayloadSize + 20 );
+    std::size_t lNrValidated ( 0 );
+    uhal::exception::exception* lExc ( NULL );
+
+    for ( ; lNrValidated < mBatchReplies.size(); lNrValidated++ )
+    {
+      std::shared_ptr< Buffers >& lBuffers ( mBatchReplies.at ( lNrValidated ).first );
+      const std::size_t lMessage ( mBatchReplies.at ( lNrValidated ).second );
+      const uint8_t* lReplyBuf ( & mReplyMemory.at ( lMessage * lSlotSize ) );
+      const uint32_t lBytesTransferred ( mBatchMessages.at ( lMessage ).msg_len );
+
+      if ( lBytesTransferred != lBuffers->replyCounter() )
+      {
+        log ( Error() , "Expected " , Integer ( lBuffers->replyCounter() ) , "-byte UDP payload from target " , Quote ( this->uri() ) , ", but only received " , Integer ( lBytesTransferred ) , " bytes. Validating returned data to work out where error occurred." );
+      }
+
+      uint32_t lNrBytesCopied ( 0 );
+
+      for ( const auto& lBuffer : lBuffers->getReplyBuffer() )
+      {
+        // Don't copy more than was received, for cases when less data received than expected
+        if ( lNrBytesCopied >= lBytesTransferred )
+          break;
+
+        const uint32_t lNrBytesToCopy ( std::min ( lBuffer.second , lBytesTransferred - lNrBytesCopied ) );
+        memcpy ( lBuffer.first , lReplyBuf + lNrBytesCopied , lNrBytesToCopy );
+        lNrBytesCopied += lNrBytesToCopy;
+      }
+
+      try
+      {
+        lExc = ClientInterface::validate ( lBuffers ); //Control of the pointer has been passed back to the client interface
+      }
+      catch ( exception::exception& aExc )
+      {
+        lExc = new exception::ValidationError ();
+        log ( *lExc , "Exception caught during reply validation for UDP device with URI " , Quote ( this->uri() ) , "; what returned: " , Quote ( aExc.what() ) );
+      }
+
+      if ( lExc )
+      {
+        lNrValidated++;
+        break;
+      }
+    }
+
+    std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+    mPacketsInFlight -= mBatchReplies.size();
+
+    for ( std::size_t i = 0; i < mBatchReplies.size(); i++ )
+    {
+      recordReply();
+    }
+
+    if ( lExc )
+    {
+      // Validation stops at the first failure, so the remaining buffers were neither validated nor returned to the pool
+      for ( std::size_t i = lNrValidated; i < mBatchReplies.size(); i++ )
+      {
+        ClientInterface::returnBufferToPool ( mBatchReplies.at ( i ).first );
+      }
+
+      mBatchReplies.clear();
+      mAsynchronousException = lExc;
+      NotifyConditionalVariable ( true );
+      return;
+    }
+
+    mBatchReplies.clear();
+    writeBatch();
+
+    if ( mReplyQueue.size() )
+    {
+      if ( ! mBatchReceivePending )
+      {
+        readBatch();
+      }
+    }
+    else if ( mDispatchQueue.empty() && ! mBatchSendPosted )
+    {
+      mDeadlineTimer.expires_from_now( boost::posix_time::seconds(60) );
+      NotifyConditionalVariable ( true );
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::prepareBusyPollSocket ( )
+  {
+    if ( mKernelBusyPollPeriod > 0 )
+    {
+      const boost::system::error_code lErrorCode ( utilities::setKernelBusyPoll ( mSocket.native_handle() , mKernelBusyPollPeriod ) );
+
+      if ( lErrorCode )
+      {
+        log ( Warning() , "Could not set SO_BUSY_POLL for UDP socket with URI " , Quote ( this->uri() ) , " (error " , Quote ( lErrorCode.message() ) , "); only the client will busy-poll" );
+      }
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::sendBusy ( const std::shared_ptr< Buffers >& aBuffers )
+  {
+    std::vector< iovec > lSegments;
+
+    for ( const auto& lSegment : aBuffers->getSendSegments() )
+    {
+      iovec lSegmentIovec = { const_cast<uint8_t*> ( lSegment.first ) , lSegment.second };
+      lSegments.push_back ( lSegmentIovec );
+    }
+
+    log ( Debug() , "Sending " , Integer ( aBuffers->sendCounter() ) , " bytes" );
+    boost::system::error_code lErrorCode;
+    const std::size_t lBytesTransferred ( utilities::busyTransfer ( mSocket.native_handle() , lSegments , true ,
+                                          std::chrono::steady_clock::now() + std::chrono::milliseconds ( this->getBoostTimeoutPeriod().total_milliseconds() ) , lErrorCode ,
+                                          mEndpoint.data() , mEndpoint.size() ) );
+
+    // The buffer is owned by the reply queue from now on, so that it is returned to the pool if anything goes wrong
+    mReplyQueue.push_back ( aBuffers );
+    recordSend();
+    mPacketsInFlight++;
+
+    if ( lErrorCode == boost::asio::error::timed_out )
+    {
+      recordCongestion();
+      exception::UdpTimeout lExc;
+      log ( lExc , "Timeout (" , Integer ( this->getBoostTimeoutPeriod().total_milliseconds() ) , " milliseconds) occurred for UDP send to target with URI: ", this->uri() );
+      throw lExc;
+    }
+    else if ( lErrorCode || ( lBytesTransferred != aBuffers->sendCounter() ) )
+    {
+      exception::ASIOUdpError lExc;
+      log ( lExc , "Error ", Quote ( lErrorCode.message() ) , " encountered during send to UDP target with URI: " , this->uri() ,
+            " (" , Integer ( lBytesTransferred ) , " of " , Integer ( aBuffers->sendCounter() ) , " bytes sent)" );
+      throw lExc;
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::receiveBusy ( )
+  {
+    std::shared_ptr< Buffers > lBuffers ( mReplyQueue.front() );
+    std::deque< std::pair< uint8_t* , uint32_t > >& lReplyBuffers ( lBuffers->getReplyBuffer() );
+    log ( Debug() , "Expecting " , Integer ( lBuffers->replyCounter() ) , " bytes in reply." );
+
+    // As in read(), the reply is received directly into its final destinations unless there are too many of them for one recvmsg call
+    const bool lInPlace ( lReplyBuffers.size() <= IOV_MAX );
+    mReplySegments.clear();
+
+    if ( lInPlace )
+    {
+      for ( const auto& lBuffer : lReplyBuffers )
+      {
+        iovec lSegment = { lBuffer.first , lBuffer.second };
+        mReplySegments.push_back ( lSegment );
+      }
+    }
+    else
+    {
+      iovec lSegment = { & ( mReplyMemory.at ( 0 ) ) , lBuffers->replyCounter() };
+      mReplySegments.push_back ( lSegment );
+    }
+
+    boost::system::error_code lErrorCode;
+    const std::size_t lBytesTransferred ( utilities::busyReceive ( mSocket.native_handle() , mReplySegments.data() , mReplySegments.size() ,
+                                          std::chrono::steady_clock::now() + std::chrono::milliseconds ( this->getBoostTimeoutPeriod().total_milliseconds() ) , lErrorCode ) );
+
+    if ( lErrorCode == boost::asio::error::timed_out )
+    {
+      recordCongestion();
+      exception::UdpTimeout lExc;
+      log ( lExc , "Timeout (" , Integer ( this->getBoostTimeoutPeriod().total_milliseconds() ) , " milliseconds) occurred for UDP receive from target with URI: ", this->uri() );
+      throw lExc;
+    }
+    else if ( lErrorCode )
+    {
+      exception::ASIOUdpError lExc;
+      log ( lExc , "Error ", Quote ( lErrorCode.message() ) , " encountered during receive from UDP target with URI: " , this->uri() );
+      throw lExc;
+    }
+
+    if ( lBytesTransferred != lBuffers->replyCounter() )
+    {
+      log ( Error() , "Expected " , Integer ( lBuffers->replyCounter() ) , "-byte UDP payload from target " , Quote ( this->uri() ) , ", but only received " , Integer ( lBytesTransferred ) , " bytes. Validating returned data to work out where error occurred." );
+    }
+
+    if ( ! lInPlace )
+    {
+      uint8_t* lReplyBuf ( & ( mReplyMemory.at ( 0 ) ) );
+
+      for ( const auto& lBuffer : lReplyBuffers )
+      {
+        const std::size_t lNrBytesCopied ( lReplyBuf - ( & mReplyMemory.at ( 0 ) ) );
+
+        if ( lNrBytesCopied >= lBytesTransferred )
+          break;
+
+        const uint32_t lNrBytesToCopy ( std::min < std::size_t > ( lBuffer.second , lBytesTransferred - lNrBytesCopied ) );
+        memcpy ( lBuffer.first , lReplyBuf , lNrBytesToCopy );
+        lReplyBuf += lNrBytesToCopy;
+      }
+    }
+
+    mReplyQueue.pop_front();
+    recordReply();
+    mPacketsInFlight--;
+
+    exception::exception* lExc ( NULL );
+
+    try
+    {
+      lExc = ClientInterface::validate ( lBuffers ); //Control of the pointer has been passed back to the client interface
+    }
+    catch ( exception::exception& aExc )
+    {
+      lExc = new exception::ValidationError ();
+      log ( *lExc , "Exception caught during reply validation for UDP device with URI " , Quote ( this->uri() ) , "; what returned: " , Quote ( aExc.what() ) );
+    }
+
+    if ( lExc )
+    {
+      // Like asynchronous exceptions, this is deleted by dispatchExceptionHandler once the transport layer has been tidied up
+      mAsynchronousException = lExc;
+      lExc->throwAsDerivedType();
+    }
+  }
+
+
   template < typename InnerProtocol >
   void UDP< InnerProtocol >::CheckDeadline()
   {
@@ -415,12 +1439,36 @@ namespace uhal
     // deadline before this actor had a chance to run.
     std::lock_guard<std::mutex> lLock ( this->mTransportLayerMutex );
 
-    if ( mDeadlineTimer.expires_at() <= boost::asio::deadline_timer::traits_type::now() )
+    if ( mClosing )
+      return;
+
+    if ( ( mDeadlineTimer.expires_at() <= boost::asio::deadline_timer::traits_type::now() ) && mReplyBuffers && ( mRecoveryAttempts < mMaxRecoveryAttempts ) && mSocket.is_open() )
+    {
+      // Either the request or its reply has been lost; ask the target which packet it expects next, keeping the receive operation outstanding
+      mRecoveryAttempts++;
+      recordCongestion();
+
+      // Packets in flight may be resent, so their replies no longer give a reliable measurement of the round-trip time
+      std::fill ( mSendTimes.begin() , mSendTimes.end() , std::chrono::steady_clock::time_point() );
+
+      log ( Notice() , "No reply to packet " , Integer ( getPacketId ( mReplyBuffers ) ) , " from UDP target with URI " , Quote ( this->uri() ) ,
+            " within " , Integer ( getAttemptTimeoutPeriod().total_milliseconds() ) , " ms; querying target status (recovery attempt " ,
+            Integer ( mRecoveryAttempts ) , " of " , Integer ( mMaxRecoveryAttempts ) , ")" );
+      sendStatusRequest();
+      mDeadlineTimer.expires_from_now ( getAttemptTimeoutPeriod() );
+    }
+    else if ( mDeadlineTimer.expires_at() <= boost::asio::deadline_timer::traits_type::now() )
     {
       // SETTING THE EXCEPTION HERE CAN APPEAR AS A TIMEOUT WHEN NONE ACTUALLY EXISTS
-      if (  mDispatchBuffers || mReplyBuffers )
+      if (  mDispatchBuffers || mReplyBuffers || mReplyQueue.size() )
       {
         log ( Warning() , "Closing UDP socket for URI " , Quote ( this->uri() ) , " since deadline has passed" );
+        recordCongestion();
+
+        if ( mMaxRecoveryAttempts > 0 )
+        {
+          mFatalPacketLosses++;
+        }
       }
       else
       {
@@ -430,6 +1478,12 @@ namespace uhal
       // The deadline has passed. The socket is closed so that any outstanding
       // asynchronous operations are cancelled.
       mSocket.close();
+
+      if ( mSharedReceivePending )
+      {
+        mSharedReceivePending = false;
+        mIOservice.post ( [this] () { this->read_callback(boost::asio::error::operation_aborted, 0); } );
+      }
       // There is no longer an active deadline. The expiry is set to positive
       // infinity so that the actor takes no action until a new deadline is set.
       mDeadlineTimer.expires_at ( boost::posix_time::pos_infin );
@@ -440,9 +1494,162 @@ namespace uhal
   }
 
 
+  template < typename InnerProtocol >
+  boost::posix_time::time_duration UDP< InnerProtocol >::getAttemptTimeoutPeriod()
+  {
+    return std::max ( this->getBoostTimeoutPeriod() / int ( mMaxRecoveryAttempts + 1 ) , boost::posix_time::time_duration ( boost::posix_time::milliseconds ( 1 ) ) );
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::queryTargetStatus()
+  {
+    std::vector<uint32_t> lRequest ( 16 , 0x00000000 );
+    lRequest.at ( 0 ) = htonl ( 0x200000F1 );
+    pollfd lPollFd;
+    lPollFd.fd = mSocket.native_handle();
+    lPollFd.events = POLLIN;
+
+    for ( uint32_t lAttempt = 0; lAttempt <= mMaxRecoveryAttempts; lAttempt++ )
+    {
+      mSocket.send_to ( boost::asio::buffer ( lRequest ) , mEndpoint );
+
+      // Discard any stale replies from before the socket was re-opened, until the status reply arrives
+      while ( ::poll ( &lPollFd , 1 , getAttemptTimeoutPeriod().total_milliseconds() ) > 0 )
+      {
+        const std::size_t lBytesTransferred ( mSocket.receive ( boost::asio::buffer ( mReplyMemory ) ) );
+        const uint32_t* lReply ( reinterpret_cast<const uint32_t*> ( & ( mReplyMemory.at ( 0 ) ) ) );
+
+        if ( ( lBytesTransferred >= 64 ) && ( ntohl ( lReply[0] ) == 0x200000F1 ) )
+        {
+          mTargetMtu = ntohl ( lReply[1] );
+          mTargetReplyHistoryDepth = ntohl ( lReply[2] );
+          mNextPacketId = ( ntohl ( lReply[3] ) >> 8 ) & 0xFFFF;
+          mNextPacketId = ( mNextPacketId == 0 ? 1 : mNextPacketId );
+          log ( Info() , "UDP target with URI " , Quote ( this->uri() ) , " expects packet ID " , Integer ( mNextPacketId ) , " next, and keeps " , Integer ( mTargetReplyHistoryDepth ) , " replies for re-transmission" );
+          return;
+        }
+      }
+    }
+
+    exception::UdpTimeout lExc;
+    log ( lExc , "No reply to " , Integer ( mMaxRecoveryAttempts + 1 ) , " status requests sent to UDP target with URI: " , this->uri() );
+    throw lExc;
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::sendStatusRequest()
+  {
+    std::vector<uint32_t> lRequest ( 16 , 0x00000000 );
+    lRequest.at ( 0 ) = htonl ( 0x200000F1 );
+    boost::system::error_code lErrorCode;
+    mSocket.send_to ( boost::asio::buffer ( lRequest ) , mEndpoint , 0 , lErrorCode );
+
+    if ( lErrorCode )
+    {
+      log ( Warning() , "Error " , Quote ( lErrorCode.message() ) , " encountered sending status request to UDP target with URI: " , this->uri() );
+    }
+  }
+
+
+  template < typename InnerProtocol >
+  bool UDP< InnerProtocol >::isExpectedReply ( const std::size_t aBytesTransferred )
+  {
+    const uint32_t* lReply ( reinterpret_cast<const uint32_t*> ( & ( mReplyMemory.at ( 0 ) ) ) );
+
+    if ( ( aBytesTransferred >= 64 ) && ( ntohl ( lReply[0] ) == 0x200000F1 ) )
+    {
+      recover ( ( ntohl ( lReply[3] ) >> 8 ) & 0xFFFF );
+      return false;
+    }
+
+    if ( ( aBytesTransferred >= 4 ) && ( lReply[0] != * ( reinterpret_cast<const uint32_t*> ( mReplyBuffers->getSendBuffer() ) ) ) )
+    {
+      log ( Debug() , "Discarding reply with packet header " , Integer ( lReply[0] , IntFmt<hex,fixed>() ) , " from UDP target with URI " , Quote ( this->uri() ) ,
+            ", since awaiting reply to packet " , Integer ( getPacketId ( mReplyBuffers ) ) );
+      return false;
+    }
+
+    if ( mRecoveryAttempts > 0 )
+    {
+      log ( Notice() , "Recovered lost packet " , Integer ( getPacketId ( mReplyBuffers ) ) , " for UDP target with URI " , Quote ( this->uri() ) , " after " , Integer ( mRecoveryAttempts ) , " attempt(s)" );
+      mRecoveredPacketLosses++;
+      mRecoveryAttempts = 0;
+    }
+
+    return true;
+  }
+
+
+  template < typename InnerProtocol >
+  void UDP< InnerProtocol >::recover ( const uint16_t aNextExpectedId )
+  {
+    // Packets sent before the one the target expects next have been received by the target, so only their replies were lost;
+    // that packet and all later ones were lost (or dropped by the target as out-of-order), so must be sent again
+    std::deque < std::shared_ptr< Buffers > > lAwaitingReply ( mReplyQueue );
+    lAwaitingReply.push_front ( mReplyBuffers );
+    bool lReceivedByTarget ( true );
+    std::size_t lNrResent ( 0 );
+    boost::system::error_code lErrorCode;
+
+    for ( const auto& lBuffers : lAwaitingReply )
+    {
+      if ( getPacketId ( lBuffers ) == aNextExpectedId )
+      {
+        lReceivedByTarget = false;
+      }
+
+      if ( lReceivedByTarget )
+      {
+        const uint32_t lResendRequest ( htonl ( 0x200000F2 | ( uint32_t ( getPacketId ( lBuffers ) ) << 8 ) ) );
+        mSocket.send_to ( boost::asio::buffer ( &lResendRequest , 4 ) , mEndpoint , 0 , lErrorCode );
+      }
+      else
+      {
+        std::vector< boost::asio::const_buffer > lAsioSendBuffer;
+        for ( const auto& lSegment : lBuffers->getSendSegments() )
+        {
+          lAsioSendBuffer.push_back ( boost::asio::const_buffer ( lSegment.first , lSegment.second ) );
+        }
+        mSocket.send_to ( lAsioSendBuffer , mEndpoint , 0 , lErrorCode );
+        lNrResent++;
+      }
+
+      if ( lErrorCode )
+      {
+        log ( Warning() , "Error " , Quote ( lErrorCode.message() ) , " encountered during recovery of lost packets for UDP target with URI: " , this->uri() );
+        return;
+      }
+    }
+
+    log ( Info() , "UDP target with URI " , Quote ( this->uri() ) , " expects packet ID " , Integer ( aNextExpectedId ) , " next; re-sent " ,
+          Integer ( lNrResent ) , " of " , Integer ( lAwaitingReply.size() ) , " packets awaiting a reply, and requested re-transmission of the other replies" );
+  }
+
+
+  template < typename InnerProtocol >
+  uint16_t UDP< InnerProtocol >::getPacketId ( const std::shared_ptr< Buffers >& aBuffers )
+  {
+    return ( * ( reinterpret_cast<const uint32_t*> ( aBuffers->getSendBuffer() ) ) >> 8 ) & 0xFFFF;
+  }
+
+
   template < typename InnerProtocol >
   void UDP< InnerProtocol >::Flush( )
   {
+    if ( mBusyPoll )
+    {
+      std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
+
+      while ( mReplyQueue.size() )
+      {
+        receiveBusy();
+      }
+
+      return;
+    }
+
     WaitOnConditionalVariable();
 
     std::lock_guard<std::mutex> lLock ( mTransportLayerMutex );
@@ -454,6 +1661,14 @@ namespace uhal
 
 
 
+  template < typename InnerProtocol >
+  bool UDP< InnerProtocol >::startFlush( )
+  {
+    // Buffers are written as soon as they are dispatched (subject to the number of packets in flight), so there is nothing to kick off
+    return ! mBusyPoll;
+  }
+
+
   template < typename InnerProtocol >
   void UDP< InnerProtocol >::dispatchExceptionHandler()
   {
@@ -483,6 +1698,24 @@ namespace uhal
     ClientInterface::returnBufferToPool ( mDispatchQueue );
     ClientInterface::returnBufferToPool ( mReplyQueue );
     mPacketsInFlight = 0;
+    mSendTimes.clear();
+    mRecoveryAttempts = 0;
+    mSharedReceivePending = false;
+    mSharedEarlyReplies.clear();
+    mSharedAwaitedReplies.clear();
+    mNextPacketId = 0;
+
+    // The target (or the route to it) may have changed, so the base round-trip time is measured afresh; and, as after a timeout in TCP,
+    // the window restarts from one packet
+    mMinRtt = 0;
+    mRoundMinRtt = 0;
+    mRoundEnd = std::chrono::steady_clock::time_point();
+
+    if ( mAdaptiveWindow )
+    {
+      mSlowStartThreshold = std::max ( mWindow / 2 , 1.0 );
+      mWindow = 1;
+    }
 
     ClientInterface::returnBufferToPool ( mDispatchBuffers );
     mDispatchBuffers.reset();
@@ -501,6 +1734,11 @@ namespace uhal
       mFlushDone = aValue;
     }
     mConditionalVariable.notify_one();
+
+    if ( aValue && mAsynchronousException )
+    {
+      ClientInterface::failPendingDispatches ( *mAsynchronousException );
+    }
   }
 
 
@@ -0,0 +1,335 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/SharedTCPConnection.hpp"
+
+
+#include <exception>
+
+#include <arpa/inet.h>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+#include "uhal/ClientFactory.hpp"
+#include "uhal/IOservicePool.hpp"
+#include "uhal/log/LogLevels.hpp"
+#include "uhal/log/log.hpp"
+#include "uhal/log/log_inserters.integer.hpp"
+#include "uhal/log/log_inserters.quote.hpp"
+
+
+namespace uhal
+{
+
+  std::mutex SharedTCPConnection::mRegistryMutex;
+
+  std::map< std::string , std::weak_ptr< SharedTCPConnection > > SharedTCPConnection::mRegistry;
+
+  std::map< std::string , uint32_t > SharedTCPConnection::mPoolCounters;
+
+
+  std::shared_ptr< SharedTCPConnection > SharedTCPConnection::get ( const std::string& aGroup , const std::string& aHostname , const std::string& aPort , const uint32_t aPoolSize )
+  {
+    std::lock_guard<std::mutex> lLock ( mRegistryMutex );
+    const std::string lPool ( aGroup + "@" + aHostname + ":" + aPort );
+    const std::string lName ( lPool + "#" + std::to_string ( mPoolCounters[lPool]++ % aPoolSize ) );
+    std::shared_ptr< SharedTCPConnection > lConnection ( mRegistry[lName].lock() );
+
+    if ( ! lConnection )
+    {
+      lConnection.reset ( new SharedTCPConnection ( lName , aHostname , aPort ) );
+      mRegistry[lName] = lConnection;
+    }
+
+    return lConnection;
+  }
+
+
+  SharedTCPConnection::SharedTCPConnection ( const std::string& aName , const std::string& aHostname , const std::string& aPort ) :
+    mName ( aName ),
+    mIOservicePool ( ClientFactory::getInstance().getIOservicePool() ),
+    mIOservice ( mIOservicePool->getIOservice() ),
+    mEndpoint ( boost::asio::ip::tcp::resolver ( mIOservice ).resolve ( boost::asio::ip::tcp::resolver::query ( aHostname , aPort ) ) ),
+    mSocket ( mIOservice ),
+    mClosing ( false ),
+    mFailed ( false ),
+    mSendTimer ( mIOservice ),
+    mReplyByteCounter ( 0 )
+  {
+  }
+
+
+  SharedTCPConnection::~SharedTCPConnection()
+  {
+    try
+    {
+      IOservicePool::drain ( mIOservice , [this] () {
+        mClosing = true;
+        mSocket.close();
+        mSendTimer.cancel();
+      } );
+    }
+    catch ( const std::exception& aExc )
+    {
+      log ( Error() , "Exception " , Quote ( aExc.what() ) , " caught in SharedTCPConnection destructor" );
+    }
+  }
+
+
+  void SharedTCPConnection::attach ( const uint32_t aIPaddress , const uint16_t aPort , const Receiver& aReceiver )
+  {
+    std::lock_guard<std::mutex> lLock ( mReceiversMutex );
+
+    if ( ! mReceivers.insert ( std::make_pair ( std::make_pair ( aIPaddress , aPort ) , aReceiver ) ).second )
+    {
+      exception::SharedControlHubTargetInUse lExc;
+      log ( lExc , "Another client using ControlHub connection " , Quote ( mName ) , " already communicates with target " ,
+            Integer ( ntohl ( aIPaddress ) , IntFmt< hex , fixed >() ) , ", port " , Integer ( ntohs ( aPort ) ) );
+      throw lExc;
+    }
+  }
+
+
+  void SharedTCPConnection::detach ( const uint32_t aIPaddress , const uint16_t aPort )
+  {
+    std::lock_guard<std::mutex> lLock ( mReceiversMutex );
+    mReceivers.erase ( std::make_pair ( aIPaddress , aPort ) );
+  }
+
+
+  void SharedTCPConnection::send ( const std::vector< boost::asio::const_buffer >& aSegments , const boost::posix_time::time_duration& aTimeout )
+  {
+    // The segments belong to the client, and may be reused as soon as this returns
+    std::shared_ptr< std::vector< uint8_t > > lChunk ( new std::vector< uint8_t > ( boost::asio::buffer_size ( aSegments ) ) );
+    boost::asio::buffer_copy ( boost::asio::buffer ( *lChunk ) , aSegments );
+
+    mIOservice.post ( [this, lChunk, aTimeout] () {
+      mSendQueue.push_back ( std::make_pair ( lChunk , aTimeout ) );
+      this->sendNext();
+    } );
+  }
+
+
+  void SharedTCPConnection::sendNext()
+  {
+    if ( mClosing || mChunkBeingSent || mSendQueue.empty() )
+      return;
+
+    mChunkBeingSent = mSendQueue.front().first;
+    mSendTimer.expires_from_now ( mSendQueue.front().second );
+    mSendTimer.async_wait ( [this] (const boost::system::error_code&) { this->sendTimeout_callback(); } );
+    mSendQueue.pop_front();
+
+    if ( mFailed || ! mSocket.is_open() )
+    {
+      connect();
+    }
+    else
+    {
+      sendChunk();
+    }
+  }
+
+
+  void SharedTCPConnection::sendChunk()
+  {
+    boost::asio::async_write ( mSocket , boost::asio::buffer ( *mChunkBeingSent ) , [this] (const boost::system::error_code& e, std::size_t) { this->send_callback(e); } );
+  }
+
+
+  void SharedTCPConnection::connect()
+  {
+    // Any handlers of the previous connection's operations have already run, or have been queued ahead of the connect handler
+    if ( mSocket.is_open() )
+    {
+      boost::system::error_code lErrorCode;
+      mSocket.close ( lErrorCode );
+    }
+
+    log ( Info() , "Attempting to create ControlHub connection " , Quote ( mName ) );
+    boost::asio::async_connect ( mSocket , mEndpoint , [this] (const boost::system::error_code& e, boost::asio::ip::tcp::resolver::iterator) { this->connect_callback(e); } );
+  }
+
+
+  void SharedTCPConnection::connect_callback ( const boost::system::error_code& aErrorCode )
+  {
+    if ( mClosing )
+      return;
+
+    if ( aErrorCode )
+    {
+      log ( Error() , "Error " , Quote ( aErrorCode.message() ) , " encountered when creating ControlHub connection " , Quote ( mName ) );
+      mSendTimer.expires_at ( boost::posix_time::pos_infin );
+      mChunkBeingSent.reset();
+      mFailed = true;
+      abandon();
+      return;
+    }
+
+    boost::system::error_code lErrorCode;
+    mSocket.set_option ( boost::asio::ip::tcp::no_delay ( true ) , lErrorCode );
+    mFailed = false;
+    log ( Info() , "ControlHub connection " , Quote ( mName ) , " succeeded" );
+    receive();
+    sendChunk();
+  }
+
+
+  void SharedTCPConnection::send_callback ( const boost::system::error_code& aErrorCode )
+  {
+    if ( mClosing )
+      return;
+
+    mSendTimer.expires_at ( boost::posix_time::pos_infin );
+    mChunkBeingSent.reset();
+
+    if ( aErrorCode )
+    {
+      // Part of the chunk may have been sent, so the stream can no longer be parsed by the ControlHub
+      fail ( aErrorCode );
+    }
+
+    sendNext();
+  }
+
+
+  void SharedTCPConnection::sendTimeout_callback()
+  {
+    // The timer is set to expire at infinity once the chunk has been sent, so a wait which completes after that does nothing
+    if ( mClosing || ( mSendTimer.expires_at() > boost::asio::deadline_timer::traits_type::now() ) )
+      return;
+
+    log ( Warning() , "Timed out sending chunk on ControlHub connection " , Quote ( mName ) );
+    mSendTimer.expires_at ( boost::posix_time::pos_infin );
+
+    // The pending connect or write then completes with an error, which fails the connection
+    boost::system::error_code lErrorCode;
+    mSocket.close ( lErrorCode );
+  }
+
+
+  void SharedTCPConnection::receive()
+  {
+    if ( mClosing )
+      return;
+
+    boost::asio::async_read ( mSocket , boost::asio::buffer ( &mReplyByteCounter , 4 ) , boost::asio::transfer_exactly ( 4 ) ,
+                              [this] (const boost::system::error_code& e, std::size_t) { this->receiveHeader_callback(e); } );
+  }
+
+
+  void SharedTCPConnection::receiveHeader_callback ( const boost::system::error_code& aErrorCode )
+  {
+    if ( aErrorCode )
+    {
+      fail ( aErrorCode );
+      return;
+    }
+
+    mReceiveMemory.resize ( ntohl ( mReplyByteCounter ) );
+    boost::asio::async_read ( mSocket , boost::asio::buffer ( mReceiveMemory ) , boost::asio::transfer_exactly ( mReceiveMemory.size() ) ,
+                              [this] (const boost::system::error_code& e, std::size_t) { this->receiveChunk_callback(e); } );
+  }
+
+
+  void SharedTCPConnection::receiveChunk_callback ( const boost::system::error_code& aErrorCode )
+  {
+    if ( aErrorCode )
+    {
+      fail ( aErrorCode );
+      return;
+    }
+
+    // Each reply starts with a 12-byte preamble: byte-count of the rest of the reply, target IP address, target port and error code
+    {
+      std::lock_guard<std::mutex> lLock ( mReceiversMutex );
+      std::size_t lOffset ( 0 );
+
+      while ( lOffset + 12 <= mReceiveMemory.size() )
+      {
+        const uint8_t* lReply ( mReceiveMemory.data() + lOffset );
+        const std::size_t lReplySize ( 4 + ntohl ( *reinterpret_cast< const uint32_t* > ( lReply ) ) );
+        const std::pair< uint32_t , uint16_t > lTarget ( *reinterpret_cast< const uint32_t* > ( lReply + 4 ) , *reinterpret_cast< const uint16_t* > ( lReply + 8 ) );
+        std::map< std::pair< uint32_t , uint16_t > , Receiver >::const_iterator lIt ( mReceivers.find ( lTarget ) );
+
+        if ( lOffset + lReplySize > mReceiveMemory.size() )
+        {
+          log ( Error() , "Discarding truncated reply received on ControlHub connection " , Quote ( mName ) );
+          break;
+        }
+
+        if ( lIt != mReceivers.end() )
+        {
+          lIt->second ( lReply , lReplySize );
+        }
+        else
+        {
+          log ( Debug() , "Discarding reply received on ControlHub connection " , Quote ( mName ) , " from a target without a client" );
+        }
+
+        lOffset += lReplySize;
+      }
+    }
+
+    receive();
+  }
+
+
+  void SharedTCPConnection::fail ( const boost::system::error_code& aErrorCode )
+  {
+    // Operations which are aborted when the failed connection is closed complete with errors as well
+    if ( mClosing || mFailed )
+      return;
+
+    log ( Warning() , "Error " , Quote ( aErrorCode.message() ) , " encountered on ControlHub connection " , Quote ( mName ) );
+    mFailed = true;
+    abandon();
+  }
+
+
+  void SharedTCPConnection::abandon()
+  {
+    boost::system::error_code lErrorCode;
+    mSocket.close ( lErrorCode );
+    mSendQueue.clear();
+
+    std::lock_guard<std::mutex> lLock ( mReceiversMutex );
+
+    for ( const auto& lReceiver : mReceivers )
+    {
+      lReceiver.second ( NULL , 0 );
+    }
+  }
+
+}
@@ -0,0 +1,191 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/SharedUDPSocket.hpp"
+
+
+#include <exception>
+#include <sstream>
+
+#include <sys/socket.h>
+
+#include "uhal/ClientFactory.hpp"
+#include "uhal/IOservicePool.hpp"
+#include "uhal/log/LogLevels.hpp"
+#include "uhal/log/log.hpp"
+#include "uhal/log/log_inserters.integer.hpp"
+#include "uhal/log/log_inserters.quote.hpp"
+
+
+namespace uhal
+{
+
+  std::mutex SharedUDPSocket::mRegistryMutex;
+
+  std::map< std::string , std::weak_ptr< SharedUDPSocket > > SharedUDPSocket::mRegistry;
+
+
+  std::shared_ptr< SharedUDPSocket > SharedUDPSocket::get ( const std::string& aGroup )
+  {
+    std::lock_guard<std::mutex> lLock ( mRegistryMutex );
+    std::shared_ptr< SharedUDPSocket > lSocket ( mRegistry[aGroup].lock() );
+
+    if ( ! lSocket )
+    {
+      lSocket.reset ( new SharedUDPSocket ( aGroup ) );
+      mRegistry[aGroup] = lSocket;
+    }
+
+    return lSocket;
+  }
+
+
+  SharedUDPSocket::SharedUDPSocket ( const std::string& aGroup ) :
+    mGroup ( aGroup ),
+    mIOservicePool ( ClientFactory::getInstance().getIOservicePool() ),
+    mIOservice ( mIOservicePool->getIOservice() ),
+    mSocket ( mIOservice , boost::asio::ip::udp::endpoint ( boost::asio::ip::udp::v4(), 0 ) ),
+    mClosing ( false ),
+    mReceiveMemory ( 65536 , 0x00 )
+  {
+    log ( Info() , "Created UDP socket shared by client group " , Quote ( mGroup ) , " on port " , Integer ( mSocket.local_endpoint().port() ) );
+    receive();
+  }
+
+
+  SharedUDPSocket::~SharedUDPSocket()
+  {
+    try
+    {
+      IOservicePool::drain ( mIOservice , [this] () {
+        mClosing = true;
+        mSocket.close();
+      } );
+    }
+    catch ( const std::exception& aExc )
+    {
+      log ( Error() , "Exception " , Quote ( aExc.what() ) , " caught in SharedUDPSocket destructor" );
+    }
+  }
+
+
+  void SharedUDPSocket::attach ( const boost::asio::ip::udp::endpoint& aEndpoint , const Receiver& aReceiver )
+  {
+    std::lock_guard<std::mutex> lLock ( mReceiversMutex );
+
+    if ( ! mReceivers.insert ( std::make_pair ( aEndpoint , aReceiver ) ).second )
+    {
+      std::ostringstream lEndpoint;
+      lEndpoint << aEndpoint;
+      exception::SharedUdpEndpointInUse lExc;
+      log ( lExc , "Another client in group " , Quote ( mGroup ) , " already communicates with UDP target " , Quote ( lEndpoint.str() ) );
+      throw lExc;
+    }
+  }
+
+
+  void SharedUDPSocket::detach ( const boost::asio::ip::udp::endpoint& aEndpoint )
+  {
+    std::lock_guard<std::mutex> lLock ( mReceiversMutex );
+    mReceivers.erase ( aEndpoint );
+  }
+
+
+  std::size_t SharedUDPSocket::send ( const std::vector< std::pair< const uint8_t* , uint32_t > >& aSegments , const boost::asio::ip::udp::endpoint& aEndpoint , boost::system::error_code& aErrorCode )
+  {
+    // The datagram is sent with a plain system call, which (unlike operations on an ASIO socket object) may be made from any thread while the receive loop is running
+    std::vector< iovec > lSegments;
+    lSegments.reserve ( aSegments.size() );
+
+    for ( const auto& lSegment : aSegments )
+    {
+      iovec lSegmentIovec = { const_cast<uint8_t*> ( lSegment.first ) , lSegment.second };
+      lSegments.push_back ( lSegmentIovec );
+    }
+
+    msghdr lMessage = msghdr();
+    lMessage.msg_name = const_cast<boost::asio::ip::udp::endpoint&> ( aEndpoint ).data();
+    lMessage.msg_namelen = aEndpoint.size();
+    lMessage.msg_iov = lSegments.data();
+    lMessage.msg_iovlen = lSegments.size();
+
+    const ssize_t lResult ( ::sendmsg ( mSocket.native_handle() , &lMessage , 0 ) );
+
+    if ( lResult < 0 )
+    {
+      aErrorCode = boost::system::error_code ( errno , boost::system::system_category() );
+      return 0;
+    }
+
+    aErrorCode = boost::system::error_code();
+    return lResult;
+  }
+
+
+  void SharedUDPSocket::receive()
+  {
+    if ( mClosing )
+      return;
+
+    mSocket.async_receive_from ( boost::asio::buffer ( mReceiveMemory ) , mSender , [this] (const boost::system::error_code& e, std::size_t n) { this->receive_callback(e, n); } );
+  }
+
+
+  void SharedUDPSocket::receive_callback ( const boost::system::error_code& aErrorCode , std::size_t aBytesTransferred )
+  {
+    if ( aErrorCode == boost::asio::error::operation_aborted )
+      return;
+
+    if ( aErrorCode )
+    {
+      // E.g. ICMP port unreachable reported for an earlier datagram; the clients' own timeouts deal with missing replies
+      log ( Warning() , "Error " , Quote ( aErrorCode.message() ) , " encountered during receive on UDP socket shared by client group " , Quote ( mGroup ) );
+    }
+    else
+    {
+      std::lock_guard<std::mutex> lLock ( mReceiversMutex );
+      std::map< boost::asio::ip::udp::endpoint , Receiver >::const_iterator lIt ( mReceivers.find ( mSender ) );
+
+      if ( lIt != mReceivers.end() )
+      {
+        lIt->second ( mReceiveMemory.data() , aBytesTransferred );
+      }
+      else
+      {
+        log ( Debug() , "Discarding datagram received on UDP socket shared by client group " , Quote ( mGroup ) , " from a target without a client" );
+      }
+    }
+
+    receive();
+  }
+
+}
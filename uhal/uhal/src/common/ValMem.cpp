@@ -40,16 +40,17 @@
 namespace uhal
 {
 
-  _ValHeader_::_ValHeader_ ( const bool& aValid ) :
-    valid ( aValid )
+  _ValHeader_::_ValHeader_ ( const bool& aValid , const ArenaAllocator< uint32_t >& aAllocator ) :
+    valid ( aValid ),
+    IPbusHeaders ( aAllocator )
   {
   }
 
 
   template< typename T >
 
-  _ValWord_<T>::_ValWord_ ( const T& aValue , const bool& aValid , const uint32_t aMask ) :
-    _ValHeader_ ( aValid ) ,
+  _ValWord_<T>::_ValWord_ ( const T& aValue , const bool& aValid , const uint32_t aMask , const ArenaAllocator< uint32_t >& aAllocator ) :
+    _ValHeader_ ( aValid , aAllocator ) ,
     value ( aValue ) ,
     mask ( aMask )
   {
@@ -67,6 +68,16 @@ namespace uhal
 
 
 
+  template< typename T >
+
+  _ValVector_<T>::_ValVector_ ( const uint32_t& aSize , const bool& aValid , const ArenaAllocator< uint32_t >& aAllocator ) :
+    _ValHeader_ ( aValid , aAllocator ),
+    value ( aSize , T() )
+  {
+  }
+
+
+
 
   ValHeader::ValHeader() :
     mMembers ( new _ValHeader_ ( false ) )
@@ -74,6 +85,12 @@ namespace uhal
   }
 
 
+  ValHeader::ValHeader ( const std::shared_ptr< _ValHeader_ >& aMembers ) :
+    mMembers ( aMembers )
+  {
+  }
+
+
   bool ValHeader::valid()
   {
     return mMembers->valid;
@@ -101,6 +118,13 @@ namespace uhal
   }
 
 
+  template< typename T >
+  ValWord< T >::ValWord ( const std::shared_ptr< _ValWord_<T> >& aMembers ) :
+    mMembers ( aMembers )
+  {
+  }
+
+
   template< typename T >
   ValWord< T >::ValWord() :
     mMembers ( new _ValWord_<T> ( T() , false , 0xFFFFFFFF ) )
@@ -206,6 +230,13 @@ namespace uhal
   }
 
 
+  template< typename T >
+  ValVector< T >::ValVector ( const std::shared_ptr< _ValVector_<T> >& aMembers ) :
+    mMembers ( aMembers )
+  {
+  }
+
+
   template< typename T >
   ValVector< T >::ValVector() :
     mMembers ( new _ValVector_<T> ( std::vector<T>() , false ) )
@@ -402,6 +433,12 @@ namespace uhal
   }
 
 
+  template struct _ValWord_< uint8_t >;
+  template struct _ValWord_< uint32_t >;
+
+  template struct _ValVector_< uint8_t >;
+  template struct _ValVector_< uint32_t >;
+
   template class ValWord< uint8_t >;
   template class ValWord< uint32_t >;
 
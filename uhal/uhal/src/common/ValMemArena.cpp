@@ -0,0 +1,115 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/ValMemArena.hpp"
+
+
+namespace uhal
+{
+
+  ValMemArena::ValMemArena() :
+    mSlabPosition ( NULL ),
+    mSlabEnd ( NULL )
+  {
+    for ( std::size_t i = 0; i < kNrSizeClasses; i++ )
+    {
+      mFreeBlocks[i] = NULL;
+      mReturnedBlocks[i].store ( NULL , std::memory_order_relaxed );
+    }
+  }
+
+
+  ValMemArena::~ValMemArena()
+  {
+    for ( char* lSlab : mSlabs )
+    {
+      ::operator delete ( lSlab );
+    }
+  }
+
+
+  void* ValMemArena::allocate ( const std::size_t aSize )
+  {
+    const std::size_t lSizeClass ( aSize == 0 ? 0 : ( aSize - 1 ) / kSizeClassGranularity );
+
+    if ( lSizeClass >= kNrSizeClasses )
+    {
+      return ::operator new ( aSize );
+    }
+
+    // Collect any blocks that have been freed (by any thread) since the free list last ran dry
+    if ( ! mFreeBlocks[lSizeClass] )
+    {
+      mFreeBlocks[lSizeClass] = mReturnedBlocks[lSizeClass].exchange ( NULL , std::memory_order_acquire );
+    }
+
+    if ( FreeBlock* lBlock = mFreeBlocks[lSizeClass] )
+    {
+      mFreeBlocks[lSizeClass] = lBlock->next;
+      return lBlock;
+    }
+
+    const std::size_t lBlockSize ( ( lSizeClass + 1 ) * kSizeClassGranularity );
+
+    if ( std::size_t ( mSlabEnd - mSlabPosition ) < lBlockSize )
+    {
+      mSlabs.push_back ( static_cast< char* > ( ::operator new ( kSlabSize ) ) );
+      mSlabPosition = mSlabs.back();
+      mSlabEnd = mSlabPosition + kSlabSize;
+    }
+
+    void* lBlock ( mSlabPosition );
+    mSlabPosition += lBlockSize;
+    return lBlock;
+  }
+
+
+  void ValMemArena::deallocate ( void* aPtr , const std::size_t aSize )
+  {
+    const std::size_t lSizeClass ( aSize == 0 ? 0 : ( aSize - 1 ) / kSizeClassGranularity );
+
+    if ( lSizeClass >= kNrSizeClasses )
+    {
+      ::operator delete ( aPtr );
+      return;
+    }
+
+    // Blocks are only ever pushed here, and taken all at once by the allocating thread, so a simple CAS loop is free from the ABA problem
+    FreeBlock* lBlock ( static_cast< FreeBlock* > ( aPtr ) );
+    lBlock->next = mReturnedBlocks[lSizeClass].load ( std::memory_order_relaxed );
+
+    while ( ! mReturnedBlocks[lSizeClass].compare_exchange_weak ( lBlock->next , lBlock , std::memory_order_release , std::memory_order_relaxed ) )
+    {
+    }
+  }
+
+}
@@ -0,0 +1,156 @@
+/*
+---------------------------------------------------------------------------
+
+    This file is part of uHAL.
+
+    uHAL is a hardware access library and programming framework
+    originally developed for upgrades of the Level-1 trigger of the CMS
+    experiment at CERN.
+
+    uHAL is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    uHAL is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with uHAL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+      Andrew Rose, Imperial College, London
+      email: awr01 <AT> imperial.ac.uk
+
+      Marc Magrans de Abril, CERN
+      email: marc.magrans.de.abril <AT> cern.ch
+
+---------------------------------------------------------------------------
+*/
+
+#include "uhal/utilities/sockets.hpp"
+
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <thread>
+
+#include <boost/asio/error.hpp>
+
+
+namespace uhal
+{
+  namespace utilities
+  {
+    std::size_t busyReceive ( const int aSocket , iovec* aSegments , const std::size_t aNrSegments , const std::chrono::steady_clock::time_point& aDeadline , boost::system::error_code& aErrorCode )
+    {
+      msghdr lMessage = msghdr();
+      lMessage.msg_iov = aSegments;
+      lMessage.msg_iovlen = aNrSegments;
+
+      while ( true )
+      {
+        const ssize_t lResult ( ::recvmsg ( aSocket , &lMessage , MSG_DONTWAIT ) );
+
+        if ( lResult >= 0 )
+        {
+          return lResult;
+        }
+        else if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+        {
+          aErrorCode = boost::system::error_code ( errno , boost::system::system_category() );
+          return 0;
+        }
+        else if ( std::chrono::steady_clock::now() >= aDeadline )
+        {
+          aErrorCode = boost::asio::error::timed_out;
+          return 0;
+        }
+
+        // Yielding is almost free when no other thread wants this core, but stops the spin from starving one that does (e.g. a software target)
+        std::this_thread::yield();
+      }
+    }
+
+
+    std::size_t busyTransfer ( const int aSocket , std::vector< iovec >& aSegments , const bool aSend , const std::chrono::steady_clock::time_point& aDeadline , boost::system::error_code& aErrorCode , const sockaddr* aDestination , const socklen_t aDestinationSize )
+    {
+      std::size_t lBytesTransferred ( 0 );
+      std::vector< iovec >::iterator lFirst ( aSegments.begin() );
+
+      while ( true )
+      {
+        while ( ( lFirst != aSegments.end() ) && ( lFirst->iov_len == 0 ) )
+        {
+          lFirst++;
+        }
+
+        if ( lFirst == aSegments.end() )
+        {
+          return lBytesTransferred;
+        }
+
+        msghdr lMessage = msghdr();
+        lMessage.msg_name = const_cast< sockaddr* > ( aDestination );
+        lMessage.msg_namelen = aDestinationSize;
+        lMessage.msg_iov = & ( *lFirst );
+        lMessage.msg_iovlen = std::min < std::size_t > ( aSegments.end() - lFirst , IOV_MAX );
+        const ssize_t lResult ( aSend ? ::sendmsg ( aSocket , &lMessage , MSG_DONTWAIT | MSG_NOSIGNAL ) : ::recvmsg ( aSocket , &lMessage , MSG_DONTWAIT ) );
+
+        if ( lResult > 0 )
+        {
+          lBytesTransferred += lResult;
+
+          // Trim the transferred bytes from the front of the remaining segments
+          for ( std::size_t lNrBytes ( lResult ); lNrBytes > 0; )
+          {
+            const std::size_t lNrBytesFromSegment ( std::min < std::size_t > ( lNrBytes , lFirst->iov_len ) );
+            lFirst->iov_base = static_cast< uint8_t* > ( lFirst->iov_base ) + lNrBytesFromSegment;
+            lFirst->iov_len -= lNrBytesFromSegment;
+            lNrBytes -= lNrBytesFromSegment;
+
+            if ( lFirst->iov_len == 0 )
+            {
+              lFirst++;
+            }
+          }
+        }
+        else if ( lResult == 0 )
+        {
+          aErrorCode = boost::asio::error::eof;
+          return lBytesTransferred;
+        }
+        else if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+        {
+          aErrorCode = boost::system::error_code ( errno , boost::system::system_category() );
+          return lBytesTransferred;
+        }
+        else if ( std::chrono::steady_clock::now() >= aDeadline )
+        {
+          aErrorCode = boost::asio::error::timed_out;
+          return lBytesTransferred;
+        }
+        else
+        {
+          std::this_thread::yield();
+        }
+      }
+    }
+
+
+    boost::system::error_code setKernelBusyPoll ( const int aSocket , const uint32_t aPeriod )
+    {
+      const int lPeriod ( aPeriod );
+
+      if ( ::setsockopt ( aSocket , SOL_SOCKET , SO_BUSY_POLL , &lPeriod , sizeof ( lPeriod ) ) != 0 )
+      {
+        return boost::system::error_code ( errno , boost::system::system_category() );
+      }
+
+      return boost::system::error_code();
+    }
+  }
+}